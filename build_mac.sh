@@ -11,23 +11,47 @@ mkdir -p "$OBJ_DIR" "$BIN_DIR"
 CC=${CC:-clang}
 CXX=${CXX:-clang++}
 SHELL_CFLAGS=${SHELL_CFLAGS:--std=c17 -Wall -Wextra -Wno-unused-parameter}
+SHELL_DEFINES=${SHELL_DEFINES:--D_POSIX_C_SOURCE=200809L -D_DARWIN_C_SOURCE}
 LLM_CFLAGS=${LLM_CFLAGS:--std=c17 -Wall -Wextra -Wno-unused-parameter}
 LLM_CXXFLAGS=${LLM_CXXFLAGS:--std=c++20 -Wall -Wextra -Wno-unused-parameter}
 
 SHELL_SOURCES=(
     src/kernel/shell/main.c
     src/kernel/shell/shell.c
+    src/kernel/shell/snapshot.c
+    src/kernel/shell/source.c
+    src/kernel/shell/path.c
+    src/kernel/shell/vars.c
+    src/kernel/shell/server.c
+    src/kernel/shell/frecency.c
+    src/kernel/shell/history.c
+    src/kernel/shell/lineedit.c
+    src/kernel/shell/complete.c
+    src/kernel/shell/prompt.c
     src/kernel/shell/parser/lexer.c
     src/kernel/shell/parser/parser.c
     src/kernel/shell/exec/executor.c
+    src/kernel/shell/exec/glob.c
     src/kernel/shell/builtins/registry.c
+    src/kernel/shell/builtins/io.c
+    src/kernel/shell/builtins/cat.c
     src/kernel/shell/builtins/cd.c
+    src/kernel/shell/builtins/dirs.c
     src/kernel/shell/builtins/echo.c
+    src/kernel/shell/builtins/enable.c
     src/kernel/shell/builtins/exit.c
     src/kernel/shell/builtins/export.c
+    src/kernel/shell/builtins/history.c
+    src/kernel/shell/builtins/parallel.c
+    src/kernel/shell/builtins/printf.c
     src/kernel/shell/builtins/pwd.c
+    src/kernel/shell/builtins/read.c
+    src/kernel/shell/builtins/source.c
+    src/kernel/shell/builtins/tee.c
+    src/kernel/shell/builtins/test.c
     src/kernel/shell/builtins/umask.c
     src/kernel/shell/builtins/unset.c
+    src/kernel/shell/builtins/z.c
 )
 
 LLM_SOURCES=(
@@ -47,14 +71,21 @@ function obj_name() {
 build_shell() {
     echo "==> Building genshell"
     local shell_objects=()
+    local library_objects=()
     for src in "${SHELL_SOURCES[@]}"; do
         local obj
         obj=$(obj_name "$src")
-        "$CC" $SHELL_CFLAGS -Isrc/kernel/shell -Iinclude -c "$src" -o "$obj"
+        "$CC" $SHELL_CFLAGS $SHELL_DEFINES -Isrc/kernel/shell -Iinclude -c "$src" -o "$obj"
         shell_objects+=("$obj")
+        if [[ "$src" != */main.c ]]; then
+            library_objects+=("$obj")
+        fi
     done
-    "$CC" -std=c17 -o "$BIN_DIR/genshell" "${shell_objects[@]}"
+    "$CC" -std=c17 -rdynamic -o "$BIN_DIR/genshell" "${shell_objects[@]}" -lpthread -ldl
     echo "Built $BIN_DIR/genshell"
+    rm -f "$BIN_DIR/libgenshell.a"
+    ar rcs "$BIN_DIR/libgenshell.a" "${library_objects[@]}"
+    echo "Built $BIN_DIR/libgenshell.a (embedding API: include/genshell.h)"
 }
 
 build_gemma_cli() {
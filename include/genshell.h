@@ -0,0 +1,56 @@
+#ifndef GENSHELL_H
+#define GENSHELL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Embedding interface of libgenshell. Every struct gs_shell is a separate
+ * session: its variables, working directory (held open as a directory
+ * descriptor), umask and standard descriptors belong to the instance rather
+ * than to the process, so a host can run many sessions side by side, each
+ * on a thread of its own. A session must only be used by one thread at a
+ * time. External commands still run as child processes, which adopt the
+ * session's state between fork and exec.
+ *
+ * Sessions never change process-wide state: the host keeps its environment,
+ * working directory, umask, signal dispositions and stdio. Files a session
+ * creates get the session's umask on top of the process's, so hosts usually
+ * run with a process umask of 0. Hosts should ignore SIGPIPE, since a
+ * builtin writing to a closed pipe would otherwise kill the process.
+ */
+
+struct gs_shell;
+
+typedef struct {
+    const char *progname;      /* $0; "genshell" when NULL */
+    char *const *envp;         /* initial variables as NAME=value, NULL-terminated; NULL for none */
+    const char *cwd;           /* starting directory; NULL for the process's */
+    int in_fd, out_fd, err_fd; /* standard descriptors; borrowed, never closed by the session */
+    unsigned umask;            /* file-creation mask, e.g. 022 */
+} gs_shell_options;
+
+/* Returns a new session, or NULL if cwd cannot be opened or memory runs out. */
+struct gs_shell *gs_shell_new(const gs_shell_options *options);
+void gs_shell_free(struct gs_shell *shell);
+
+/*
+ * Runs text as a sequence of command lines in the session and returns the
+ * exit status of the last command (or of exit), or a negative error.
+ */
+int gs_shell_eval(struct gs_shell *shell, const char *text);
+
+/* Rebinds the session's standard descriptors between evaluations. */
+void gs_shell_set_io(struct gs_shell *shell, int in_fd, int out_fd, int err_fd);
+
+/* The value of a variable, valid until the session next changes it; NULL when unset. */
+const char *gs_shell_getvar(const struct gs_shell *shell, const char *name);
+int gs_shell_setvar(struct gs_shell *shell, const char *name, const char *value);
+int gs_shell_unsetvar(struct gs_shell *shell, const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GENSHELL_H */
@@ -0,0 +1,92 @@
+#ifndef GENSHELL_BUILTIN_H
+#define GENSHELL_BUILTIN_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Stable interface for builtins, shared by the ones compiled into genshell
+ * and the ones loaded at run time with "enable -f FILE NAME". A loadable
+ * builtin is a shared object exporting a gs_builtin_plugin named
+ * gs_builtin_plugin_NAME (see GS_BUILTIN_PLUGIN); the shell refuses objects
+ * built against a different GS_BUILTIN_ABI_VERSION. Plugins may call the
+ * gs_builtin_io_current, gs_builtin_out_* and gs_builtin_err_printf
+ * functions below, which the genshell executable exports.
+ */
+#define GS_BUILTIN_ABI_VERSION 1u
+
+struct gs_shell;
+
+/* Runs in the shell process when invoked on its own (not in a pipeline). */
+#define GS_BUILTIN_FLAG_PARENT 0x01u
+/* POSIX special builtin; not available to loadable builtins. */
+#define GS_BUILTIN_FLAG_SPECIAL 0x02u
+/* Touches no shell state, so it may run on a helper thread inside pipelines. */
+#define GS_BUILTIN_FLAG_INPROC 0x04u
+/* Only writes output and never reads stdin, so it can run to completion first. */
+#define GS_BUILTIN_FLAG_PRODUCER 0x08u
+/* Changes state no gs_shell_snapshot restores, so a subshell running it forks. */
+#define GS_BUILTIN_FLAG_FORK 0x10u
+
+typedef int (*gs_builtin_fn)(struct gs_shell *shell, int argc, char *const argv[]);
+
+typedef struct {
+    unsigned abi_version; /* GS_BUILTIN_ABI_VERSION the plugin was built with */
+    const char *name;
+    gs_builtin_fn fn;
+    unsigned flags; /* GS_BUILTIN_FLAG_PARENT, _INPROC, _PRODUCER and _FORK */
+} gs_builtin_plugin;
+
+#define GS_BUILTIN_PLUGIN_PREFIX "gs_builtin_plugin_"
+#define GS_BUILTIN_PLUGIN(name, fn, flags) \
+    const gs_builtin_plugin gs_builtin_plugin_##name = {GS_BUILTIN_ABI_VERSION, #name, (fn), (flags)}
+
+/*
+ * Descriptors a builtin reads from and writes to for the current invocation:
+ * the invoking shell's standard descriptors with the command's redirections
+ * applied. In-process pipeline stages bind their pipe ends here, and shells
+ * embedded in one process their own descriptors, instead of touching the
+ * process-wide 0, 1 and 2. err_fd follows the original two fields, so
+ * plugins built before it existed still read those correctly.
+ */
+typedef struct {
+    int in_fd;
+    int out_fd;
+    int err_fd;
+} gs_builtin_io;
+
+const gs_builtin_io *gs_builtin_io_current(void);
+
+/*
+ * Output gathered while a builtin runs and written to the bound output
+ * descriptor in one writev after it returns.
+ */
+void gs_builtin_out_write(const char *data, size_t len);
+/*
+ * Like gs_builtin_out_write, but large runs are referenced rather than copied:
+ * data must outlive the invocation, including the flush after the builtin
+ * returns. Never pass memory the builtin frees before returning.
+ */
+void gs_builtin_out_ref(const char *data, size_t len);
+void gs_builtin_out_puts(const char *text);
+void gs_builtin_out_printf(const char *format, ...)
+#if defined(__GNUC__)
+    __attribute__((format(printf, 1, 2)))
+#endif
+    ;
+
+/* Formats a diagnostic and writes it to the bound error descriptor in one write. */
+void gs_builtin_err_printf(const char *format, ...)
+#if defined(__GNUC__)
+    __attribute__((format(printf, 1, 2)))
+#endif
+    ;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GENSHELL_BUILTIN_H */
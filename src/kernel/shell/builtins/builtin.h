@@ -1,19 +1,59 @@
 #ifndef GS_BUILTIN_H
 #define GS_BUILTIN_H
 
-#include "../shell.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/uio.h>
 
-#define GS_BUILTIN_FLAG_PARENT 0x01u
-#define GS_BUILTIN_FLAG_SPECIAL 0x02u
+#include <genshell_builtin.h>
 
-typedef int (*gs_builtin_fn)(struct gs_shell *shell, int argc, char *const argv[]);
+#include "../shell.h"
 
 typedef struct {
     const char *name;
     gs_builtin_fn fn;
     unsigned flags;
+    /*
+     * Single-letter options implemented by a builtin that shadows a standard
+     * utility; invocations using any other option run the external utility.
+     * NULL when the builtin validates its own arguments.
+     */
+    const char *options;
 } gs_builtin_spec;
 
 const gs_builtin_spec *gs_builtin_lookup(const char *name);
+bool gs_builtin_accepts(const gs_builtin_spec *spec, int argc, char *const argv[]);
+
+/*
+ * Adds spec (which must outlive the shell) to the registry, replacing any
+ * builtin of the same name. Only call this from the main thread while no
+ * in-process pipeline stages are running.
+ */
+int gs_builtin_register(const gs_builtin_spec *spec);
+/* Calls visit for every builtin currently reachable by name. */
+void gs_builtin_foreach(void (*visit)(const gs_builtin_spec *spec, void *ctx), void *ctx);
+
+/*
+ * The directory change shared by cd, pushd and popd: optionally searches
+ * CDPATH, changes to the lexically resolved path (or the physical one) and
+ * updates PWD and OLDPWD. Errors are reported under name; returns 0 or 1.
+ * *announce is set when a non-empty CDPATH entry supplied the directory.
+ */
+int gs_builtin_change_dir(struct gs_shell *shell, const char *name, const char *operand, bool physical,
+                          bool use_cdpath, bool *announce);
+
+/* Binds io (NULL for descriptors 0-2) to the calling thread; returns the previous binding. */
+const gs_builtin_io *gs_builtin_io_bind(const gs_builtin_io *io);
+int gs_builtin_write_all(int fd, const char *data, size_t len);
+int gs_builtin_writev_all(int fd, struct iovec *iov, int iovcnt);
+
+/*
+ * Runs a builtin with a fresh output writer. Text appended through the
+ * gs_builtin_out_* calls is gathered into iovec batches and written to the
+ * bound output descriptor in one writev after the builtin returns; a failed
+ * flush is reported (quietly for EPIPE) and turns status 0 into 1. Builtins
+ * that stream bulk data (cat, tee) write to the descriptor directly instead.
+ */
+int gs_builtin_invoke(const gs_builtin_spec *spec, struct gs_shell *shell, int argc, char *const argv[]);
 
 #endif /* GS_BUILTIN_H */
@@ -0,0 +1,232 @@
+/*
+ * cat - POSIX shell builtin
+ * Concatenates files (or stdin for "-" and no operands) onto the bound output
+ * descriptor. Data is moved inside the kernel wherever the descriptor types
+ * allow it: splice(2) when either side is a pipe, copy_file_range(2) between
+ * regular files and sendfile(2) from a regular file to anything else. Only
+ * when none of those apply (ttys, non-Linux hosts) does it fall back to a
+ * read/write loop. "-u" is accepted and ignored since output is unbuffered.
+ * Like coreutils it refuses to copy a file onto itself ("cat f >> f"), which
+ * would otherwise keep reading what it has just appended until the disk fills.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+
+#include "builtin.h"
+
+#define CAT_CHUNK (1u << 20)
+#define CAT_BUFFER (1u << 17)
+
+typedef enum {
+    COPY_DONE,
+    COPY_FALLBACK,
+    COPY_FAILED
+} copy_result;
+
+#if defined(__linux__)
+static bool kernel_path_unsupported(int err) {
+    return err == EINVAL || err == ENOSYS || err == EXDEV || err == EBADF || err == EOPNOTSUPP;
+}
+
+/*
+ * Each loop reports COPY_FALLBACK only if the kernel refuses the very first
+ * transfer, so the caller can resume with the next strategy from the same
+ * file offsets.
+ */
+static copy_result splice_loop(int in_fd, int out_fd) {
+    bool moved = false;
+    while (true) {
+        ssize_t n = splice(in_fd, NULL, out_fd, NULL, CAT_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (n > 0) {
+            moved = true;
+            continue;
+        }
+        if (n == 0) {
+            return COPY_DONE;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        return (!moved && kernel_path_unsupported(errno)) ? COPY_FALLBACK : COPY_FAILED;
+    }
+}
+
+static copy_result copy_file_range_loop(int in_fd, int out_fd) {
+    bool moved = false;
+    while (true) {
+        ssize_t n = copy_file_range(in_fd, NULL, out_fd, NULL, CAT_CHUNK, 0u);
+        if (n > 0) {
+            moved = true;
+            continue;
+        }
+        if (n == 0) {
+            return COPY_DONE;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        return (!moved && kernel_path_unsupported(errno)) ? COPY_FALLBACK : COPY_FAILED;
+    }
+}
+
+static copy_result sendfile_loop(int in_fd, int out_fd) {
+    bool moved = false;
+    while (true) {
+        ssize_t n = sendfile(out_fd, in_fd, NULL, CAT_CHUNK);
+        if (n > 0) {
+            moved = true;
+            continue;
+        }
+        if (n == 0) {
+            return COPY_DONE;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        return (!moved && kernel_path_unsupported(errno)) ? COPY_FALLBACK : COPY_FAILED;
+    }
+}
+
+static copy_result kernel_copy(int in_fd, int out_fd) {
+    struct stat in_st;
+    struct stat out_st;
+    if (fstat(in_fd, &in_st) != 0 || fstat(out_fd, &out_st) != 0) {
+        return COPY_FALLBACK;
+    }
+    if (S_ISFIFO(in_st.st_mode) || S_ISFIFO(out_st.st_mode)) {
+        return splice_loop(in_fd, out_fd);
+    }
+    if (!S_ISREG(in_st.st_mode)) {
+        return COPY_FALLBACK;
+    }
+    if (S_ISREG(out_st.st_mode)) {
+        copy_result result = copy_file_range_loop(in_fd, out_fd);
+        if (result != COPY_FALLBACK) {
+            return result;
+        }
+    }
+    return sendfile_loop(in_fd, out_fd);
+}
+#endif
+
+static copy_result buffered_copy(int in_fd, int out_fd) {
+    char *buf = (char *)malloc(CAT_BUFFER);
+    if (!buf) {
+        errno = ENOMEM;
+        return COPY_FAILED;
+    }
+    copy_result result = COPY_DONE;
+    while (true) {
+        ssize_t n = read(in_fd, buf, CAT_BUFFER);
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            result = COPY_FAILED;
+            break;
+        }
+        if (gs_builtin_write_all(out_fd, buf, (size_t)n) != GS_OK) {
+            result = COPY_FAILED;
+            break;
+        }
+    }
+    int saved_errno = errno;
+    free(buf);
+    errno = saved_errno;
+    return result;
+}
+
+static int copy_fd(int in_fd, int out_fd) {
+#if defined(__linux__)
+    copy_result result = kernel_copy(in_fd, out_fd);
+    if (result != COPY_FALLBACK) {
+        return result == COPY_DONE ? GS_OK : GS_ERR_EXEC;
+    }
+#endif
+    return buffered_copy(in_fd, out_fd) == COPY_DONE ? GS_OK : GS_ERR_EXEC;
+}
+
+/* True when out_fd is a regular file and the same one as in_fd. */
+static bool same_file(int in_fd, int out_fd) {
+    struct stat in_st;
+    struct stat out_st;
+    return fstat(in_fd, &in_st) == 0 && fstat(out_fd, &out_st) == 0 && S_ISREG(out_st.st_mode) &&
+           in_st.st_dev == out_st.st_dev && in_st.st_ino == out_st.st_ino;
+}
+
+int genshell_builtin_cat(struct gs_shell *shell, int argc, char *const argv[]) {
+    const gs_builtin_io *io = gs_builtin_io_current();
+    int argi = 1;
+    while (argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0') {
+        if (strcmp(argv[argi], "--") == 0) {
+            ++argi;
+            break;
+        }
+        ++argi; /* only -u is accepted, and it is the default */
+    }
+
+    if (argi == argc) {
+        if (same_file(io->in_fd, io->out_fd)) {
+            gs_builtin_err_printf("genshell: cat: -: input file is output file\n");
+            return 1;
+        }
+        if (copy_fd(io->in_fd, io->out_fd) != GS_OK) {
+            if (errno != EPIPE) {
+                gs_builtin_err_printf("genshell: cat: %s\n", strerror(errno));
+            }
+            return 1;
+        }
+        return 0;
+    }
+
+    int status = 0;
+    for (int i = argi; i < argc; ++i) {
+        const char *path = argv[i];
+        bool use_stdin = strcmp(path, "-") == 0;
+        int fd = use_stdin ? io->in_fd : gs_shell_open(shell, path, O_RDONLY);
+        if (fd < 0) {
+            gs_builtin_err_printf("genshell: cat: %s: %s\n", path, strerror(errno));
+            status = 1;
+            continue;
+        }
+        if (same_file(fd, io->out_fd)) {
+            gs_builtin_err_printf("genshell: cat: %s: input file is output file\n", path);
+            if (!use_stdin) {
+                close(fd);
+            }
+            status = 1;
+            continue;
+        }
+        int rc = copy_fd(fd, io->out_fd);
+        int saved_errno = errno;
+        if (!use_stdin) {
+            close(fd);
+        }
+        if (rc != GS_OK) {
+            if (saved_errno == EPIPE) {
+                return 1;
+            }
+            gs_builtin_err_printf("genshell: cat: %s: %s\n", path, strerror(saved_errno));
+            status = 1;
+        }
+    }
+    return status;
+}
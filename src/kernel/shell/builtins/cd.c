@@ -2,72 +2,203 @@
  * cd - POSIX shell builtin
  * Changes the shell's current working directory, updating PWD/OLDPWD and
  * supporting the usual forms: "cd" (HOME), "cd -" (previous directory), and
- * explicit path arguments. The command runs in the parent shell process so the
- * directory change persists for subsequent commands.
+ * explicit path arguments, searched along CDPATH when relative. By default
+ * (-L) the new PWD is computed lexically from the old one, so symbolic links
+ * stay as the user typed them and no getcwd(3) is needed; -P resolves the
+ * physical directory instead. Each change is recorded in the frecency
+ * database that z searches. The command runs in the parent shell process so
+ * the directory change persists for subsequent commands.
  */
 
 #include <errno.h>
-#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include "../frecency.h"
 #include "builtin.h"
 
-int genshell_builtin_cd(struct gs_shell *shell, int argc, char *const argv[]) {
-    (void)shell;
-
-    const char *target = NULL;
-    int status = 0;
-    char old_pwd[PATH_MAX];
-    bool have_old = false;
+/* Returns a malloc'd "dir/name", or "name" relative to "." for an empty dir. */
+static char *join_path(const char *dir, size_t dir_len, const char *name) {
+    size_t name_len = strlen(name);
+    char *out = (char *)malloc(dir_len + name_len + 3u);
+    if (!out) {
+        return NULL;
+    }
+    if (dir_len == 0u) {
+        memcpy(out, "./", 2u);
+        dir_len = 2u;
+    } else {
+        memcpy(out, dir, dir_len);
+        if (dir[dir_len - 1u] != '/') {
+            out[dir_len++] = '/';
+        }
+    }
+    memcpy(out + dir_len, name, name_len + 1u);
+    return out;
+}
 
-    if (getcwd(old_pwd, sizeof(old_pwd)) != NULL) {
-        have_old = true;
+/* Operands that CDPATH applies to: relative, not starting with "." or "..". */
+static bool uses_cdpath(const char *operand) {
+    if (operand[0] == '/' || operand[0] == '\0') {
+        return false;
+    }
+    if (operand[0] == '.') {
+        return !(operand[1] == '\0' || operand[1] == '/' ||
+                 (operand[1] == '.' && (operand[2] == '\0' || operand[2] == '/')));
     }
+    return true;
+}
 
-    if (argc < 2) {
-        target = getenv("HOME");
-        if (!target || target[0] == '\0') {
-            fprintf(stderr, "genshell: cd: HOME not set\n");
-            return 1;
+/* Returns the malloc'd CDPATH match for operand, or NULL to use it as is. */
+static char *search_cdpath(const struct gs_shell *shell, const char *operand, bool *announce) {
+    const char *cdpath = gs_shell_getvar(shell, "CDPATH");
+    if (!cdpath || !uses_cdpath(operand)) {
+        return NULL;
+    }
+    const char *dir = cdpath;
+    for (;;) {
+        const char *end = strchr(dir, ':');
+        size_t dir_len = end ? (size_t)(end - dir) : strlen(dir);
+        char *candidate = join_path(dir, dir_len, operand);
+        struct stat st;
+        if (candidate && fstatat(shell->cwd_fd, candidate, &st, 0) == 0 && S_ISDIR(st.st_mode)) {
+            *announce = dir_len > 0u;
+            return candidate;
+        }
+        free(candidate);
+        if (!end) {
+            return NULL;
         }
-    } else if (argc > 2) {
-        fprintf(stderr, "genshell: cd: too many arguments\n");
+        dir = end + 1;
+    }
+}
+
+/* The logical working directory: PWD when it is usable, else the physical one. */
+static char *current_directory(const struct gs_shell *shell) {
+    const char *pwd = gs_shell_getvar(shell, "PWD");
+    if (gs_path_is_canonical(pwd)) {
+        return strdup(pwd);
+    }
+    return gs_shell_physical_cwd(shell);
+}
+
+int gs_builtin_change_dir(struct gs_shell *shell, const char *name, const char *operand, bool physical,
+                          bool use_cdpath, bool *announce) {
+    bool found = false;
+    char *curpath = use_cdpath ? search_cdpath(shell, operand, &found) : NULL;
+    if (announce) {
+        *announce = found;
+    }
+    if (!curpath) {
+        curpath = strdup(operand);
+    }
+    char *old_pwd = current_directory(shell);
+    if (!curpath) {
+        gs_builtin_err_printf("genshell: %s: allocation failure\n", name);
+        free(old_pwd);
         return 1;
-    } else if (strcmp(argv[1], "-") == 0) {
-        target = getenv("OLDPWD");
-        if (!target || target[0] == '\0') {
-            fprintf(stderr, "genshell: cd: OLDPWD not set\n");
-            return 1;
+    }
+
+    char *new_pwd = NULL;
+    if (!physical) {
+        if (curpath[0] == '/') {
+            new_pwd = strdup(curpath);
+        } else if (old_pwd) {
+            new_pwd = join_path(old_pwd, strlen(old_pwd), curpath);
+        }
+        if (new_pwd) {
+            gs_path_canonicalize(new_pwd);
         }
-    } else {
-        target = argv[1];
     }
 
-    if (chdir(target) != 0) {
-        fprintf(stderr, "genshell: cd: %s: %s\n", target, strerror(errno));
+    if (gs_shell_preserve_cwd(shell) != GS_OK || gs_shell_preserve_variable(shell, "OLDPWD") != GS_OK ||
+        gs_shell_preserve_variable(shell, "PWD") != GS_OK) {
+        gs_builtin_err_printf("genshell: %s: cannot save the current directory: %s\n", name, strerror(errno));
+        free(curpath);
+        free(old_pwd);
+        free(new_pwd);
         return 1;
     }
 
-    char new_pwd[PATH_MAX];
-    if (getcwd(new_pwd, sizeof(new_pwd)) == NULL) {
-        /* Fall back to the target path if getcwd fails (e.g., perms issues). */
-        strncpy(new_pwd, target, sizeof(new_pwd) - 1u);
-        new_pwd[sizeof(new_pwd) - 1u] = '\0';
+    /*
+     * The lexical path can fail where the kernel's would not (".." out of a
+     * directory reached through a symbolic link that has since changed); then
+     * follow the operand physically, as -P would.
+     */
+    if (!new_pwd || gs_shell_set_cwd(shell, new_pwd) != GS_OK) {
+        free(new_pwd);
+        new_pwd = NULL;
+        if (gs_shell_set_cwd(shell, curpath) != GS_OK) {
+            gs_builtin_err_printf("genshell: %s: %s: %s\n", name, operand, strerror(errno));
+            free(curpath);
+            free(old_pwd);
+            return 1;
+        }
+        new_pwd = gs_shell_physical_cwd(shell);
     }
 
-    if (have_old) {
-        setenv("OLDPWD", old_pwd, 1);
+    if (old_pwd) {
+        gs_shell_setvar(shell, "OLDPWD", old_pwd);
     }
-    setenv("PWD", new_pwd, 1);
+    gs_shell_setvar(shell, "PWD", new_pwd ? new_pwd : curpath);
+    gs_frecency_record(shell, gs_shell_getvar(shell, "PWD"));
+    free(curpath);
+    free(old_pwd);
+    free(new_pwd);
+    return 0;
+}
 
-    if (argc == 2 && strcmp(argv[1], "-") == 0) {
-        printf("%s\n", new_pwd);
-        fflush(stdout);
+int genshell_builtin_cd(struct gs_shell *shell, int argc, char *const argv[]) {
+    bool physical = false;
+    int argi = 1;
+    for (; argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0'; ++argi) {
+        if (strcmp(argv[argi], "--") == 0) {
+            ++argi;
+            break;
+        }
+        for (const char *opt = argv[argi] + 1; *opt; ++opt) {
+            if (*opt != 'L' && *opt != 'P') {
+                gs_builtin_err_printf("genshell: cd: -%c: invalid option\nusage: cd [-L|-P] [dir]\n", *opt);
+                return 2;
+            }
+            physical = *opt == 'P';
+        }
     }
 
+    const char *target = NULL;
+    bool previous = false;
+    if (argi >= argc) {
+        target = gs_shell_getvar(shell, "HOME");
+        if (!target || target[0] == '\0') {
+            gs_builtin_err_printf("genshell: cd: HOME not set\n");
+            return 1;
+        }
+    } else if (argc - argi > 1) {
+        gs_builtin_err_printf("genshell: cd: too many arguments\n");
+        return 1;
+    } else if (strcmp(argv[argi], "-") == 0) {
+        target = gs_shell_getvar(shell, "OLDPWD");
+        if (!target || target[0] == '\0') {
+            gs_builtin_err_printf("genshell: cd: OLDPWD not set\n");
+            return 1;
+        }
+        previous = true;
+    } else {
+        target = argv[argi];
+    }
+    if (target[0] == '\0') {
+        return 0;
+    }
+
+    bool announce = false;
+    int status = gs_builtin_change_dir(shell, "cd", target, physical, !previous, &announce);
+    if (status == 0 && (previous || announce)) {
+        const char *pwd = gs_shell_getvar(shell, "PWD");
+        gs_builtin_out_printf("%s\n", pwd ? pwd : "");
+    }
     return status;
 }
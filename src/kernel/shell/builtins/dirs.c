@@ -0,0 +1,319 @@
+/*
+ * dirs, pushd, popd - directory stack builtins
+ * The stack's entry 0 is the current directory ($PWD) and the entries below
+ * it live in the shell (newest first). "pushd DIR" changes to DIR (searching
+ * CDPATH like cd) and pushes the old directory, "pushd" swaps the top two,
+ * "pushd +N/-N" rotates entry N to the top, and "popd [+N/-N]" removes an
+ * entry, changing to the new top when it removes entry 0; -n manipulates the
+ * stack without changing directory. Each prints the stack afterwards, as
+ * "dirs" does: on one line with $HOME shown as "~" (-l keeps full paths, -p
+ * prints one entry per line, -v numbers them, -c clears the stack). The
+ * three share this file because they share the stack code.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "builtin.h"
+
+#define DIRS_LONG 0x01u
+#define DIRS_PER_LINE 0x02u
+#define DIRS_NUMBERED 0x04u
+
+static const char *stack_entry(const struct gs_shell *shell, size_t index) {
+    if (index == 0u) {
+        const char *pwd = gs_shell_getvar(shell, "PWD");
+        return pwd ? pwd : ".";
+    }
+    return shell->dirs[index - 1u];
+}
+
+static size_t stack_size(const struct gs_shell *shell) {
+    return shell->dir_count + 1u;
+}
+
+/* Inserts the malloc'd path at position index of the stored stack. */
+static bool stack_insert(struct gs_shell *shell, size_t index, char *path) {
+    if (!path) {
+        return false;
+    }
+    if (shell->dir_count == shell->dir_capacity) {
+        size_t new_cap = shell->dir_capacity ? shell->dir_capacity * 2u : 8u;
+        char **tmp = (char **)realloc(shell->dirs, new_cap * sizeof(char *));
+        if (!tmp) {
+            free(path);
+            return false;
+        }
+        shell->dirs = tmp;
+        shell->dir_capacity = new_cap;
+    }
+    memmove(shell->dirs + index + 1u, shell->dirs + index, (shell->dir_count - index) * sizeof(char *));
+    shell->dirs[index] = path;
+    shell->dir_count++;
+    return true;
+}
+
+static void stack_remove(struct gs_shell *shell, size_t index) {
+    free(shell->dirs[index]);
+    memmove(shell->dirs + index, shell->dirs + index + 1u, (shell->dir_count - index - 1u) * sizeof(char *));
+    shell->dir_count--;
+}
+
+static void print_entry(const struct gs_shell *shell, const char *path, unsigned flags) {
+    const char *home = gs_shell_getvar(shell, "HOME");
+    size_t home_len = home ? strlen(home) : 0u;
+    if (!(flags & DIRS_LONG) && home_len > 1u && strncmp(path, home, home_len) == 0 &&
+        (path[home_len] == '/' || path[home_len] == '\0')) {
+        gs_builtin_out_write("~", 1u);
+        path += home_len;
+    }
+    gs_builtin_out_puts(path);
+}
+
+static void print_stack(const struct gs_shell *shell, unsigned flags) {
+    for (size_t i = 0; i < stack_size(shell); ++i) {
+        if (flags & DIRS_NUMBERED) {
+            gs_builtin_out_printf("%2zu  ", i);
+        } else if (i > 0u && !(flags & DIRS_PER_LINE)) {
+            gs_builtin_out_write(" ", 1u);
+        }
+        print_entry(shell, stack_entry(shell, i), flags);
+        if (flags & (DIRS_PER_LINE | DIRS_NUMBERED)) {
+            gs_builtin_out_write("\n", 1u);
+        }
+    }
+    if (!(flags & (DIRS_PER_LINE | DIRS_NUMBERED))) {
+        gs_builtin_out_write("\n", 1u);
+    }
+}
+
+static bool is_stack_index(const char *arg) {
+    if ((arg[0] != '+' && arg[0] != '-') || arg[1] == '\0') {
+        return false;
+    }
+    for (const char *p = arg + 1; *p; ++p) {
+        if (*p < '0' || *p > '9') {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Resolves "+N" (from the top) or "-N" (from the bottom) to a stack position. */
+static bool parse_stack_index(const struct gs_shell *shell, const char *name, const char *arg, size_t *out) {
+    errno = 0;
+    unsigned long n = strtoul(arg + 1, NULL, 10);
+    size_t size = stack_size(shell);
+    if (errno != 0 || n >= size) {
+        gs_builtin_err_printf("genshell: %s: %s: directory stack index out of range\n", name, arg);
+        return false;
+    }
+    *out = arg[0] == '+' ? (size_t)n : size - 1u - (size_t)n;
+    return true;
+}
+
+/* Changes to a directory already on the stack, which needs no CDPATH search. */
+static int enter(struct gs_shell *shell, const char *name, const char *path) {
+    char *copy = strdup(path); /* the entry is freed or moved when the stack changes */
+    if (!copy) {
+        gs_builtin_err_printf("genshell: %s: allocation failure\n", name);
+        return 1;
+    }
+    int status = gs_builtin_change_dir(shell, name, copy, false, false, NULL);
+    free(copy);
+    return status;
+}
+
+static int preserve(struct gs_shell *shell, const char *name) {
+    if (gs_shell_preserve_dirs(shell) != GS_OK) {
+        gs_builtin_err_printf("genshell: %s: allocation failure\n", name);
+        return 1;
+    }
+    return 0;
+}
+
+/* Makes position index the top of the stack, keeping the circular order. */
+static int rotate(struct gs_shell *shell, size_t index) {
+    size_t size = stack_size(shell);
+    char **order = (char **)calloc(size, sizeof(char *));
+    if (!order) {
+        return 1;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        order[i] = strdup(stack_entry(shell, (index + i) % size));
+        if (!order[i]) {
+            while (i > 0u) {
+                free(order[--i]);
+            }
+            free(order);
+            return 1;
+        }
+    }
+    int status = enter(shell, "pushd", order[0]);
+    if (status == 0) {
+        for (size_t i = 0; i < shell->dir_count; ++i) {
+            free(shell->dirs[i]);
+            shell->dirs[i] = order[i + 1u];
+        }
+    } else {
+        for (size_t i = 1; i < size; ++i) {
+            free(order[i]);
+        }
+    }
+    free(order[0]);
+    free(order);
+    return status;
+}
+
+int genshell_builtin_dirs(struct gs_shell *shell, int argc, char *const argv[]) {
+    unsigned flags = 0u;
+    bool clear = false;
+    const char *index_arg = NULL;
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (is_stack_index(arg)) {
+            index_arg = arg;
+            continue;
+        }
+        if (arg[0] != '-' || arg[1] == '\0') {
+            gs_builtin_err_printf("genshell: dirs: %s: invalid argument\nusage: dirs [-clpv] [+N | -N]\n", arg);
+            return 2;
+        }
+        for (const char *opt = arg + 1; *opt; ++opt) {
+            switch (*opt) {
+            case 'c':
+                clear = true;
+                break;
+            case 'l':
+                flags |= DIRS_LONG;
+                break;
+            case 'p':
+                flags |= DIRS_PER_LINE;
+                break;
+            case 'v':
+                flags |= DIRS_NUMBERED;
+                break;
+            default:
+                gs_builtin_err_printf("genshell: dirs: -%c: invalid option\nusage: dirs [-clpv] [+N | -N]\n", *opt);
+                return 2;
+            }
+        }
+    }
+
+    if (clear) {
+        if (preserve(shell, "dirs") != 0) {
+            return 1;
+        }
+        while (shell->dir_count > 0u) {
+            stack_remove(shell, shell->dir_count - 1u);
+        }
+        return 0;
+    }
+    if (index_arg) {
+        size_t index;
+        if (!parse_stack_index(shell, "dirs", index_arg, &index)) {
+            return 1;
+        }
+        print_entry(shell, stack_entry(shell, index), flags);
+        gs_builtin_out_write("\n", 1u);
+        return 0;
+    }
+    print_stack(shell, flags);
+    return 0;
+}
+
+int genshell_builtin_pushd(struct gs_shell *shell, int argc, char *const argv[]) {
+    bool no_cd = false;
+    int argi = 1;
+    if (argi < argc && strcmp(argv[argi], "-n") == 0) {
+        no_cd = true;
+        ++argi;
+    }
+    if (argi < argc && strcmp(argv[argi], "--") == 0) {
+        ++argi;
+    }
+    if (argc - argi > 1) {
+        gs_builtin_err_printf("genshell: pushd: too many arguments\n");
+        return 1;
+    }
+    if (preserve(shell, "pushd") != 0) {
+        return 1;
+    }
+
+    int status;
+    if (argi == argc) {
+        if (shell->dir_count == 0u) {
+            gs_builtin_err_printf("genshell: pushd: no other directory\n");
+            return 1;
+        }
+        status = enter(shell, "pushd", shell->dirs[0]);
+        if (status == 0) {
+            const char *old = gs_shell_getvar(shell, "OLDPWD");
+            char *copy = strdup(old ? old : ".");
+            if (copy) {
+                free(shell->dirs[0]);
+                shell->dirs[0] = copy;
+            } else {
+                status = 1;
+            }
+        }
+    } else if (is_stack_index(argv[argi])) {
+        size_t index;
+        if (!parse_stack_index(shell, "pushd", argv[argi], &index)) {
+            return 1;
+        }
+        status = index == 0u ? 0 : rotate(shell, index);
+    } else if (no_cd) {
+        status = stack_insert(shell, 0u, strdup(argv[argi])) ? 0 : 1;
+    } else {
+        status = gs_builtin_change_dir(shell, "pushd", argv[argi], false, true, NULL);
+        if (status == 0) {
+            const char *old = gs_shell_getvar(shell, "OLDPWD");
+            status = stack_insert(shell, 0u, strdup(old ? old : ".")) ? 0 : 1;
+        }
+    }
+    if (status == 0) {
+        print_stack(shell, 0u);
+    }
+    return status;
+}
+
+int genshell_builtin_popd(struct gs_shell *shell, int argc, char *const argv[]) {
+    bool no_cd = false;
+    int argi = 1;
+    if (argi < argc && strcmp(argv[argi], "-n") == 0) {
+        no_cd = true;
+        ++argi;
+    }
+    if (argc - argi > 1 || (argi < argc && !is_stack_index(argv[argi]))) {
+        gs_builtin_err_printf("genshell: popd: usage: popd [-n] [+N | -N]\n");
+        return 2;
+    }
+    if (shell->dir_count == 0u) {
+        gs_builtin_err_printf("genshell: popd: directory stack empty\n");
+        return 1;
+    }
+    size_t index = 0u;
+    if (argi < argc && !parse_stack_index(shell, "popd", argv[argi], &index)) {
+        return 1;
+    }
+    if (preserve(shell, "popd") != 0) {
+        return 1;
+    }
+
+    if (index > 0u) {
+        stack_remove(shell, index - 1u);
+    } else if (no_cd) {
+        stack_remove(shell, 0u);
+    } else {
+        if (enter(shell, "popd", shell->dirs[0]) != 0) {
+            return 1;
+        }
+        stack_remove(shell, 0u);
+    }
+    print_stack(shell, 0u);
+    return 0;
+}
@@ -2,11 +2,12 @@
  * echo - POSIX shell builtin
  * Writes its arguments separated by spaces followed by a newline. Supports the
  * common "-n" option to suppress the trailing newline. Behaviour for other
- * flags matches the simple POSIX baseline (no escape processing).
+ * flags matches the simple POSIX baseline (no escape processing). Arguments
+ * are handed to the builtin writer by reference, so even long lines reach the
+ * bound output descriptor in one writev without being copied.
  */
 
 #include <stdbool.h>
-#include <stdio.h>
 #include <string.h>
 
 #include "builtin.h"
@@ -23,15 +24,13 @@ int genshell_builtin_echo(struct gs_shell *shell, int argc, char *const argv[])
     }
 
     for (int i = start; i < argc; ++i) {
-        fputs(argv[i], stdout);
+        gs_builtin_out_ref(argv[i], strlen(argv[i]));
         if (i + 1 < argc) {
-            fputc(' ', stdout);
+            gs_builtin_out_write(" ", 1u);
         }
     }
-
     if (newline) {
-        fputc('\n', stdout);
+        gs_builtin_out_write("\n", 1u);
     }
-    fflush(stdout);
     return 0;
 }
@@ -0,0 +1,147 @@
+/*
+ * enable - shell builtin
+ * Without operands, lists the builtins reachable by name. "enable -f FILE
+ * NAME..." loads the shared object FILE and registers each NAME from the
+ * gs_builtin_plugin it exports as gs_builtin_plugin_NAME (see
+ * include/genshell_builtin.h), so in-house utilities run inside the shell
+ * instead of through fork and exec. A loaded builtin replaces any builtin of
+ * the same name; plugins built for another ABI version are rejected, and
+ * objects stay loaded for the life of the process. A relative FILE with a
+ * slash is taken from the shell's working directory, not the process's.
+ */
+
+#include <ctype.h>
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "builtin.h"
+
+#define ENABLE_PLUGIN_FLAGS \
+    (GS_BUILTIN_FLAG_PARENT | GS_BUILTIN_FLAG_INPROC | GS_BUILTIN_FLAG_PRODUCER | GS_BUILTIN_FLAG_FORK)
+
+static void print_builtin(const gs_builtin_spec *spec, void *ctx) {
+    (void)ctx;
+    gs_builtin_out_write("enable ", 7u);
+    gs_builtin_out_ref(spec->name, strlen(spec->name));
+    gs_builtin_out_write("\n", 1u);
+}
+
+/* Returns path made absolute against the shell's directory, or a copy when no slash makes it a path. */
+static char *resolve_object(const struct gs_shell *shell, const char *path) {
+    if (path[0] == '/' || !strchr(path, '/')) {
+        return strdup(path);
+    }
+    char *cwd = gs_shell_physical_cwd(shell);
+    if (!cwd) {
+        return NULL;
+    }
+    size_t cwd_len = strlen(cwd);
+    size_t path_len = strlen(path);
+    char *out = (char *)malloc(cwd_len + path_len + 2u);
+    if (out) {
+        memcpy(out, cwd, cwd_len);
+        out[cwd_len] = '/';
+        memcpy(out + cwd_len + 1u, path, path_len + 1u);
+    }
+    free(cwd);
+    return out;
+}
+
+/* Registers the plugin exported for name by handle; returns 0 on success. */
+static int load_builtin(void *handle, const char *path, const char *name) {
+    size_t prefix_len = strlen(GS_BUILTIN_PLUGIN_PREFIX);
+    size_t name_len = strlen(name);
+    char *symbol = (char *)malloc(prefix_len + name_len + 1u);
+    if (!symbol) {
+        gs_builtin_err_printf("genshell: enable: allocation failure\n");
+        return 1;
+    }
+    memcpy(symbol, GS_BUILTIN_PLUGIN_PREFIX, prefix_len);
+    for (size_t i = 0; i < name_len; ++i) {
+        unsigned char ch = (unsigned char)name[i];
+        symbol[prefix_len + i] = (isalnum(ch) || ch == '_') ? (char)ch : '_';
+    }
+    symbol[prefix_len + name_len] = '\0';
+    const gs_builtin_plugin *plugin = (const gs_builtin_plugin *)dlsym(handle, symbol);
+    free(symbol);
+
+    if (!plugin) {
+        gs_builtin_err_printf("genshell: enable: %s: not found in %s\n", name, path);
+        return 1;
+    }
+    if (plugin->abi_version != GS_BUILTIN_ABI_VERSION) {
+        gs_builtin_err_printf("genshell: enable: %s: built for builtin ABI %u, shell provides %u\n", name,
+                plugin->abi_version, GS_BUILTIN_ABI_VERSION);
+        return 1;
+    }
+    if (!plugin->fn) {
+        gs_builtin_err_printf("genshell: enable: %s: no entry point\n", name);
+        return 1;
+    }
+
+    gs_builtin_spec *spec = (gs_builtin_spec *)calloc(1u, sizeof(gs_builtin_spec));
+    char *spec_name = strdup(name);
+    if (!spec || !spec_name) {
+        free(spec);
+        free(spec_name);
+        gs_builtin_err_printf("genshell: enable: allocation failure\n");
+        return 1;
+    }
+    spec->name = spec_name;
+    spec->fn = plugin->fn;
+    spec->flags = plugin->flags & ENABLE_PLUGIN_FLAGS;
+    spec->options = NULL;
+    if (gs_builtin_register(spec) != GS_OK) {
+        free(spec_name);
+        free(spec);
+        gs_builtin_err_printf("genshell: enable: %s: failed to register\n", name);
+        return 1;
+    }
+    return 0;
+}
+
+int genshell_builtin_enable(struct gs_shell *shell, int argc, char *const argv[]) {
+    if (argc == 1) {
+        gs_builtin_foreach(print_builtin, NULL);
+        return 0;
+    }
+    if (strcmp(argv[1], "-f") != 0 || argc < 4) {
+        gs_builtin_err_printf("usage: enable [-f file name ...]\n");
+        return 2;
+    }
+
+    const char *path = argv[2];
+    char *object = resolve_object(shell, path);
+    if (!object) {
+        gs_builtin_err_printf("genshell: enable: %s: cannot resolve the path\n", path);
+        return 1;
+    }
+    void *handle = dlopen(object, RTLD_NOW | RTLD_LOCAL);
+    free(object);
+    if (!handle) {
+        gs_builtin_err_printf("genshell: enable: %s\n", dlerror());
+        return 1;
+    }
+
+    int status = 0;
+    int loaded = 0;
+    for (int i = 3; i < argc; ++i) {
+        const char *name = argv[i];
+        if (name[0] == '\0' || strchr(name, '/')) {
+            gs_builtin_err_printf("genshell: enable: `%s': not a valid builtin name\n", name);
+            status = 1;
+            continue;
+        }
+        if (load_builtin(handle, path, name) != 0) {
+            status = 1;
+            continue;
+        }
+        ++loaded;
+    }
+    if (loaded == 0) {
+        dlclose(handle);
+    }
+    return status;
+}
@@ -19,7 +19,7 @@ int genshell_builtin_exit(struct gs_shell *shell, int argc, char *const argv[])
     }
 
     if (argc > 2) {
-        fprintf(stderr, "genshell: exit: too many arguments\n");
+        gs_builtin_err_printf("genshell: exit: too many arguments\n");
         return 1;
     }
 
@@ -30,7 +30,7 @@ int genshell_builtin_exit(struct gs_shell *shell, int argc, char *const argv[])
         char *end = NULL;
         long value = strtol(argv[1], &end, 10);
         if (errno != 0 || !end || *end != '\0') {
-            fprintf(stderr, "genshell: exit: %s: numeric argument required\n", argv[1]);
+            gs_builtin_err_printf("genshell: exit: %s: numeric argument required\n", argv[1]);
             shell->exit_requested = true;
             shell->exit_status = 2;
             return 2;
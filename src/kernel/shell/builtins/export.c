@@ -3,7 +3,10 @@
  * Marks shell variables for export to the environment of subsequent commands.
  * Without operands it lists the current exported variables. With NAME=VALUE
  * pairs it assigns and exports, and with bare names it promotes existing shell
- * variables (or initialises them empty) into the environment.
+ * variables (or initialises them empty) into the environment. Every shell
+ * variable is exported, so the listing is the shell's variable table, already
+ * sorted by name; it is gathered by the builtin writer and leaves in a single
+ * write.
  */
 
 #include <ctype.h>
@@ -14,8 +17,6 @@
 
 #include "builtin.h"
 
-extern char **environ;
-
 static int is_valid_name(const char *name) {
     if (!name || name[0] == '\0') {
         return 0;
@@ -31,22 +32,22 @@ static int is_valid_name(const char *name) {
     return 1;
 }
 
-static void print_exports(void) {
-    for (char **env = environ; env && *env; ++env) {
+static void print_exports(struct gs_shell *shell) {
+    for (char **env = gs_shell_environ(shell); env && *env; ++env) {
         const char *entry = *env;
         const char *eq = strchr(entry, '=');
         if (!eq) {
             continue;
         }
-        printf("export %.*s=%s\n", (int)(eq - entry), entry, eq + 1);
+        gs_builtin_out_write("export ", 7u);
+        gs_builtin_out_ref(entry, strlen(entry));
+        gs_builtin_out_write("\n", 1u);
     }
 }
 
 int genshell_builtin_export(struct gs_shell *shell, int argc, char *const argv[]) {
-    (void)shell;
-
     if (argc == 1) {
-        print_exports();
+        print_exports(shell);
         return 0;
     }
 
@@ -59,33 +60,32 @@ int genshell_builtin_export(struct gs_shell *shell, int argc, char *const argv[]
             size_t name_len = (size_t)(eq - arg);
             char *name = strndup(arg, name_len);
             if (!name) {
-                fprintf(stderr, "genshell: export: allocation failure\n");
+                gs_builtin_err_printf("genshell: export: allocation failure\n");
                 return 1;
             }
             if (!is_valid_name(name)) {
-                fprintf(stderr, "genshell: export: `%s': invalid identifier\n", arg);
+                gs_builtin_err_printf("genshell: export: `%s': invalid identifier\n", arg);
                 free(name);
                 status = 1;
                 continue;
             }
             const char *value = eq + 1;
-            if (setenv(name, value, 1) != 0) {
-                fprintf(stderr, "genshell: export: failed to set %s\n", name);
+            if (gs_shell_preserve_variable(shell, name) != GS_OK || gs_shell_setvar(shell, name, value) != GS_OK) {
+                gs_builtin_err_printf("genshell: export: failed to set %s\n", name);
                 status = 1;
             }
             free(name);
         } else {
             if (!is_valid_name(arg)) {
-                fprintf(stderr, "genshell: export: `%s': invalid identifier\n", arg);
+                gs_builtin_err_printf("genshell: export: `%s': invalid identifier\n", arg);
                 status = 1;
                 continue;
             }
-            const char *value = getenv(arg);
-            if (!value) {
-                value = "";
+            if (gs_shell_getvar(shell, arg)) {
+                continue; /* already exported */
             }
-            if (setenv(arg, value, 1) != 0) {
-                fprintf(stderr, "genshell: export: failed to export %s\n", arg);
+            if (gs_shell_preserve_variable(shell, arg) != GS_OK || gs_shell_setvar(shell, arg, "") != GS_OK) {
+                gs_builtin_err_printf("genshell: export: failed to export %s\n", arg);
                 status = 1;
             }
         }
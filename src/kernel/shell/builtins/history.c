@@ -0,0 +1,56 @@
+/*
+ * history - shell builtin
+ * Lists the command history shared by the user's shells, oldest first and
+ * numbered from 1; "history N" lists only the last N entries. The log is
+ * refreshed first, so commands other sessions ran since this one started
+ * are included. Entries are read from the mapped log as they are printed;
+ * see history.h.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../history.h"
+#include "builtin.h"
+
+int genshell_builtin_history(struct gs_shell *shell, int argc, char *const argv[]) {
+    int argi = 1;
+    if (argi < argc && argv[argi][0] == '-' && argv[argi][1] == '-' && argv[argi][2] == '\0') {
+        ++argi;
+    }
+    if (argc - argi > 1) {
+        gs_builtin_err_printf("genshell: history: too many arguments\nusage: history [n]\n");
+        return 2;
+    }
+    size_t limit = SIZE_MAX;
+    if (argi < argc) {
+        char *end = NULL;
+        errno = 0;
+        unsigned long long n = strtoull(argv[argi], &end, 10);
+        if (argv[argi][0] == '\0' || argv[argi][0] == '-' || *end != '\0' || errno != 0) {
+            gs_builtin_err_printf("genshell: history: %s: numeric argument required\n", argv[argi]);
+            return 2;
+        }
+        limit = n < SIZE_MAX ? (size_t)n : SIZE_MAX;
+    }
+
+    struct gs_history *history = gs_shell_history(shell);
+    if (!history) {
+        return 0;
+    }
+    (void)gs_history_refresh(history);
+    size_t count = gs_history_count(history);
+    size_t first = count > limit ? count - limit : 0u;
+    for (size_t i = first; i < count; ++i) {
+        gs_history_entry entry;
+        if (!gs_history_get(history, i, &entry)) {
+            continue;
+        }
+        gs_builtin_out_printf("%5zu  ", i + 1u);
+        gs_builtin_out_ref(entry.text, entry.len); /* the mapping outlives the builtin */
+        gs_builtin_out_write("\n", 1u);
+    }
+    return 0;
+}
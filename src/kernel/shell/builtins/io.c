@@ -0,0 +1,308 @@
+/*
+ * Builtin I/O helpers
+ * Tracks the per-thread descriptor binding used by builtins and provides
+ * write loops that cope with short writes and EINTR. Pipeline stages executed
+ * on helper threads bind their own pipe ends, and each shell binds its own
+ * standard descriptors, so concurrent builtins never share the stdio FILE
+ * objects. Builtin text output goes through a per-invocation writer that is
+ * flushed once, after the builtin returns; diagnostics go to the bound error
+ * descriptor.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "builtin.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+static const gs_builtin_io k_default_io = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+static _Thread_local const gs_builtin_io *t_current_io = NULL;
+
+const gs_builtin_io *gs_builtin_io_current(void) {
+    return t_current_io ? t_current_io : &k_default_io;
+}
+
+const gs_builtin_io *gs_builtin_io_bind(const gs_builtin_io *io) {
+    const gs_builtin_io *previous = t_current_io;
+    t_current_io = io;
+    return previous;
+}
+
+int gs_builtin_write_all(int fd, const char *data, size_t len) {
+    while (len > 0u) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return GS_ERR_EXEC;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return GS_OK;
+}
+
+int gs_builtin_writev_all(int fd, struct iovec *iov, int iovcnt) {
+    while (iovcnt > 0) {
+        int batch = iovcnt < IOV_MAX ? iovcnt : IOV_MAX;
+        ssize_t n = writev(fd, iov, batch);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return GS_ERR_EXEC;
+        }
+        size_t left = (size_t)n;
+        while (iovcnt > 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt > 0 && left > 0u) {
+            iov->iov_base = (char *)iov->iov_base + left;
+            iov->iov_len -= left;
+        }
+    }
+    return GS_OK;
+}
+
+#define OUT_INLINE_IOV 16u
+#define OUT_INLINE_BYTES 1024u
+#define OUT_CHUNK_MIN 4096u
+#define OUT_REF_MIN 64u /* shorter borrowed pieces are cheaper to copy */
+
+/*
+ * Output gathered for one builtin invocation. Copied text lives in arena
+ * chunks that never move, so iovecs can point into them; consecutive copies
+ * extend the same iovec. Small outputs need no allocation at all.
+ */
+typedef struct {
+    struct iovec *iov;
+    size_t iov_count;
+    size_t iov_cap;
+    char *chunk;
+    size_t chunk_used;
+    size_t chunk_size;
+    char **heap_chunks;
+    size_t heap_count;
+    bool failed;
+    struct iovec inline_iov[OUT_INLINE_IOV];
+    char inline_bytes[OUT_INLINE_BYTES];
+} gs_builtin_out;
+
+static _Thread_local gs_builtin_out *t_current_out = NULL;
+
+static bool out_push_iov(gs_builtin_out *out, const char *data, size_t len) {
+    if (out->iov_count > 0u) {
+        struct iovec *last = &out->iov[out->iov_count - 1u];
+        if ((const char *)last->iov_base + last->iov_len == data) {
+            last->iov_len += len;
+            return true;
+        }
+    }
+    if (out->iov_count == out->iov_cap) {
+        size_t new_cap = out->iov_cap * 2u;
+        struct iovec *tmp = out->iov == out->inline_iov ? (struct iovec *)malloc(new_cap * sizeof(struct iovec))
+                                                        : (struct iovec *)realloc(out->iov, new_cap * sizeof(struct iovec));
+        if (!tmp) {
+            return false;
+        }
+        if (out->iov == out->inline_iov) {
+            memcpy(tmp, out->inline_iov, sizeof(out->inline_iov));
+        }
+        out->iov = tmp;
+        out->iov_cap = new_cap;
+    }
+    out->iov[out->iov_count].iov_base = (void *)data;
+    out->iov[out->iov_count].iov_len = len;
+    out->iov_count++;
+    return true;
+}
+
+/* Makes room for len bytes in the arena, starting a new chunk if needed. */
+static bool out_reserve(gs_builtin_out *out, size_t len) {
+    if (out->chunk_size - out->chunk_used >= len) {
+        return true;
+    }
+    size_t size = out->chunk_size * 2u;
+    if (size < OUT_CHUNK_MIN) {
+        size = OUT_CHUNK_MIN;
+    }
+    if (size < len) {
+        size = len;
+    }
+    char **list = (char **)realloc(out->heap_chunks, (out->heap_count + 1u) * sizeof(char *));
+    if (!list) {
+        return false;
+    }
+    out->heap_chunks = list;
+    char *chunk = (char *)malloc(size);
+    if (!chunk) {
+        return false;
+    }
+    out->heap_chunks[out->heap_count++] = chunk;
+    out->chunk = chunk;
+    out->chunk_used = 0u;
+    out->chunk_size = size;
+    return true;
+}
+
+static void out_copy(gs_builtin_out *out, const char *data, size_t len) {
+    if (out->failed || len == 0u) {
+        return;
+    }
+    if (!out_reserve(out, len)) {
+        out->failed = true;
+        return;
+    }
+    char *dst = out->chunk + out->chunk_used;
+    memcpy(dst, data, len);
+    out->chunk_used += len;
+    if (!out_push_iov(out, dst, len)) {
+        out->failed = true;
+    }
+}
+
+void gs_builtin_out_write(const char *data, size_t len) {
+    gs_builtin_out *out = t_current_out;
+    if (!out) {
+        (void)gs_builtin_write_all(gs_builtin_io_current()->out_fd, data, len);
+        return;
+    }
+    out_copy(out, data, len);
+}
+
+void gs_builtin_out_ref(const char *data, size_t len) {
+    gs_builtin_out *out = t_current_out;
+    if (!out || len < OUT_REF_MIN) {
+        gs_builtin_out_write(data, len);
+        return;
+    }
+    if (!out->failed && !out_push_iov(out, data, len)) {
+        out->failed = true;
+    }
+}
+
+void gs_builtin_out_puts(const char *text) {
+    gs_builtin_out_write(text, strlen(text));
+}
+
+void gs_builtin_out_printf(const char *format, ...) {
+    gs_builtin_out *out = t_current_out;
+    va_list args;
+    va_start(args, format);
+    if (!out) {
+        char buf[512];
+        int n = vsnprintf(buf, sizeof(buf), format, args);
+        va_end(args);
+        if (n > 0) {
+            (void)gs_builtin_write_all(gs_builtin_io_current()->out_fd, buf, (size_t)n < sizeof(buf) ? (size_t)n : sizeof(buf) - 1u);
+        }
+        return;
+    }
+    if (out->failed) {
+        va_end(args);
+        return;
+    }
+
+    /* Format straight into the arena; retry in a large enough chunk if it did not fit. */
+    va_list retry;
+    va_copy(retry, args);
+    size_t space = out->chunk_size - out->chunk_used;
+    int n = vsnprintf(out->chunk + out->chunk_used, space, format, args);
+    va_end(args);
+    if (n >= 0 && (size_t)n >= space) {
+        if (out_reserve(out, (size_t)n + 1u)) {
+            n = vsnprintf(out->chunk + out->chunk_used, (size_t)n + 1u, format, retry);
+        } else {
+            n = -1;
+        }
+    }
+    va_end(retry);
+    if (n < 0) {
+        out->failed = true;
+        return;
+    }
+    char *dst = out->chunk + out->chunk_used;
+    out->chunk_used += (size_t)n;
+    if (n > 0 && !out_push_iov(out, dst, (size_t)n)) {
+        out->failed = true;
+    }
+}
+
+void gs_builtin_err_printf(const char *format, ...) {
+    char buf[1024];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (n < 0) {
+        return;
+    }
+    char *text = buf;
+    if ((size_t)n >= sizeof(buf)) {
+        text = (char *)malloc((size_t)n + 1u);
+        if (!text) {
+            text = buf;
+            n = (int)sizeof(buf) - 1;
+        } else {
+            va_start(args, format);
+            vsnprintf(text, (size_t)n + 1u, format, args);
+            va_end(args);
+        }
+    }
+    (void)gs_builtin_write_all(gs_builtin_io_current()->err_fd, text, (size_t)n);
+    if (text != buf) {
+        free(text);
+    }
+}
+
+int gs_builtin_invoke(const gs_builtin_spec *spec, struct gs_shell *shell, int argc, char *const argv[]) {
+    gs_builtin_out out;
+    out.iov = out.inline_iov;
+    out.iov_count = 0u;
+    out.iov_cap = OUT_INLINE_IOV;
+    out.chunk = out.inline_bytes;
+    out.chunk_used = 0u;
+    out.chunk_size = OUT_INLINE_BYTES;
+    out.heap_chunks = NULL;
+    out.heap_count = 0u;
+    out.failed = false;
+
+    gs_builtin_out *outer = t_current_out;
+    t_current_out = &out;
+    int status = spec->fn(shell, argc, argv);
+    t_current_out = outer;
+
+    int err = out.failed ? ENOMEM : 0;
+    if (!err && out.iov_count > 0u &&
+        gs_builtin_writev_all(gs_builtin_io_current()->out_fd, out.iov, (int)out.iov_count) != GS_OK) {
+        err = errno;
+    }
+    if (err) {
+        if (err != EPIPE) {
+            gs_builtin_err_printf("genshell: %s: write error: %s\n", spec->name, strerror(err));
+        }
+        if (status == 0) {
+            status = 1;
+        }
+    }
+
+    for (size_t i = 0; i < out.heap_count; ++i) {
+        free(out.heap_chunks[i]);
+    }
+    free(out.heap_chunks);
+    if (out.iov != out.inline_iov) {
+        free(out.iov);
+    }
+    return status;
+}
@@ -0,0 +1,488 @@
+/*
+ * parallel - genshell builtin
+ * Runs a command template once per work item with a bounded number of
+ * concurrent jobs, like "xargs -P" without leaving the shell:
+ *
+ *     parallel [-j N] [-k] [-t] command [arg...] [::: item...]
+ *
+ * Items are the operands after ":::" or, without them, the lines of standard
+ * input, read only as job slots free up. Every "{}" in the template is
+ * replaced by the item; when there is none the item is appended. Each job is
+ * a forked shell that runs the quoted command line, so builtins work and an
+ * external command is exec'd in place of that shell. Up to N jobs (default:
+ * online CPUs, 0 for no limit) run at once. The reaper sleeps in poll(2) on
+ * pidfds and output pipes instead of polling waitpid. -k keeps output in item
+ * order by collecting each job's output through a pipe; -t reports the exit
+ * status and wall time of each job on stderr. Exits with the number of failed
+ * jobs, capped at 101.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#include "builtin.h"
+
+#define PARALLEL_READ_SIZE 4096u
+#define PARALLEL_MAX_FAILED 101
+
+typedef struct {
+    pid_t pid;
+    int pidfd;  /* -1 when the kernel cannot hand out pidfds */
+    int out_fd; /* read end of the job's output pipe (-k), or -1 */
+    char *command;
+    struct timespec started;
+    char *output;
+    size_t output_len;
+    size_t output_cap;
+    bool exited;
+    bool complete;
+    int status;
+    double seconds;
+} parallel_job;
+
+typedef struct {
+    int in_fd;
+    char *buf;
+    size_t len;
+    size_t cap;
+    bool eof;
+} line_reader;
+
+/* Returns the next input line without its newline, or NULL at end of input. */
+static char *read_item_line(line_reader *reader) {
+    while (true) {
+        char *nl = reader->len ? (char *)memchr(reader->buf, '\n', reader->len) : NULL;
+        if (nl || (reader->eof && reader->len > 0u)) {
+            size_t item_len = nl ? (size_t)(nl - reader->buf) : reader->len;
+            char *item = strndup(reader->buf, item_len);
+            size_t consumed = nl ? item_len + 1u : item_len;
+            memmove(reader->buf, reader->buf + consumed, reader->len - consumed);
+            reader->len -= consumed;
+            return item;
+        }
+        if (reader->eof) {
+            return NULL;
+        }
+        if (reader->cap - reader->len < PARALLEL_READ_SIZE) {
+            size_t new_cap = reader->cap ? reader->cap * 2u : PARALLEL_READ_SIZE * 2u;
+            char *tmp = (char *)realloc(reader->buf, new_cap);
+            if (!tmp) {
+                return NULL;
+            }
+            reader->buf = tmp;
+            reader->cap = new_cap;
+        }
+        ssize_t n = read(reader->in_fd, reader->buf + reader->len, reader->cap - reader->len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            reader->eof = true;
+            continue;
+        }
+        reader->len += (size_t)n;
+    }
+}
+
+static bool append_mem(char **buf, size_t *len, size_t *cap, const char *data, size_t size) {
+    if (*len + size + 1u > *cap) {
+        size_t new_cap = *cap ? *cap : 64u;
+        while (new_cap < *len + size + 1u) {
+            new_cap *= 2u;
+        }
+        char *tmp = (char *)realloc(*buf, new_cap);
+        if (!tmp) {
+            return false;
+        }
+        *buf = tmp;
+        *cap = new_cap;
+    }
+    memcpy(*buf + *len, data, size);
+    *len += size;
+    (*buf)[*len] = '\0';
+    return true;
+}
+
+/* Appends text for use inside single quotes. */
+static bool append_escaped(char **buf, size_t *len, size_t *cap, const char *text) {
+    for (const char *p = text; *p; ++p) {
+        bool ok = *p == '\'' ? append_mem(buf, len, cap, "'\\''", 4u) : append_mem(buf, len, cap, p, 1u);
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Builds the job's command line: every template word single-quoted with "{}"
+ * replaced by the item, plus the item as a final word if nothing was replaced.
+ */
+static char *build_command(char *const words[], int count, const char *item) {
+    char *buf = NULL;
+    size_t len = 0u;
+    size_t cap = 0u;
+    bool used_item = false;
+    bool ok = true;
+    for (int i = 0; ok && i < count; ++i) {
+        ok = append_mem(&buf, &len, &cap, " '", 2u);
+        for (const char *p = words[i]; ok && *p; ++p) {
+            if (p[0] == '{' && p[1] == '}') {
+                ok = append_escaped(&buf, &len, &cap, item);
+                used_item = true;
+                ++p;
+            } else {
+                char one[2] = {*p, '\0'};
+                ok = append_escaped(&buf, &len, &cap, one);
+            }
+        }
+        ok = ok && append_mem(&buf, &len, &cap, "'", 1u);
+    }
+    if (ok && !used_item) {
+        ok = append_mem(&buf, &len, &cap, " '", 2u) && append_escaped(&buf, &len, &cap, item) &&
+             append_mem(&buf, &len, &cap, "'", 1u);
+    }
+    if (!ok) {
+        free(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+static int open_pidfd(pid_t pid) {
+#if defined(__linux__) && defined(SYS_pidfd_open)
+    int fd = (int)syscall(SYS_pidfd_open, pid, 0);
+    if (fd >= 0) {
+        (void)fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    return fd;
+#else
+    (void)pid;
+    return -1;
+#endif
+}
+
+static double elapsed_since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+ * Forks the shell that runs jobs[index]. Its stdout is the job's output pipe
+ * when output is kept in order and the bound output descriptor otherwise;
+ * stdin is /dev/null when the items themselves come from stdin.
+ */
+static int start_job(struct gs_shell *shell, parallel_job *jobs, size_t index, bool keep_order, bool null_stdin) {
+    parallel_job *job = &jobs[index];
+    const gs_builtin_io *io = gs_builtin_io_current();
+    int pipefd[2] = {-1, -1};
+    if (keep_order) {
+        if (gs_pipe_cloexec(pipefd) < 0) {
+            gs_builtin_err_printf("genshell: parallel: pipe failed: %s\n", strerror(errno));
+            return 1;
+        }
+    }
+
+    fflush(NULL);
+    clock_gettime(CLOCK_MONOTONIC, &job->started);
+    pid_t pid = fork();
+    if (pid < 0) {
+        gs_builtin_err_printf("genshell: parallel: fork failed: %s\n", strerror(errno));
+        if (pipefd[0] >= 0) {
+            close(pipefd[0]);
+            close(pipefd[1]);
+        }
+        return 1;
+    }
+    if (pid == 0) {
+        if (pipefd[0] >= 0) {
+            close(pipefd[0]);
+        }
+        shell->fds[STDOUT_FILENO] = pipefd[1] >= 0 ? pipefd[1] : io->out_fd;
+        shell->fds[STDIN_FILENO] = null_stdin ? open("/dev/null", O_RDONLY | O_CLOEXEC) : io->in_fd;
+        shell->fds[STDERR_FILENO] = io->err_fd;
+        for (size_t i = 0; i < index; ++i) {
+            if (jobs[i].out_fd >= 0) {
+                close(jobs[i].out_fd);
+            }
+            if (jobs[i].pidfd >= 0) {
+                close(jobs[i].pidfd);
+            }
+        }
+        gs_shell_enter_process(shell);
+        int status = gs_shell_run_string(shell, job->command, true);
+        _exit(status < 0 ? 1 : status & 0xFF);
+    }
+
+    if (pipefd[1] >= 0) {
+        close(pipefd[1]);
+    }
+    job->pid = pid;
+    job->out_fd = pipefd[0];
+    job->pidfd = open_pidfd(pid);
+    return 0;
+}
+
+static void record_exit(parallel_job *job, int wstatus) {
+    job->exited = true;
+    job->seconds = elapsed_since(&job->started);
+    if (WIFEXITED(wstatus)) {
+        job->status = WEXITSTATUS(wstatus);
+    } else if (WIFSIGNALED(wstatus)) {
+        job->status = 128 + WTERMSIG(wstatus);
+    } else {
+        job->status = 1;
+    }
+    if (job->pidfd >= 0) {
+        close(job->pidfd);
+        job->pidfd = -1;
+    }
+}
+
+static void try_reap(parallel_job *job) {
+    int wstatus = 0;
+    if (waitpid(job->pid, &wstatus, WNOHANG) == job->pid) {
+        record_exit(job, wstatus);
+    }
+}
+
+/* Pulls whatever the job has written; closes the pipe at end of file. */
+static void drain_output(parallel_job *job) {
+    char chunk[PARALLEL_READ_SIZE];
+    ssize_t n = read(job->out_fd, chunk, sizeof(chunk));
+    if (n < 0 && errno == EINTR) {
+        return;
+    }
+    if (n <= 0 || !append_mem(&job->output, &job->output_len, &job->output_cap, chunk, (size_t)n)) {
+        close(job->out_fd);
+        job->out_fd = -1;
+    }
+}
+
+/*
+ * Sleeps until an unfinished job exits or produces output and handles it.
+ * Jobs without a pidfd are checked with WNOHANG every 10ms instead.
+ */
+static int wait_for_events(parallel_job *jobs, size_t first, size_t count, size_t running) {
+    struct pollfd *fds = (struct pollfd *)calloc(running * 2u, sizeof(struct pollfd));
+    size_t *owners = (size_t *)calloc(running * 2u, sizeof(size_t));
+    if (!fds || !owners) {
+        free(fds);
+        free(owners);
+        return 1;
+    }
+    size_t nfds = 0u;
+    bool blind = false;
+    for (size_t i = first; i < count; ++i) {
+        parallel_job *job = &jobs[i];
+        if (job->complete) {
+            continue;
+        }
+        if (!job->exited) {
+            if (job->pidfd >= 0) {
+                fds[nfds].fd = job->pidfd;
+                fds[nfds].events = POLLIN;
+                owners[nfds++] = i;
+            } else {
+                blind = true;
+            }
+        }
+        if (job->out_fd >= 0) {
+            fds[nfds].fd = job->out_fd;
+            fds[nfds].events = POLLIN;
+            owners[nfds++] = i;
+        }
+    }
+
+    int ready = poll(fds, (nfds_t)nfds, blind ? 10 : -1);
+    for (size_t f = 0; ready > 0 && f < nfds; ++f) {
+        if (!fds[f].revents) {
+            continue;
+        }
+        parallel_job *job = &jobs[owners[f]];
+        if (fds[f].fd == job->out_fd) {
+            drain_output(job);
+        } else if (fds[f].fd == job->pidfd) {
+            try_reap(job);
+        }
+    }
+    if (blind) {
+        for (size_t i = first; i < count; ++i) {
+            if (!jobs[i].complete && !jobs[i].exited && jobs[i].pidfd < 0) {
+                try_reap(&jobs[i]);
+            }
+        }
+    }
+    free(fds);
+    free(owners);
+    return 0;
+}
+
+int genshell_builtin_parallel(struct gs_shell *shell, int argc, char *const argv[]) {
+    long max_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    bool keep_order = false;
+    bool timing = false;
+    int argi = 1;
+    for (; argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0'; ++argi) {
+        const char *arg = argv[argi];
+        if (strcmp(arg, "--") == 0) {
+            ++argi;
+            break;
+        }
+        if (strcmp(arg, "-k") == 0) {
+            keep_order = true;
+        } else if (strcmp(arg, "-t") == 0) {
+            timing = true;
+        } else if (strncmp(arg, "-j", 2) == 0) {
+            const char *value = arg[2] ? arg + 2 : (argi + 1 < argc ? argv[++argi] : NULL);
+            char *end = NULL;
+            errno = 0;
+            max_jobs = value ? strtol(value, &end, 10) : -1;
+            if (!value || errno != 0 || *end != '\0' || max_jobs < 0) {
+                gs_builtin_err_printf("genshell: parallel: -j: invalid job count\n");
+                return 2;
+            }
+            if (max_jobs == 0) {
+                max_jobs = LONG_MAX;
+            }
+        } else {
+            gs_builtin_err_printf("genshell: parallel: %s: invalid option\n", arg);
+            return 2;
+        }
+    }
+    if (max_jobs < 1) {
+        max_jobs = 1;
+    }
+
+    int template_count = 0;
+    while (argi + template_count < argc && strcmp(argv[argi + template_count], ":::") != 0) {
+        ++template_count;
+    }
+    if (template_count == 0) {
+        gs_builtin_err_printf("usage: parallel [-j N] [-k] [-t] command [arg...] [::: item...]\n");
+        return 2;
+    }
+    char *const *template_words = argv + argi;
+    int item_argi = argi + template_count < argc ? argi + template_count + 1 : -1;
+    const gs_builtin_io *io = gs_builtin_io_current();
+    line_reader reader = {io->in_fd, NULL, 0u, 0u, false};
+
+    parallel_job *jobs = NULL;
+    size_t job_count = 0u;
+    size_t job_cap = 0u;
+    size_t running = 0u;
+    size_t next_emit = 0u;
+    int failed = 0;
+    int status = 0;
+    bool items_left = true;
+
+    while (true) {
+        while (items_left && running < (size_t)max_jobs) {
+            char *item = item_argi >= 0 ? (item_argi < argc ? strdup(argv[item_argi++]) : NULL) : read_item_line(&reader);
+            if (!item) {
+                items_left = false;
+                break;
+            }
+            if (job_count == job_cap) {
+                size_t new_cap = job_cap ? job_cap * 2u : 16u;
+                parallel_job *tmp = (parallel_job *)realloc(jobs, new_cap * sizeof(parallel_job));
+                if (!tmp) {
+                    free(item);
+                    gs_builtin_err_printf("genshell: parallel: allocation failure\n");
+                    items_left = false;
+                    status = 1;
+                    break;
+                }
+                jobs = tmp;
+                job_cap = new_cap;
+            }
+            parallel_job *job = &jobs[job_count];
+            memset(job, 0, sizeof(*job));
+            job->pidfd = -1;
+            job->out_fd = -1;
+            job->command = build_command(template_words, template_count, item);
+            free(item);
+            if (!job->command || start_job(shell, jobs, job_count, keep_order, item_argi < 0) != 0) {
+                free(job->command);
+                items_left = false;
+                status = 1;
+                break;
+            }
+            ++job_count;
+            ++running;
+        }
+        if (running == 0u) {
+            break;
+        }
+
+        if (wait_for_events(jobs, next_emit, job_count, running) != 0) {
+            gs_builtin_err_printf("genshell: parallel: allocation failure\n");
+            status = 1;
+            for (size_t i = next_emit; i < job_count; ++i) {
+                while (!jobs[i].complete && waitpid(jobs[i].pid, NULL, 0) < 0 && errno == EINTR) {
+                }
+            }
+            break;
+        }
+
+        for (size_t i = next_emit; i < job_count; ++i) {
+            parallel_job *job = &jobs[i];
+            if (job->complete || !job->exited || job->out_fd >= 0) {
+                continue;
+            }
+            job->complete = true;
+            --running;
+            if (job->status != 0 && failed < PARALLEL_MAX_FAILED) {
+                ++failed;
+            }
+            if (timing) {
+                gs_builtin_err_printf("genshell: parallel: job %zu: status %d, %.3fs:%s\n", i + 1u, job->status,
+                        job->seconds, job->command);
+            }
+        }
+
+        /* Finished jobs are emitted in item order; later ones wait their turn. */
+        while (next_emit < job_count && jobs[next_emit].complete) {
+            parallel_job *job = &jobs[next_emit++];
+            if (job->output_len > 0u) {
+                (void)gs_builtin_write_all(io->out_fd, job->output, job->output_len);
+            }
+            free(job->output);
+            free(job->command);
+            job->output = NULL;
+            job->command = NULL;
+        }
+    }
+
+    for (size_t i = next_emit; i < job_count; ++i) {
+        if (jobs[i].out_fd >= 0) {
+            close(jobs[i].out_fd);
+        }
+        if (jobs[i].pidfd >= 0) {
+            close(jobs[i].pidfd);
+        }
+        free(jobs[i].output);
+        free(jobs[i].command);
+    }
+    free(jobs);
+    free(reader.buf);
+    return status ? status : failed;
+}
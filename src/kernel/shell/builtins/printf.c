@@ -0,0 +1,601 @@
+/*
+ * printf - POSIX shell builtin
+ * Formats its arguments under control of a format string: backslash escapes,
+ * the d i o u x X c s b e E f F g G a A conversions with flags, widths and
+ * precisions (including "*"), and "%%". The format is reused while arguments
+ * remain; missing arguments read as "" or 0, and numeric arguments may be
+ * 'c character constants. Each distinct format is compiled once into a list
+ * of directives (literal runs with escapes already decoded, and conversion
+ * specs ready for the C library) and kept in a small process-wide cache keyed
+ * by the format text, so printf in a loop only pays for formatting. Output
+ * goes through the builtin writer: literal runs are referenced from the
+ * cache, and the whole result leaves in one writev.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "builtin.h"
+
+#define PRINTF_CACHE_SLOTS 128u
+#define PRINTF_CACHE_LIMIT 96u /* formats beyond this are compiled per call */
+
+typedef enum {
+    PF_LITERAL,
+    PF_CONVERSION,
+    PF_STOP /* "\c" in the format: end all output */
+} pf_kind;
+
+typedef struct {
+    pf_kind kind;
+    size_t offset; /* literal bytes in the format's storage */
+    size_t length;
+    char conversion;
+    bool width_star;
+    bool precision_star;
+    int width;
+    int precision; /* -1 when absent */
+    char spec[16]; /* e.g. "%-*.*lld", always taking width and precision */
+} pf_directive;
+
+typedef struct {
+    char *key;
+    uint64_t hash;
+    pf_directive *items;
+    size_t count;
+    char *storage;
+    bool has_conversions;
+} pf_format;
+
+typedef struct {
+    char *const *args;
+    int count;
+    int next;
+    int status;
+} pf_args;
+
+static pf_format *g_cache[PRINTF_CACHE_SLOTS];
+static size_t g_cache_count;
+static pthread_mutex_t g_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_atfork_once = PTHREAD_ONCE_INIT;
+
+/* Formats are looked up in forked children too: never let one inherit the lock held. */
+static void lock_before_fork(void) {
+    pthread_mutex_lock(&g_cache_lock);
+}
+
+static void unlock_after_fork(void) {
+    pthread_mutex_unlock(&g_cache_lock);
+}
+
+static void register_atfork(void) {
+    pthread_atfork(lock_before_fork, unlock_after_fork, unlock_after_fork);
+}
+
+static uint64_t hash_text(const char *text) {
+    uint64_t hash = 1469598103934665603ull;
+    for (const unsigned char *p = (const unsigned char *)text; *p; ++p) {
+        hash ^= *p;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+typedef struct {
+    char *data;
+    size_t length;
+    size_t capacity;
+} byte_buffer;
+
+static bool buffer_push(byte_buffer *buf, char ch) {
+    if (buf->length + 1u >= buf->capacity) {
+        size_t new_cap = buf->capacity ? buf->capacity * 2u : 64u;
+        char *tmp = (char *)realloc(buf->data, new_cap);
+        if (!tmp) {
+            return false;
+        }
+        buf->data = tmp;
+        buf->capacity = new_cap;
+    }
+    buf->data[buf->length++] = ch;
+    buf->data[buf->length] = '\0';
+    return true;
+}
+
+/*
+ * Decodes the escape after a backslash at *p into buf. With in_argument (the
+ * %b rules) octal escapes take a leading 0 plus up to three digits. Returns
+ * false for "\c".
+ */
+static bool decode_escape(const char **p, byte_buffer *buf, bool in_argument, bool *ok) {
+    const char *s = *p;
+    char ch = *s;
+    char out;
+    switch (ch) {
+    case '\\':
+        out = '\\';
+        break;
+    case 'a':
+        out = '\a';
+        break;
+    case 'b':
+        out = '\b';
+        break;
+    case 'f':
+        out = '\f';
+        break;
+    case 'n':
+        out = '\n';
+        break;
+    case 'r':
+        out = '\r';
+        break;
+    case 't':
+        out = '\t';
+        break;
+    case 'v':
+        out = '\v';
+        break;
+    case '"':
+    case '\'':
+        out = ch;
+        break;
+    case 'c':
+        *p = s + 1;
+        return false;
+    default:
+        if (ch >= '0' && ch <= '7') {
+            const char *digits = (in_argument && ch == '0') ? s + 1 : s;
+            int value = 0;
+            int n = 0;
+            while (n < 3 && digits[n] >= '0' && digits[n] <= '7') {
+                value = value * 8 + (digits[n] - '0');
+                ++n;
+            }
+            *ok = *ok && buffer_push(buf, (char)value);
+            *p = digits + n;
+            return true;
+        }
+        *ok = *ok && buffer_push(buf, '\\');
+        if (ch != '\0') {
+            *ok = *ok && buffer_push(buf, ch);
+            *p = s + 1;
+        } else {
+            *p = s;
+        }
+        return true;
+    }
+    *ok = *ok && buffer_push(buf, out);
+    *p = s + 1;
+    return true;
+}
+
+static void free_format(pf_format *format) {
+    if (!format) {
+        return;
+    }
+    free(format->key);
+    free(format->items);
+    free(format->storage);
+    free(format);
+}
+
+static bool push_directive(pf_format *format, size_t *capacity, const pf_directive *directive) {
+    if (format->count == *capacity) {
+        size_t new_cap = *capacity ? *capacity * 2u : 8u;
+        pf_directive *tmp = (pf_directive *)realloc(format->items, new_cap * sizeof(pf_directive));
+        if (!tmp) {
+            return false;
+        }
+        format->items = tmp;
+        *capacity = new_cap;
+    }
+    format->items[format->count++] = *directive;
+    return true;
+}
+
+/* Parses one conversion after '%'; *p is left past the conversion character. */
+static bool compile_conversion(const char **p, pf_directive *directive) {
+    const char *s = *p;
+    char flags[6];
+    size_t flag_count = 0u;
+    while (*s && strchr("-+ #0", *s)) {
+        if (flag_count < sizeof(flags) - 1u && !memchr(flags, *s, flag_count)) {
+            flags[flag_count++] = *s;
+        }
+        ++s;
+    }
+    flags[flag_count] = '\0';
+
+    directive->precision = -1;
+    if (*s == '*') {
+        directive->width_star = true;
+        ++s;
+    } else {
+        while (isdigit((unsigned char)*s)) {
+            directive->width = directive->width * 10 + (*s - '0');
+            ++s;
+        }
+    }
+    if (*s == '.') {
+        ++s;
+        directive->precision = 0;
+        if (*s == '*') {
+            directive->precision_star = true;
+            ++s;
+        } else {
+            while (isdigit((unsigned char)*s)) {
+                directive->precision = directive->precision * 10 + (*s - '0');
+                ++s;
+            }
+        }
+    }
+    while (*s && strchr("hlLjzt", *s)) {
+        ++s; /* length modifiers are accepted and ignored */
+    }
+
+    char conv = *s;
+    const char *length = "";
+    const char *suffix;
+    switch (conv) {
+    case 'd':
+    case 'i':
+        length = "ll";
+        suffix = "d";
+        break;
+    case 'o':
+    case 'u':
+    case 'x':
+    case 'X':
+        length = "ll";
+        suffix = conv == 'o' ? "o" : conv == 'u' ? "u" : conv == 'x' ? "x" : "X";
+        break;
+    case 'e':
+    case 'E':
+    case 'f':
+    case 'F':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        length = "L";
+        suffix = conv == 'e' ? "e" : conv == 'E' ? "E" : conv == 'f' ? "f" : conv == 'F' ? "F" :
+                 conv == 'g' ? "g" : conv == 'G' ? "G" : conv == 'a' ? "a" : "A";
+        break;
+    case 's':
+    case 'b':
+        suffix = "s";
+        break;
+    case 'c':
+        suffix = "c";
+        break;
+    default:
+        *p = s;
+        return false;
+    }
+    directive->kind = PF_CONVERSION;
+    directive->conversion = conv;
+    snprintf(directive->spec, sizeof(directive->spec), conv == 'c' ? "%%%s*%s%s" : "%%%s*.*%s%s", flags, length, suffix);
+    *p = s + 1;
+    return true;
+}
+
+/* Compiles a format into directives; NULL (with a message) if it is invalid. */
+static pf_format *compile_format(const char *text, uint64_t hash) {
+    pf_format *format = (pf_format *)calloc(1u, sizeof(pf_format));
+    if (!format) {
+        return NULL;
+    }
+    format->key = strdup(text);
+    format->hash = hash;
+    byte_buffer storage = {0};
+    size_t capacity = 0u;
+    bool ok = format->key != NULL;
+    pf_directive literal = {0};
+    literal.kind = PF_LITERAL;
+
+    const char *p = text;
+    while (ok && *p) {
+        if (*p != '%' && *p != '\\') {
+            ok = buffer_push(&storage, *p++);
+            continue;
+        }
+        if (*p == '\\') {
+            ++p;
+            if (!decode_escape(&p, &storage, false, &ok)) {
+                pf_directive stop = {0};
+                stop.kind = PF_STOP;
+                literal.length = storage.length - literal.offset;
+                ok = ok && (literal.length == 0u || push_directive(format, &capacity, &literal)) &&
+                     push_directive(format, &capacity, &stop);
+                literal.offset = storage.length;
+                break;
+            }
+            continue;
+        }
+        if (p[1] == '%') {
+            ok = buffer_push(&storage, '%');
+            p += 2;
+            continue;
+        }
+        ++p;
+        pf_directive directive = {0};
+        if (!compile_conversion(&p, &directive)) {
+            if (*p) {
+                gs_builtin_err_printf("genshell: printf: %%%c: invalid directive\n", *p);
+            } else {
+                gs_builtin_err_printf("genshell: printf: missing format character\n");
+            }
+            free(storage.data);
+            free_format(format);
+            return NULL;
+        }
+        literal.length = storage.length - literal.offset;
+        ok = (literal.length == 0u || push_directive(format, &capacity, &literal)) &&
+             push_directive(format, &capacity, &directive);
+        literal.offset = storage.length;
+        format->has_conversions = true;
+    }
+    literal.length = storage.length - literal.offset;
+    if (ok && literal.length > 0u) {
+        ok = push_directive(format, &capacity, &literal);
+    }
+    if (!ok) {
+        gs_builtin_err_printf("genshell: printf: allocation failure\n");
+        free(storage.data);
+        free_format(format);
+        return NULL;
+    }
+    format->storage = storage.data;
+    return format;
+}
+
+/*
+ * Returns the compiled form of text, compiling and caching it on first use.
+ * Cached formats are immutable and never freed, so concurrent printf stages
+ * only hold the lock for the lookup. *owned is set when the caller must free
+ * an uncached result.
+ */
+static const pf_format *lookup_format(const char *text, bool *owned) {
+    uint64_t hash = hash_text(text);
+    size_t slot = (size_t)(hash % PRINTF_CACHE_SLOTS);
+    *owned = false;
+
+    pthread_once(&g_atfork_once, register_atfork);
+    pthread_mutex_lock(&g_cache_lock);
+    for (size_t i = 0; i < PRINTF_CACHE_SLOTS; ++i) {
+        pf_format *entry = g_cache[(slot + i) % PRINTF_CACHE_SLOTS];
+        if (!entry) {
+            break;
+        }
+        if (entry->hash == hash && strcmp(entry->key, text) == 0) {
+            pthread_mutex_unlock(&g_cache_lock);
+            return entry;
+        }
+    }
+    pthread_mutex_unlock(&g_cache_lock);
+
+    pf_format *format = compile_format(text, hash);
+    if (!format) {
+        return NULL;
+    }
+    pthread_mutex_lock(&g_cache_lock);
+    bool cached = false;
+    if (g_cache_count < PRINTF_CACHE_LIMIT) {
+        for (size_t i = 0; i < PRINTF_CACHE_SLOTS; ++i) {
+            pf_format **entry = &g_cache[(slot + i) % PRINTF_CACHE_SLOTS];
+            if (*entry && (*entry)->hash == hash && strcmp((*entry)->key, text) == 0) {
+                break; /* another thread won the race; keep ours private */
+            }
+            if (!*entry) {
+                *entry = format;
+                g_cache_count++;
+                cached = true;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&g_cache_lock);
+    *owned = !cached;
+    return format;
+}
+
+static const char *next_arg(pf_args *args) {
+    if (args->next < args->count) {
+        return args->args[args->next++];
+    }
+    return NULL;
+}
+
+/* Reports a numeric argument that was not (entirely) a number. */
+static void check_number(pf_args *args, const char *text, const char *end) {
+    if (end == text || *end != '\0') {
+        gs_builtin_err_printf("genshell: printf: %s: %s\n", text, end == text ? "expected a numeric value" : "not completely converted");
+        args->status = 1;
+    } else if (errno == ERANGE) {
+        gs_builtin_err_printf("genshell: printf: %s: %s\n", text, strerror(ERANGE));
+        args->status = 1;
+    }
+}
+
+static bool char_constant(const char *text, long long *out) {
+    if (text[0] == '\'' || text[0] == '"') {
+        *out = (unsigned char)text[1];
+        return true;
+    }
+    return false;
+}
+
+static long long integer_arg(pf_args *args, bool is_unsigned) {
+    const char *text = next_arg(args);
+    long long value = 0;
+    if (!text || text[0] == '\0' || char_constant(text, &value)) {
+        return value;
+    }
+    char *end = NULL;
+    errno = 0;
+    const char *s = text;
+    while (isspace((unsigned char)*s)) {
+        ++s;
+    }
+    if (is_unsigned && *s != '-') {
+        value = (long long)strtoull(s, &end, 0);
+    } else {
+        value = strtoll(s, &end, 0);
+    }
+    check_number(args, s, end);
+    return value;
+}
+
+static long double float_arg(pf_args *args) {
+    const char *text = next_arg(args);
+    long long ch = 0;
+    if (!text || text[0] == '\0') {
+        return 0.0L;
+    }
+    if (char_constant(text, &ch)) {
+        return (long double)ch;
+    }
+    char *end = NULL;
+    errno = 0;
+    long double value = strtold(text, &end);
+    check_number(args, text, end);
+    return value;
+}
+
+static int star_arg(pf_args *args) {
+    long long value = integer_arg(args, false);
+    if (value > INT32_MAX) {
+        return INT32_MAX;
+    }
+    if (value < -INT32_MAX) {
+        return -INT32_MAX;
+    }
+    return (int)value;
+}
+
+/* Expands the escapes of a %b argument; returns false if it contained "\c". */
+static bool expand_b_argument(const char *text, byte_buffer *buf, bool *ok) {
+    *ok = buffer_push(buf, '\0');
+    buf->length = 0u;
+    for (const char *p = text; *ok && *p;) {
+        if (*p != '\\') {
+            *ok = buffer_push(buf, *p++);
+            continue;
+        }
+        ++p;
+        if (!decode_escape(&p, buf, true, ok)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Emits one conversion; returns false once "\c" in a %b argument ends output. */
+static bool emit_conversion(const pf_directive *d, pf_args *args) {
+    int width = d->width_star ? star_arg(args) : d->width;
+    int precision = d->precision_star ? star_arg(args) : d->precision;
+    switch (d->conversion) {
+    case 'd':
+    case 'i':
+        gs_builtin_out_printf(d->spec, width, precision, integer_arg(args, false));
+        return true;
+    case 'o':
+    case 'u':
+    case 'x':
+    case 'X':
+        gs_builtin_out_printf(d->spec, width, precision, (unsigned long long)integer_arg(args, true));
+        return true;
+    case 'c': {
+        const char *text = next_arg(args);
+        if (text && text[0] != '\0') {
+            gs_builtin_out_printf(d->spec, width, text[0]);
+        } else if (width > 1 || width < -1) {
+            gs_builtin_out_printf("%*s", width, "");
+        }
+        return true;
+    }
+    case 's': {
+        const char *text = next_arg(args);
+        if (!text) {
+            text = "";
+        }
+        if (width == 0 && precision < 0) {
+            gs_builtin_out_ref(text, strlen(text));
+        } else {
+            gs_builtin_out_printf(d->spec, width, precision, text);
+        }
+        return true;
+    }
+    case 'b': {
+        const char *text = next_arg(args);
+        byte_buffer buf = {0};
+        bool ok = true;
+        bool more = expand_b_argument(text ? text : "", &buf, &ok);
+        if (!ok) {
+            gs_builtin_err_printf("genshell: printf: allocation failure\n");
+            args->status = 1;
+        } else if (width == 0 && precision < 0) {
+            gs_builtin_out_write(buf.data, buf.length);
+        } else {
+            gs_builtin_out_printf(d->spec, width, precision, buf.data);
+        }
+        free(buf.data);
+        return more;
+    }
+    default:
+        gs_builtin_out_printf(d->spec, width, precision, float_arg(args));
+        return true;
+    }
+}
+
+int genshell_builtin_printf(struct gs_shell *shell, int argc, char *const argv[]) {
+    (void)shell;
+    int argi = 1;
+    if (argi < argc && strcmp(argv[argi], "--") == 0) {
+        ++argi;
+    }
+    if (argi >= argc) {
+        gs_builtin_err_printf("usage: printf format [arguments]\n");
+        return 2;
+    }
+
+    bool owned = false;
+    const pf_format *format = lookup_format(argv[argi], &owned);
+    if (!format) {
+        return 1;
+    }
+
+    pf_args args = {argv + argi + 1, argc - argi - 1, 0, 0};
+    bool running = true;
+    do {
+        int before = args.next;
+        for (size_t i = 0; running && i < format->count; ++i) {
+            const pf_directive *d = &format->items[i];
+            if (d->kind == PF_LITERAL && owned) {
+                /* freed before the output is flushed, so copy it */
+                gs_builtin_out_write(format->storage + d->offset, d->length);
+            } else if (d->kind == PF_LITERAL) {
+                gs_builtin_out_ref(format->storage + d->offset, d->length);
+            } else if (d->kind == PF_STOP) {
+                running = false;
+            } else {
+                running = emit_conversion(d, &args);
+            }
+        }
+        if (args.next == before) {
+            break;
+        }
+    } while (running && format->has_conversions && args.next < args.count);
+
+    if (owned) {
+        free_format((pf_format *)format);
+    }
+    return args.status;
+}
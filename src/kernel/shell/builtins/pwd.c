@@ -1,11 +1,13 @@
 /*
  * pwd - POSIX shell builtin
- * Prints the shell's current working directory. Supports -L (logical PWD) and
- * -P (physical path via getcwd), defaulting to logical semantics when possible.
+ * Prints the shell's current working directory. Supports -L (logical PWD, as
+ * maintained by cd) and -P (the physical path of the shell's directory), defaulting to logical
+ * semantics whenever PWD is an absolute path without "." or ".." components.
+ * Writes through the builtin writer so it can run in-process as a pipeline
+ * stage.
  */
 
 #include <errno.h>
-#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,8 +17,6 @@
 #include "builtin.h"
 
 int genshell_builtin_pwd(struct gs_shell *shell, int argc, char *const argv[]) {
-    (void)shell;
-
     bool logical = true;
 
     for (int i = 1; i < argc; ++i) {
@@ -25,27 +25,29 @@ int genshell_builtin_pwd(struct gs_shell *shell, int argc, char *const argv[]) {
         } else if (strcmp(argv[i], "-P") == 0) {
             logical = false;
         } else {
-            fprintf(stderr, "genshell: pwd: invalid option -- %s\n", argv[i]);
+            gs_builtin_err_printf("genshell: pwd: invalid option -- %s\n", argv[i]);
             return 1;
         }
     }
 
     const char *pwd = NULL;
-    char buf[PATH_MAX];
+    char *physical = NULL;
 
     if (logical) {
-        pwd = getenv("PWD");
+        pwd = gs_shell_getvar(shell, "PWD");
     }
 
-    if (!pwd || pwd[0] == '\0' || !logical) {
-        if (getcwd(buf, sizeof(buf)) == NULL) {
-            fprintf(stderr, "genshell: pwd: %s\n", strerror(errno));
+    if (!logical || !gs_path_is_canonical(pwd)) {
+        physical = gs_shell_physical_cwd(shell);
+        if (!physical) {
+            gs_builtin_err_printf("genshell: pwd: %s\n", strerror(errno));
             return 1;
         }
-        pwd = buf;
+        pwd = physical;
     }
 
-    printf("%s\n", pwd);
-    fflush(stdout);
+    gs_builtin_out_puts(pwd);
+    gs_builtin_out_write("\n", 1u);
+    free(physical);
     return 0;
 }
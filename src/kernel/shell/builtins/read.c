@@ -0,0 +1,294 @@
+/*
+ * read - POSIX shell builtin
+ * Reads one logical line from standard input and splits it into fields on
+ * IFS, assigning them to the named variables (REPLY when none are given); the
+ * last variable receives the rest of the line. Without -r a backslash quotes
+ * the next character and backslash-newline continues the line. Input must be
+ * consumed only up to the newline so later commands see the rest: on pipes
+ * and terminals that means a read(2) per byte, but on seekable input the
+ * builtin reads a block and lseeks back to the line boundary instead, so a
+ * line costs a few syscalls however long it is.
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "builtin.h"
+
+#define READ_BLOCK 512u
+
+typedef struct {
+    char *text;
+    unsigned char *quoted; /* 1 where the byte was escaped by a backslash */
+    size_t length;
+    size_t capacity;
+} read_line;
+
+typedef struct {
+    int fd;
+    bool seekable;
+    char block[READ_BLOCK];
+} read_source;
+
+static int is_valid_name(const char *name) {
+    if (!name || name[0] == '\0') {
+        return 0;
+    }
+    if (!(isalpha((unsigned char)name[0]) || name[0] == '_')) {
+        return 0;
+    }
+    for (const char *p = name + 1; *p; ++p) {
+        if (!(isalnum((unsigned char)*p) || *p == '_')) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static bool line_push(read_line *line, char ch, bool quoted) {
+    if (line->length + 1u >= line->capacity) {
+        size_t new_cap = line->capacity ? line->capacity * 2u : 128u;
+        char *text = (char *)realloc(line->text, new_cap);
+        if (!text) {
+            return false;
+        }
+        line->text = text;
+        unsigned char *mask = (unsigned char *)realloc(line->quoted, new_cap);
+        if (!mask) {
+            return false;
+        }
+        line->quoted = mask;
+        line->capacity = new_cap;
+    }
+    line->text[line->length] = ch;
+    line->quoted[line->length] = quoted ? 1u : 0u;
+    line->length++;
+    line->text[line->length] = '\0';
+    return true;
+}
+
+static ssize_t read_retry(int fd, char *buf, size_t len) {
+    ssize_t n;
+    do {
+        n = read(fd, buf, len);
+    } while (n < 0 && errno == EINTR);
+    return n;
+}
+
+/*
+ * Appends the raw bytes of one physical line, newline excluded, to *raw.
+ * Returns 1 when a newline ended it, 0 at end of input, negative on error.
+ */
+static int read_physical_line(read_source *src, read_line *raw) {
+    if (!src->seekable) {
+        for (;;) {
+            char ch;
+            ssize_t n = read_retry(src->fd, &ch, 1u);
+            if (n < 0) {
+                return GS_ERR_EXEC;
+            }
+            if (n == 0) {
+                return 0;
+            }
+            if (ch == '\n') {
+                return 1;
+            }
+            if (ch != '\0' && !line_push(raw, ch, false)) {
+                return GS_ERR_ALLOC;
+            }
+        }
+    }
+    for (;;) {
+        ssize_t n = read_retry(src->fd, src->block, sizeof(src->block));
+        if (n < 0) {
+            return GS_ERR_EXEC;
+        }
+        if (n == 0) {
+            return 0;
+        }
+        char *nl = (char *)memchr(src->block, '\n', (size_t)n);
+        size_t used = nl ? (size_t)(nl - src->block) : (size_t)n;
+        for (size_t i = 0; i < used; ++i) {
+            if (src->block[i] != '\0' && !line_push(raw, src->block[i], false)) {
+                return GS_ERR_ALLOC;
+            }
+        }
+        if (nl) {
+            off_t excess = (off_t)((size_t)n - used - 1u);
+            if (excess > 0 && lseek(src->fd, -excess, SEEK_CUR) < 0) {
+                return GS_ERR_EXEC;
+            }
+            return 1;
+        }
+    }
+}
+
+/*
+ * Reads one logical line into *line, resolving backslash escapes unless raw.
+ * Returns 1 for a complete line, 0 if input ended first, negative on error.
+ */
+static int read_logical_line(read_source *src, bool raw_mode, read_line *line) {
+    read_line raw = {0};
+    int result;
+    for (;;) {
+        raw.length = 0u;
+        result = read_physical_line(src, &raw);
+        if (result < 0) {
+            break;
+        }
+        bool continued = false;
+        for (size_t i = 0; i < raw.length; ++i) {
+            char ch = raw.text[i];
+            bool ok;
+            if (!raw_mode && ch == '\\') {
+                if (i + 1u == raw.length) {
+                    continued = result == 1;
+                    ok = true;
+                } else {
+                    ok = line_push(line, raw.text[++i], true);
+                }
+            } else {
+                ok = line_push(line, ch, false);
+            }
+            if (!ok) {
+                result = GS_ERR_ALLOC;
+                break;
+            }
+        }
+        if (result < 0 || !continued) {
+            break;
+        }
+    }
+    free(raw.text);
+    free(raw.quoted);
+    return result;
+}
+
+static bool is_ifs(const char *ifs, const read_line *line, size_t i) {
+    return !line->quoted[i] && line->text[i] != '\0' && strchr(ifs, line->text[i]) != NULL;
+}
+
+static bool is_ifs_space(const char *ifs, const read_line *line, size_t i) {
+    char ch = line->text[i];
+    return is_ifs(ifs, line, i) && (ch == ' ' || ch == '\t' || ch == '\n');
+}
+
+static int assign(struct gs_shell *shell, const char *name, const char *value) {
+    if (gs_shell_preserve_variable(shell, name) != GS_OK || gs_shell_setvar(shell, name, value) != GS_OK) {
+        gs_builtin_err_printf("genshell: read: failed to set %s\n", name);
+        return 1;
+    }
+    return 0;
+}
+
+/* Splits the line on IFS and assigns the fields to names[0..count). */
+static int assign_fields(struct gs_shell *shell, const char *ifs, read_line *line, char *const names[], int count) {
+    size_t pos = 0u;
+    size_t end = line->length;
+    int status = 0;
+    while (pos < end && is_ifs_space(ifs, line, pos)) {
+        ++pos;
+    }
+    for (int v = 0; v < count; ++v) {
+        if (v == count - 1) {
+            while (end > pos && is_ifs_space(ifs, line, end - 1u)) {
+                --end;
+            }
+            char saved = line->text[end];
+            line->text[end] = '\0';
+            status |= assign(shell, names[v], line->text + pos);
+            line->text[end] = saved;
+            break;
+        }
+        size_t start = pos;
+        while (pos < end && !is_ifs(ifs, line, pos)) {
+            ++pos;
+        }
+        size_t field_end = pos;
+        /* Consume one delimiter: IFS white space plus at most one other IFS byte. */
+        while (pos < end && is_ifs_space(ifs, line, pos)) {
+            ++pos;
+        }
+        if (pos < end && is_ifs(ifs, line, pos) && !is_ifs_space(ifs, line, pos)) {
+            ++pos;
+            while (pos < end && is_ifs_space(ifs, line, pos)) {
+                ++pos;
+            }
+        }
+        char saved = line->text[field_end];
+        line->text[field_end] = '\0';
+        status |= assign(shell, names[v], line->text + start);
+        line->text[field_end] = saved;
+    }
+    return status;
+}
+
+int genshell_builtin_read(struct gs_shell *shell, int argc, char *const argv[]) {
+    bool raw_mode = false;
+    int argi = 1;
+    for (; argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0'; ++argi) {
+        if (strcmp(argv[argi], "--") == 0) {
+            ++argi;
+            break;
+        }
+        for (const char *opt = argv[argi] + 1; *opt; ++opt) {
+            if (*opt != 'r') {
+                gs_builtin_err_printf("genshell: read: -%c: invalid option\nusage: read [-r] [name ...]\n", *opt);
+                return 2;
+            }
+            raw_mode = true;
+        }
+    }
+
+    static char *const k_reply[] = {"REPLY"};
+    char *const *names = argi < argc ? argv + argi : k_reply;
+    int count = argi < argc ? argc - argi : 1;
+    for (int i = 0; i < count; ++i) {
+        if (!is_valid_name(names[i])) {
+            gs_builtin_err_printf("genshell: read: `%s': not a valid identifier\n", names[i]);
+            return 2;
+        }
+    }
+
+    read_source src;
+    src.fd = gs_builtin_io_current()->in_fd;
+    src.seekable = lseek(src.fd, 0, SEEK_CUR) >= 0;
+
+    read_line line = {0};
+    int result = read_logical_line(&src, raw_mode, &line);
+    if (result < 0) {
+        if (result == GS_ERR_ALLOC) {
+            gs_builtin_err_printf("genshell: read: allocation failure\n");
+        } else {
+            gs_builtin_err_printf("genshell: read: read error: %s\n", strerror(errno));
+        }
+        free(line.text);
+        free(line.quoted);
+        return 2;
+    }
+
+    /* A copy, since assigning to IFS itself replaces the shell's value. */
+    const char *ifs_value = gs_shell_getvar(shell, "IFS");
+    char *ifs = strdup(ifs_value ? ifs_value : " \t\n");
+    if (!ifs || !line_push(&line, '\0', false)) {
+        free(ifs);
+        free(line.text);
+        free(line.quoted);
+        gs_builtin_err_printf("genshell: read: allocation failure\n");
+        return 2;
+    }
+    line.length--;
+    int status = assign_fields(shell, ifs, &line, names, count);
+    free(ifs);
+    free(line.text);
+    free(line.quoted);
+    if (status != 0) {
+        return 2;
+    }
+    return (result == 1) ? 0 : 1;
+}
@@ -1,67 +1,276 @@
 #include "builtin.h"
 
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
+static int builtin_cat(struct gs_shell *shell, int argc, char *const argv[]);
 static int builtin_cd(struct gs_shell *shell, int argc, char *const argv[]);
+static int builtin_enable(struct gs_shell *shell, int argc, char *const argv[]);
 static int builtin_exit(struct gs_shell *shell, int argc, char *const argv[]);
+static int builtin_history(struct gs_shell *shell, int argc, char *const argv[]);
+static int builtin_parallel(struct gs_shell *shell, int argc, char *const argv[]);
+static int builtin_popd(struct gs_shell *shell, int argc, char *const argv[]);
+static int builtin_printf(struct gs_shell *shell, int argc, char *const argv[]);
+static int builtin_pushd(struct gs_shell *shell, int argc, char *const argv[]);
 static int builtin_pwd(struct gs_shell *shell, int argc, char *const argv[]);
+static int builtin_dirs(struct gs_shell *shell, int argc, char *const argv[]);
 static int builtin_echo(struct gs_shell *shell, int argc, char *const argv[]);
 static int builtin_export(struct gs_shell *shell, int argc, char *const argv[]);
 static int builtin_unset(struct gs_shell *shell, int argc, char *const argv[]);
+static int builtin_read(struct gs_shell *shell, int argc, char *const argv[]);
+static int builtin_source(struct gs_shell *shell, int argc, char *const argv[]);
+static int builtin_tee(struct gs_shell *shell, int argc, char *const argv[]);
+static int builtin_test(struct gs_shell *shell, int argc, char *const argv[]);
 static int builtin_umask(struct gs_shell *shell, int argc, char *const argv[]);
+static int builtin_z(struct gs_shell *shell, int argc, char *const argv[]);
 
 static const gs_builtin_spec k_builtins[] = {
-    {"cd", builtin_cd, GS_BUILTIN_FLAG_PARENT | GS_BUILTIN_FLAG_SPECIAL},
-    {"echo", builtin_echo, 0u},
-    {"exit", builtin_exit, GS_BUILTIN_FLAG_PARENT | GS_BUILTIN_FLAG_SPECIAL},
-    {"export", builtin_export, GS_BUILTIN_FLAG_PARENT | GS_BUILTIN_FLAG_SPECIAL},
-    {"pwd", builtin_pwd, GS_BUILTIN_FLAG_PARENT},
-    {"umask", builtin_umask, GS_BUILTIN_FLAG_PARENT | GS_BUILTIN_FLAG_SPECIAL},
-    {"unset", builtin_unset, GS_BUILTIN_FLAG_PARENT | GS_BUILTIN_FLAG_SPECIAL},
+    {".", builtin_source, GS_BUILTIN_FLAG_PARENT | GS_BUILTIN_FLAG_SPECIAL | GS_BUILTIN_FLAG_FORK, NULL},
+    {"[", builtin_test, GS_BUILTIN_FLAG_INPROC, NULL},
+    {"cat", builtin_cat, GS_BUILTIN_FLAG_INPROC, "u"},
+    {"cd", builtin_cd, GS_BUILTIN_FLAG_PARENT | GS_BUILTIN_FLAG_SPECIAL, NULL},
+    {"dirs", builtin_dirs, GS_BUILTIN_FLAG_PARENT, NULL},
+    {"echo", builtin_echo, GS_BUILTIN_FLAG_INPROC | GS_BUILTIN_FLAG_PRODUCER, NULL},
+    {"enable", builtin_enable, GS_BUILTIN_FLAG_PARENT | GS_BUILTIN_FLAG_FORK, NULL},
+    {"exit", builtin_exit, GS_BUILTIN_FLAG_PARENT | GS_BUILTIN_FLAG_SPECIAL, NULL},
+    {"export", builtin_export, GS_BUILTIN_FLAG_PARENT | GS_BUILTIN_FLAG_SPECIAL, NULL},
+    {"history", builtin_history, GS_BUILTIN_FLAG_PARENT, NULL},
+    {"parallel", builtin_parallel, GS_BUILTIN_FLAG_PARENT, NULL},
+    {"popd", builtin_popd, GS_BUILTIN_FLAG_PARENT, NULL},
+    {"printf", builtin_printf, GS_BUILTIN_FLAG_INPROC | GS_BUILTIN_FLAG_PRODUCER, NULL},
+    {"pushd", builtin_pushd, GS_BUILTIN_FLAG_PARENT, NULL},
+    {"pwd", builtin_pwd, GS_BUILTIN_FLAG_PARENT | GS_BUILTIN_FLAG_INPROC | GS_BUILTIN_FLAG_PRODUCER, NULL},
+    {"read", builtin_read, GS_BUILTIN_FLAG_PARENT, NULL},
+    {"source", builtin_source, GS_BUILTIN_FLAG_PARENT | GS_BUILTIN_FLAG_FORK, NULL},
+    {"tee", builtin_tee, GS_BUILTIN_FLAG_INPROC, "a"},
+    {"test", builtin_test, GS_BUILTIN_FLAG_INPROC, NULL},
+    {"umask", builtin_umask, GS_BUILTIN_FLAG_PARENT | GS_BUILTIN_FLAG_SPECIAL, NULL},
+    {"unset", builtin_unset, GS_BUILTIN_FLAG_PARENT | GS_BUILTIN_FLAG_SPECIAL, NULL},
+    {"z", builtin_z, GS_BUILTIN_FLAG_PARENT, NULL},
 };
 
-static int compare_builtin(const void *lhs, const void *rhs) {
-    const gs_builtin_spec *a = (const gs_builtin_spec *)lhs;
-    const gs_builtin_spec *b = (const gs_builtin_spec *)rhs;
-    return strcmp(a->name, b->name);
+/*
+ * Name lookup goes through an open-addressing table (linear probing, at most
+ * half full) over the compiled-in builtins plus any registered at run time.
+ * Registration is rare, so it simply rebuilds the table; later registrations
+ * shadow earlier ones of the same name. Registered specs are never freed, as
+ * prepared commands may still point at a shadowed one. Shells on other
+ * threads look names up without locking: a rebuilt table is published with
+ * a single atomic store and the one it replaces is retired rather than
+ * freed, since a lookup may still be probing it. Registrations serialise on
+ * g_register_lock.
+ */
+typedef struct {
+    const gs_builtin_spec *spec;
+    uint32_t hash;
+} builtin_slot;
+
+typedef struct {
+    size_t mask;
+    builtin_slot slots[];
+} builtin_table;
+
+static _Atomic(const builtin_table *) g_table;
+static pthread_mutex_t g_register_lock = PTHREAD_MUTEX_INITIALIZER;
+static const gs_builtin_spec **g_registered;
+static size_t g_registered_count;
+static size_t g_registered_capacity;
+static pthread_once_t g_table_once = PTHREAD_ONCE_INIT;
+
+static uint32_t hash_name(const char *name) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p; ++p) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void table_insert(builtin_slot *slots, size_t mask, const gs_builtin_spec *spec) {
+    uint32_t hash = hash_name(spec->name);
+    for (size_t i = hash & mask;; i = (i + 1u) & mask) {
+        if (!slots[i].spec || (slots[i].hash == hash && strcmp(slots[i].spec->name, spec->name) == 0)) {
+            slots[i].spec = spec;
+            slots[i].hash = hash;
+            return;
+        }
+    }
+}
+
+static int table_rebuild(void) {
+    size_t count = sizeof(k_builtins) / sizeof(k_builtins[0]) + g_registered_count;
+    size_t capacity = 32u;
+    while (capacity < count * 2u) {
+        capacity *= 2u;
+    }
+    builtin_table *table = (builtin_table *)calloc(1u, sizeof(builtin_table) + capacity * sizeof(builtin_slot));
+    if (!table) {
+        return GS_ERR_ALLOC;
+    }
+    table->mask = capacity - 1u;
+    for (size_t i = 0; i < sizeof(k_builtins) / sizeof(k_builtins[0]); ++i) {
+        table_insert(table->slots, table->mask, &k_builtins[i]);
+    }
+    for (size_t i = 0; i < g_registered_count; ++i) {
+        table_insert(table->slots, table->mask, g_registered[i]);
+    }
+    atomic_store_explicit(&g_table, table, memory_order_release);
+    return GS_OK;
+}
+
+static void table_init(void) {
+    table_rebuild();
 }
 
 const gs_builtin_spec *gs_builtin_lookup(const char *name) {
     if (!name) {
         return NULL;
     }
-    gs_builtin_spec key = {name, NULL, 0u};
-    const gs_builtin_spec *result = (const gs_builtin_spec *)bsearch(
-        &key,
-        k_builtins,
-        sizeof(k_builtins) / sizeof(k_builtins[0]),
-        sizeof(k_builtins[0]),
-        compare_builtin);
-    return result;
+    pthread_once(&g_table_once, table_init);
+    const builtin_table *table = atomic_load_explicit(&g_table, memory_order_acquire);
+    if (!table) {
+        return NULL;
+    }
+    uint32_t hash = hash_name(name);
+    for (size_t i = hash & table->mask; table->slots[i].spec; i = (i + 1u) & table->mask) {
+        if (table->slots[i].hash == hash && strcmp(table->slots[i].spec->name, name) == 0) {
+            return table->slots[i].spec;
+        }
+    }
+    return NULL;
+}
+
+int gs_builtin_register(const gs_builtin_spec *spec) {
+    if (!spec || !spec->name || !spec->fn) {
+        return GS_ERR_EXEC;
+    }
+    pthread_once(&g_table_once, table_init);
+    pthread_mutex_lock(&g_register_lock);
+    if (g_registered_count == g_registered_capacity) {
+        size_t new_cap = g_registered_capacity ? g_registered_capacity * 2u : 8u;
+        const gs_builtin_spec **tmp =
+            (const gs_builtin_spec **)realloc((void *)g_registered, new_cap * sizeof(*tmp));
+        if (!tmp) {
+            pthread_mutex_unlock(&g_register_lock);
+            return GS_ERR_ALLOC;
+        }
+        g_registered = tmp;
+        g_registered_capacity = new_cap;
+    }
+    g_registered[g_registered_count++] = spec;
+    int rc = table_rebuild();
+    if (rc != GS_OK) {
+        g_registered_count--;
+    }
+    pthread_mutex_unlock(&g_register_lock);
+    return rc;
+}
+
+void gs_builtin_foreach(void (*visit)(const gs_builtin_spec *spec, void *ctx), void *ctx) {
+    for (size_t i = 0; i < sizeof(k_builtins) / sizeof(k_builtins[0]); ++i) {
+        if (gs_builtin_lookup(k_builtins[i].name) == &k_builtins[i]) {
+            visit(&k_builtins[i], ctx);
+        }
+    }
+    pthread_mutex_lock(&g_register_lock);
+    for (size_t i = 0; i < g_registered_count; ++i) {
+        if (gs_builtin_lookup(g_registered[i]->name) == g_registered[i]) {
+            visit(g_registered[i], ctx);
+        }
+    }
+    pthread_mutex_unlock(&g_register_lock);
+}
+
+bool gs_builtin_accepts(const gs_builtin_spec *spec, int argc, char *const argv[]) {
+    if (!spec || !spec->options) {
+        return true;
+    }
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        if (arg[0] != '-' || arg[1] == '\0') {
+            break;
+        }
+        if (strcmp(arg, "--") == 0) {
+            break;
+        }
+        for (const char *opt = arg + 1; *opt; ++opt) {
+            if (!strchr(spec->options, *opt)) {
+                return false;
+            }
+        }
+    }
+    return true;
 }
 
 /* Declarations implemented in dedicated translation units. */
+extern int genshell_builtin_cat(struct gs_shell *, int, char *const []);
 extern int genshell_builtin_cd(struct gs_shell *, int, char *const []);
+extern int genshell_builtin_enable(struct gs_shell *, int, char *const []);
 extern int genshell_builtin_exit(struct gs_shell *, int, char *const []);
+extern int genshell_builtin_history(struct gs_shell *, int, char *const []);
+extern int genshell_builtin_parallel(struct gs_shell *, int, char *const []);
+extern int genshell_builtin_popd(struct gs_shell *, int, char *const []);
+extern int genshell_builtin_printf(struct gs_shell *, int, char *const []);
+extern int genshell_builtin_pushd(struct gs_shell *, int, char *const []);
 extern int genshell_builtin_pwd(struct gs_shell *, int, char *const []);
+extern int genshell_builtin_dirs(struct gs_shell *, int, char *const []);
 extern int genshell_builtin_echo(struct gs_shell *, int, char *const []);
 extern int genshell_builtin_export(struct gs_shell *, int, char *const []);
 extern int genshell_builtin_unset(struct gs_shell *, int, char *const []);
+extern int genshell_builtin_read(struct gs_shell *, int, char *const []);
+extern int genshell_builtin_source(struct gs_shell *, int, char *const []);
+extern int genshell_builtin_tee(struct gs_shell *, int, char *const []);
+extern int genshell_builtin_test(struct gs_shell *, int, char *const []);
 extern int genshell_builtin_umask(struct gs_shell *, int, char *const []);
+extern int genshell_builtin_z(struct gs_shell *, int, char *const []);
+
+static int builtin_cat(struct gs_shell *shell, int argc, char *const argv[]) {
+    return genshell_builtin_cat(shell, argc, argv);
+}
 
 static int builtin_cd(struct gs_shell *shell, int argc, char *const argv[]) {
     return genshell_builtin_cd(shell, argc, argv);
 }
 
+static int builtin_enable(struct gs_shell *shell, int argc, char *const argv[]) {
+    return genshell_builtin_enable(shell, argc, argv);
+}
+
 static int builtin_exit(struct gs_shell *shell, int argc, char *const argv[]) {
     return genshell_builtin_exit(shell, argc, argv);
 }
 
+static int builtin_history(struct gs_shell *shell, int argc, char *const argv[]) {
+    return genshell_builtin_history(shell, argc, argv);
+}
+
+static int builtin_parallel(struct gs_shell *shell, int argc, char *const argv[]) {
+    return genshell_builtin_parallel(shell, argc, argv);
+}
+
+static int builtin_popd(struct gs_shell *shell, int argc, char *const argv[]) {
+    return genshell_builtin_popd(shell, argc, argv);
+}
+
+static int builtin_printf(struct gs_shell *shell, int argc, char *const argv[]) {
+    return genshell_builtin_printf(shell, argc, argv);
+}
+
+static int builtin_pushd(struct gs_shell *shell, int argc, char *const argv[]) {
+    return genshell_builtin_pushd(shell, argc, argv);
+}
+
 static int builtin_pwd(struct gs_shell *shell, int argc, char *const argv[]) {
     return genshell_builtin_pwd(shell, argc, argv);
 }
 
+static int builtin_dirs(struct gs_shell *shell, int argc, char *const argv[]) {
+    return genshell_builtin_dirs(shell, argc, argv);
+}
+
 static int builtin_echo(struct gs_shell *shell, int argc, char *const argv[]) {
     return genshell_builtin_echo(shell, argc, argv);
 }
@@ -74,6 +283,26 @@ static int builtin_unset(struct gs_shell *shell, int argc, char *const argv[]) {
     return genshell_builtin_unset(shell, argc, argv);
 }
 
+static int builtin_read(struct gs_shell *shell, int argc, char *const argv[]) {
+    return genshell_builtin_read(shell, argc, argv);
+}
+
+static int builtin_source(struct gs_shell *shell, int argc, char *const argv[]) {
+    return genshell_builtin_source(shell, argc, argv);
+}
+
+static int builtin_tee(struct gs_shell *shell, int argc, char *const argv[]) {
+    return genshell_builtin_tee(shell, argc, argv);
+}
+
+static int builtin_test(struct gs_shell *shell, int argc, char *const argv[]) {
+    return genshell_builtin_test(shell, argc, argv);
+}
+
 static int builtin_umask(struct gs_shell *shell, int argc, char *const argv[]) {
     return genshell_builtin_umask(shell, argc, argv);
 }
+
+static int builtin_z(struct gs_shell *shell, int argc, char *const argv[]) {
+    return genshell_builtin_z(shell, argc, argv);
+}
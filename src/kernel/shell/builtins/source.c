@@ -0,0 +1,68 @@
+/*
+ * . (source) - POSIX shell builtin
+ * Runs the commands of a file in the current shell environment, so variable,
+ * directory and umask changes persist. A name without a slash is looked up in
+ * PATH (readable regular files only) and then in the current directory. The
+ * exit status is that of the last command run, 0 if there was none. Parsed
+ * files are cached by the shell (see ../source.c), so sourcing an unchanged
+ * library again skips lexing and parsing.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "builtin.h"
+
+/* Returns a malloc'd PATH match for name, or NULL if there is none. */
+static char *search_path(const struct gs_shell *shell, const char *name) {
+    const char *path = gs_shell_getvar(shell, "PATH");
+    if (!path) {
+        return NULL;
+    }
+    size_t name_len = strlen(name);
+    const char *dir = path;
+    for (;;) {
+        const char *end = strchr(dir, ':');
+        size_t dir_len = end ? (size_t)(end - dir) : strlen(dir);
+        if (dir_len > 0u) {
+            char *candidate = (char *)malloc(dir_len + name_len + 2u);
+            if (!candidate) {
+                return NULL;
+            }
+            memcpy(candidate, dir, dir_len);
+            candidate[dir_len] = '/';
+            memcpy(candidate + dir_len + 1u, name, name_len + 1u);
+            struct stat st;
+            if (fstatat(shell->cwd_fd, candidate, &st, 0) == 0 && S_ISREG(st.st_mode) &&
+                faccessat(shell->cwd_fd, candidate, R_OK, 0) == 0) {
+                return candidate;
+            }
+            free(candidate);
+        }
+        if (!end) {
+            return NULL;
+        }
+        dir = end + 1;
+    }
+}
+
+int genshell_builtin_source(struct gs_shell *shell, int argc, char *const argv[]) {
+    int argi = 1;
+    if (argi < argc && strcmp(argv[argi], "--") == 0) {
+        ++argi;
+    }
+    if (argi >= argc) {
+        gs_builtin_err_printf("genshell: %s: filename argument required\nusage: %s filename [arguments]\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    const char *name = argv[argi];
+    char *found = strchr(name, '/') ? NULL : search_path(shell, name);
+    int status = gs_shell_source(shell, found ? found : name);
+    free(found);
+    return status;
+}
@@ -0,0 +1,333 @@
+/*
+ * tee - POSIX shell builtin
+ * Copies its input to the bound output descriptor and to every file operand
+ * ("-a" appends instead of truncating). When the input is a pipe on Linux the
+ * data never enters user space: each round tee(2)s the pending input into one
+ * scratch pipe per extra target, splice(2)s the same bytes from the input into
+ * the last target (consuming them) and then drains every scratch pipe into its
+ * target. The smallest scratch pipe takes the first tee(2) of a round, so the
+ * round never holds more than every other scratch pipe can take, even when
+ * one could not be grown to the input's size. Splices loop until the whole
+ * round is written, so a slow reader only stalls the round instead of losing
+ * data. Targets the kernel refuses to splice into, and non-pipe input, are
+ * served with buffered read/write.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "builtin.h"
+
+#define TEE_BUFFER (1u << 17)
+
+typedef struct {
+    const char *name;
+    int fd;
+    bool owned;
+    bool active;
+    bool buffered;   /* kernel refused splice into this target */
+    int scratch[2];  /* scratch pipe fed by tee(2), or -1 */
+    size_t capacity; /* of the scratch pipe, as the kernel reports it */
+} tee_target;
+
+static int status_for_failure(tee_target *target, int err) {
+    if (err != EPIPE) {
+        gs_builtin_err_printf("genshell: tee: %s: %s\n", target->name, strerror(err));
+    }
+    target->active = false;
+    return 1;
+}
+
+static int buffered_rounds(int in_fd, tee_target *targets, size_t count) {
+    char *buf = (char *)malloc(TEE_BUFFER);
+    if (!buf) {
+        gs_builtin_err_printf("genshell: tee: allocation failure\n");
+        return 1;
+    }
+    int status = 0;
+    while (true) {
+        ssize_t n = read(in_fd, buf, TEE_BUFFER);
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            gs_builtin_err_printf("genshell: tee: read error: %s\n", strerror(errno));
+            status = 1;
+            break;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (targets[i].active && gs_builtin_write_all(targets[i].fd, buf, (size_t)n) != GS_OK) {
+                status = status_for_failure(&targets[i], errno);
+            }
+        }
+    }
+    free(buf);
+    return status;
+}
+
+#if defined(__linux__)
+/*
+ * Moves exactly *len bytes from the pipe src into the target, splicing when
+ * allowed. On failure *len holds the bytes that were not moved.
+ */
+static int drain_exact(int src, tee_target *target, size_t *remaining, char *buf) {
+    size_t len = *remaining;
+    int err = 0;
+    while (len > 0u) {
+        if (!target->buffered) {
+            ssize_t n = splice(src, NULL, target->fd, NULL, len, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (n > 0) {
+                len -= (size_t)n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0 && (errno == EINVAL || errno == EBADF)) {
+                target->buffered = true;
+                continue;
+            }
+            err = n < 0 ? errno : EIO;
+            break;
+        }
+        size_t want = len < TEE_BUFFER ? len : TEE_BUFFER;
+        ssize_t n = read(src, buf, want);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            err = n < 0 ? errno : EIO;
+            break;
+        }
+        len -= (size_t)n;
+        if (gs_builtin_write_all(target->fd, buf, (size_t)n) != GS_OK) {
+            err = errno;
+            break;
+        }
+    }
+    *remaining = len;
+    return err;
+}
+
+/* Discards len bytes of input once no target is left to consume them. */
+static void discard_exact(int src, size_t len, char *buf) {
+    while (len > 0u) {
+        ssize_t n = read(src, buf, len < TEE_BUFFER ? len : TEE_BUFFER);
+        if (n <= 0 && !(n < 0 && errno == EINTR)) {
+            return;
+        }
+        if (n > 0) {
+            len -= (size_t)n;
+        }
+    }
+}
+
+static int splice_rounds(int in_fd, tee_target *targets, size_t count) {
+    char *buf = (char *)malloc(TEE_BUFFER);
+    if (!buf) {
+        gs_builtin_err_printf("genshell: tee: allocation failure\n");
+        return 1;
+    }
+    int pipe_size = fcntl(in_fd, F_GETPIPE_SZ);
+    int status = 0;
+    for (size_t i = 0; i + 1u < count; ++i) {
+        if (gs_pipe_cloexec(targets[i].scratch) != 0) {
+            gs_builtin_err_printf("genshell: tee: pipe failed: %s\n", strerror(errno));
+            status = 1;
+            goto done;
+        }
+        if (pipe_size > 0) {
+            (void)fcntl(targets[i].scratch[1], F_SETPIPE_SZ, pipe_size); /* may exceed pipe-max-size */
+        }
+        int capacity = fcntl(targets[i].scratch[1], F_GETPIPE_SZ);
+        targets[i].capacity = capacity > 0 ? (size_t)capacity : 4096u;
+    }
+    size_t chunk = pipe_size > 0 ? (size_t)pipe_size : 65536u;
+
+    while (true) {
+        size_t consumer = count;
+        for (size_t i = count; i > 0; --i) {
+            if (targets[i - 1u].active) {
+                consumer = i - 1u;
+                break;
+            }
+        }
+        if (consumer == count) {
+            break;
+        }
+
+        /* The smallest scratch pipe fixes the round size; later tees into
+         * empty scratch pipes at least as large copy the same bytes. */
+        size_t first = consumer;
+        for (size_t i = 0; i < consumer; ++i) {
+            if (targets[i].active && (first == consumer || targets[i].capacity < targets[first].capacity)) {
+                first = i;
+            }
+        }
+        ssize_t round = -1;
+        for (size_t k = 0; first < consumer && k <= consumer; ++k) {
+            size_t i = k == 0u ? first : k - 1u;
+            if (!targets[i].active || (k > 0u && i == first)) {
+                continue;
+            }
+            size_t want = round < 0 ? targets[i].capacity : (size_t)round;
+            ssize_t n;
+            do {
+                n = tee(in_fd, targets[i].scratch[1], want, 0u);
+            } while (n < 0 && errno == EINTR);
+            if (n < 0) {
+                gs_builtin_err_printf("genshell: tee: %s\n", strerror(errno));
+                status = 1;
+                goto done;
+            }
+            if (round < 0) {
+                round = n;
+            } else if (n != round) {
+                status = status_for_failure(&targets[i], EIO); /* its copy no longer matches the input */
+                continue;
+            }
+            if (n == 0) {
+                break;
+            }
+        }
+
+        if (round == 0) {
+            break;
+        }
+        if (round < 0) {
+            /* Only the consumer is left: stream straight through. */
+            ssize_t n;
+            do {
+                n = targets[consumer].buffered
+                        ? -1
+                        : splice(in_fd, NULL, targets[consumer].fd, NULL, chunk, SPLICE_F_MOVE | SPLICE_F_MORE);
+            } while (n < 0 && errno == EINTR);
+            if (n == 0) {
+                break;
+            }
+            if (n > 0) {
+                continue;
+            }
+            if (!targets[consumer].buffered && errno != EINVAL && errno != EBADF) {
+                status = status_for_failure(&targets[consumer], errno);
+                continue;
+            }
+            targets[consumer].buffered = true;
+            ssize_t got;
+            do {
+                got = read(in_fd, buf, TEE_BUFFER);
+            } while (got < 0 && errno == EINTR);
+            if (got <= 0) {
+                break;
+            }
+            if (gs_builtin_write_all(targets[consumer].fd, buf, (size_t)got) != GS_OK) {
+                status = status_for_failure(&targets[consumer], errno);
+            }
+            continue;
+        }
+
+        size_t left = (size_t)round;
+        int err = drain_exact(in_fd, &targets[consumer], &left, buf);
+        if (err != 0) {
+            /* Drop the unconsumed part of the round so the scratch copies
+             * stay aligned with the input. */
+            status = status_for_failure(&targets[consumer], err);
+            discard_exact(in_fd, left, buf);
+        }
+        for (size_t i = 0; i < consumer; ++i) {
+            if (!targets[i].active) {
+                continue;
+            }
+            left = (size_t)round;
+            err = drain_exact(targets[i].scratch[0], &targets[i], &left, buf);
+            if (err != 0) {
+                status = status_for_failure(&targets[i], err);
+            }
+        }
+    }
+
+done:
+    for (size_t i = 0; i < count; ++i) {
+        if (targets[i].scratch[0] >= 0) {
+            close(targets[i].scratch[0]);
+            close(targets[i].scratch[1]);
+        }
+    }
+    free(buf);
+    return status;
+}
+#endif
+
+int genshell_builtin_tee(struct gs_shell *shell, int argc, char *const argv[]) {
+    const gs_builtin_io *io = gs_builtin_io_current();
+    bool append = false;
+    int argi = 1;
+    while (argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0') {
+        if (strcmp(argv[argi], "--") == 0) {
+            ++argi;
+            break;
+        }
+        append = true; /* -a is the only accepted option */
+        ++argi;
+    }
+
+    size_t count = (size_t)(argc - argi) + 1u;
+    tee_target *targets = (tee_target *)calloc(count, sizeof(tee_target));
+    if (!targets) {
+        gs_builtin_err_printf("genshell: tee: allocation failure\n");
+        return 1;
+    }
+
+    int status = 0;
+    size_t used = 0u;
+    for (int i = argi; i < argc; ++i) {
+        int flags = O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC);
+        int fd = gs_shell_open(shell, argv[i], flags);
+        if (fd < 0) {
+            gs_builtin_err_printf("genshell: tee: %s: %s\n", argv[i], strerror(errno));
+            status = 1;
+            continue;
+        }
+        targets[used++] = (tee_target){argv[i], fd, true, true, false, {-1, -1}, 0u};
+    }
+    /* Standard output goes last so it consumes the input in splice mode. */
+    targets[used++] = (tee_target){"standard output", io->out_fd, false, true, false, {-1, -1}, 0u};
+
+    int rc;
+#if defined(__linux__)
+    struct stat in_st;
+    if (fstat(io->in_fd, &in_st) == 0 && S_ISFIFO(in_st.st_mode)) {
+        rc = splice_rounds(io->in_fd, targets, used);
+    } else {
+        rc = buffered_rounds(io->in_fd, targets, used);
+    }
+#else
+    rc = buffered_rounds(io->in_fd, targets, used);
+#endif
+    if (rc != 0) {
+        status = rc;
+    }
+    for (size_t i = 0; i < used; ++i) {
+        if (targets[i].owned) {
+            close(targets[i].fd);
+        }
+        if (!targets[i].active) {
+            status = 1;
+        }
+    }
+    free(targets);
+    return status;
+}
@@ -0,0 +1,427 @@
+/*
+ * test, [ - POSIX shell builtin
+ * Evaluates conditional expressions: string tests (-n, -z, =, ==, !=, <, >),
+ * integer comparisons (-eq, -ne, -lt, -le, -gt, -ge), file tests (-b -c -d
+ * -e -f -g -h -L -k -p -r -s -S -t -u -w -x, -nt, -ot, -ef), negation with
+ * "!", grouping with "(" ")" and the -a / -o connectives. One to four
+ * arguments follow the POSIX argument-count rules; longer expressions use a
+ * precedence parser (! binds tighter than -a, which binds tighter than -o).
+ * File tests call statx asking only for the fields the primary needs; other
+ * systems use stat/lstat. Exit status is 0 (true), 1 (false) or 2 (error).
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/sysmacros.h>
+#endif
+
+#include "builtin.h"
+
+#if defined(__linux__) && defined(STATX_TYPE)
+#define TEST_HAVE_STATX 1
+#endif
+
+#define TEST_WANT_TYPE 0x01u
+#define TEST_WANT_MODE 0x02u
+#define TEST_WANT_SIZE 0x04u
+#define TEST_WANT_MTIME 0x08u
+#define TEST_WANT_INODE 0x10u
+
+typedef struct {
+    mode_t mode;
+    off_t size;
+    struct timespec mtime;
+    dev_t dev;
+    ino_t ino;
+} file_info;
+
+typedef struct {
+    const char *name;
+    char *const *args;
+    int count;
+    int pos;
+    bool error;
+    int dir_fd; /* relative paths start at the shell's working directory */
+} test_parser;
+
+/* Looks a path up, asking the kernel only for the fields in want. */
+static bool query_file(int dir_fd, const char *path, bool follow, unsigned want, file_info *info) {
+    memset(info, 0, sizeof(*info));
+#if defined(TEST_HAVE_STATX)
+    unsigned mask = 0u;
+    if (want & TEST_WANT_TYPE) {
+        mask |= STATX_TYPE;
+    }
+    if (want & TEST_WANT_MODE) {
+        mask |= STATX_TYPE | STATX_MODE;
+    }
+    if (want & TEST_WANT_SIZE) {
+        mask |= STATX_SIZE;
+    }
+    if (want & TEST_WANT_MTIME) {
+        mask |= STATX_MTIME;
+    }
+    if (want & TEST_WANT_INODE) {
+        mask |= STATX_INO;
+    }
+    struct statx stx;
+    int flags = follow ? 0 : AT_SYMLINK_NOFOLLOW;
+    if (statx(dir_fd, path, flags, mask, &stx) == 0) {
+        info->mode = stx.stx_mode;
+        info->size = (off_t)stx.stx_size;
+        info->mtime.tv_sec = stx.stx_mtime.tv_sec;
+        info->mtime.tv_nsec = stx.stx_mtime.tv_nsec;
+        info->dev = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+        info->ino = (ino_t)stx.stx_ino;
+        return true;
+    }
+    if (errno != ENOSYS) {
+        return false;
+    }
+#else
+    (void)want;
+#endif
+    struct stat st;
+    if (fstatat(dir_fd, path, &st, follow ? 0 : AT_SYMLINK_NOFOLLOW) != 0) {
+        return false;
+    }
+    info->mode = st.st_mode;
+    info->size = st.st_size;
+#if defined(__APPLE__)
+    info->mtime = st.st_mtimespec;
+#else
+    info->mtime = st.st_mtim;
+#endif
+    info->dev = st.st_dev;
+    info->ino = st.st_ino;
+    return true;
+}
+
+static bool is_unary_op(const char *op) {
+    return op[0] == '-' && op[1] != '\0' && op[2] == '\0' && strchr("bcdefghkLnprsStuwxz", op[1]) != NULL;
+}
+
+static bool is_binary_op(const char *op) {
+    static const char *const ops[] = {"=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge",
+                                      "-nt", "-ot", "-ef", "-a", "-o"};
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); ++i) {
+        if (strcmp(op, ops[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_integer(test_parser *p, const char *text, long long *out) {
+    const char *s = text;
+    while (*s == ' ' || *s == '\t') {
+        ++s;
+    }
+    char *end = NULL;
+    errno = 0;
+    long long value = strtoll(s, &end, 10);
+    while (end && (*end == ' ' || *end == '\t')) {
+        ++end;
+    }
+    if (end == s || errno != 0 || !end || *end != '\0') {
+        gs_builtin_err_printf("genshell: %s: %s: integer expression expected\n", p->name, text);
+        p->error = true;
+        return false;
+    }
+    *out = value;
+    return true;
+}
+
+static bool eval_unary(test_parser *p, const char *op, const char *operand) {
+    char flag = op[1];
+    switch (flag) {
+    case 'n':
+        return operand[0] != '\0';
+    case 'z':
+        return operand[0] == '\0';
+    case 't': {
+        long long fd = 0;
+        return parse_integer(p, operand, &fd) && fd >= 0 && fd <= 0x7fffffff && isatty((int)fd);
+    }
+    case 'r':
+        return faccessat(p->dir_fd, operand, R_OK, AT_EACCESS) == 0;
+    case 'w':
+        return faccessat(p->dir_fd, operand, W_OK, AT_EACCESS) == 0;
+    case 'x':
+        return faccessat(p->dir_fd, operand, X_OK, AT_EACCESS) == 0;
+    default:
+        break;
+    }
+
+    file_info info;
+    bool follow = flag != 'h' && flag != 'L';
+    unsigned want = flag == 's' ? TEST_WANT_SIZE : (flag == 'g' || flag == 'u' || flag == 'k') ? TEST_WANT_MODE : TEST_WANT_TYPE;
+    if (flag == 'e') {
+        want = 0u;
+    }
+    if (!query_file(p->dir_fd, operand, follow, want, &info)) {
+        return false;
+    }
+    switch (flag) {
+    case 'e':
+        return true;
+    case 'b':
+        return S_ISBLK(info.mode);
+    case 'c':
+        return S_ISCHR(info.mode);
+    case 'd':
+        return S_ISDIR(info.mode);
+    case 'f':
+        return S_ISREG(info.mode);
+    case 'h':
+    case 'L':
+        return S_ISLNK(info.mode);
+    case 'p':
+        return S_ISFIFO(info.mode);
+    case 'S':
+        return S_ISSOCK(info.mode);
+    case 's':
+        return info.size > 0;
+    case 'g':
+        return (info.mode & S_ISGID) != 0;
+    case 'u':
+        return (info.mode & S_ISUID) != 0;
+    case 'k':
+        return (info.mode & S_ISVTX) != 0;
+    default:
+        return false;
+    }
+}
+
+static int compare_mtime(const file_info *a, const file_info *b) {
+    if (a->mtime.tv_sec != b->mtime.tv_sec) {
+        return a->mtime.tv_sec < b->mtime.tv_sec ? -1 : 1;
+    }
+    if (a->mtime.tv_nsec != b->mtime.tv_nsec) {
+        return a->mtime.tv_nsec < b->mtime.tv_nsec ? -1 : 1;
+    }
+    return 0;
+}
+
+static bool eval_binary(test_parser *p, const char *lhs, const char *op, const char *rhs) {
+    if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0) {
+        return strcmp(lhs, rhs) == 0;
+    }
+    if (strcmp(op, "!=") == 0) {
+        return strcmp(lhs, rhs) != 0;
+    }
+    if (strcmp(op, "<") == 0) {
+        return strcmp(lhs, rhs) < 0;
+    }
+    if (strcmp(op, ">") == 0) {
+        return strcmp(lhs, rhs) > 0;
+    }
+    if (strcmp(op, "-a") == 0) {
+        return lhs[0] != '\0' && rhs[0] != '\0';
+    }
+    if (strcmp(op, "-o") == 0) {
+        return lhs[0] != '\0' || rhs[0] != '\0';
+    }
+    if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0 || strcmp(op, "-ef") == 0) {
+        bool same = strcmp(op, "-ef") == 0;
+        unsigned want = same ? TEST_WANT_INODE : TEST_WANT_MTIME;
+        file_info a;
+        file_info b;
+        bool have_a = query_file(p->dir_fd, lhs, true, want, &a);
+        bool have_b = query_file(p->dir_fd, rhs, true, want, &b);
+        if (same) {
+            return have_a && have_b && a.dev == b.dev && a.ino == b.ino;
+        }
+        if (op[1] == 'n') {
+            return have_a && (!have_b || compare_mtime(&a, &b) > 0);
+        }
+        return have_b && (!have_a || compare_mtime(&a, &b) < 0);
+    }
+
+    long long a = 0;
+    long long b = 0;
+    if (!parse_integer(p, lhs, &a) || !parse_integer(p, rhs, &b)) {
+        return false;
+    }
+    if (strcmp(op, "-eq") == 0) {
+        return a == b;
+    }
+    if (strcmp(op, "-ne") == 0) {
+        return a != b;
+    }
+    if (strcmp(op, "-lt") == 0) {
+        return a < b;
+    }
+    if (strcmp(op, "-le") == 0) {
+        return a <= b;
+    }
+    if (strcmp(op, "-gt") == 0) {
+        return a > b;
+    }
+    return a >= b;
+}
+
+static const char *peek_arg(const test_parser *p, int offset) {
+    int index = p->pos + offset;
+    return index < p->count ? p->args[index] : NULL;
+}
+
+static bool parse_or(test_parser *p);
+
+static bool parse_primary(test_parser *p) {
+    const char *tok = peek_arg(p, 0);
+    if (!tok) {
+        gs_builtin_err_printf("genshell: %s: argument expected\n", p->name);
+        p->error = true;
+        return false;
+    }
+    const char *next = peek_arg(p, 1);
+    if (strcmp(tok, "(") == 0 && !(next && peek_arg(p, 2) && is_binary_op(next) && strcmp(next, "-a") != 0 &&
+                                   strcmp(next, "-o") != 0)) {
+        p->pos++;
+        bool value = parse_or(p);
+        const char *close = peek_arg(p, 0);
+        if (!close || strcmp(close, ")") != 0) {
+            if (!p->error) {
+                gs_builtin_err_printf("genshell: %s: `)' expected\n", p->name);
+            }
+            p->error = true;
+            return false;
+        }
+        p->pos++;
+        return value;
+    }
+    if (next && peek_arg(p, 2) && is_binary_op(next) && strcmp(next, "-a") != 0 && strcmp(next, "-o") != 0) {
+        p->pos += 3;
+        return eval_binary(p, tok, next, p->args[p->pos - 1]);
+    }
+    if (is_unary_op(tok) && next) {
+        p->pos += 2;
+        return eval_unary(p, tok, next);
+    }
+    p->pos++;
+    return tok[0] != '\0';
+}
+
+static bool parse_not(test_parser *p) {
+    const char *tok = peek_arg(p, 0);
+    if (tok && strcmp(tok, "!") == 0 && peek_arg(p, 1)) {
+        p->pos++;
+        return !parse_not(p);
+    }
+    return parse_primary(p);
+}
+
+static bool parse_and(test_parser *p) {
+    bool value = parse_not(p);
+    while (!p->error) {
+        const char *tok = peek_arg(p, 0);
+        if (!tok || strcmp(tok, "-a") != 0) {
+            break;
+        }
+        p->pos++;
+        bool rhs = parse_not(p);
+        value = value && rhs;
+    }
+    return value;
+}
+
+static bool parse_or(test_parser *p) {
+    bool value = parse_and(p);
+    while (!p->error) {
+        const char *tok = peek_arg(p, 0);
+        if (!tok || strcmp(tok, "-o") != 0) {
+            break;
+        }
+        p->pos++;
+        bool rhs = parse_and(p);
+        value = value || rhs;
+    }
+    return value;
+}
+
+/* Full expression grammar, used beyond the POSIX argument-count cases. */
+static bool eval_expression(test_parser *p, int start, int count) {
+    test_parser sub = {p->name, p->args + start, count, 0, false, p->dir_fd};
+    bool value = parse_or(&sub);
+    if (!sub.error && sub.pos < sub.count) {
+        gs_builtin_err_printf("genshell: %s: %s: unexpected argument\n", p->name, sub.args[sub.pos]);
+        sub.error = true;
+    }
+    p->error = p->error || sub.error;
+    return value;
+}
+
+/* POSIX rules for zero to four arguments: args[start .. start+count). */
+static bool eval_args(test_parser *p, int start, int count) {
+    char *const *a = p->args + start;
+    switch (count) {
+    case 0:
+        return false;
+    case 1:
+        return a[0][0] != '\0';
+    case 2:
+        if (strcmp(a[0], "!") == 0) {
+            return !eval_args(p, start + 1, 1);
+        }
+        if (is_unary_op(a[0])) {
+            return eval_unary(p, a[0], a[1]);
+        }
+        gs_builtin_err_printf("genshell: %s: %s: unary operator expected\n", p->name, a[0]);
+        p->error = true;
+        return false;
+    case 3:
+        if (is_binary_op(a[1])) {
+            return eval_binary(p, a[0], a[1], a[2]);
+        }
+        if (strcmp(a[0], "!") == 0) {
+            return !eval_args(p, start + 1, 2);
+        }
+        if (strcmp(a[0], "(") == 0 && strcmp(a[2], ")") == 0) {
+            return eval_args(p, start + 1, 1);
+        }
+        break;
+    case 4:
+        if (strcmp(a[0], "!") == 0) {
+            return !eval_args(p, start + 1, 3);
+        }
+        if (strcmp(a[0], "(") == 0 && strcmp(a[3], ")") == 0) {
+            return eval_args(p, start + 1, 2);
+        }
+        break;
+    default:
+        break;
+    }
+    return eval_expression(p, start, count);
+}
+
+int genshell_builtin_test(struct gs_shell *shell, int argc, char *const argv[]) {
+    const char *name = argv[0];
+    int count = argc - 1;
+    if (strcmp(name, "[") == 0) {
+        if (count < 1 || strcmp(argv[argc - 1], "]") != 0) {
+            gs_builtin_err_printf("genshell: [: missing `]'\n");
+            return 2;
+        }
+        --count;
+    }
+    test_parser parser = {name, argv + 1, count, 0, false, shell->cwd_fd};
+    bool value = eval_args(&parser, 0, count);
+    if (parser.error) {
+        return 2;
+    }
+    return value ? 0 : 1;
+}
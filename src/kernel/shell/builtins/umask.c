@@ -2,7 +2,9 @@
  * umask - POSIX shell builtin
  * Displays or updates the shell's file-creation mask. Accepts an optional
  * octal mask argument (e.g., 022). With -S it prints the symbolic rwx form of
- * the current mask. Any changes persist for subsequent child processes.
+ * the current mask. The mask belongs to the shell rather than the process:
+ * files the shell opens are created with it, and child processes adopt it
+ * before exec, so changes persist for subsequent commands.
  */
 
 #include <errno.h>
@@ -17,31 +19,30 @@ static void print_symbolic(mode_t mask) {
     const char classes[3] = {'u', 'g', 'o'};
     const mode_t bits[3] = {S_IRWXU, S_IRWXG, S_IRWXO};
 
-    printf("%#03o", (unsigned)(mask & 0777));
+    gs_builtin_out_printf("%#03o", (unsigned)(mask & 0777));
     for (int i = 0; i < 3; ++i) {
-        printf(" %c=", classes[i]);
+        char label[4] = {' ', classes[i], '=', '\0'};
+        gs_builtin_out_puts(label);
         mode_t class_bits = (~mask) & bits[i];
         if (class_bits & (S_IRUSR >> (i * 3))) {
-            putchar('r');
+            gs_builtin_out_write("r", 1u);
         }
         if (class_bits & (S_IWUSR >> (i * 3))) {
-            putchar('w');
+            gs_builtin_out_write("w", 1u);
         }
         if (class_bits & (S_IXUSR >> (i * 3))) {
-            putchar('x');
+            gs_builtin_out_write("x", 1u);
         }
-        putchar(' ');
+        gs_builtin_out_write(" ", 1u);
     }
-    putchar('\n');
+    gs_builtin_out_write("\n", 1u);
 }
 
 static void print_octal(mode_t mask) {
-    printf("%03o\n", (unsigned)(mask & 0777));
+    gs_builtin_out_printf("%03o\n", (unsigned)(mask & 0777));
 }
 
 int genshell_builtin_umask(struct gs_shell *shell, int argc, char *const argv[]) {
-    (void)shell;
-
     int argi = 1;
     int symbolic = 0;
 
@@ -51,8 +52,7 @@ int genshell_builtin_umask(struct gs_shell *shell, int argc, char *const argv[])
     }
 
     if (argc == argi) {
-        mode_t mask = umask(0);
-        umask(mask);
+        mode_t mask = (mode_t)shell->umask;
         if (symbolic) {
             print_symbolic(mask);
         } else {
@@ -62,7 +62,7 @@ int genshell_builtin_umask(struct gs_shell *shell, int argc, char *const argv[])
     }
 
     if (argc > argi + 1) {
-        fprintf(stderr, "genshell: umask: too many arguments\n");
+        gs_builtin_err_printf("genshell: umask: too many arguments\n");
         return 1;
     }
 
@@ -71,10 +71,11 @@ int genshell_builtin_umask(struct gs_shell *shell, int argc, char *const argv[])
     char *end = NULL;
     long value = strtol(arg, &end, 8);
     if (errno != 0 || !end || *end != '\0' || value < 0 || value > 0777) {
-        fprintf(stderr, "genshell: umask: invalid mode: %s\n", arg);
+        gs_builtin_err_printf("genshell: umask: invalid mode: %s\n", arg);
         return 1;
     }
 
-    umask((mode_t)value);
+    gs_shell_preserve_umask(shell);
+    shell->umask = (unsigned)value;
     return 0;
 }
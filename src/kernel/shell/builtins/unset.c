@@ -1,8 +1,8 @@
 /*
  * unset - POSIX shell builtin
  * Removes variables and functions from the execution environment. This
- * implementation focuses on variable removal via unsetenv(3) and validates
- * identifiers before attempting to erase them.
+ * implementation focuses on variable removal from the shell's variable table
+ * and validates identifiers before attempting to erase them.
  */
 
 #include <ctype.h>
@@ -27,8 +27,6 @@ static int is_valid_name(const char *name) {
 }
 
 int genshell_builtin_unset(struct gs_shell *shell, int argc, char *const argv[]) {
-    (void)shell;
-
     if (argc < 2) {
         return 0;
     }
@@ -37,12 +35,12 @@ int genshell_builtin_unset(struct gs_shell *shell, int argc, char *const argv[])
 
     for (int i = 1; i < argc; ++i) {
         if (!is_valid_name(argv[i])) {
-            fprintf(stderr, "genshell: unset: `%s': invalid identifier\n", argv[i]);
+            gs_builtin_err_printf("genshell: unset: `%s': invalid identifier\n", argv[i]);
             status = 1;
             continue;
         }
-        if (unsetenv(argv[i]) != 0) {
-            fprintf(stderr, "genshell: unset: failed to unset %s\n", argv[i]);
+        if (gs_shell_preserve_variable(shell, argv[i]) != GS_OK || gs_shell_unsetvar(shell, argv[i]) != GS_OK) {
+            gs_builtin_err_printf("genshell: unset: failed to unset %s\n", argv[i]);
             status = 1;
         }
     }
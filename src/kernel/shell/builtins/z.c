@@ -0,0 +1,96 @@
+/*
+ * z - jump to a frequently and recently used directory
+ * "z KEYWORD..." changes to the highest scoring directory recorded by cd
+ * whose final component contains the last keyword and whose path contains
+ * the earlier ones in order. Scores weight each directory's visit count by
+ * how recently it was visited (-r ranks by visits alone, -t by recency).
+ * -e prints the best match instead of changing to it, -l (the default with
+ * no keywords) lists every match with its score, best last, and -x removes
+ * the current directory from the database. The database is shared by every
+ * shell of the user; see frecency.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "../frecency.h"
+#include "builtin.h"
+
+#define Z_USAGE "usage: z [-elrtx] [keyword ...]\n"
+
+int genshell_builtin_z(struct gs_shell *shell, int argc, char *const argv[]) {
+    bool echo = false;
+    bool list = false;
+    bool forget = false;
+    gs_frecency_order order = GS_FRECENCY_BY_SCORE;
+    int argi = 1;
+    for (; argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0'; ++argi) {
+        if (argv[argi][1] == '-' && argv[argi][2] == '\0') {
+            ++argi;
+            break;
+        }
+        for (const char *opt = argv[argi] + 1; *opt; ++opt) {
+            switch (*opt) {
+            case 'e':
+                echo = true;
+                break;
+            case 'l':
+                list = true;
+                break;
+            case 'r':
+                order = GS_FRECENCY_BY_RANK;
+                break;
+            case 't':
+                order = GS_FRECENCY_BY_RECENT;
+                break;
+            case 'x':
+                forget = true;
+                break;
+            default:
+                gs_builtin_err_printf("genshell: z: -%c: invalid option\n" Z_USAGE, *opt);
+                return 2;
+            }
+        }
+    }
+
+    if (forget) {
+        const char *pwd = gs_shell_getvar(shell, "PWD");
+        if (!pwd || gs_frecency_forget(shell, pwd) != GS_OK) {
+            gs_builtin_err_printf("genshell: z: cannot update the directory database\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    gs_frecency_match *matches = NULL;
+    size_t count = 0u;
+    if (gs_frecency_query(shell, argv + argi, argc - argi, order, &matches, &count) != GS_OK) {
+        gs_builtin_err_printf("genshell: z: cannot read the directory database\n");
+        return 1;
+    }
+    int status = 1;
+    if (list || argi == argc) {
+        for (size_t i = count; i-- > 0u;) {
+            gs_builtin_out_printf("%-10.1f %s\n", matches[i].score, matches[i].path);
+        }
+        status = count > 0u ? 0 : 1;
+    } else {
+        /* The best match that still exists; stale entries age out on their own. */
+        for (size_t i = 0; i < count; ++i) {
+            struct stat st;
+            if (stat(matches[i].path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+                continue;
+            }
+            if (echo) {
+                gs_builtin_out_printf("%s\n", matches[i].path);
+                status = 0;
+            } else {
+                status = gs_builtin_change_dir(shell, "z", matches[i].path, false, false, NULL);
+            }
+            break;
+        }
+    }
+    gs_frecency_matches_free(matches, count);
+    return status;
+}
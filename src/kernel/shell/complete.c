@@ -0,0 +1,575 @@
+/*
+ * Tab completion.
+ *
+ * The line up to the cursor is scanned the way the lexer would see it, with
+ * quotes and backslashes removed, to find the word being completed and
+ * whether it is in command position (first in a command, after any
+ * assignments, and not a redirection target).
+ *
+ * Command names come from the builtins and from an index of the
+ * executables on PATH kept on the shell. The index holds one sorted listing
+ * per PATH directory together with the directory's inode and mtime. Each
+ * completion re-checks every directory with a single stat and re-reads only
+ * the ones that changed. A listing is trusted only if the directory's mtime
+ * is from before the second it was read, as with the glob cache. Listings
+ * and file-name completion both read directories through gs_glob_list, so
+ * they share its large getdents64 batches. Only entries whose d_type leaves
+ * any doubt are stat'ed.
+ */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "complete.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "builtins/builtin.h"
+#include "exec/glob.h"
+#include "shell.h"
+
+#define CP_QUOTED " \t\n\\'\"$`&|;<>()*?[]#{}!"
+
+typedef struct {
+    char *path; /* the PATH entry as written */
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    time_t read_at;
+    bool listed;
+    bool in_path; /* named by the PATH of the latest completion */
+    char *names;
+    size_t names_len;
+    size_t names_cap;
+    uint32_t *offsets;
+    size_t count;
+    size_t capacity;
+    const char **sorted; /* into names */
+} cp_dir;
+
+struct gs_command_index {
+    cp_dir *dirs;
+    size_t count;
+    size_t capacity;
+};
+
+/* What a directory visit needs. */
+typedef struct {
+    int dir_fd;
+    const char *base; /* name prefix to keep */
+    size_t base_len;
+    bool executables; /* keep only directories and executables */
+    const char *quoted_dir;
+    gs_completions *out;
+    cp_dir *index_dir;
+    int rc;
+} cp_visit;
+
+static const struct timespec *mtime_of(const struct stat *st) {
+#if defined(__APPLE__)
+    return &st->st_mtimespec;
+#else
+    return &st->st_mtim;
+#endif
+}
+
+static int push_item(gs_completions *out, char *item) {
+    if (!item) {
+        return GS_ERR_ALLOC;
+    }
+    if (out->count == out->capacity) {
+        size_t new_cap = out->capacity ? out->capacity * 2u : 16u;
+        char **tmp = (char **)realloc(out->items, new_cap * sizeof(char *));
+        if (!tmp) {
+            free(item);
+            return GS_ERR_ALLOC;
+        }
+        out->items = tmp;
+        out->capacity = new_cap;
+    }
+    out->items[out->count++] = item;
+    return GS_OK;
+}
+
+/* Returns prefix followed by name with the shell's special characters escaped, then suffix. */
+static char *quote_join(const char *prefix, const char *name, size_t len, const char *suffix) {
+    size_t prefix_len = strlen(prefix);
+    size_t suffix_len = strlen(suffix);
+    char *item = (char *)malloc(prefix_len + 2u * len + suffix_len + 1u);
+    if (!item) {
+        return NULL;
+    }
+    memcpy(item, prefix, prefix_len);
+    size_t n = prefix_len;
+    for (size_t i = 0; i < len; ++i) {
+        if (strchr(CP_QUOTED, name[i])) {
+            item[n++] = '\\';
+        }
+        item[n++] = name[i];
+    }
+    memcpy(item + n, suffix, suffix_len + 1u);
+    return item;
+}
+
+static bool is_name_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static bool is_directory_entry(int dir_fd, const char *name, unsigned char type) {
+    if (type == DT_DIR) {
+        return true;
+    }
+    struct stat st;
+    return (type == DT_LNK || type == DT_UNKNOWN) && fstatat(dir_fd, name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+}
+
+static bool is_executable_entry(int dir_fd, const char *name, unsigned char type) {
+    if (type == DT_DIR) {
+        return false;
+    }
+    struct stat st;
+    if (type != DT_REG && (fstatat(dir_fd, name, &st, 0) != 0 || !S_ISREG(st.st_mode))) {
+        return false;
+    }
+    return faccessat(dir_fd, name, X_OK, 0) == 0;
+}
+
+static void visit_file(const char *name, size_t len, unsigned char type, void *ctx) {
+    cp_visit *visit = (cp_visit *)ctx;
+    if (visit->rc != GS_OK || len < visit->base_len || memcmp(name, visit->base, visit->base_len) != 0 ||
+        (name[0] == '.' && visit->base[0] != '.')) {
+        return;
+    }
+    bool dir = is_directory_entry(visit->dir_fd, name, type);
+    if (visit->executables && !dir && !is_executable_entry(visit->dir_fd, name, type)) {
+        return;
+    }
+    visit->rc = push_item(visit->out, quote_join(visit->quoted_dir, name, len, dir ? "/" : ""));
+}
+
+static void visit_command(const char *name, size_t len, unsigned char type, void *ctx) {
+    cp_visit *visit = (cp_visit *)ctx;
+    cp_dir *dir = visit->index_dir;
+    if (visit->rc != GS_OK || !is_executable_entry(visit->dir_fd, name, type)) {
+        return;
+    }
+    if (dir->count == dir->capacity) {
+        size_t new_cap = dir->capacity ? dir->capacity * 2u : 64u;
+        uint32_t *tmp = (uint32_t *)realloc(dir->offsets, new_cap * sizeof(uint32_t));
+        if (!tmp) {
+            visit->rc = GS_ERR_ALLOC;
+            return;
+        }
+        dir->offsets = tmp;
+        dir->capacity = new_cap;
+    }
+    if (dir->names_len + len + 1u > dir->names_cap) {
+        size_t new_cap = dir->names_cap ? dir->names_cap : 1024u;
+        while (new_cap < dir->names_len + len + 1u) {
+            new_cap *= 2u;
+        }
+        char *tmp = new_cap <= UINT32_MAX ? (char *)realloc(dir->names, new_cap) : NULL;
+        if (!tmp) {
+            visit->rc = GS_ERR_ALLOC;
+            return;
+        }
+        dir->names = tmp;
+        dir->names_cap = new_cap;
+    }
+    dir->offsets[dir->count++] = (uint32_t)dir->names_len;
+    memcpy(dir->names + dir->names_len, name, len + 1u);
+    dir->names_len += len + 1u;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+static void dir_clear(cp_dir *dir) {
+    dir->count = 0u;
+    dir->names_len = 0u;
+    free(dir->sorted);
+    dir->sorted = NULL;
+    dir->listed = false;
+}
+
+/* Lists the executables of one PATH directory again if it changed since the last listing. */
+static int dir_refresh(const struct gs_shell *shell, cp_dir *dir) {
+    const char *path = dir->path[0] ? dir->path : ".";
+    int base = path[0] == '/' ? AT_FDCWD : shell->cwd_fd;
+    struct stat st;
+    if (fstatat(base, path, &st, 0) == 0 && dir->listed && dir->dev == st.st_dev && dir->ino == st.st_ino &&
+        dir->mtime.tv_sec == mtime_of(&st)->tv_sec && dir->mtime.tv_nsec == mtime_of(&st)->tv_nsec &&
+        mtime_of(&st)->tv_sec < dir->read_at) {
+        return GS_OK;
+    }
+    dir_clear(dir);
+    int fd = openat(base, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return GS_OK;
+    }
+    const struct timespec *mtime = mtime_of(&st);
+    dir->read_at = time(NULL);
+    cp_visit visit = {fd, "", 0u, true, "", NULL, dir, GS_OK};
+    int rc = gs_glob_list(fd, false, ".", visit_command, &visit);
+    close(fd);
+    if (rc == GS_OK) {
+        rc = visit.rc;
+    }
+    if (rc != GS_OK) {
+        dir_clear(dir);
+        return rc == GS_ERR_ALLOC ? rc : GS_OK;
+    }
+    dir->sorted = (const char **)malloc((dir->count ? dir->count : 1u) * sizeof(const char *));
+    if (!dir->sorted) {
+        dir_clear(dir);
+        return GS_ERR_ALLOC;
+    }
+    for (size_t i = 0; i < dir->count; ++i) {
+        dir->sorted[i] = dir->names + dir->offsets[i];
+    }
+    qsort(dir->sorted, dir->count, sizeof(const char *), compare_names);
+    dir->dev = st.st_dev;
+    dir->ino = st.st_ino;
+    dir->mtime = *mtime;
+    dir->listed = true;
+    return GS_OK;
+}
+
+static void dir_free(cp_dir *dir) {
+    free(dir->path);
+    free(dir->names);
+    free(dir->offsets);
+    free(dir->sorted);
+}
+
+/* Brings the index in line with $PATH, dropping directories no longer on it. */
+static int index_refresh(struct gs_shell *shell) {
+    if (!shell->commands) {
+        shell->commands = (struct gs_command_index *)calloc(1u, sizeof(struct gs_command_index));
+        if (!shell->commands) {
+            return GS_ERR_ALLOC;
+        }
+    }
+    struct gs_command_index *index = shell->commands;
+    for (size_t i = 0; i < index->count; ++i) {
+        index->dirs[i].in_path = false;
+    }
+    const char *path = gs_shell_getvar(shell, "PATH");
+    for (const char *p = path ? path : ""; path;) {
+        const char *end = strchr(p, ':');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        cp_dir *dir = NULL;
+        for (size_t i = 0; i < index->count && !dir; ++i) {
+            if (strlen(index->dirs[i].path) == len && memcmp(index->dirs[i].path, p, len) == 0) {
+                dir = &index->dirs[i];
+            }
+        }
+        if (!dir) {
+            if (index->count == index->capacity) {
+                size_t new_cap = index->capacity ? index->capacity * 2u : 16u;
+                cp_dir *tmp = (cp_dir *)realloc(index->dirs, new_cap * sizeof(cp_dir));
+                if (!tmp) {
+                    return GS_ERR_ALLOC;
+                }
+                index->dirs = tmp;
+                index->capacity = new_cap;
+            }
+            dir = &index->dirs[index->count];
+            memset(dir, 0, sizeof(*dir));
+            dir->path = strndup(p, len);
+            if (!dir->path) {
+                return GS_ERR_ALLOC;
+            }
+            index->count++;
+        }
+        if (!dir->in_path) {
+            dir->in_path = true;
+            int rc = dir_refresh(shell, dir);
+            if (rc != GS_OK) {
+                return rc;
+            }
+        }
+        if (!end) {
+            break;
+        }
+        p = end + 1;
+    }
+    size_t kept = 0u;
+    for (size_t i = 0; i < index->count; ++i) {
+        if (index->dirs[i].in_path) {
+            index->dirs[kept++] = index->dirs[i];
+        } else {
+            dir_free(&index->dirs[i]);
+        }
+    }
+    index->count = kept;
+    return GS_OK;
+}
+
+typedef struct {
+    const char *prefix;
+    size_t len;
+    gs_completions *out;
+    int rc;
+} cp_builtin_visit;
+
+static void visit_builtin(const gs_builtin_spec *spec, void *ctx) {
+    cp_builtin_visit *visit = (cp_builtin_visit *)ctx;
+    if (visit->rc == GS_OK && strncmp(spec->name, visit->prefix, visit->len) == 0) {
+        visit->rc = push_item(visit->out, quote_join("", spec->name, strlen(spec->name), ""));
+    }
+}
+
+static int complete_command(struct gs_shell *shell, const char *prefix, gs_completions *out) {
+    size_t len = strlen(prefix);
+    cp_builtin_visit builtins = {prefix, len, out, GS_OK};
+    gs_builtin_foreach(visit_builtin, &builtins);
+    int rc = builtins.rc != GS_OK ? builtins.rc : index_refresh(shell);
+    for (size_t d = 0; rc == GS_OK && shell->commands && d < shell->commands->count; ++d) {
+        const cp_dir *dir = &shell->commands->dirs[d];
+        size_t lo = 0u;
+        size_t hi = dir->count;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2u;
+            if (strcmp(dir->sorted[mid], prefix) < 0) {
+                lo = mid + 1u;
+            } else {
+                hi = mid;
+            }
+        }
+        for (size_t i = lo; rc == GS_OK && i < dir->count && strncmp(dir->sorted[i], prefix, len) == 0; ++i) {
+            rc = push_item(out, quote_join("", dir->sorted[i], strlen(dir->sorted[i]), ""));
+        }
+    }
+    return rc;
+}
+
+static int complete_variable(const struct gs_shell *shell, const char *prefix, size_t len, bool braced,
+                             gs_completions *out) {
+    int rc = GS_OK;
+    for (size_t i = 0; rc == GS_OK && i < shell->vars.count; ++i) {
+        const char *entry = shell->vars.entries[i];
+        const char *eq = strchr(entry, '=');
+        size_t name_len = eq ? (size_t)(eq - entry) : strlen(entry);
+        if (name_len < len || strncmp(entry, prefix, len) != 0) {
+            continue;
+        }
+        char *item = (char *)malloc(name_len + 4u);
+        if (!item) {
+            return GS_ERR_ALLOC;
+        }
+        size_t n = 0u;
+        item[n++] = '$';
+        if (braced) {
+            item[n++] = '{';
+        }
+        memcpy(item + n, entry, name_len);
+        n += name_len;
+        if (braced) {
+            item[n++] = '}';
+        }
+        item[n] = '\0';
+        rc = push_item(out, item);
+    }
+    return rc;
+}
+
+static int complete_file(struct gs_shell *shell, const char *word, bool executables, gs_completions *out) {
+    const char *slash = strrchr(word, '/');
+    size_t dir_len = slash ? (size_t)(slash - word) + 1u : 0u;
+    bool home_relative = word[0] == '~' && word[1] == '/';
+    /* "~/" stays as typed, so the tilde still expands when the line runs. */
+    char *quoted_dir = home_relative ? quote_join("~", word + 1, dir_len - 1u, "") : quote_join("", word, dir_len, "");
+    char *dir = NULL;
+    if (home_relative) {
+        const char *home = gs_shell_getvar(shell, "HOME");
+        home = home ? home : "";
+        size_t home_len = strlen(home);
+        dir = (char *)malloc(home_len + dir_len);
+        if (dir) {
+            memcpy(dir, home, home_len);
+            memcpy(dir + home_len, word + 1, dir_len - 1u);
+            dir[home_len + dir_len - 1u] = '\0';
+        }
+    } else {
+        dir = dir_len > 0u ? strndup(word, dir_len) : strdup(".");
+    }
+    if (!quoted_dir || !dir) {
+        free(quoted_dir);
+        free(dir);
+        return GS_ERR_ALLOC;
+    }
+    int rc = GS_OK;
+    int fd = openat(shell->cwd_fd, dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        const char *caching = gs_shell_getvar(shell, "GENSHELL_GLOB_CACHE");
+        cp_visit visit = {fd, word + dir_len, strlen(word + dir_len), executables, quoted_dir, out, NULL, GS_OK};
+        rc = gs_glob_list(fd, !caching || strcmp(caching, "0") != 0, ".", visit_file, &visit);
+        rc = rc == GS_ERR_ALLOC ? rc : visit.rc;
+        close(fd);
+    }
+    out->display = strlen(quoted_dir);
+    free(quoted_dir);
+    free(dir);
+    return rc;
+}
+
+static bool is_separator(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == ';' || c == '|' || c == '&' || c == '<' || c == '>' ||
+           c == '(' || c == ')';
+}
+
+/* Whether a finished word is an assignment, after which a command name may still follow. */
+static bool is_assignment(const char *word, size_t len) {
+    size_t i = 0u;
+    while (i < len && is_name_char(word[i]) && !(i == 0u && word[i] >= '0' && word[i] <= '9')) {
+        ++i;
+    }
+    return i > 0u && i < len && word[i] == '=';
+}
+
+static int compare_items(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+int gs_complete(struct gs_shell *shell, const char *line, size_t pos, gs_completions *out) {
+    memset(out, 0, sizeof(*out));
+    char *raw = (char *)malloc(pos + 1u);
+    if (!raw) {
+        return GS_ERR_ALLOC;
+    }
+    size_t raw_len = 0u;
+    bool in_single = false;
+    bool in_double = false;
+    bool command = true;
+    bool redirect = false;
+    size_t dollar_line = SIZE_MAX; /* the word's last expandable '$', in the line and in raw */
+    size_t dollar_raw = 0u;
+    for (size_t i = 0; i < pos; ++i) {
+        char c = line[i];
+        if (in_single) {
+            if (c == '\'') {
+                in_single = false;
+            } else {
+                raw[raw_len++] = c;
+            }
+            continue;
+        }
+        if (c == '\\' && i + 1u < pos) {
+            raw[raw_len++] = line[++i];
+            continue;
+        }
+        if (c == '$') {
+            dollar_line = i;
+            dollar_raw = raw_len;
+        }
+        if (in_double) {
+            if (c == '"') {
+                in_double = false;
+            } else {
+                raw[raw_len++] = c;
+            }
+            continue;
+        }
+        if (c == '\'' || c == '"') {
+            in_single = c == '\'';
+            in_double = c == '"';
+            continue;
+        }
+        if (!is_separator(c)) {
+            raw[raw_len++] = c;
+            continue;
+        }
+        if (raw_len > 0u) {
+            if (redirect) {
+                redirect = false;
+            } else if (!is_assignment(raw, raw_len)) {
+                command = false;
+            }
+        }
+        if (c == ';' || c == '|' || c == '&' || c == '(' || c == ')') {
+            command = true;
+            redirect = false;
+        } else if (c == '<' || c == '>') {
+            redirect = true;
+        }
+        raw_len = 0u;
+        dollar_line = SIZE_MAX;
+        out->start = i + 1u;
+    }
+    raw[raw_len] = '\0';
+
+    int rc = GS_OK;
+    const char *name = dollar_line != SIZE_MAX ? raw + dollar_raw + 1 : NULL;
+    bool braced = name && *name == '{';
+    if (name) {
+        name += braced;
+        for (const char *p = name; *p; ++p) {
+            if (!is_name_char(*p)) {
+                name = NULL;
+                break;
+            }
+        }
+    }
+    if (name) {
+        out->start = dollar_line;
+        out->raw_len = raw_len - dollar_raw;
+        rc = complete_variable(shell, name, strlen(name), braced, out);
+    } else if (command && !redirect && !strchr(raw, '/')) {
+        out->raw_len = raw_len;
+        rc = complete_command(shell, raw, out);
+    } else {
+        out->raw_len = raw_len;
+        rc = complete_file(shell, raw, command && !redirect, out);
+    }
+    free(raw);
+    if (rc != GS_OK) {
+        gs_completions_dispose(out);
+        return rc;
+    }
+    if (out->count > 1u) {
+        qsort(out->items, out->count, sizeof(char *), compare_items);
+        size_t kept = 1u;
+        for (size_t i = 1; i < out->count; ++i) {
+            if (strcmp(out->items[i], out->items[kept - 1u]) == 0) {
+                free(out->items[i]);
+            } else {
+                out->items[kept++] = out->items[i];
+            }
+        }
+        out->count = kept;
+    }
+    return GS_OK;
+}
+
+void gs_completions_dispose(gs_completions *completions) {
+    for (size_t i = 0; i < completions->count; ++i) {
+        free(completions->items[i]);
+    }
+    free(completions->items);
+    completions->items = NULL;
+    completions->count = 0u;
+    completions->capacity = 0u;
+}
+
+void gs_command_index_free(struct gs_command_index *index) {
+    if (!index) {
+        return;
+    }
+    for (size_t i = 0; i < index->count; ++i) {
+        dir_free(&index->dirs[i]);
+    }
+    free(index->dirs);
+    free(index);
+}
@@ -0,0 +1,35 @@
+#ifndef GS_COMPLETE_H
+#define GS_COMPLETE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct gs_shell;
+struct gs_command_index;
+
+/*
+ * Completion of the word before the cursor: a command name (builtins and
+ * the executables on PATH) in command position, a variable name after '$',
+ * and otherwise a file name.
+ */
+
+typedef struct {
+    char **items;   /* sorted and distinct, quoted as they would be typed; directories end in '/' */
+    size_t count;
+    size_t capacity;
+    size_t start;   /* the candidates replace the line from here to the cursor */
+    size_t raw_len; /* length of the replaced text with its quoting removed */
+    size_t display; /* leading bytes every item shares that listings leave out */
+} gs_completions;
+
+/* Fills out with the candidates for line up to pos; GS_OK even when there are none. */
+int gs_complete(struct gs_shell *shell, const char *line, size_t pos, gs_completions *out);
+void gs_completions_dispose(gs_completions *completions);
+
+/*
+ * The shell's index of PATH executables: one sorted listing per directory,
+ * read again only when that directory's inode or mtime changes.
+ */
+void gs_command_index_free(struct gs_command_index *index);
+
+#endif /* GS_COMPLETE_H */
@@ -1,19 +1,30 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include "executor.h"
 
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include "../builtins/builtin.h"
+#include "../parser/lexer.h"
+#include "../parser/parser.h"
+#include "glob.h"
+
+#define GS_CAPTURE_READ_SIZE (1u << 16)
 
 typedef struct {
     char *data;
@@ -21,24 +32,63 @@ typedef struct {
     size_t capacity;
 } gs_strbuf;
 
+/* Output offsets of the '*', '?' and '[' a word contributed unquoted. */
+typedef struct {
+    size_t *offsets;
+    size_t count;
+    size_t capacity;
+} gs_glob_marks;
+
+/* Where a word's fields begin once its unquoted $(...) results are split on IFS. */
+typedef struct {
+    size_t *breaks; /* output offset at which each field after the first begins */
+    size_t count;
+    size_t capacity;
+    bool after_white; /* the current, empty field was begun by IFS whitespace */
+} gs_fields;
+
 typedef struct {
     gs_redirection_type type;
     int fd;
     char *target;
 } gs_expanded_redir;
 
+/* Child feeding (or fed by) a /dev/fd/N argument created for <(...) / >(...). */
+typedef struct {
+    pid_t pid;
+    int fd; /* our end of the pipe, named by the argument */
+} gs_procsub;
+
 typedef struct {
     char **argv;
     size_t argc;
     gs_expanded_redir *redirs;
     size_t redir_count;
     const gs_builtin_spec *builtin;
+    gs_procsub *procsubs;
+    size_t procsub_count;
+    gs_command_kind kind;
+    const gs_command_list *body; /* grouped commands only */
 } gs_prepared_command;
 
+/* A descriptor slot as it was before an in-process redirection replaced it. */
 typedef struct {
-    int fd;
-    int saved_fd;
-} saved_descriptor;
+    int slot;
+    int previous;
+    int opened; /* descriptor the redirection opened, closed on restore; -1 for none */
+} saved_slot;
+
+/* Builtin pipeline stage executed on a helper thread instead of a child. */
+typedef struct {
+    struct gs_shell *shell;
+    gs_prepared_command *cmd;
+    gs_builtin_io io;
+    bool owns_in;
+    bool owns_out;
+    pthread_t thread;
+    bool started;
+    int status;
+} gs_inproc_stage;
 
 static void gs_strbuf_dispose(gs_strbuf *buf) {
     free(buf->data);
@@ -126,7 +176,7 @@ static int append_parameter(gs_strbuf *buf, const struct gs_shell *shell, const
     }
     memcpy(key, name, len);
     key[len] = '\0';
-    const char *value = getenv(key);
+    const char *value = gs_shell_getvar(shell, key);
     if (!value) {
         value = "";
     }
@@ -135,10 +185,280 @@ static int append_parameter(gs_strbuf *buf, const struct gs_shell *shell, const
     return rc;
 }
 
-static int expand_word(const struct gs_shell *shell, const char *word, char **out_word) {
+/*
+ * Performs tilde (when requested) and parameter expansion, honouring literal
+ * sentinels. Here-document bodies are expanded without tilde expansion. When
+ * marks is given, it receives the positions of pattern characters that came
+ * from the word unquoted rather than from quoting or an expansion. When fields
+ * is given, unquoted $(...) results are split on IFS and their pattern
+ * characters are marked too.
+ */
+static int expand_text(struct gs_shell *shell, const char *word, bool tilde, gs_glob_marks *marks, gs_fields *fields,
+                       char **out_word);
+
+/*
+ * True when every command in the list, grouped ones included, is a builtin
+ * named literally. Such a list can run as a subshell inside this process: the
+ * state those builtins change is recorded by a gs_shell_snapshot and put back
+ * afterwards, so the missing fork is not observable. Builtins flagged
+ * GS_BUILTIN_FLAG_FORK change state no snapshot undoes (enable registers
+ * builtins for the whole process, and a sourced file can run anything), so
+ * a subshell running one still forks.
+ */
+static bool list_is_builtin_only(const gs_command_list *list) {
+    for (size_t p = 0; p < list->length; ++p) {
+        const gs_pipeline *pipeline = &list->pipelines[p];
+        if (pipeline->background) {
+            return false;
+        }
+        for (size_t i = 0; i < pipeline->length; ++i) {
+            const gs_simple_command *cmd = &pipeline->commands[i];
+            if (cmd->kind != GS_COMMAND_SIMPLE) {
+                if (!list_is_builtin_only(cmd->body)) {
+                    return false;
+                }
+                continue;
+            }
+            if (cmd->argc == 0u) {
+                continue;
+            }
+            if (strpbrk(cmd->argv[0], "$`~") || cmd->argv[0][0] == GS_PROCSUB_SENTINEL) {
+                return false;
+            }
+            const gs_builtin_spec *spec = gs_builtin_lookup(cmd->argv[0]);
+            if (!spec || !gs_builtin_accepts(spec, (int)cmd->argc, cmd->argv) || (spec->flags & GS_BUILTIN_FLAG_FORK)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/* Single-line substitutions made of builtins only are captured in-process. */
+static bool substitution_is_inproc(const char *text) {
+    if (strchr(text, '\n')) {
+        return false;
+    }
+    gs_token_buffer tokens = {0};
+    if (gs_lexer_tokenize(text, &tokens) != GS_OK) {
+        return false;
+    }
+    gs_command_list list = {0};
+    int rc = gs_parse_tokens(&tokens, &list);
+    gs_token_buffer_dispose(&tokens);
+    if (rc != GS_OK) {
+        return false;
+    }
+    bool inproc = list.length > 0u && list_is_builtin_only(&list);
+    gs_command_list_dispose(&list);
+    return inproc;
+}
+
+static int read_capture(int fd, gs_strbuf *out) {
+    while (true) {
+        int rc = gs_strbuf_reserve(out, GS_CAPTURE_READ_SIZE);
+        if (rc != GS_OK) {
+            return rc;
+        }
+        ssize_t n = read(fd, out->data + out->length, out->capacity - out->length - 1u);
+        if (n == 0) {
+            return GS_OK;
+        }
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return GS_ERR_EXEC;
+        }
+        out->length += (size_t)n;
+        out->data[out->length] = '\0';
+    }
+}
+
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+/*
+ * Runs a builtin-only substitution in this process with the shell's standard
+ * output slot pointed at a memfd, then pulls the whole output back with a
+ * single pread.
+ */
+static int capture_inproc(struct gs_shell *shell, const char *text, gs_strbuf *out) {
+    int mem_fd = memfd_create("genshell-capture", MFD_CLOEXEC);
+    if (mem_fd < 0) {
+        return GS_ERR_UNIMPLEMENTED;
+    }
+    int saved_stdout = shell->fds[STDOUT_FILENO];
+    shell->fds[STDOUT_FILENO] = mem_fd;
+    struct gs_shell_snapshot snapshot;
+    gs_shell_snapshot_begin(shell, &snapshot);
+    gs_shell_eval(shell, text);
+    int status = gs_shell_snapshot_restore(shell, &snapshot);
+    shell->fds[STDOUT_FILENO] = saved_stdout;
+
+    int rc = GS_OK;
+    struct stat st;
+    if (fstat(mem_fd, &st) == 0 && st.st_size > 0) {
+        size_t size = (size_t)st.st_size;
+        rc = gs_strbuf_reserve(out, size);
+        if (rc == GS_OK) {
+            ssize_t n = pread(mem_fd, out->data + out->length, size, 0);
+            if (n > 0) {
+                out->length += (size_t)n;
+                out->data[out->length] = '\0';
+            }
+        }
+    }
+    close(mem_fd);
+    shell->last_status = status < 0 ? 1 : status;
+    return rc;
+}
+#endif
+
+/* Forks a subshell for the substitution and reads its output from a pipe. */
+static int capture_forked(struct gs_shell *shell, const char *text, gs_strbuf *out) {
+    int fds[2];
+    if (gs_pipe_cloexec(fds) < 0) {
+        gs_builtin_err_printf("genshell: pipe failed: %s\n", strerror(errno));
+        return GS_ERR_EXEC;
+    }
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        gs_builtin_err_printf("genshell: fork failed: %s\n", strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return GS_ERR_EXEC;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        shell->fds[STDOUT_FILENO] = fds[1];
+        gs_shell_enter_process(shell);
+        int status = gs_shell_run_string(shell, text, true);
+        _exit(status < 0 ? 1 : status & 0xFF);
+    }
+    close(fds[1]);
+    int rc = read_capture(fds[0], out);
+    close(fds[0]);
+
+    int wstatus = 0;
+    while (waitpid(pid, &wstatus, 0) < 0 && errno == EINTR) {
+    }
+    if (WIFEXITED(wstatus)) {
+        shell->last_status = WEXITSTATUS(wstatus);
+    } else if (WIFSIGNALED(wstatus)) {
+        shell->last_status = 128 + WTERMSIG(wstatus);
+    }
+    return rc;
+}
+
+static int mark_pattern_char(gs_glob_marks *marks, size_t offset);
+
+static int add_field_break(gs_fields *fields, size_t offset) {
+    if (fields->count == fields->capacity) {
+        size_t new_cap = fields->capacity ? fields->capacity * 2u : 8u;
+        size_t *tmp = (size_t *)realloc(fields->breaks, new_cap * sizeof(size_t));
+        if (!tmp) {
+            return GS_ERR_ALLOC;
+        }
+        fields->breaks = tmp;
+        fields->capacity = new_cap;
+    }
+    fields->breaks[fields->count++] = offset;
+    return GS_OK;
+}
+
+/*
+ * Appends an unquoted substitution result, ending a field at each IFS
+ * delimiter in it. Runs of IFS whitespace count once and never begin an empty
+ * field; any other IFS character always ends one, joining whitespace around it.
+ */
+static int append_fields(struct gs_shell *shell, gs_strbuf *buf, const char *data, size_t len, gs_fields *fields,
+                         gs_glob_marks *marks) {
+    const char *ifs = gs_shell_getvar(shell, "IFS");
+    if (!ifs) {
+        ifs = " \t\n";
+    }
+    for (size_t i = 0; i < len; ++i) {
+        char ch = data[i];
+        int rc = GS_OK;
+        if (ch != '\0' && strchr(ifs, ch)) {
+            bool white = ch == ' ' || ch == '\t' || ch == '\n';
+            bool empty = buf->length == (fields->count ? fields->breaks[fields->count - 1u] : 0u);
+            if (!empty || (!white && !fields->after_white)) {
+                rc = add_field_break(fields, buf->length);
+                fields->after_white = white;
+            } else if (!white) {
+                fields->after_white = false;
+            }
+        } else {
+            if (marks && (ch == '*' || ch == '?' || ch == '[')) {
+                rc = mark_pattern_char(marks, buf->length);
+            }
+            if (rc == GS_OK) {
+                rc = gs_strbuf_append_char(buf, ch);
+            }
+        }
+        if (rc != GS_OK) {
+            return rc;
+        }
+    }
+    return GS_OK;
+}
+
+/*
+ * Appends the output of $(text) to buf, minus trailing newlines; with fields,
+ * the output is split as append_fields describes.
+ */
+static int append_command_substitution(struct gs_shell *shell, gs_strbuf *buf, const char *text, size_t len,
+                                       gs_fields *fields, gs_glob_marks *marks) {
+    char *command = (char *)malloc(len + 1u);
+    if (!command) {
+        return GS_ERR_ALLOC;
+    }
+    memcpy(command, text, len);
+    command[len] = '\0';
+
+    gs_strbuf output = {0};
+    int rc = GS_ERR_UNIMPLEMENTED;
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    if (substitution_is_inproc(command)) {
+        rc = capture_inproc(shell, command, &output);
+    }
+#endif
+    if (rc == GS_ERR_UNIMPLEMENTED) {
+        rc = capture_forked(shell, command, &output);
+    }
+    free(command);
+    if (rc == GS_OK) {
+        while (output.length > 0u && output.data[output.length - 1u] == '\n') {
+            --output.length;
+        }
+        rc = fields ? append_fields(shell, buf, output.data, output.length, fields, marks)
+                    : gs_strbuf_append_mem(buf, output.data, output.length);
+    }
+    gs_strbuf_dispose(&output);
+    return rc;
+}
+
+static int mark_pattern_char(gs_glob_marks *marks, size_t offset) {
+    if (marks->count == marks->capacity) {
+        size_t new_cap = marks->capacity ? marks->capacity * 2u : 8u;
+        size_t *tmp = (size_t *)realloc(marks->offsets, new_cap * sizeof(size_t));
+        if (!tmp) {
+            return GS_ERR_ALLOC;
+        }
+        marks->offsets = tmp;
+        marks->capacity = new_cap;
+    }
+    marks->offsets[marks->count++] = offset;
+    return GS_OK;
+}
+
+static int expand_text(struct gs_shell *shell, const char *word, bool tilde, gs_glob_marks *marks, gs_fields *fields,
+                       char **out_word) {
     gs_strbuf buf = {0};
     const char *p = word;
     bool literal_next = false;
+    bool split_next = false;
 
     while (p && *p) {
         char ch = *p++;
@@ -155,8 +475,12 @@ static int expand_word(const struct gs_shell *shell, const char *word, char **ou
             literal_next = true;
             continue;
         }
-        if (ch == '~' && buf.length == 0u) {
-            const char *home = getenv("HOME");
+        if (ch == GS_SPLIT_SENTINEL) {
+            split_next = fields != NULL;
+            continue;
+        }
+        if (tilde && ch == '~' && buf.length == 0u) {
+            const char *home = gs_shell_getvar(shell, "HOME");
             if (!home) {
                 home = "";
             }
@@ -176,6 +500,20 @@ static int expand_word(const struct gs_shell *shell, const char *word, char **ou
                 }
                 break;
             }
+            if (*p == '(') {
+                const char *close = gs_lexer_find_closing_paren(p + 1);
+                if (close) {
+                    int rc = append_command_substitution(shell, &buf, p + 1, (size_t)(close - (p + 1)),
+                                                         split_next ? fields : NULL, marks);
+                    split_next = false;
+                    if (rc != GS_OK) {
+                        gs_strbuf_dispose(&buf);
+                        return rc;
+                    }
+                    p = close + 1;
+                    continue;
+                }
+            }
             if (*p == '$' || *p == '?' || *p == '0') {
                 char special = *p++;
                 int rc = append_parameter(&buf, shell, &special, 1u);
@@ -229,7 +567,13 @@ static int expand_word(const struct gs_shell *shell, const char *word, char **ou
             }
             continue;
         }
-        int rc = gs_strbuf_append_char(&buf, ch);
+        int rc = GS_OK;
+        if (marks && (ch == '*' || ch == '?' || ch == '[')) {
+            rc = mark_pattern_char(marks, buf.length);
+        }
+        if (rc == GS_OK) {
+            rc = gs_strbuf_append_char(&buf, ch);
+        }
         if (rc != GS_OK) {
             gs_strbuf_dispose(&buf);
             return rc;
@@ -247,6 +591,169 @@ static int expand_word(const struct gs_shell *shell, const char *word, char **ou
     return GS_OK;
 }
 
+static int expand_word(struct gs_shell *shell, const char *word, char **out_word) {
+    return expand_text(shell, word, true, NULL, NULL, out_word);
+}
+
+/* True when word has an unquoted '*', '?' or '[' and so may be a pattern. */
+static bool word_has_pattern_chars(const char *word) {
+    for (const char *p = word; *p; ++p) {
+        if (*p == GS_LITERAL_SENTINEL && p[1] != '\0') {
+            ++p;
+        } else if (*p == '*' || *p == '?' || *p == '[') {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * The expanded field with every pattern character that must match literally
+ * escaped; base is the field's offset in the word the marks refer to.
+ */
+static char *glob_pattern(const char *expanded, const gs_glob_marks *marks, size_t base) {
+    size_t len = strlen(expanded);
+    char *pattern = (char *)malloc(len * 2u + 1u);
+    if (!pattern) {
+        return NULL;
+    }
+    size_t w = 0u;
+    size_t next_mark = 0u;
+    for (size_t i = 0; i < len; ++i) {
+        char ch = expanded[i];
+        bool active = next_mark < marks->count && marks->offsets[next_mark] == base + i;
+        if (active) {
+            ++next_mark;
+        } else if (ch == '*' || ch == '?' || ch == '[' || ch == '\\') {
+            pattern[w++] = '\\';
+        }
+        pattern[w++] = ch;
+    }
+    pattern[w] = '\0';
+    return pattern;
+}
+
+static int push_argument(gs_prepared_command *cmd, size_t *capacity, char *arg) {
+    if (!arg) {
+        return GS_ERR_ALLOC;
+    }
+    if (cmd->argc + 1u >= *capacity) {
+        size_t new_cap = *capacity * 2u;
+        char **tmp = (char **)realloc(cmd->argv, new_cap * sizeof(char *));
+        if (!tmp) {
+            free(arg);
+            return GS_ERR_ALLOC;
+        }
+        cmd->argv = tmp;
+        *capacity = new_cap;
+    }
+    cmd->argv[cmd->argc++] = arg;
+    cmd->argv[cmd->argc] = NULL;
+    return GS_OK;
+}
+
+/*
+ * Appends expanded[start, end) as one field, or as its pathname matches when
+ * marks from *next_mark on fall inside it.
+ */
+static int push_field(struct gs_shell *shell, gs_prepared_command *cmd, size_t *capacity, const char *expanded,
+                      size_t start, size_t end, const gs_glob_marks *marks, size_t *next_mark) {
+    gs_glob_marks field_marks = {marks->offsets ? marks->offsets + *next_mark : NULL, 0u, 0u};
+    while (*next_mark < marks->count && marks->offsets[*next_mark] < end) {
+        ++*next_mark;
+        ++field_marks.count;
+    }
+    char *field = strndup(expanded + start, end - start);
+    if (!field || field_marks.count == 0u) {
+        return push_argument(cmd, capacity, field);
+    }
+    char *pattern = glob_pattern(field, &field_marks, start);
+    const char *caching = gs_shell_getvar(shell, "GENSHELL_GLOB_CACHE");
+    bool use_cache = !caching || strcmp(caching, "0") != 0;
+    char **matches = NULL;
+    size_t match_count = 0u;
+    int rc = pattern ? gs_glob_expand(shell->cwd_fd, use_cache, pattern, &matches, &match_count) : GS_ERR_ALLOC;
+    free(pattern);
+    if (rc != GS_OK) {
+        free(field);
+        return rc;
+    }
+    if (match_count == 0u) {
+        return push_argument(cmd, capacity, field); /* no match: the field stays as written */
+    }
+    free(field);
+    size_t i = 0u;
+    for (; i < match_count && rc == GS_OK; ++i) {
+        rc = push_argument(cmd, capacity, matches[i]);
+    }
+    for (; i < match_count; ++i) {
+        free(matches[i]);
+    }
+    free(matches);
+    return rc;
+}
+
+/*
+ * Appends the fields word expands to: unquoted $(...) results split on IFS,
+ * and each field replaced by its pathname matches when it is a pattern. A
+ * word whose expansion leaves only an empty trailing field adds nothing.
+ */
+static int expand_argument(struct gs_shell *shell, const char *word, gs_prepared_command *cmd, size_t *capacity) {
+    bool split = strchr(word, GS_SPLIT_SENTINEL) != NULL;
+    if (!split && !word_has_pattern_chars(word)) {
+        char *expanded = NULL;
+        int rc = expand_word(shell, word, &expanded);
+        return rc == GS_OK ? push_argument(cmd, capacity, expanded) : rc;
+    }
+    gs_glob_marks marks = {0};
+    gs_fields fields = {0};
+    char *expanded = NULL;
+    int rc = expand_text(shell, word, true, &marks, split ? &fields : NULL, &expanded);
+    size_t length = rc == GS_OK ? strlen(expanded) : 0u;
+    size_t next_mark = 0u;
+    for (size_t f = 0; rc == GS_OK && f <= fields.count; ++f) {
+        size_t start = f > 0u ? fields.breaks[f - 1u] : 0u;
+        size_t end = f < fields.count ? fields.breaks[f] : length;
+        if (split && f == fields.count && start == end) {
+            break;
+        }
+        rc = push_field(shell, cmd, capacity, expanded, start, end, &marks, &next_mark);
+    }
+    free(fields.breaks);
+    free(marks.offsets);
+    free(expanded);
+    return rc;
+}
+
+static int expand_redirection_target(struct gs_shell *shell, const gs_redirection *redir, char **out_target) {
+    switch (redir->type) {
+    case GS_REDIR_HEREDOC_LITERAL:
+        *out_target = strdup(redir->target);
+        return *out_target ? GS_OK : GS_ERR_ALLOC;
+    case GS_REDIR_HEREDOC:
+        return expand_text(shell, redir->target, false, NULL, NULL, out_target);
+    case GS_REDIR_HERESTRING: {
+        char *expanded = NULL;
+        int rc = expand_word(shell, redir->target, &expanded);
+        if (rc != GS_OK) {
+            return rc;
+        }
+        size_t len = strlen(expanded);
+        char *with_newline = (char *)realloc(expanded, len + 2u);
+        if (!with_newline) {
+            free(expanded);
+            return GS_ERR_ALLOC;
+        }
+        with_newline[len] = '\n';
+        with_newline[len + 1u] = '\0';
+        *out_target = with_newline;
+        return GS_OK;
+    }
+    default:
+        return expand_word(shell, redir->target, out_target);
+    }
+}
+
 static void dispose_expanded_redirs(gs_expanded_redir *redirs, size_t count) {
     if (!redirs) {
         return;
@@ -257,10 +764,93 @@ static void dispose_expanded_redirs(gs_expanded_redir *redirs, size_t count) {
     free(redirs);
 }
 
+/*
+ * Closes our ends of the substitution pipes first so readers see EOF and
+ * writers see EPIPE, then reaps every substituted process.
+ */
+static void reap_process_substitutions(gs_prepared_command *cmd) {
+    for (size_t i = 0; i < cmd->procsub_count; ++i) {
+        close(cmd->procsubs[i].fd);
+    }
+    for (size_t i = 0; i < cmd->procsub_count; ++i) {
+        while (waitpid(cmd->procsubs[i].pid, NULL, 0) < 0 && errno == EINTR) {
+        }
+    }
+    free(cmd->procsubs);
+    cmd->procsubs = NULL;
+    cmd->procsub_count = 0u;
+}
+
+/*
+ * Starts the command of a <(...) or >(...) word on one end of a fresh pipe
+ * and stores "/dev/fd/N" naming the other end, which the command inherits.
+ */
+static int spawn_process_substitution(struct gs_shell *shell, gs_prepared_command *cmd, const char *word, char **out_path) {
+    bool reads_from_child = word[1] == '<';
+    const char *text = word + 2;
+
+    gs_procsub *grown = (gs_procsub *)realloc(cmd->procsubs, (cmd->procsub_count + 1u) * sizeof(gs_procsub));
+    if (!grown) {
+        return GS_ERR_ALLOC;
+    }
+    cmd->procsubs = grown;
+
+    int fds[2];
+    if (gs_pipe_cloexec(fds) < 0) {
+        gs_builtin_err_printf("genshell: pipe failed: %s\n", strerror(errno));
+        return GS_ERR_EXEC;
+    }
+    int child_end = reads_from_child ? fds[1] : fds[0];
+    int our_end = reads_from_child ? fds[0] : fds[1];
+    int child_target = reads_from_child ? STDOUT_FILENO : STDIN_FILENO;
+
+    /* The named end must survive the command's child installing descriptors 0-9. */
+    if (our_end < GS_SHELL_FD_COUNT) {
+        int high = fcntl(our_end, F_DUPFD_CLOEXEC, GS_SHELL_FD_COUNT);
+        if (high < 0) {
+            gs_builtin_err_printf("genshell: process substitution: %s\n", strerror(errno));
+            close(fds[0]);
+            close(fds[1]);
+            return GS_ERR_EXEC;
+        }
+        close(our_end);
+        our_end = high;
+    }
+
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        gs_builtin_err_printf("genshell: fork failed: %s\n", strerror(errno));
+        close(our_end);
+        close(child_end);
+        return GS_ERR_EXEC;
+    }
+    if (pid == 0) {
+        close(our_end);
+        for (size_t i = 0; i < cmd->procsub_count; ++i) {
+            close(cmd->procsubs[i].fd);
+        }
+        shell->fds[child_target] = child_end;
+        gs_shell_enter_process(shell);
+        int status = gs_shell_run_string(shell, text, true);
+        _exit(status < 0 ? 1 : status & 0xFF);
+    }
+    close(child_end);
+
+    char path[32];
+    snprintf(path, sizeof(path), "/dev/fd/%d", our_end);
+    *out_path = strdup(path);
+    cmd->procsubs[cmd->procsub_count].pid = pid;
+    cmd->procsubs[cmd->procsub_count].fd = our_end;
+    cmd->procsub_count++;
+    return *out_path ? GS_OK : GS_ERR_ALLOC;
+}
+
 static void dispose_prepared_command(gs_prepared_command *cmd) {
     if (!cmd) {
         return;
     }
+    reap_process_substitutions(cmd);
     if (cmd->argv) {
         for (size_t i = 0; i < cmd->argc; ++i) {
             free(cmd->argv[i]);
@@ -273,28 +863,34 @@ static void dispose_prepared_command(gs_prepared_command *cmd) {
     cmd->redirs = NULL;
     cmd->redir_count = 0u;
     cmd->builtin = NULL;
+    cmd->body = NULL;
 }
 
 static int prepare_command(struct gs_shell *shell, const gs_simple_command *command, gs_prepared_command *out) {
     memset(out, 0, sizeof(*out));
 
-    size_t argv_len = command->argc;
-    out->argv = (char **)calloc(argv_len + 1u, sizeof(char *));
+    size_t capacity = command->argc + 1u;
+    out->argv = (char **)calloc(capacity, sizeof(char *));
     if (!out->argv) {
         return GS_ERR_ALLOC;
     }
 
     for (size_t i = 0; i < command->argc; ++i) {
-        char *expanded = NULL;
-        int rc = expand_word(shell, command->argv[i], &expanded);
+        int rc;
+        if (command->argv[i][0] == GS_PROCSUB_SENTINEL) {
+            char *path = NULL;
+            rc = spawn_process_substitution(shell, out, command->argv[i], &path);
+            if (rc == GS_OK) {
+                rc = push_argument(out, &capacity, path);
+            }
+        } else {
+            rc = expand_argument(shell, command->argv[i], out, &capacity);
+        }
         if (rc != GS_OK) {
             dispose_prepared_command(out);
             return rc;
         }
-        out->argv[i] = expanded;
     }
-    out->argc = command->argc;
-    out->argv[argv_len] = NULL;
 
     if (command->redir_count > 0u) {
         out->redirs = (gs_expanded_redir *)calloc(command->redir_count, sizeof(gs_expanded_redir));
@@ -305,7 +901,13 @@ static int prepare_command(struct gs_shell *shell, const gs_simple_command *comm
         out->redir_count = command->redir_count;
         for (size_t i = 0; i < command->redir_count; ++i) {
             char *expanded = NULL;
-            int rc = expand_word(shell, command->redirs[i].target, &expanded);
+            int rc;
+            if (command->redirs[i].target && command->redirs[i].target[0] == GS_PROCSUB_SENTINEL) {
+                /* "< <(cmd)" and "> >(cmd)" redirect to the /dev/fd/N name as an argument would. */
+                rc = spawn_process_substitution(shell, out, command->redirs[i].target, &expanded);
+            } else {
+                rc = expand_redirection_target(shell, &command->redirs[i], &expanded);
+            }
             if (rc != GS_OK) {
                 dispose_prepared_command(out);
                 return rc;
@@ -316,20 +918,81 @@ static int prepare_command(struct gs_shell *shell, const gs_simple_command *comm
         }
     }
 
+    out->kind = command->kind;
+    out->body = command->body;
     const char *name = (out->argc > 0u) ? out->argv[0] : NULL;
     out->builtin = name ? gs_builtin_lookup(name) : NULL;
+    if (out->builtin && !gs_builtin_accepts(out->builtin, (int)out->argc, out->argv)) {
+        out->builtin = NULL;
+    }
     return GS_OK;
 }
 
-static int open_redirection(const gs_expanded_redir *redir) {
+/*
+ * Returns a readable descriptor holding a here-document body. Linux uses an
+ * anonymous memfd so nothing touches the disk. Elsewhere the body goes into a
+ * pipe; whatever does not fit in the pipe buffer is written by a detached
+ * (double-forked) writer so the reader can never deadlock against us.
+ */
+static int open_heredoc(const char *body) {
+    size_t len = strlen(body);
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    int mem_fd = memfd_create("genshell-heredoc", MFD_CLOEXEC);
+    if (mem_fd >= 0) {
+        if (gs_builtin_write_all(mem_fd, body, len) != GS_OK || lseek(mem_fd, 0, SEEK_SET) < 0) {
+            int saved_errno = errno;
+            close(mem_fd);
+            errno = saved_errno;
+            return -1;
+        }
+        return mem_fd;
+    }
+#endif
+    int fds[2];
+    if (gs_pipe_cloexec(fds) < 0) {
+        return -1;
+    }
+    int flags = fcntl(fds[1], F_GETFL);
+    fcntl(fds[1], F_SETFL, flags | O_NONBLOCK);
+    size_t done = 0u;
+    while (done < len) {
+        ssize_t n = write(fds[1], body + done, len - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        done += (size_t)n;
+    }
+    if (done < len) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(fds[0]);
+            if (fork() == 0) {
+                fcntl(fds[1], F_SETFL, flags);
+                gs_builtin_write_all(fds[1], body + done, len - done);
+            }
+            _exit(0);
+        }
+        if (pid > 0) {
+            waitpid(pid, NULL, 0);
+        }
+    }
+    close(fds[1]);
+    return fds[0];
+}
+
+/* Opens the target of a file or here-document redirection, close-on-exec. */
+static int open_redirection(const struct gs_shell *shell, const gs_expanded_redir *redir) {
     int flags = 0;
-    mode_t mode = 0666;
 
     switch (redir->type) {
     case GS_REDIR_STDIN:
         flags = O_RDONLY;
         break;
     case GS_REDIR_STDOUT:
+    case GS_REDIR_CLOBBER:
         flags = O_WRONLY | O_CREAT | O_TRUNC;
         break;
     case GS_REDIR_STDOUT_APPEND:
@@ -338,98 +1001,183 @@ static int open_redirection(const gs_expanded_redir *redir) {
     case GS_REDIR_STDERR:
         flags = O_WRONLY | O_CREAT | O_TRUNC;
         break;
+    case GS_REDIR_READ_WRITE:
+        flags = O_RDWR | O_CREAT;
+        break;
+    case GS_REDIR_HEREDOC:
+    case GS_REDIR_HEREDOC_LITERAL:
+    case GS_REDIR_HERESTRING:
+        return open_heredoc(redir->target);
     default:
         return -1;
     }
 
-    int fd = open(redir->target, flags, mode);
-    return fd;
+    return gs_shell_open(shell, redir->target, flags);
+}
+
+static const char *redirection_label(const gs_expanded_redir *redir) {
+    switch (redir->type) {
+    case GS_REDIR_HEREDOC:
+    case GS_REDIR_HEREDOC_LITERAL:
+    case GS_REDIR_HERESTRING:
+        return "here-document";
+    default:
+        return redir->target;
+    }
 }
 
-static int apply_child_redirs(const gs_expanded_redir *redirs, size_t count) {
+/*
+ * Resolves the "m" (or "-") of n>&m / n<&m. Returns the descriptor to copy,
+ * -1 to close, or GS_ERR_EXEC for anything that is not a descriptor number.
+ */
+static int parse_dup_source(const gs_expanded_redir *redir) {
+    const char *text = redir->target;
+    if (strcmp(text, "-") == 0) {
+        return -1;
+    }
+    if (!*text) {
+        return GS_ERR_EXEC;
+    }
+    long value = 0;
+    for (const char *p = text; *p; ++p) {
+        if (!isdigit((unsigned char)*p) || value > 4096) {
+            return GS_ERR_EXEC;
+        }
+        value = value * 10 + (*p - '0');
+    }
+    return (int)value;
+}
+
+/* Applies one n>&m / n<&m redirection to the descriptors of a child. */
+static int apply_dup_redir(struct gs_shell *shell, const gs_expanded_redir *redir) {
+    int source = parse_dup_source(redir);
+    if (source == GS_ERR_EXEC) {
+        gs_builtin_err_printf("genshell: %s: ambiguous redirect\n", redir->target);
+        return GS_ERR_EXEC;
+    }
+    if (source == -1) {
+        close(redir->fd);
+        if (redir->fd < GS_SHELL_FD_COUNT) {
+            shell->fds[redir->fd] = -1;
+        }
+        return GS_OK;
+    }
+    if (source == redir->fd) {
+        return fcntl(source, F_GETFD) < 0 ? GS_ERR_EXEC : GS_OK;
+    }
+    if (dup2(source, redir->fd) < 0) {
+        gs_builtin_err_printf("genshell: %d: %s\n", source, strerror(errno));
+        return GS_ERR_EXEC;
+    }
+    if (redir->fd < GS_SHELL_FD_COUNT) {
+        shell->fds[redir->fd] = redir->fd;
+    }
+    return GS_OK;
+}
+
+/*
+ * Applies redirections for real in a child that has entered the process
+ * (gs_shell_enter_process), keeping its identity descriptor table in step.
+ */
+static int apply_child_redirs(struct gs_shell *shell, const gs_expanded_redir *redirs, size_t count) {
     for (size_t i = 0; i < count; ++i) {
-        int fd = open_redirection(&redirs[i]);
+        if (redirs[i].type == GS_REDIR_DUP) {
+            if (apply_dup_redir(shell, &redirs[i]) != GS_OK) {
+                return GS_ERR_EXEC;
+            }
+            continue;
+        }
+        int fd = open_redirection(shell, &redirs[i]);
         if (fd < 0) {
-            fprintf(stderr, "genshell: failed to open %s: %s\n", redirs[i].target, strerror(errno));
+            gs_builtin_err_printf("genshell: failed to open %s: %s\n", redirection_label(&redirs[i]), strerror(errno));
             return GS_ERR_EXEC;
         }
-        if (dup2(fd, redirs[i].fd) < 0) {
-            fprintf(stderr, "genshell: redirection failed: %s\n", strerror(errno));
+        if (fd == redirs[i].fd) {
+            fcntl(fd, F_SETFD, 0);
+        } else {
+            if (dup2(fd, redirs[i].fd) < 0) {
+                gs_builtin_err_printf("genshell: redirection failed: %s\n", strerror(errno));
+                close(fd);
+                return GS_ERR_EXEC;
+            }
             close(fd);
-            return GS_ERR_EXEC;
         }
-        close(fd);
+        if (redirs[i].fd < GS_SHELL_FD_COUNT) {
+            shell->fds[redirs[i].fd] = redirs[i].fd;
+        }
     }
     return GS_OK;
 }
 
-static int ensure_saved_descriptor(saved_descriptor **array, size_t *length, size_t *capacity, int fd) {
-    for (size_t i = 0; i < *length; ++i) {
-        if ((*array)[i].fd == fd) {
-            return (int)i;
-        }
+/* Puts the shell's descriptor slots back as they were, closing what the redirections opened. */
+static void restore_parent_redirs(struct gs_shell *shell, saved_slot *saved, size_t count) {
+    if (!saved) {
+        return;
     }
-    if (*length + 1u > *capacity) {
-        size_t new_cap = *capacity ? *capacity * 2u : 4u;
-        saved_descriptor *tmp = (saved_descriptor *)realloc(*array, new_cap * sizeof(saved_descriptor));
-        if (!tmp) {
-            return GS_ERR_ALLOC;
+    for (size_t i = count; i > 0; --i) {
+        shell->fds[saved[i - 1].slot] = saved[i - 1].previous;
+        if (saved[i - 1].opened >= 0) {
+            close(saved[i - 1].opened);
         }
-        *array = tmp;
-        *capacity = new_cap;
-    }
-    int dup_fd = dup(fd);
-    if (dup_fd < 0) {
-        return GS_ERR_EXEC;
     }
-    (*array)[*length].fd = fd;
-    (*array)[*length].saved_fd = dup_fd;
-    (*length)++;
-    return (int)(*length - 1u);
+    free(saved);
 }
 
-static int apply_parent_redirs(const gs_expanded_redir *redirs, size_t count, saved_descriptor **out_saved, size_t *out_length) {
+/*
+ * Redirects a command that runs inside the shell. Only the session's
+ * descriptor table changes: an opened file fills its slot, n>&m makes slot n
+ * share slot m's descriptor and n>&- empties slot n. The process descriptors
+ * themselves, shared with everything else in it, are never touched.
+ */
+static int apply_parent_redirs(struct gs_shell *shell, const gs_expanded_redir *redirs, size_t count, saved_slot **out_saved,
+                               size_t *out_length) {
     *out_saved = NULL;
     *out_length = 0u;
     if (count == 0u) {
         return GS_OK;
     }
-
-    saved_descriptor *saved = NULL;
+    saved_slot *saved = (saved_slot *)calloc(count, sizeof(saved_slot));
+    if (!saved) {
+        return GS_ERR_ALLOC;
+    }
     size_t saved_len = 0u;
-    size_t saved_cap = 0u;
 
     for (size_t i = 0; i < count; ++i) {
-        int fd_index = ensure_saved_descriptor(&saved, &saved_len, &saved_cap, redirs[i].fd);
-        if (fd_index < 0) {
-            for (size_t j = 0; j < saved_len; ++j) {
-                close(saved[j].saved_fd);
-            }
-            free(saved);
-            return fd_index;
-        }
-
-        int fd = open_redirection(&redirs[i]);
-        if (fd < 0) {
-            fprintf(stderr, "genshell: failed to open %s: %s\n", redirs[i].target, strerror(errno));
-            for (size_t j = 0; j < saved_len; ++j) {
-                dup2(saved[j].saved_fd, saved[j].fd);
-                close(saved[j].saved_fd);
-            }
-            free(saved);
+        int slot = redirs[i].fd;
+        if (slot < 0 || slot >= GS_SHELL_FD_COUNT) {
+            gs_builtin_err_printf("genshell: %d: Bad file descriptor\n", slot);
+            restore_parent_redirs(shell, saved, saved_len);
             return GS_ERR_EXEC;
         }
-        if (dup2(fd, redirs[i].fd) < 0) {
-            fprintf(stderr, "genshell: redirection failed: %s\n", strerror(errno));
-            close(fd);
-            for (size_t j = 0; j < saved_len; ++j) {
-                dup2(saved[j].saved_fd, saved[j].fd);
-                close(saved[j].saved_fd);
+        int fd;
+        int opened = -1;
+        if (redirs[i].type == GS_REDIR_DUP) {
+            int source = parse_dup_source(&redirs[i]);
+            if (source == GS_ERR_EXEC) {
+                gs_builtin_err_printf("genshell: %s: ambiguous redirect\n", redirs[i].target);
+                restore_parent_redirs(shell, saved, saved_len);
+                return GS_ERR_EXEC;
             }
-            free(saved);
-            return GS_ERR_EXEC;
+            if (source >= GS_SHELL_FD_COUNT || (source >= 0 && shell->fds[source] < 0)) {
+                gs_builtin_err_printf("genshell: %d: Bad file descriptor\n", source);
+                restore_parent_redirs(shell, saved, saved_len);
+                return GS_ERR_EXEC;
+            }
+            fd = source < 0 ? -1 : shell->fds[source];
+        } else {
+            fd = open_redirection(shell, &redirs[i]);
+            if (fd < 0) {
+                gs_builtin_err_printf("genshell: failed to open %s: %s\n", redirection_label(&redirs[i]), strerror(errno));
+                restore_parent_redirs(shell, saved, saved_len);
+                return GS_ERR_EXEC;
+            }
+            opened = fd;
         }
-        close(fd);
+        saved[saved_len].slot = slot;
+        saved[saved_len].previous = shell->fds[slot];
+        saved[saved_len].opened = opened;
+        saved_len++;
+        shell->fds[slot] = fd;
     }
 
     *out_saved = saved;
@@ -437,68 +1185,283 @@ static int apply_parent_redirs(const gs_expanded_redir *redirs, size_t count, sa
     return GS_OK;
 }
 
-static void restore_parent_redirs(saved_descriptor *saved, size_t count) {
-    if (!saved) {
-        return;
-    }
-    for (size_t i = count; i > 0; --i) {
-        size_t idx = i - 1;
-        dup2(saved[idx].saved_fd, saved[idx].fd);
-        close(saved[idx].saved_fd);
-    }
-    free(saved);
+/* Binds the builtin io handle to the shell's standard slots; returns the previous binding. */
+static const gs_builtin_io *bind_shell_io(const struct gs_shell *shell, gs_builtin_io *io) {
+    io->in_fd = shell->fds[STDIN_FILENO];
+    io->out_fd = shell->fds[STDOUT_FILENO];
+    io->err_fd = shell->fds[STDERR_FILENO];
+    return gs_builtin_io_bind(io);
 }
 
 static int execute_parent_builtin(struct gs_shell *shell, gs_prepared_command *cmd) {
-    saved_descriptor *saved = NULL;
+    saved_slot *saved = NULL;
     size_t saved_len = 0u;
-    int rc = apply_parent_redirs(cmd->redirs, cmd->redir_count, &saved, &saved_len);
+    int rc = apply_parent_redirs(shell, cmd->redirs, cmd->redir_count, &saved, &saved_len);
     if (rc != GS_OK) {
-        restore_parent_redirs(saved, saved_len);
         return rc;
     }
 
-    int status = cmd->builtin->fn(shell, (int)cmd->argc, cmd->argv);
-    restore_parent_redirs(saved, saved_len);
+    gs_builtin_io io;
+    const gs_builtin_io *outer = bind_shell_io(shell, &io);
+    int status = gs_builtin_invoke(cmd->builtin, shell, (int)cmd->argc, cmd->argv);
+    gs_builtin_io_bind(outer);
+    restore_parent_redirs(shell, saved, saved_len);
     return status;
 }
 
 static void execute_child_builtin(struct gs_shell *shell, gs_prepared_command *cmd) {
-    int rc = apply_child_redirs(cmd->redirs, cmd->redir_count);
+    int rc = apply_child_redirs(shell, cmd->redirs, cmd->redir_count);
     if (rc != GS_OK) {
         _exit(1);
     }
-    int status = cmd->builtin->fn(shell, (int)cmd->argc, cmd->argv);
+    int status = gs_builtin_invoke(cmd->builtin, shell, (int)cmd->argc, cmd->argv);
     if (status < 0) {
         status = 1;
     }
     _exit(status & 0xFF);
 }
 
-static void execute_child_external(gs_prepared_command *cmd) {
-    int rc = apply_child_redirs(cmd->redirs, cmd->redir_count);
+static bool can_run_inproc(const gs_prepared_command *cmd) {
+    if (!cmd->builtin || !(cmd->builtin->flags & GS_BUILTIN_FLAG_INPROC)) {
+        return false;
+    }
+    for (size_t i = 0; i < cmd->redir_count; ++i) {
+        const gs_expanded_redir *redir = &cmd->redirs[i];
+        switch (redir->type) {
+        case GS_REDIR_STDIN:
+        case GS_REDIR_HEREDOC:
+        case GS_REDIR_HEREDOC_LITERAL:
+        case GS_REDIR_HERESTRING:
+            if (redir->fd != STDIN_FILENO) {
+                return false;
+            }
+            break;
+        case GS_REDIR_STDOUT:
+        case GS_REDIR_STDOUT_APPEND:
+        case GS_REDIR_CLOBBER:
+            if (redir->fd != STDOUT_FILENO) {
+                return false;
+            }
+            break;
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+static void close_stage_fds(gs_inproc_stage *stage) {
+    if (stage->owns_in) {
+        close(stage->io.in_fd);
+        stage->owns_in = false;
+    }
+    if (stage->owns_out) {
+        close(stage->io.out_fd);
+        stage->owns_out = false;
+    }
+}
+
+/*
+ * Points the stage's io handle at its redirection targets rather than
+ * dup2-ing over the process descriptors. Replaced pipe ends are closed.
+ */
+static int bind_stage_redirs(gs_inproc_stage *stage) {
+    const gs_prepared_command *cmd = stage->cmd;
+    for (size_t i = 0; i < cmd->redir_count; ++i) {
+        int fd = open_redirection(stage->shell, &cmd->redirs[i]);
+        if (fd < 0) {
+            gs_builtin_err_printf("genshell: failed to open %s: %s\n", redirection_label(&cmd->redirs[i]),
+                                  strerror(errno));
+            return GS_ERR_EXEC;
+        }
+        if (cmd->redirs[i].fd == STDIN_FILENO) {
+            if (stage->owns_in) {
+                close(stage->io.in_fd);
+            }
+            stage->io.in_fd = fd;
+            stage->owns_in = true;
+        } else {
+            if (stage->owns_out) {
+                close(stage->io.out_fd);
+            }
+            stage->io.out_fd = fd;
+            stage->owns_out = true;
+        }
+    }
+    return GS_OK;
+}
+
+/*
+ * Runs the builtin against the stage's io handle. SIGPIPE is blocked for the
+ * duration so a closed reader surfaces as EPIPE instead of killing the shell;
+ * a pending SIGPIPE is consumed and reported as 128+SIGPIPE, matching what a
+ * forked stage would have returned.
+ */
+static void *run_inproc_stage(void *arg) {
+    gs_inproc_stage *stage = (gs_inproc_stage *)arg;
+    sigset_t pipe_set;
+    sigset_t old_set;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipe_set, &old_set);
+
+    const gs_builtin_io *outer = gs_builtin_io_bind(&stage->io);
+    int status = gs_builtin_invoke(stage->cmd->builtin, stage->shell, (int)stage->cmd->argc, stage->cmd->argv);
+    gs_builtin_io_bind(outer);
+    close_stage_fds(stage);
+    if (status < 0) {
+        status = 1;
+    }
+
+    sigset_t pending;
+    sigemptyset(&pending);
+    if (sigpending(&pending) == 0 && sigismember(&pending, SIGPIPE)) {
+        int sig = 0;
+        sigwait(&pipe_set, &sig);
+        status = 128 + SIGPIPE;
+    }
+    pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+
+    stage->status = status & 0xFF;
+    return NULL;
+}
+
+static int execute_inproc_builtin(struct gs_shell *shell, gs_prepared_command *cmd) {
+    gs_inproc_stage stage = {0};
+    stage.shell = shell;
+    stage.cmd = cmd;
+    stage.io.in_fd = shell->fds[STDIN_FILENO];
+    stage.io.out_fd = shell->fds[STDOUT_FILENO];
+    stage.io.err_fd = shell->fds[STDERR_FILENO];
+    if (bind_stage_redirs(&stage) != GS_OK) {
+        close_stage_fds(&stage);
+        return 1;
+    }
+    run_inproc_stage(&stage);
+    return stage.status;
+}
+
+/* Lets the command inherit the /dev/fd/N ends of its process substitutions. */
+static void keep_process_substitutions(const gs_prepared_command *cmd) {
+    for (size_t i = 0; i < cmd->procsub_count; ++i) {
+        fcntl(cmd->procsubs[i].fd, F_SETFD, 0);
+    }
+}
+
+/* Execs an external command in a child that has entered the process. */
+static void execute_child_external(struct gs_shell *shell, gs_prepared_command *cmd) {
+    int rc = apply_child_redirs(shell, cmd->redirs, cmd->redir_count);
     if (rc != GS_OK) {
         _exit(1);
     }
+    keep_process_substitutions(cmd);
     execvp(cmd->argv[0], cmd->argv);
     int code = (errno == ENOENT) ? 127 : 126;
-    fprintf(stderr, "genshell: %s: %s\n", cmd->argv[0], strerror(errno));
+    gs_builtin_err_printf("genshell: %s: %s\n", cmd->argv[0], strerror(errno));
     _exit(code);
 }
 
+/*
+ * Runs a grouped command in a process that is about to go away (a pipeline
+ * child, a forked subshell, or the shell itself at the end of -c), so its
+ * last command may be exec'd in place.
+ */
+static void execute_child_group(struct gs_shell *shell, gs_prepared_command *cmd) {
+    int rc = apply_child_redirs(shell, cmd->redirs, cmd->redir_count);
+    if (rc != GS_OK) {
+        _exit(1);
+    }
+    shell->snapshot = NULL;
+    gs_execute_list(shell, cmd->body, true);
+    int status = shell->exit_requested ? shell->exit_status : shell->last_status;
+    fflush(NULL);
+    _exit(status & 0xFF);
+}
+
+/* True for "cat", "cat -" fed only by a here-document or here-string. */
+static bool is_heredoc_cat(const gs_prepared_command *cmd) {
+    if (!cmd->builtin || strcmp(cmd->builtin->name, "cat") != 0 || cmd->redir_count != 1u ||
+        cmd->redirs[0].fd != STDIN_FILENO) {
+        return false;
+    }
+    if (cmd->argc > 2u || (cmd->argc == 2u && strcmp(cmd->argv[1], "-") != 0)) {
+        return false;
+    }
+    gs_redirection_type type = cmd->redirs[0].type;
+    return type == GS_REDIR_HEREDOC || type == GS_REDIR_HEREDOC_LITERAL || type == GS_REDIR_HERESTRING;
+}
+
+/*
+ * Produces the output of a pipeline head that only emits bytes as a readable
+ * descriptor, so the next stage can start with its input already complete:
+ * "cat <<EOF" hands over the here-document descriptor itself, and producer
+ * builtins (echo, pwd) are run by the parent into a memfd. Neither needs a
+ * child, a helper thread or a pipe, and no writer can block on a full pipe.
+ * Returns -1 when the head does not qualify.
+ */
+static int open_pipeline_head(struct gs_shell *shell, gs_prepared_command *cmd, int *out_status) {
+    *out_status = 0;
+    if (is_heredoc_cat(cmd)) {
+        return open_redirection(shell, &cmd->redirs[0]);
+    }
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    if (cmd->builtin && (cmd->builtin->flags & GS_BUILTIN_FLAG_PRODUCER) && cmd->redir_count == 0u) {
+        int mem_fd = memfd_create("genshell-pipeline", MFD_CLOEXEC);
+        if (mem_fd < 0) {
+            return -1;
+        }
+        gs_builtin_io io = {shell->fds[STDIN_FILENO], mem_fd, shell->fds[STDERR_FILENO]};
+        const gs_builtin_io *outer = gs_builtin_io_bind(&io);
+        int status = gs_builtin_invoke(cmd->builtin, shell, (int)cmd->argc, cmd->argv);
+        gs_builtin_io_bind(outer);
+        *out_status = status < 0 ? 1 : status & 0xFF;
+        (void)lseek(mem_fd, 0, SEEK_SET);
+        return mem_fd;
+    }
+#else
+    (void)shell;
+#endif
+    return -1;
+}
+
 static int execute_pipeline_processes(struct gs_shell *shell, gs_prepared_command *cmds, size_t count) {
     pid_t *pids = (pid_t *)calloc(count, sizeof(pid_t));
-    if (!pids) {
+    gs_inproc_stage *stages = (gs_inproc_stage *)calloc(count, sizeof(gs_inproc_stage));
+    int *held_fds = (int *)calloc(count * 2u, sizeof(int));
+    if (!pids || !stages || !held_fds) {
+        free(pids);
+        free(stages);
+        free(held_fds);
         return GS_ERR_ALLOC;
     }
+    size_t held_count = 0u;
     int prev_read = -1;
     int status_result = 0;
+    size_t launched = 0u;
+    size_t first = 0u;
 
-    for (size_t i = 0; i < count; ++i) {
+    if (count > 1u) {
+        int head_status = 0;
+        int head_fd = open_pipeline_head(shell, &cmds[0], &head_status);
+        if (head_fd >= 0) {
+            stages[0].cmd = &cmds[0];
+            stages[0].status = head_status;
+            prev_read = head_fd;
+            first = 1u;
+            launched = 1u;
+        }
+    }
+
+    /*
+     * Builtin stages are wired up here but their threads only start once every
+     * child has been forked: no fork happens while helper threads run, and the
+     * descriptors they own stay open (and are closed by each child) meanwhile.
+     */
+    for (size_t i = first; i < count; ++i) {
         int pipefd[2] = {-1, -1};
         if (i + 1 < count) {
-            if (pipe(pipefd) < 0) {
-                fprintf(stderr, "genshell: pipe failed: %s\n", strerror(errno));
+            if (gs_pipe_cloexec(pipefd) < 0) {
+                gs_builtin_err_printf("genshell: pipe failed: %s\n", strerror(errno));
                 if (prev_read >= 0) {
                     close(prev_read);
                     prev_read = -1;
@@ -508,9 +1471,35 @@ static int execute_pipeline_processes(struct gs_shell *shell, gs_prepared_comman
             }
         }
 
+        if (count > 1u && can_run_inproc(&cmds[i])) {
+            gs_inproc_stage *stage = &stages[i];
+            stage->shell = shell;
+            stage->cmd = &cmds[i];
+            stage->io.in_fd = prev_read >= 0 ? prev_read : shell->fds[STDIN_FILENO];
+            stage->owns_in = prev_read >= 0;
+            stage->io.out_fd = pipefd[1] >= 0 ? pipefd[1] : shell->fds[STDOUT_FILENO];
+            stage->io.err_fd = shell->fds[STDERR_FILENO];
+            stage->owns_out = pipefd[1] >= 0;
+            if (bind_stage_redirs(stage) != GS_OK) {
+                close_stage_fds(stage);
+                stage->status = 1;
+            } else {
+                if (stage->owns_in) {
+                    held_fds[held_count++] = stage->io.in_fd;
+                }
+                if (stage->owns_out) {
+                    held_fds[held_count++] = stage->io.out_fd;
+                }
+                stage->started = true;
+            }
+            prev_read = pipefd[0];
+            launched = i + 1u;
+            continue;
+        }
+
         pid_t pid = fork();
         if (pid < 0) {
-            fprintf(stderr, "genshell: fork failed: %s\n", strerror(errno));
+            gs_builtin_err_printf("genshell: fork failed: %s\n", strerror(errno));
             if (pipefd[0] >= 0) {
                 close(pipefd[0]);
                 close(pipefd[1]);
@@ -524,34 +1513,32 @@ static int execute_pipeline_processes(struct gs_shell *shell, gs_prepared_comman
         }
 
         if (pid == 0) {
-            if (prev_read >= 0 && dup2(prev_read, STDIN_FILENO) < 0) {
-                fprintf(stderr, "genshell: dup2 failed: %s\n", strerror(errno));
-                _exit(1);
-            }
-            if (pipefd[1] >= 0 && dup2(pipefd[1], STDOUT_FILENO) < 0) {
-                fprintf(stderr, "genshell: dup2 failed: %s\n", strerror(errno));
-                _exit(1);
-            }
-
             if (pipefd[0] >= 0) {
                 close(pipefd[0]);
             }
-            if (pipefd[1] >= 0) {
-                close(pipefd[1]);
+            for (size_t h = 0; h < held_count; ++h) {
+                close(held_fds[h]);
             }
             if (prev_read >= 0) {
-                close(prev_read);
+                shell->fds[STDIN_FILENO] = prev_read;
+            }
+            if (pipefd[1] >= 0) {
+                shell->fds[STDOUT_FILENO] = pipefd[1];
             }
+            gs_shell_enter_process(shell);
 
-            if (cmds[i].builtin) {
+            if (cmds[i].kind != GS_COMMAND_SIMPLE) {
+                execute_child_group(shell, &cmds[i]);
+            } else if (cmds[i].builtin) {
                 execute_child_builtin(shell, &cmds[i]);
             } else {
-                execute_child_external(&cmds[i]);
+                execute_child_external(shell, &cmds[i]);
             }
             _exit(1); /* should not reach */
         }
 
         pids[i] = pid;
+        launched = i + 1u;
 
         if (prev_read >= 0) {
             close(prev_read);
@@ -564,46 +1551,136 @@ static int execute_pipeline_processes(struct gs_shell *shell, gs_prepared_comman
 
     if (prev_read >= 0) {
         close(prev_read);
+        prev_read = -1;
     }
 
-    for (size_t i = 0; i < count; ++i) {
-        int wstatus = 0;
-        if (waitpid(pids[i], &wstatus, 0) < 0) {
-            status_result = GS_ERR_EXEC;
+cleanup:
+    /*
+     * Start helper threads from the tail of the pipeline so that, should
+     * thread creation fail, the inline fallback always has a running reader.
+     */
+    for (size_t i = launched; i > 0; --i) {
+        gs_inproc_stage *stage = &stages[i - 1u];
+        if (!stage->started) {
             continue;
         }
-        if (i == count - 1) {
+        if (status_result < 0) {
+            close_stage_fds(stage);
+            stage->started = false;
+            continue;
+        }
+        if (pthread_create(&stage->thread, NULL, run_inproc_stage, stage) != 0) {
+            stage->started = false;
+            run_inproc_stage(stage);
+        }
+    }
+
+    for (size_t i = 0; i < launched; ++i) {
+        int stage_status = 0;
+        if (stages[i].cmd) {
+            if (stages[i].started) {
+                pthread_join(stages[i].thread, NULL);
+            }
+            stage_status = stages[i].status;
+        } else {
+            int wstatus = 0;
+            if (waitpid(pids[i], &wstatus, 0) < 0) {
+                status_result = GS_ERR_EXEC;
+                continue;
+            }
             if (WIFEXITED(wstatus)) {
-                status_result = WEXITSTATUS(wstatus);
+                stage_status = WEXITSTATUS(wstatus);
             } else if (WIFSIGNALED(wstatus)) {
-                status_result = 128 + WTERMSIG(wstatus);
+                stage_status = 128 + WTERMSIG(wstatus);
             }
         }
+        if (i == count - 1 && status_result >= 0) {
+            status_result = stage_status;
+        }
     }
 
-cleanup:
     free(pids);
+    free(stages);
+    free(held_fds);
     return status_result;
 }
 
-static int execute_redir_only(gs_prepared_command *cmd) {
-    saved_descriptor *saved = NULL;
+static int execute_redir_only(struct gs_shell *shell, gs_prepared_command *cmd) {
+    saved_slot *saved = NULL;
     size_t saved_len = 0u;
-    int rc = apply_parent_redirs(cmd->redirs, cmd->redir_count, &saved, &saved_len);
-    restore_parent_redirs(saved, saved_len);
+    int rc = apply_parent_redirs(shell, cmd->redirs, cmd->redir_count, &saved, &saved_len);
+    restore_parent_redirs(shell, saved, saved_len);
     if (rc != GS_OK) {
         return 1;
     }
     return 0;
 }
 
-int gs_execute_pipeline(struct gs_shell *shell, const gs_pipeline *pipeline) {
+/*
+ * Runs a single "{ ...; }" or "( ... )". Brace groups run in the shell with
+ * their redirections applied around the body. A subshell made only of
+ * builtins runs here too, under a snapshot that undoes its state changes;
+ * one at the very end of the input needs no isolation and takes over the
+ * process. Anything else is forked.
+ */
+static int execute_group(struct gs_shell *shell, gs_prepared_command *cmd, bool exec_last) {
+    bool isolate = cmd->kind == GS_COMMAND_SUBSHELL;
+    if (isolate && !list_is_builtin_only(cmd->body)) {
+        if (exec_last) {
+            fflush(NULL);
+            gs_shell_enter_process(shell);
+            execute_child_group(shell, cmd);
+        }
+        fflush(NULL);
+        pid_t pid = fork();
+        if (pid < 0) {
+            gs_builtin_err_printf("genshell: fork failed: %s\n", strerror(errno));
+            return 1;
+        }
+        if (pid == 0) {
+            gs_shell_enter_process(shell);
+            execute_child_group(shell, cmd);
+        }
+        int wstatus = 0;
+        while (waitpid(pid, &wstatus, 0) < 0) {
+            if (errno != EINTR) {
+                return 1;
+            }
+        }
+        if (WIFSIGNALED(wstatus)) {
+            return 128 + WTERMSIG(wstatus);
+        }
+        return WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 1;
+    }
+
+    saved_slot *saved = NULL;
+    size_t saved_len = 0u;
+    int rc = apply_parent_redirs(shell, cmd->redirs, cmd->redir_count, &saved, &saved_len);
+    if (rc != GS_OK) {
+        return 1;
+    }
+
+    int status;
+    if (isolate) {
+        struct gs_shell_snapshot snapshot;
+        gs_shell_snapshot_begin(shell, &snapshot);
+        gs_execute_list(shell, cmd->body, false);
+        status = gs_shell_snapshot_restore(shell, &snapshot);
+    } else {
+        gs_execute_list(shell, cmd->body, exec_last);
+        status = shell->last_status;
+    }
+    restore_parent_redirs(shell, saved, saved_len);
+    return status;
+}
+
+static int execute_pipeline(struct gs_shell *shell, const gs_pipeline *pipeline, bool exec_last) {
     if (!pipeline || pipeline->length == 0u) {
         return GS_OK;
     }
 
     if (pipeline->background) {
-        fprintf(stderr, "genshell: background jobs are not implemented yet\n");
+        gs_builtin_err_printf("genshell: background jobs are not implemented yet\n");
         shell->last_status = 1;
         return GS_ERR_UNIMPLEMENTED;
     }
@@ -623,13 +1700,22 @@ int gs_execute_pipeline(struct gs_shell *shell, const gs_pipeline *pipeline) {
 
     int status = 0;
 
-    if (pipeline->length == 1u && prepared[0].argc == 0u && prepared[0].redir_count > 0u) {
-        status = execute_redir_only(&prepared[0]);
+    if (pipeline->length == 1u && prepared[0].kind != GS_COMMAND_SIMPLE) {
+        status = execute_group(shell, &prepared[0], exec_last);
+    } else if (pipeline->length == 1u && prepared[0].argc == 0u && prepared[0].redir_count > 0u) {
+        status = execute_redir_only(shell, &prepared[0]);
+    } else if (pipeline->length == 1u && can_run_inproc(&prepared[0])) {
+        status = execute_inproc_builtin(shell, &prepared[0]);
     } else if (pipeline->length == 1u && prepared[0].builtin && (prepared[0].builtin->flags & GS_BUILTIN_FLAG_PARENT)) {
         status = execute_parent_builtin(shell, &prepared[0]);
         if (status < 0) {
             status = 1;
         }
+    } else if (exec_last && pipeline->length == 1u && !prepared[0].builtin && prepared[0].procsub_count == 0u) {
+        /* Last command of a -c string or script: the fork would buy nothing. */
+        fflush(NULL);
+        gs_shell_enter_process(shell);
+        execute_child_external(shell, &prepared[0]);
     } else {
         status = execute_pipeline_processes(shell, prepared, pipeline->length);
         if (status < 0) {
@@ -648,3 +1734,21 @@ done:
     free(prepared);
     return rc;
 }
+
+int gs_execute_list(struct gs_shell *shell, const gs_command_list *list, bool exec_last) {
+    gs_builtin_io io;
+    const gs_builtin_io *outer = bind_shell_io(shell, &io);
+    int rc = GS_OK;
+    for (size_t i = 0; list && i < list->length && !shell->exit_requested; ++i) {
+        const gs_pipeline *pipeline = &list->pipelines[i];
+        if (pipeline->connector == GS_CONNECT_AND && shell->last_status != 0) {
+            continue;
+        }
+        if (pipeline->connector == GS_CONNECT_OR && shell->last_status == 0) {
+            continue;
+        }
+        rc = execute_pipeline(shell, pipeline, exec_last && i + 1u == list->length);
+    }
+    gs_builtin_io_bind(outer);
+    return rc;
+}
@@ -1,9 +1,15 @@
 #ifndef GS_EXECUTOR_H
 #define GS_EXECUTOR_H
 
+#include <stdbool.h>
+
 #include "../parser/ast.h"
 #include "../shell.h"
 
-int gs_execute_pipeline(struct gs_shell *shell, const gs_pipeline *pipeline);
+/*
+ * Runs a parsed command list. With exec_last set, the caller promises nothing
+ * follows the list, so its final external command may replace the process.
+ */
+int gs_execute_list(struct gs_shell *shell, const gs_command_list *list, bool exec_last);
 
 #endif /* GS_EXECUTOR_H */
@@ -0,0 +1,818 @@
+/*
+ * Pathname expansion ("*", "?", "[...]").
+ *
+ * A pattern is split at '/' and each component is compiled once into
+ * tokens (literal runs, any-character, star and 256-bit character classes)
+ * before any directory is read. Components without pattern characters are
+ * appended to the candidate paths as they are; the others are matched
+ * against directory listings. Listings are read with large getdents64(2)
+ * batches on Linux (readdir elsewhere) and keep each entry's d_type, so only
+ * entries of unknown type or symbolic links that must be directories are
+ * stat(2)ed. Recently read listings are kept in a small LRU cache keyed by
+ * device and inode and reused while the directory's mtime is unchanged and
+ * older than the listing, which turns a repeated glob over a directory of
+ * 100k artifacts into one stat and a match pass (GENSHELL_GLOB_CACHE=0
+ * bypasses the cache). Relative patterns are resolved
+ * against the expanding shell's directory descriptor. The cache is shared by
+ * every shell in the process: it is guarded by a mutex, and listings are
+ * reference counted so one shell can keep matching against a listing that
+ * another has just evicted.
+ */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "glob.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#include "../shell.h"
+
+#define GLOB_DENTS_BUFFER (256u * 1024u)
+#define GLOB_CACHE_SLOTS 16u
+#define GLOB_CACHE_MAX_BYTES (16u * 1024u * 1024u) /* larger listings are not kept */
+
+typedef enum { GLOB_LITERAL, GLOB_ANY, GLOB_STAR, GLOB_CLASS } glob_token_kind;
+
+typedef struct {
+    glob_token_kind kind;
+    uint32_t offset; /* literal text in the matcher's text buffer */
+    uint32_t len;
+    uint8_t set[32]; /* GLOB_CLASS: bit per byte value */
+} glob_token;
+
+/* One compiled path component. */
+typedef struct {
+    glob_token *tokens;
+    size_t count;
+    char *text; /* unescaped literal runs; for a literal component, the whole name */
+    size_t text_len;
+    size_t min_len; /* bytes any match needs */
+    bool magic;
+    bool dot_literal; /* starts with a literal '.', so it may match dotfiles */
+} glob_matcher;
+
+typedef struct {
+    uint32_t name; /* offset in the listing's name buffer */
+    uint32_t len;
+    unsigned char type; /* DT_* from the directory entry */
+} glob_dirent;
+
+typedef struct {
+    char *names;
+    size_t names_len;
+    size_t names_cap;
+    glob_dirent *entries;
+    size_t count;
+    size_t capacity;
+    /* cache bookkeeping */
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    uint64_t last_used;
+    unsigned refs; /* the cache's and every expansion's; guarded by g_cache_lock */
+} glob_listing;
+
+typedef struct {
+    char **items;
+    size_t count;
+    size_t capacity;
+} glob_paths;
+
+/* Where relative paths start, and whether listings may go into the cache. */
+typedef struct {
+    int dir_fd;
+    bool use_cache;
+} glob_context;
+
+static pthread_mutex_t g_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_atfork_once = PTHREAD_ONCE_INIT;
+static glob_listing *g_cache[GLOB_CACHE_SLOTS];
+static uint64_t g_cache_clock;
+
+/* The lock is held across fork so that a child never inherits it locked. */
+static void lock_before_fork(void) {
+    pthread_mutex_lock(&g_cache_lock);
+}
+
+static void unlock_after_fork(void) {
+    pthread_mutex_unlock(&g_cache_lock);
+}
+
+static void register_atfork(void) {
+    pthread_atfork(lock_before_fork, unlock_after_fork, unlock_after_fork);
+}
+
+static void cache_lock(void) {
+    pthread_once(&g_atfork_once, register_atfork);
+    pthread_mutex_lock(&g_cache_lock);
+}
+
+static void set_bit(uint8_t *set, unsigned char c) {
+    set[c >> 3] |= (uint8_t)(1u << (c & 7u));
+}
+
+static bool test_bit(const uint8_t *set, unsigned char c) {
+    return (set[c >> 3] & (1u << (c & 7u))) != 0u;
+}
+
+static void matcher_dispose(glob_matcher *m) {
+    free(m->tokens);
+    free(m->text);
+    memset(m, 0, sizeof(*m));
+}
+
+static glob_token *push_token(glob_matcher *m, glob_token_kind kind) {
+    glob_token *token = &m->tokens[m->count++];
+    memset(token, 0, sizeof(*token));
+    token->kind = kind;
+    return token;
+}
+
+static void push_literal(glob_matcher *m, char c) {
+    glob_token *last = m->count > 0u ? &m->tokens[m->count - 1u] : NULL;
+    if (!last || last->kind != GLOB_LITERAL) {
+        last = push_token(m, GLOB_LITERAL);
+        last->offset = (uint32_t)m->text_len;
+    }
+    m->text[m->text_len++] = c;
+    last->len++;
+    m->min_len++;
+}
+
+static bool class_name_matches(const char *name, size_t len, int c) {
+    static const struct {
+        const char *name;
+        int (*test)(int);
+    } k_classes[] = {
+        {"alnum", isalnum}, {"alpha", isalpha}, {"blank", isblank}, {"cntrl", iscntrl},
+        {"digit", isdigit}, {"graph", isgraph}, {"lower", islower}, {"print", isprint},
+        {"punct", ispunct}, {"space", isspace}, {"upper", isupper}, {"xdigit", isxdigit},
+    };
+    for (size_t i = 0; i < sizeof(k_classes) / sizeof(k_classes[0]); ++i) {
+        if (strlen(k_classes[i].name) == len && memcmp(k_classes[i].name, name, len) == 0) {
+            return k_classes[i].test(c) != 0;
+        }
+    }
+    return false;
+}
+
+/* Reads one (possibly escaped) bracket character at s[*j]. */
+static unsigned char bracket_char(const char *s, size_t n, size_t *j) {
+    if (s[*j] == '\\' && *j + 1u < n) {
+        *j += 2u;
+        return (unsigned char)s[*j - 1u];
+    }
+    return (unsigned char)s[(*j)++];
+}
+
+/*
+ * Compiles the bracket expression starting at s[i] == '[' into set. Returns
+ * the index just past the closing ']', or 0 when there is none and the '['
+ * is an ordinary character.
+ */
+static size_t compile_bracket(const char *s, size_t n, size_t i, uint8_t *set) {
+    size_t j = i + 1u;
+    bool negate = false;
+    if (j < n && (s[j] == '!' || s[j] == '^')) {
+        negate = true;
+        ++j;
+    }
+    bool first = true;
+    while (j < n) {
+        if (s[j] == ']' && !first) {
+            if (negate) {
+                for (size_t b = 0; b < 32u; ++b) {
+                    set[b] = (uint8_t)~set[b];
+                }
+            }
+            return j + 1u;
+        }
+        first = false;
+        if (s[j] == '[' && j + 1u < n && s[j + 1u] == ':') {
+            const char *end = NULL;
+            for (size_t k = j + 2u; k + 1u < n; ++k) {
+                if (s[k] == ':' && s[k + 1u] == ']') {
+                    end = s + k;
+                    break;
+                }
+            }
+            if (end) {
+                const char *name = s + j + 2u;
+                size_t len = (size_t)(end - name);
+                for (int c = 1; c < 256; ++c) {
+                    if (class_name_matches(name, len, c)) {
+                        set_bit(set, (unsigned char)c);
+                    }
+                }
+                j = (size_t)(end - s) + 2u;
+                continue;
+            }
+        }
+        unsigned char lo = bracket_char(s, n, &j);
+        if (j + 1u < n && s[j] == '-' && s[j + 1u] != ']') {
+            ++j;
+            unsigned char hi = bracket_char(s, n, &j);
+            for (unsigned c = lo; c <= hi; ++c) {
+                set_bit(set, (unsigned char)c);
+            }
+        } else {
+            set_bit(set, lo);
+        }
+    }
+    return 0u;
+}
+
+static int matcher_compile(const char *s, size_t n, glob_matcher *m) {
+    memset(m, 0, sizeof(*m));
+    m->tokens = (glob_token *)malloc((n + 1u) * sizeof(glob_token));
+    m->text = (char *)malloc(n + 1u);
+    if (!m->tokens || !m->text) {
+        matcher_dispose(m);
+        return GS_ERR_ALLOC;
+    }
+    size_t i = 0u;
+    while (i < n) {
+        char c = s[i];
+        if (c == '\\' && i + 1u < n) {
+            push_literal(m, s[i + 1u]);
+            i += 2u;
+        } else if (c == '*') {
+            if (m->count == 0u || m->tokens[m->count - 1u].kind != GLOB_STAR) {
+                push_token(m, GLOB_STAR);
+            }
+            m->magic = true;
+            ++i;
+        } else if (c == '?') {
+            push_token(m, GLOB_ANY);
+            m->min_len++;
+            m->magic = true;
+            ++i;
+        } else if (c == '[') {
+            uint8_t set[32] = {0};
+            size_t end = compile_bracket(s, n, i, set);
+            if (end == 0u) {
+                push_literal(m, c);
+                ++i;
+                continue;
+            }
+            glob_token *token = push_token(m, GLOB_CLASS);
+            memcpy(token->set, set, sizeof(set));
+            m->min_len++;
+            m->magic = true;
+            i = end;
+        } else {
+            push_literal(m, c);
+            ++i;
+        }
+    }
+    m->text[m->text_len] = '\0';
+    m->dot_literal = m->count > 0u && m->tokens[0].kind == GLOB_LITERAL && m->text[m->tokens[0].offset] == '.';
+    return GS_OK;
+}
+
+/* Returns the first occurrence of needle in hay[0..len), or NULL. */
+static const char *find_literal(const char *hay, size_t len, const char *needle, size_t needle_len) {
+    const char *end = hay + len;
+    while ((size_t)(end - hay) >= needle_len) {
+        const char *hit = (const char *)memchr(hay, needle[0], (size_t)(end - hay) - needle_len + 1u);
+        if (!hit) {
+            return NULL;
+        }
+        if (memcmp(hit, needle, needle_len) == 0) {
+            return hit;
+        }
+        hay = hit + 1;
+    }
+    return NULL;
+}
+
+/*
+ * Places the text a star absorbs to end just before the next occurrence of
+ * the literal that follows it (at or after *ni). Returns false when there is
+ * none, in which case no longer star can help either.
+ */
+static bool advance_star(const glob_matcher *m, size_t star_ti, const char *name, size_t len, size_t *ni) {
+    if (star_ti + 1u >= m->count || m->tokens[star_ti + 1u].kind != GLOB_LITERAL) {
+        return true;
+    }
+    const glob_token *lit = &m->tokens[star_ti + 1u];
+    const char *hit = find_literal(name + *ni, len - *ni, m->text + lit->offset, lit->len);
+    if (!hit) {
+        return false;
+    }
+    *ni = (size_t)(hit - name);
+    return true;
+}
+
+/* Token matching with backtracking to the most recent star. */
+static bool matcher_match(const glob_matcher *m, const char *name, size_t len) {
+    if (len < m->min_len) {
+        return false;
+    }
+    const glob_token *last = m->count > 0u ? &m->tokens[m->count - 1u] : NULL;
+    if (last && last->kind == GLOB_LITERAL && memcmp(name + len - last->len, m->text + last->offset, last->len) != 0) {
+        return false; /* cheap rejection on the fixed suffix */
+    }
+    size_t ti = 0u;
+    size_t ni = 0u;
+    size_t star_ti = SIZE_MAX;
+    size_t star_ni = 0u;
+    while (ti < m->count || ni < len) {
+        if (ti < m->count) {
+            const glob_token *token = &m->tokens[ti];
+            switch (token->kind) {
+            case GLOB_STAR:
+                star_ti = ti++;
+                if (!advance_star(m, star_ti, name, len, &ni)) {
+                    return false;
+                }
+                star_ni = ni;
+                continue;
+            case GLOB_ANY:
+                if (ni < len) {
+                    ++ti;
+                    ++ni;
+                    continue;
+                }
+                break;
+            case GLOB_CLASS:
+                if (ni < len && test_bit(token->set, (unsigned char)name[ni])) {
+                    ++ti;
+                    ++ni;
+                    continue;
+                }
+                break;
+            case GLOB_LITERAL:
+                if (len - ni >= token->len && memcmp(name + ni, m->text + token->offset, token->len) == 0) {
+                    ++ti;
+                    ni += token->len;
+                    continue;
+                }
+                break;
+            }
+        }
+        if (star_ti != SIZE_MAX && star_ni < len) {
+            ni = star_ni + 1u;
+            if (!advance_star(m, star_ti, name, len, &ni)) {
+                return false;
+            }
+            star_ni = ni;
+            ti = star_ti + 1u;
+            continue;
+        }
+        return false;
+    }
+    return true;
+}
+
+static void listing_free(glob_listing *listing) {
+    if (listing) {
+        free(listing->names);
+        free(listing->entries);
+        free(listing);
+    }
+}
+
+/* Drops one reference to a cached listing; called with g_cache_lock held. */
+static void listing_unref_locked(glob_listing *listing) {
+    if (listing && --listing->refs == 0u) {
+        listing_free(listing);
+    }
+}
+
+static void listing_release(glob_listing *listing) {
+    cache_lock();
+    listing_unref_locked(listing);
+    pthread_mutex_unlock(&g_cache_lock);
+}
+
+static int listing_add(glob_listing *listing, const char *name, size_t len, unsigned char type) {
+    if ((name[0] == '.' && (len == 1u || (len == 2u && name[1] == '.'))) || len > UINT32_MAX) {
+        return GS_OK;
+    }
+    if (listing->count == listing->capacity) {
+        size_t new_cap = listing->capacity ? listing->capacity * 2u : 64u;
+        glob_dirent *tmp = (glob_dirent *)realloc(listing->entries, new_cap * sizeof(glob_dirent));
+        if (!tmp) {
+            return GS_ERR_ALLOC;
+        }
+        listing->entries = tmp;
+        listing->capacity = new_cap;
+    }
+    if (listing->names_len + len + 1u > listing->names_cap) {
+        size_t new_cap = listing->names_cap ? listing->names_cap : 1024u;
+        while (new_cap < listing->names_len + len + 1u) {
+            new_cap *= 2u;
+        }
+        if (new_cap > UINT32_MAX) {
+            return GS_ERR_ALLOC;
+        }
+        char *tmp = (char *)realloc(listing->names, new_cap);
+        if (!tmp) {
+            return GS_ERR_ALLOC;
+        }
+        listing->names = tmp;
+        listing->names_cap = new_cap;
+    }
+    glob_dirent *entry = &listing->entries[listing->count++];
+    entry->name = (uint32_t)listing->names_len;
+    entry->len = (uint32_t)len;
+    entry->type = type;
+    memcpy(listing->names + listing->names_len, name, len + 1u);
+    listing->names_len += len + 1u;
+    return GS_OK;
+}
+
+#if defined(__linux__) && defined(SYS_getdents64)
+struct glob_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/* Reads every entry of the directory open on fd, then closes fd. */
+static int read_entries(int fd, glob_listing *listing) {
+    char *buffer = (char *)malloc(GLOB_DENTS_BUFFER);
+    if (!buffer) {
+        close(fd);
+        return GS_ERR_ALLOC;
+    }
+    int rc = GS_OK;
+    for (;;) {
+        long n = syscall(SYS_getdents64, fd, buffer, GLOB_DENTS_BUFFER);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            rc = n == 0 ? GS_OK : GS_ERR_EXEC;
+            break;
+        }
+        for (long off = 0; off < n && rc == GS_OK;) {
+            const struct glob_dirent64 *d = (const struct glob_dirent64 *)(buffer + off);
+            rc = listing_add(listing, d->d_name, strlen(d->d_name), d->d_type);
+            off += d->d_reclen;
+        }
+        if (rc != GS_OK) {
+            break;
+        }
+    }
+    free(buffer);
+    close(fd);
+    return rc;
+}
+#else
+static int read_entries(int fd, glob_listing *listing) {
+    DIR *dir = fdopendir(fd);
+    if (!dir) {
+        close(fd);
+        return GS_ERR_EXEC;
+    }
+    int rc = GS_OK;
+    struct dirent *d;
+    while (rc == GS_OK && (d = readdir(dir)) != NULL) {
+        rc = listing_add(listing, d->d_name, strlen(d->d_name), d->d_type);
+    }
+    closedir(dir); /* closes fd too */
+    return rc;
+}
+#endif
+
+static const struct timespec *dir_mtime(const struct stat *st) {
+#if defined(__APPLE__)
+    return &st->st_mtimespec;
+#else
+    return &st->st_mtim;
+#endif
+}
+
+/*
+ * A cached listing can be trusted only if the directory changed strictly
+ * before the second it was read in; otherwise an entry created later in
+ * that same timestamp tick would go unnoticed. A listing found is returned
+ * with a reference the caller releases.
+ */
+static glob_listing *cache_find(const struct stat *st) {
+    glob_listing *found = NULL;
+    cache_lock();
+    for (size_t i = 0; i < GLOB_CACHE_SLOTS; ++i) {
+        glob_listing *listing = g_cache[i];
+        if (!listing || listing->dev != st->st_dev || listing->ino != st->st_ino) {
+            continue;
+        }
+        const struct timespec *mtime = dir_mtime(st);
+        if (listing->mtime.tv_sec != mtime->tv_sec || listing->mtime.tv_nsec != mtime->tv_nsec) {
+            listing_unref_locked(listing);
+            g_cache[i] = NULL;
+            break;
+        }
+        listing->last_used = ++g_cache_clock;
+        listing->refs++;
+        found = listing;
+        break;
+    }
+    pthread_mutex_unlock(&g_cache_lock);
+    return found;
+}
+
+/* Returns whether the cache took a reference to listing, which the caller holds. */
+static bool cache_store(glob_listing *listing, const struct stat *st, time_t read_at) {
+    size_t bytes = listing->names_len + listing->count * sizeof(glob_dirent);
+    if (dir_mtime(st)->tv_sec >= read_at || bytes > GLOB_CACHE_MAX_BYTES) {
+        return false;
+    }
+    cache_lock();
+    size_t victim = 0u;
+    for (size_t i = 0; i < GLOB_CACHE_SLOTS; ++i) {
+        if (!g_cache[i]) {
+            victim = i;
+            break;
+        }
+        if (g_cache[i]->last_used < g_cache[victim]->last_used) {
+            victim = i;
+        }
+    }
+    listing_unref_locked(g_cache[victim]);
+    listing->dev = st->st_dev;
+    listing->ino = st->st_ino;
+    listing->mtime = *dir_mtime(st);
+    listing->last_used = ++g_cache_clock;
+    listing->refs = 2u;
+    g_cache[victim] = listing;
+    pthread_mutex_unlock(&g_cache_lock);
+    return true;
+}
+
+/*
+ * Returns the listing of dir (cached or freshly read) and sets *shared when
+ * it is a cached one to release with listing_release rather than free. NULL
+ * means the directory cannot be read.
+ */
+static glob_listing *list_directory(const glob_context *ctx, const char *dir, bool *shared, int *rc) {
+    *shared = false;
+    *rc = GS_OK;
+    int fd = openat(ctx->dir_fd, dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return NULL;
+    }
+    glob_listing *listing = ctx->use_cache ? cache_find(&st) : NULL;
+    if (listing) {
+        close(fd);
+        *shared = true;
+        return listing;
+    }
+    listing = (glob_listing *)calloc(1u, sizeof(glob_listing));
+    if (!listing) {
+        close(fd);
+        *rc = GS_ERR_ALLOC;
+        return NULL;
+    }
+    time_t read_at = time(NULL);
+    int read_rc = read_entries(fd, listing);
+    if (read_rc != GS_OK) {
+        listing_free(listing);
+        *rc = read_rc == GS_ERR_ALLOC ? GS_ERR_ALLOC : GS_OK;
+        return NULL;
+    }
+    *shared = ctx->use_cache && cache_store(listing, &st, read_at);
+    return listing;
+}
+
+static int paths_push(glob_paths *paths, char *path) {
+    if (!path) {
+        return GS_ERR_ALLOC;
+    }
+    if (paths->count == paths->capacity) {
+        size_t new_cap = paths->capacity ? paths->capacity * 2u : 16u;
+        char **tmp = (char **)realloc(paths->items, new_cap * sizeof(char *));
+        if (!tmp) {
+            free(path);
+            return GS_ERR_ALLOC;
+        }
+        paths->items = tmp;
+        paths->capacity = new_cap;
+    }
+    paths->items[paths->count++] = path;
+    return GS_OK;
+}
+
+static char *join(const char *prefix, const char *name, size_t name_len, bool slash) {
+    size_t prefix_len = strlen(prefix);
+    char *out = (char *)malloc(prefix_len + name_len + 2u);
+    if (out) {
+        memcpy(out, prefix, prefix_len);
+        memcpy(out + prefix_len, name, name_len);
+        if (slash) {
+            out[prefix_len + name_len++] = '/';
+        }
+        out[prefix_len + name_len] = '\0';
+    }
+    return out;
+}
+
+static bool is_directory(const glob_context *ctx, const char *path, unsigned char type) {
+    if (type == DT_DIR) {
+        return true;
+    }
+    if (type != DT_UNKNOWN && type != DT_LNK) {
+        return false;
+    }
+    struct stat st;
+    return fstatat(ctx->dir_fd, path, &st, 0) == 0 && S_ISDIR(st.st_mode);
+}
+
+/*
+ * Extends every prefix (empty, or ending in '/') by the entries of that
+ * directory matching m. When dir_only, matches must be directories and keep
+ * a trailing '/'.
+ */
+static int expand_component(const glob_context *ctx, const glob_paths *prefixes, const glob_matcher *m, bool dir_only,
+                            glob_paths *out) {
+    for (size_t p = 0; p < prefixes->count; ++p) {
+        const char *prefix = prefixes->items[p];
+        bool shared = false;
+        int rc = GS_OK;
+        glob_listing *listing = list_directory(ctx, prefix[0] ? prefix : ".", &shared, &rc);
+        if (!listing) {
+            if (rc != GS_OK) {
+                return rc;
+            }
+            continue;
+        }
+        for (size_t i = 0; i < listing->count && rc == GS_OK; ++i) {
+            const glob_dirent *entry = &listing->entries[i];
+            const char *name = listing->names + entry->name;
+            if ((name[0] == '.' && !m->dot_literal) || !matcher_match(m, name, entry->len)) {
+                continue;
+            }
+            char *path = join(prefix, name, entry->len, dir_only);
+            if (path && dir_only && !is_directory(ctx, path, entry->type)) {
+                free(path);
+                continue;
+            }
+            rc = paths_push(out, path);
+        }
+        if (shared) {
+            listing_release(listing);
+        } else {
+            listing_free(listing);
+        }
+        if (rc != GS_OK) {
+            return rc;
+        }
+    }
+    return GS_OK;
+}
+
+static void paths_dispose(glob_paths *paths) {
+    gs_glob_free(paths->items, paths->count);
+    memset(paths, 0, sizeof(*paths));
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Splits pattern at '/' into compiled components, noting whether any is a pattern. */
+static int compile_components(const char *pattern, glob_matcher **out, size_t *out_count, bool *magic) {
+    size_t capacity = 1u;
+    for (const char *p = pattern; *p; ++p) {
+        capacity += *p == '/';
+    }
+    glob_matcher *matchers = (glob_matcher *)calloc(capacity, sizeof(glob_matcher));
+    if (!matchers) {
+        return GS_ERR_ALLOC;
+    }
+    size_t count = 0u;
+    *magic = false;
+    for (const char *p = pattern; *p;) {
+        const char *end = strchr(p, '/');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        if (len > 0u) {
+            if (matcher_compile(p, len, &matchers[count]) != GS_OK) {
+                while (count > 0u) {
+                    matcher_dispose(&matchers[--count]);
+                }
+                free(matchers);
+                return GS_ERR_ALLOC;
+            }
+            *magic = *magic || matchers[count].magic;
+            ++count;
+        }
+        p += len;
+        while (*p == '/') {
+            ++p;
+        }
+    }
+    *out = matchers;
+    *out_count = count;
+    return GS_OK;
+}
+
+int gs_glob_expand(int dir_fd, bool use_cache, const char *pattern, char ***out_paths, size_t *out_count) {
+    const glob_context ctx = {dir_fd, use_cache};
+    *out_paths = NULL;
+    *out_count = 0u;
+    glob_matcher *matchers = NULL;
+    size_t count = 0u;
+    bool magic = false;
+    int rc = compile_components(pattern, &matchers, &count, &magic);
+    if (rc != GS_OK || !magic) {
+        for (size_t i = 0; i < count; ++i) {
+            matcher_dispose(&matchers[i]);
+        }
+        free(matchers);
+        return rc;
+    }
+
+    size_t pattern_len = strlen(pattern);
+    bool trailing_slash = pattern_len > 0u && pattern[pattern_len - 1u] == '/';
+    glob_paths current = {0};
+    rc = paths_push(&current, strdup(pattern[0] == '/' ? "/" : ""));
+    for (size_t c = 0; c < count && rc == GS_OK && current.count > 0u; ++c) {
+        const glob_matcher *m = &matchers[c];
+        bool last = c + 1u == count;
+        glob_paths next = {0};
+        if (m->magic) {
+            rc = expand_component(&ctx, &current, m, !last || trailing_slash, &next);
+        } else {
+            /* Literal components are checked by the next directory read, or by lstat at the end. */
+            for (size_t p = 0; p < current.count && rc == GS_OK; ++p) {
+                char *path = join(current.items[p], m->text, m->text_len, !last || trailing_slash);
+                struct stat st;
+                if (path && last && fstatat(dir_fd, path, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                    free(path);
+                    continue;
+                }
+                rc = paths_push(&next, path);
+            }
+        }
+        paths_dispose(&current);
+        current = next;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        matcher_dispose(&matchers[i]);
+    }
+    free(matchers);
+    if (rc != GS_OK) {
+        paths_dispose(&current);
+        return rc;
+    }
+    if (current.count == 0u) {
+        free(current.items);
+        return GS_OK;
+    }
+    qsort(current.items, current.count, sizeof(char *), compare_paths);
+    *out_paths = current.items;
+    *out_count = current.count;
+    return GS_OK;
+}
+
+void gs_glob_free(char **paths, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        free(paths[i]);
+    }
+    free(paths);
+}
+
+int gs_glob_list(int dir_fd, bool use_cache, const char *dir,
+                 void (*visit)(const char *name, size_t len, unsigned char type, void *ctx), void *ctx) {
+    const glob_context context = {dir_fd, use_cache};
+    bool shared = false;
+    int rc = GS_OK;
+    glob_listing *listing = list_directory(&context, dir, &shared, &rc);
+    if (!listing) {
+        return rc != GS_OK ? rc : GS_ERR_EXEC;
+    }
+    for (size_t i = 0; i < listing->count; ++i) {
+        const glob_dirent *entry = &listing->entries[i];
+        visit(listing->names + entry->name, entry->len, entry->type, ctx);
+    }
+    if (shared) {
+        listing_release(listing);
+    } else {
+        listing_free(listing);
+    }
+    return GS_OK;
+}
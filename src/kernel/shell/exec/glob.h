@@ -0,0 +1,29 @@
+#ifndef GS_GLOB_H
+#define GS_GLOB_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Pathname expansion of one word. pattern is the expanded word in which
+ * every '*', '?', '[' and '\' that must match literally (because it was
+ * quoted or produced by an expansion) is preceded by a backslash. On GS_OK
+ * *out_paths holds the sorted matches, or is NULL with *out_count 0 when the
+ * word has no pattern characters or matches nothing, in which case the
+ * caller keeps the word as it is. Relative patterns are resolved against
+ * dir_fd (AT_FDCWD for the process directory); use_cache false bypasses the
+ * listing cache. Release matches with gs_glob_free.
+ */
+int gs_glob_expand(int dir_fd, bool use_cache, const char *pattern, char ***out_paths, size_t *out_count);
+void gs_glob_free(char **paths, size_t count);
+
+/*
+ * Calls visit for every entry of directory dir (relative to dir_fd) except
+ * "." and "..", with its DT_* type (DT_UNKNOWN when the file system has
+ * none), reading it the way expansion does. Returns GS_OK, GS_ERR_EXEC when
+ * the directory cannot be read, or GS_ERR_ALLOC.
+ */
+int gs_glob_list(int dir_fd, bool use_cache, const char *dir,
+                 void (*visit)(const char *name, size_t len, unsigned char type, void *ctx), void *ctx);
+
+#endif /* GS_GLOB_H */
@@ -0,0 +1,883 @@
+/*
+ * Frecency database for cd and z.
+ *
+ * File layout (native byte order, every section 8-byte aligned):
+ *
+ *   header    magic, section offsets and counts
+ *   entries   one fz_entry per directory, sorted by path bytes
+ *   suffixes  (entry, start) pairs, one per position in each entry's final
+ *             component, sorted case-insensitively by path[start..]
+ *   strings   the paths the entries point at
+ *   log       fz_record visits and forgets appended since the last compaction
+ *
+ * A visit takes an exclusive flock(2), appends one record with pwrite(2) and
+ * returns; once the log outgrows FZ_LOG_LIMIT the writer folds it into a
+ * freshly sorted file and rename(2)s that over the old one. Writers that
+ * locked the replaced inode notice the rename and retry on the new file.
+ * Queries lock shared only while mapping the file: appends land beyond the
+ * mapped length and compaction never rewrites an inode in place, so the
+ * mapping stays consistent after the lock is dropped.
+ *
+ * A keyword lookup binary-searches the suffix index for the last keyword,
+ * which finds every directory whose final component contains it in
+ * O(log n + matches), then folds in the short log tail.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "frecency.h"
+#include "shell.h"
+
+#define FZ_MAGIC "GSZDB\0\0\1"
+#define FZ_BYTE_ORDER 0x01020304u
+#define FZ_VISIT 0x5349565au
+#define FZ_FORGET 0x5452475au
+#define FZ_MAX_PATH 4096u
+#define FZ_LOG_LIMIT (64u * 1024u) /* log bytes that trigger a compaction */
+#define FZ_RANK_LIMIT 100000.0     /* total rank beyond which ranks age */
+#define FZ_OPEN_ATTEMPTS 8
+
+typedef struct {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t entry_count;
+    uint64_t entries_offset;
+    uint64_t suffixes_offset;
+    uint64_t suffix_count;
+    uint64_t log_offset;
+    uint64_t reserved[2];
+} fz_header;
+
+typedef struct {
+    uint64_t path_offset;
+    uint32_t path_len;
+    uint32_t base; /* offset of the final component within the path */
+    double rank;
+    int64_t last_visit;
+} fz_entry;
+
+typedef struct {
+    uint32_t entry;
+    uint32_t start;
+} fz_suffix;
+
+typedef struct {
+    uint32_t kind;
+    uint32_t path_len;
+    int64_t time;
+} fz_record;
+
+/* A read-only mapping of the database. */
+typedef struct {
+    const unsigned char *base;
+    size_t size;
+    const fz_entry *entries;
+    uint32_t entry_count;
+    const fz_suffix *suffixes;
+    size_t suffix_count;
+    size_t log_offset;
+} fz_view;
+
+/* Log records folded per path. */
+typedef struct {
+    const char *path;
+    uint32_t len;
+    double visits;
+    int64_t last_visit;
+    bool reset;    /* forgotten: ignore the compacted rank */
+    bool in_table; /* the path also has a compacted entry */
+} fz_pending;
+
+typedef struct {
+    fz_pending *items;
+    size_t count;
+    uint32_t *slots; /* item index + 1, 0 when empty */
+    size_t slot_count;
+} fz_tail;
+
+/* A directory with its effective rank, as collected for a query or compaction. */
+typedef struct {
+    const char *path;
+    uint32_t len;
+    double rank;
+    int64_t last_visit;
+} fz_item;
+
+static size_t align8(size_t n) {
+    return (n + 7u) & ~(size_t)7u;
+}
+
+static unsigned char fold(unsigned char c) {
+    return c >= 'A' && c <= 'Z' ? (unsigned char)(c + ('a' - 'A')) : c;
+}
+
+static int compare_bytes(const char *a, size_t a_len, const char *b, size_t b_len) {
+    int cmp = memcmp(a, b, a_len < b_len ? a_len : b_len);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return a_len < b_len ? -1 : (a_len > b_len ? 1 : 0);
+}
+
+static int compare_folded(const char *a, size_t a_len, const char *b, size_t b_len) {
+    size_t n = a_len < b_len ? a_len : b_len;
+    for (size_t i = 0; i < n; ++i) {
+        unsigned char ca = fold((unsigned char)a[i]);
+        unsigned char cb = fold((unsigned char)b[i]);
+        if (ca != cb) {
+            return ca < cb ? -1 : 1;
+        }
+    }
+    return a_len < b_len ? -1 : (a_len > b_len ? 1 : 0);
+}
+
+static uint32_t base_offset(const char *path, uint32_t len) {
+    uint32_t base = len;
+    while (base > 0u && path[base - 1u] != '/') {
+        --base;
+    }
+    return base;
+}
+
+/* Returns the malloc'd database path, or NULL when none applies. */
+static char *database_path(const struct gs_shell *shell, bool interactive) {
+    const char *named = gs_shell_getvar(shell, "GENSHELL_Z_DB");
+    if (named) {
+        return named[0] ? strdup(named) : NULL;
+    }
+    const char *home = gs_shell_getvar(shell, "HOME");
+    if (!interactive || !home || home[0] != '/') {
+        return NULL;
+    }
+    size_t len = strlen(home);
+    char *path = (char *)malloc(len + sizeof("/.genshell_z"));
+    if (path) {
+        memcpy(path, home, len);
+        memcpy(path + len, "/.genshell_z", sizeof("/.genshell_z"));
+    }
+    return path;
+}
+
+/*
+ * Opens and locks the database, retrying when a compaction replaced the file
+ * between the open and the lock. Returns -1 with errno set on failure.
+ */
+static int open_locked(const char *path, int lock, bool create) {
+    for (int attempt = 0; attempt < FZ_OPEN_ATTEMPTS; ++attempt) {
+        int fd = create ? open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600) : open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return -1;
+        }
+        int rc;
+        do {
+            rc = flock(fd, lock);
+        } while (rc != 0 && errno == EINTR);
+        struct stat held;
+        struct stat named;
+        if (rc == 0 && fstat(fd, &held) == 0 && stat(path, &named) == 0 && held.st_dev == named.st_dev &&
+            held.st_ino == named.st_ino) {
+            return fd;
+        }
+        int saved_errno = errno;
+        close(fd);
+        if (rc != 0) {
+            errno = saved_errno;
+            return -1;
+        }
+    }
+    errno = EAGAIN;
+    return -1;
+}
+
+static bool header_valid(const fz_header *hdr, size_t size) {
+    if (memcmp(hdr->magic, FZ_MAGIC, sizeof(hdr->magic)) != 0 || hdr->byte_order != FZ_BYTE_ORDER) {
+        return false;
+    }
+    uint64_t entries_end = hdr->entries_offset + (uint64_t)hdr->entry_count * sizeof(fz_entry);
+    return hdr->entries_offset >= sizeof(fz_header) && hdr->entries_offset % 8u == 0u && entries_end <= size &&
+           hdr->suffixes_offset % 8u == 0u && hdr->suffix_count <= size / sizeof(fz_suffix) &&
+           hdr->suffixes_offset + hdr->suffix_count * sizeof(fz_suffix) <= size && hdr->log_offset % 8u == 0u &&
+           hdr->log_offset >= sizeof(fz_header) && hdr->log_offset <= size;
+}
+
+/* Maps fd; an empty or foreign file yields an empty view. */
+static int view_open(int fd, fz_view *view) {
+    memset(view, 0, sizeof(*view));
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return GS_ERR_EXEC;
+    }
+    if ((size_t)st.st_size < sizeof(fz_header)) {
+        return GS_OK;
+    }
+    size_t size = (size_t)st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return GS_ERR_EXEC;
+    }
+    const fz_header *hdr = (const fz_header *)map;
+    if (!header_valid(hdr, size)) {
+        munmap(map, size);
+        return GS_OK;
+    }
+    view->base = (const unsigned char *)map;
+    view->size = size;
+    view->entries = (const fz_entry *)(view->base + hdr->entries_offset);
+    view->entry_count = hdr->entry_count;
+    view->suffixes = (const fz_suffix *)(view->base + hdr->suffixes_offset);
+    view->suffix_count = (size_t)hdr->suffix_count;
+    view->log_offset = (size_t)hdr->log_offset;
+    return GS_OK;
+}
+
+static void view_close(fz_view *view) {
+    if (view->base) {
+        munmap((void *)view->base, view->size);
+    }
+    memset(view, 0, sizeof(*view));
+}
+
+/* Returns entry index's path, or NULL when the entry is out of bounds. */
+static const char *entry_path(const fz_view *view, uint32_t index) {
+    if (index >= view->entry_count) {
+        return NULL;
+    }
+    const fz_entry *entry = &view->entries[index];
+    if (entry->path_len == 0u || entry->path_len > FZ_MAX_PATH || entry->base > entry->path_len ||
+        entry->path_offset + entry->path_len > view->log_offset) {
+        return NULL;
+    }
+    return (const char *)view->base + entry->path_offset;
+}
+
+/* Binary-searches the path-sorted entries; returns the index or -1. */
+static long find_entry(const fz_view *view, const char *path, uint32_t len) {
+    size_t lo = 0u;
+    size_t hi = view->entry_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2u;
+        const char *mid_path = entry_path(view, (uint32_t)mid);
+        if (!mid_path) {
+            return -1;
+        }
+        int cmp = compare_bytes(mid_path, view->entries[mid].path_len, path, len);
+        if (cmp == 0) {
+            return (long)mid;
+        }
+        if (cmp < 0) {
+            lo = mid + 1u;
+        } else {
+            hi = mid;
+        }
+    }
+    return -1;
+}
+
+static uint32_t hash_path(const char *path, uint32_t len) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < len; ++i) {
+        hash ^= (unsigned char)path[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static fz_pending *tail_find(const fz_tail *tail, const char *path, uint32_t len) {
+    if (tail->slot_count == 0u) {
+        return NULL;
+    }
+    size_t mask = tail->slot_count - 1u;
+    for (size_t slot = hash_path(path, len) & mask;; slot = (slot + 1u) & mask) {
+        uint32_t index = tail->slots[slot];
+        if (index == 0u) {
+            return NULL;
+        }
+        fz_pending *item = &tail->items[index - 1u];
+        if (item->len == len && memcmp(item->path, path, len) == 0) {
+            return item;
+        }
+    }
+}
+
+static void tail_free(fz_tail *tail) {
+    free(tail->items);
+    free(tail->slots);
+    memset(tail, 0, sizeof(*tail));
+}
+
+/* Folds the log records after the compacted sections, stopping at a torn one. */
+static int tail_load(const fz_view *view, fz_tail *tail) {
+    memset(tail, 0, sizeof(*tail));
+    size_t records = 0u;
+    size_t offset = view->log_offset;
+    while (offset + sizeof(fz_record) <= view->size) {
+        fz_record rec;
+        memcpy(&rec, view->base + offset, sizeof(rec));
+        if ((rec.kind != FZ_VISIT && rec.kind != FZ_FORGET) || rec.path_len == 0u || rec.path_len > FZ_MAX_PATH ||
+            offset + sizeof(rec) + rec.path_len > view->size) {
+            break;
+        }
+        ++records;
+        offset += align8(sizeof(rec) + rec.path_len);
+    }
+    if (records == 0u) {
+        return GS_OK;
+    }
+    tail->slot_count = 16u;
+    while (tail->slot_count < records * 2u) {
+        tail->slot_count *= 2u;
+    }
+    tail->items = (fz_pending *)calloc(records, sizeof(fz_pending));
+    tail->slots = (uint32_t *)calloc(tail->slot_count, sizeof(uint32_t));
+    if (!tail->items || !tail->slots) {
+        tail_free(tail);
+        return GS_ERR_ALLOC;
+    }
+
+    size_t mask = tail->slot_count - 1u;
+    offset = view->log_offset;
+    for (size_t r = 0; r < records; ++r) {
+        fz_record rec;
+        memcpy(&rec, view->base + offset, sizeof(rec));
+        const char *path = (const char *)view->base + offset + sizeof(rec);
+        offset += align8(sizeof(rec) + rec.path_len);
+        fz_pending *item = tail_find(tail, path, rec.path_len);
+        if (!item) {
+            size_t slot = hash_path(path, rec.path_len) & mask;
+            while (tail->slots[slot] != 0u) {
+                slot = (slot + 1u) & mask;
+            }
+            item = &tail->items[tail->count++];
+            item->path = path;
+            item->len = rec.path_len;
+            item->in_table = find_entry(view, path, rec.path_len) >= 0;
+            tail->slots[slot] = (uint32_t)tail->count;
+        }
+        if (rec.kind == FZ_FORGET) {
+            item->visits = 0.0;
+            item->last_visit = 0;
+            item->reset = true;
+        } else {
+            item->visits += 1.0;
+            if (rec.time > item->last_visit) {
+                item->last_visit = rec.time;
+            }
+        }
+    }
+    return GS_OK;
+}
+
+/* Combines entry index with its log records; false when it has no rank left. */
+static bool entry_item(const fz_view *view, const fz_tail *tail, uint32_t index, fz_item *out) {
+    const char *path = entry_path(view, index);
+    if (!path) {
+        return false;
+    }
+    const fz_entry *entry = &view->entries[index];
+    out->path = path;
+    out->len = entry->path_len;
+    out->rank = entry->rank;
+    out->last_visit = entry->last_visit;
+    const fz_pending *pending = tail_find(tail, path, entry->path_len);
+    if (pending) {
+        if (pending->reset) {
+            out->rank = 0.0;
+            out->last_visit = 0;
+        }
+        out->rank += pending->visits;
+        if (pending->last_visit > out->last_visit) {
+            out->last_visit = pending->last_visit;
+        }
+    }
+    return out->rank > 0.0;
+}
+
+static bool pending_item(const fz_pending *pending, fz_item *out) {
+    out->path = pending->path;
+    out->len = pending->len;
+    out->rank = pending->visits;
+    out->last_visit = pending->last_visit;
+    return !pending->in_table && out->rank > 0.0;
+}
+
+static int write_all(int fd, const unsigned char *data, size_t len) {
+    while (len > 0u) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return GS_ERR_EXEC;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+    return GS_OK;
+}
+
+static int compare_items(const void *a, const void *b) {
+    const fz_item *x = (const fz_item *)a;
+    const fz_item *y = (const fz_item *)b;
+    return compare_bytes(x->path, x->len, y->path, y->len);
+}
+
+typedef struct {
+    const char *text; /* path[start..len) */
+    uint32_t len;
+    uint32_t entry;
+    uint32_t start;
+} fz_sort_suffix;
+
+static int compare_sort_suffixes(const void *a, const void *b) {
+    const fz_sort_suffix *x = (const fz_sort_suffix *)a;
+    const fz_sort_suffix *y = (const fz_sort_suffix *)b;
+    return compare_folded(x->text, x->len, y->text, y->len);
+}
+
+/* Serialises items (sorted by path) as a fresh database with an empty log. */
+static int build_image(const fz_item *items, uint32_t count, unsigned char **out, size_t *out_len) {
+    size_t suffix_count = 0u;
+    size_t string_bytes = 0u;
+    for (uint32_t i = 0; i < count; ++i) {
+        suffix_count += items[i].len - base_offset(items[i].path, items[i].len);
+        string_bytes += items[i].len;
+    }
+    size_t entries_offset = sizeof(fz_header);
+    size_t suffixes_offset = entries_offset + (size_t)count * sizeof(fz_entry);
+    size_t strings_offset = suffixes_offset + suffix_count * sizeof(fz_suffix);
+    size_t total = align8(strings_offset + string_bytes);
+
+    unsigned char *image = (unsigned char *)calloc(1u, total);
+    fz_sort_suffix *sorted = (fz_sort_suffix *)malloc((suffix_count ? suffix_count : 1u) * sizeof(fz_sort_suffix));
+    if (!image || !sorted) {
+        free(image);
+        free(sorted);
+        return GS_ERR_ALLOC;
+    }
+
+    fz_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, FZ_MAGIC, sizeof(hdr.magic));
+    hdr.byte_order = FZ_BYTE_ORDER;
+    hdr.entry_count = count;
+    hdr.entries_offset = entries_offset;
+    hdr.suffixes_offset = suffixes_offset;
+    hdr.suffix_count = suffix_count;
+    hdr.log_offset = total;
+    memcpy(image, &hdr, sizeof(hdr));
+
+    size_t string_offset = strings_offset;
+    size_t s = 0u;
+    for (uint32_t i = 0; i < count; ++i) {
+        fz_entry entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.path_offset = string_offset;
+        entry.path_len = items[i].len;
+        entry.base = base_offset(items[i].path, items[i].len);
+        entry.rank = items[i].rank;
+        entry.last_visit = items[i].last_visit;
+        memcpy(image + entries_offset + (size_t)i * sizeof(entry), &entry, sizeof(entry));
+        memcpy(image + string_offset, items[i].path, items[i].len);
+        string_offset += items[i].len;
+        for (uint32_t start = entry.base; start < entry.path_len; ++start) {
+            sorted[s].text = items[i].path + start;
+            sorted[s].len = entry.path_len - start;
+            sorted[s].entry = i;
+            sorted[s].start = start;
+            ++s;
+        }
+    }
+    qsort(sorted, suffix_count, sizeof(fz_sort_suffix), compare_sort_suffixes);
+    for (size_t i = 0; i < suffix_count; ++i) {
+        fz_suffix suffix = {sorted[i].entry, sorted[i].start};
+        memcpy(image + suffixes_offset + i * sizeof(suffix), &suffix, sizeof(suffix));
+    }
+    free(sorted);
+    *out = image;
+    *out_len = total;
+    return GS_OK;
+}
+
+/* Rewrites the database held locked through fd with its log folded in. */
+static int compact(int fd, const char *path) {
+    fz_view view;
+    fz_tail tail;
+    if (view_open(fd, &view) != GS_OK) {
+        return GS_ERR_EXEC;
+    }
+    if (tail_load(&view, &tail) != GS_OK) {
+        view_close(&view);
+        return GS_ERR_ALLOC;
+    }
+
+    int status = GS_ERR_ALLOC;
+    unsigned char *image = NULL;
+    size_t image_len = 0u;
+    fz_item *items = (fz_item *)malloc(((size_t)view.entry_count + tail.count + 1u) * sizeof(fz_item));
+    if (items) {
+        size_t count = 0u;
+        double total = 0.0;
+        for (uint32_t i = 0; i < view.entry_count; ++i) {
+            if (entry_item(&view, &tail, i, &items[count])) {
+                total += items[count++].rank;
+            }
+        }
+        for (size_t i = 0; i < tail.count; ++i) {
+            if (pending_item(&tail.items[i], &items[count])) {
+                total += items[count++].rank;
+            }
+        }
+        /* Age every rank once the total grows too large, forgetting the rarest. */
+        if (total > FZ_RANK_LIMIT) {
+            double scale = FZ_RANK_LIMIT * 0.9 / total;
+            size_t kept = 0u;
+            for (size_t i = 0; i < count; ++i) {
+                items[i].rank *= scale;
+                if (items[i].rank >= 1.0) {
+                    items[kept++] = items[i];
+                }
+            }
+            count = kept;
+        }
+        qsort(items, count, sizeof(fz_item), compare_items);
+        status = count <= UINT32_MAX ? build_image(items, (uint32_t)count, &image, &image_len) : GS_ERR_EXEC;
+    }
+
+    if (status == GS_OK) {
+        size_t path_len = strlen(path);
+        char *temp = (char *)malloc(path_len + sizeof(".XXXXXX"));
+        status = GS_ERR_ALLOC;
+        if (temp) {
+            memcpy(temp, path, path_len);
+            memcpy(temp + path_len, ".XXXXXX", sizeof(".XXXXXX"));
+            int out = mkstemp(temp);
+            status = GS_ERR_EXEC;
+            if (out >= 0) {
+                status = write_all(out, image, image_len);
+                if (close(out) != 0 || (status == GS_OK && rename(temp, path) != 0)) {
+                    status = GS_ERR_EXEC;
+                }
+                if (status != GS_OK) {
+                    unlink(temp);
+                }
+            }
+            free(temp);
+        }
+    }
+    free(image);
+    free(items);
+    tail_free(&tail);
+    view_close(&view);
+    return status;
+}
+
+/* Appends one log record under an exclusive lock, compacting when it is due. */
+static int append(const char *db, uint32_t kind, const char *path) {
+    size_t len = strlen(path);
+    if (path[0] != '/' || len > FZ_MAX_PATH) {
+        return GS_ERR_EXEC;
+    }
+    int fd = open_locked(db, LOCK_EX, true);
+    if (fd < 0) {
+        return GS_ERR_EXEC;
+    }
+    struct stat st;
+    fz_header hdr;
+    int status = GS_ERR_EXEC;
+    if (fstat(fd, &st) != 0) {
+        goto done;
+    }
+    size_t size = (size_t)st.st_size;
+    if (size == 0u) {
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, FZ_MAGIC, sizeof(hdr.magic));
+        hdr.byte_order = FZ_BYTE_ORDER;
+        hdr.entries_offset = sizeof(hdr);
+        hdr.suffixes_offset = sizeof(hdr);
+        hdr.log_offset = sizeof(hdr);
+        if (pwrite(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)) {
+            goto done;
+        }
+        size = sizeof(hdr);
+    } else if (size < sizeof(hdr) || pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr) ||
+               !header_valid(&hdr, size)) {
+        goto done; /* not a database: leave the file alone */
+    }
+
+    unsigned char record[sizeof(fz_record) + FZ_MAX_PATH + 8u];
+    fz_record rec = {kind, (uint32_t)len, (int64_t)time(NULL)};
+    size_t record_len = align8(sizeof(rec) + len);
+    memset(record, 0, record_len);
+    memcpy(record, &rec, sizeof(rec));
+    memcpy(record + sizeof(rec), path, len);
+    if (pwrite(fd, record, record_len, (off_t)size) != (ssize_t)record_len) {
+        goto done;
+    }
+    status = GS_OK;
+    if (size + record_len - (size_t)hdr.log_offset > FZ_LOG_LIMIT) {
+        status = compact(fd, db);
+    }
+done:
+    close(fd);
+    return status;
+}
+
+void gs_frecency_record(const struct gs_shell *shell, const char *path) {
+    const char *home = gs_shell_getvar(shell, "HOME");
+    if (!path || (home && strcmp(path, home) == 0)) {
+        return;
+    }
+    char *db = database_path(shell, shell->interactive);
+    if (db) {
+        (void)append(db, FZ_VISIT, path);
+        free(db);
+    }
+}
+
+int gs_frecency_forget(const struct gs_shell *shell, const char *path) {
+    char *db = database_path(shell, true);
+    if (!db) {
+        return GS_ERR_EXEC;
+    }
+    int status = append(db, FZ_FORGET, path);
+    free(db);
+    return status;
+}
+
+/* Finds needle in hay[0..len) from the right (case-folded if fold_case). */
+static long find_last(const char *hay, size_t len, const char *needle, size_t needle_len, bool fold_case) {
+    for (size_t i = len + 1u; i-- > needle_len;) {
+        size_t start = i - needle_len;
+        if (fold_case ? compare_folded(hay + start, needle_len, needle, needle_len) == 0
+                      : memcmp(hay + start, needle, needle_len) == 0) {
+            return (long)start;
+        }
+    }
+    return -1;
+}
+
+static long find_first(const char *hay, size_t len, const char *needle, size_t needle_len, bool fold_case) {
+    for (size_t start = 0u; start + needle_len <= len; ++start) {
+        if (fold_case ? compare_folded(hay + start, needle_len, needle, needle_len) == 0
+                      : memcmp(hay + start, needle, needle_len) == 0) {
+            return (long)start;
+        }
+    }
+    return -1;
+}
+
+/* The last keyword in the final component, the others in order before it. */
+static bool item_matches(const fz_item *item, char *const keywords[], int count, bool fold_case) {
+    if (count == 0) {
+        return true;
+    }
+    uint32_t base = base_offset(item->path, item->len);
+    const char *last = keywords[count - 1];
+    size_t last_len = strlen(last);
+    long at = find_last(item->path + base, item->len - base, last, last_len, fold_case);
+    if (at < 0) {
+        return false;
+    }
+    size_t limit = base + (size_t)at;
+    size_t pos = 0u;
+    for (int k = 0; k + 1 < count; ++k) {
+        size_t kw_len = strlen(keywords[k]);
+        long found = find_first(item->path + pos, limit - pos, keywords[k], kw_len, fold_case);
+        if (found < 0) {
+            return false;
+        }
+        pos += (size_t)found + kw_len;
+    }
+    return true;
+}
+
+static double item_score(const fz_item *item, gs_frecency_order order, int64_t now) {
+    switch (order) {
+    case GS_FRECENCY_BY_RANK:
+        return item->rank;
+    case GS_FRECENCY_BY_RECENT:
+        return (double)item->last_visit;
+    case GS_FRECENCY_BY_SCORE:
+        break;
+    }
+    int64_t age = now - item->last_visit;
+    if (age < 3600) {
+        return item->rank * 4.0;
+    }
+    if (age < 86400) {
+        return item->rank * 2.0;
+    }
+    if (age < 604800) {
+        return item->rank / 2.0;
+    }
+    return item->rank / 4.0;
+}
+
+typedef struct {
+    gs_frecency_match *items;
+    size_t count;
+    size_t capacity;
+} fz_results;
+
+static int results_add(fz_results *results, const fz_item *item, gs_frecency_order order, int64_t now) {
+    if (results->count == results->capacity) {
+        size_t new_cap = results->capacity ? results->capacity * 2u : 16u;
+        gs_frecency_match *tmp = (gs_frecency_match *)realloc(results->items, new_cap * sizeof(gs_frecency_match));
+        if (!tmp) {
+            return GS_ERR_ALLOC;
+        }
+        results->items = tmp;
+        results->capacity = new_cap;
+    }
+    char *path = (char *)malloc(item->len + 1u);
+    if (!path) {
+        return GS_ERR_ALLOC;
+    }
+    memcpy(path, item->path, item->len);
+    path[item->len] = '\0';
+    gs_frecency_match *match = &results->items[results->count++];
+    match->path = path;
+    match->rank = item->rank;
+    match->last_visit = item->last_visit;
+    match->score = item_score(item, order, now);
+    return GS_OK;
+}
+
+static int compare_matches(const void *a, const void *b) {
+    const gs_frecency_match *x = (const gs_frecency_match *)a;
+    const gs_frecency_match *y = (const gs_frecency_match *)b;
+    if (x->score != y->score) {
+        return x->score > y->score ? -1 : 1;
+    }
+    return strcmp(x->path, y->path);
+}
+
+/* First suffix not ordered before key, comparing case-insensitively. */
+static size_t suffix_lower_bound(const fz_view *view, const char *key, size_t key_len) {
+    size_t lo = 0u;
+    size_t hi = view->suffix_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2u;
+        const fz_suffix *suffix = &view->suffixes[mid];
+        const char *path = entry_path(view, suffix->entry);
+        uint32_t len = path ? view->entries[suffix->entry].path_len : 0u;
+        if (!path || suffix->start >= len) {
+            return view->suffix_count; /* corrupt index: match nothing */
+        }
+        if (compare_folded(path + suffix->start, len - suffix->start, key, key_len) < 0) {
+            lo = mid + 1u;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static int collect(const fz_view *view, const fz_tail *tail, char *const keywords[], int count, bool fold_case,
+                   gs_frecency_order order, fz_results *results) {
+    int64_t now = (int64_t)time(NULL);
+    fz_item item;
+    if (count == 0) {
+        for (uint32_t i = 0; i < view->entry_count; ++i) {
+            if (entry_item(view, tail, i, &item) && results_add(results, &item, order, now) != GS_OK) {
+                return GS_ERR_ALLOC;
+            }
+        }
+    } else {
+        unsigned char *seen = (unsigned char *)calloc((size_t)view->entry_count / 8u + 1u, 1u);
+        if (!seen) {
+            return GS_ERR_ALLOC;
+        }
+        const char *key = keywords[count - 1];
+        size_t key_len = strlen(key);
+        for (size_t s = suffix_lower_bound(view, key, key_len); s < view->suffix_count; ++s) {
+            const fz_suffix *suffix = &view->suffixes[s];
+            const char *path = entry_path(view, suffix->entry);
+            uint32_t len = path ? view->entries[suffix->entry].path_len : 0u;
+            if (!path || suffix->start >= len || len - suffix->start < key_len ||
+                compare_folded(path + suffix->start, key_len, key, key_len) != 0) {
+                break;
+            }
+            if (seen[suffix->entry / 8u] & (1u << (suffix->entry % 8u))) {
+                continue;
+            }
+            seen[suffix->entry / 8u] |= (unsigned char)(1u << (suffix->entry % 8u));
+            if (entry_item(view, tail, suffix->entry, &item) && item_matches(&item, keywords, count, fold_case) &&
+                results_add(results, &item, order, now) != GS_OK) {
+                free(seen);
+                return GS_ERR_ALLOC;
+            }
+        }
+        free(seen);
+    }
+    for (size_t i = 0; i < tail->count; ++i) {
+        if (pending_item(&tail->items[i], &item) && item_matches(&item, keywords, count, fold_case) &&
+            results_add(results, &item, order, now) != GS_OK) {
+            return GS_ERR_ALLOC;
+        }
+    }
+    return GS_OK;
+}
+
+int gs_frecency_query(const struct gs_shell *shell, char *const keywords[], int count, gs_frecency_order order,
+                      gs_frecency_match **out, size_t *out_count) {
+    *out = NULL;
+    *out_count = 0u;
+    char *db = database_path(shell, true);
+    if (!db) {
+        return GS_OK;
+    }
+    int fd = open_locked(db, LOCK_SH, false);
+    free(db);
+    if (fd < 0) {
+        return errno == ENOENT ? GS_OK : GS_ERR_EXEC;
+    }
+    fz_view view;
+    int status = view_open(fd, &view);
+    close(fd); /* the mapping outlives the lock; see the top of the file */
+    if (status != GS_OK) {
+        return status;
+    }
+
+    bool fold_case = true;
+    for (int k = 0; k < count; ++k) {
+        for (const char *p = keywords[k]; *p; ++p) {
+            if (*p >= 'A' && *p <= 'Z') {
+                fold_case = false;
+            }
+        }
+    }
+
+    fz_tail tail;
+    fz_results results = {0};
+    status = tail_load(&view, &tail);
+    if (status == GS_OK) {
+        status = collect(&view, &tail, keywords, count, fold_case, order, &results);
+        tail_free(&tail);
+    }
+    view_close(&view);
+    if (status != GS_OK) {
+        gs_frecency_matches_free(results.items, results.count);
+        return status;
+    }
+    qsort(results.items, results.count, sizeof(gs_frecency_match), compare_matches);
+    *out = results.items;
+    *out_count = results.count;
+    return GS_OK;
+}
+
+void gs_frecency_matches_free(gs_frecency_match *matches, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        free(matches[i].path);
+    }
+    free(matches);
+}
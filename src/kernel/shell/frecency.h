@@ -0,0 +1,54 @@
+#ifndef GS_FRECENCY_H
+#define GS_FRECENCY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct gs_shell;
+
+/*
+ * Shared frecency database of visited directories, used by cd (which records
+ * visits) and the z builtin (which queries them). The file named by
+ * the shell's $GENSHELL_Z_DB (default ~/.genshell_z; empty disables it) holds a
+ * compacted, path-sorted entry table with a sorted suffix index over each
+ * entry's final path component, followed by an append-only log of visits
+ * since the last compaction. Writers serialise with flock(2) and compaction
+ * replaces the file by rename(2), so any number of shells can share it while
+ * readers work from a private mapping.
+ */
+
+typedef enum {
+    GS_FRECENCY_BY_SCORE, /* rank weighted by how recently it was visited */
+    GS_FRECENCY_BY_RANK,
+    GS_FRECENCY_BY_RECENT
+} gs_frecency_order;
+
+typedef struct {
+    char *path;
+    double rank;
+    int64_t last_visit;
+    double score; /* the value results are ordered by */
+} gs_frecency_match;
+
+/*
+ * Records a visit to an absolute directory; failures are silently ignored.
+ * Only interactive shells use the default database, so scripts that cd
+ * around do not pollute it; an explicit $GENSHELL_Z_DB records everywhere.
+ */
+void gs_frecency_record(const struct gs_shell *shell, const char *path);
+/* Drops path from the database; returns GS_OK or a negative error. */
+int gs_frecency_forget(const struct gs_shell *shell, const char *path);
+
+/*
+ * Finds directories matching every keyword: the last one must occur in the
+ * final path component and the others, in order, before it. With no
+ * keywords every directory matches. Keywords are case-insensitive unless one
+ * contains an upper-case letter. Results are sorted best first; release them
+ * with gs_frecency_matches_free.
+ */
+int gs_frecency_query(const struct gs_shell *shell, char *const keywords[], int count, gs_frecency_order order,
+                      gs_frecency_match **out, size_t *out_count);
+void gs_frecency_matches_free(gs_frecency_match *matches, size_t count);
+
+#endif /* GS_FRECENCY_H */
@@ -0,0 +1,1164 @@
+/*
+ * Shared command history.
+ *
+ * The log is a sequence of records in native byte order:
+ *
+ *   hs_record  magic, command length, time, pid, session, serial, checksum,
+ *              directory hash
+ *   command    the command's bytes, zero-padded to a multiple of 8 bytes
+ *
+ * A session appends a record with a single write(2) on a descriptor opened
+ * with O_APPEND: the kernel picks the offset and, on a local file system,
+ * does not interleave concurrent appends, so sessions take no lock. The
+ * (pid, session, serial) triple tells their entries apart and orders each
+ * session's own. A writer that dies mid-record (or meets a full disk)
+ * leaves a torn record that fails its checksum; readers step over it a byte
+ * at a time to the next valid record, which need not be aligned any more.
+ * As appends are serialised, a valid record after a torn one means the torn
+ * one will never complete, while a torn record at the very end may still be
+ * in flight, so scanning stops there and resumes on the next refresh.
+ *
+ * The index "<log>.idx" is a header naming the log's inode followed by the
+ * uint64 offsets of the log's first N records. It only grows, extended by
+ * whichever session finds more than HS_INDEX_LAG records beyond it and wins
+ * a non-blocking flock(2); an index that no longer matches the log is
+ * replaced by rename(2), never rewritten, so mappings of it stay valid.
+ * Opening maps the index and then the log, checks the last indexed record
+ * and scans only the records after it. Entries are read from the mappings
+ * on demand, so nothing is loaded up front.
+ *
+ * Reverse search uses an in-memory trigram index: for every three bytes
+ * (ASCII case-folded) the ascending list of entries containing them, stored
+ * as LEB128 differences so a list costs about a byte per entry. Because the
+ * last byte of each difference is the only one without its top bit set, a
+ * list can be walked backwards from its newest entry. The index fills
+ * oldest first, HS_TRIGRAM_BATCH entries per gs_history_warm (or search)
+ * call, so nothing ever waits for the whole history; a search checks the
+ * entries it does not cover yet one by one, newest first. The words of a
+ * query may match in any order; the other candidates come from the shortest
+ * posting list among the words' trigrams and are confirmed against the
+ * entry, so a search reads a handful of entries however long the history is.
+ *
+ * Suggestions come from a radix trie of the entries, also built on first
+ * use: edge labels are offsets into the log mapping rather than copies, and
+ * every node keeps the newest entry below it, so the best completion of a
+ * prefix is found by walking the prefix alone. Each record carries a hash
+ * of the directory it ran in, and a second trie per directory answers the
+ * same question for the current one; a match from there counts as
+ * HS_DIR_BONUS entries newer than it is. The trie fills newest first, a
+ * batch of older entries per call, so no keystroke waits for the whole
+ * history; the line editor adds batches while the user is idle.
+ */
+#include "history.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shell.h"
+
+#define HS_RECORD_MAGIC 0x54534948u /* "HIST" */
+#define HS_INDEX_MAGIC "GSHIDX\0\1"
+#define HS_BYTE_ORDER 0x01020304u
+#define HS_MAX_COMMAND (256u * 1024u)
+#define HS_INDEX_LAG 256u /* unindexed records that make a session extend the index */
+#define HS_OFFSET_CHUNK 1024u
+#define HS_QUERY_WORDS 16u
+#define HS_MAP_SLACK (1u << 20) /* mapped past the end, so most appends need no new mapping */
+#define HS_DIR_BONUS 2048u      /* how much newer a suggestion from the current directory counts as */
+#define HS_PREFIX_BATCH 1024u   /* older entries added to the prefix trie per step, about 0.5 ms */
+#define HS_TRIGRAM_BATCH 512u   /* entries added to the trigram index per step, about 0.5 ms */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t len;
+    int64_t time;
+    uint32_t pid;
+    uint32_t session;
+    uint64_t serial;
+    uint32_t checksum; /* FNV-1a of the record with this field zero, then the command */
+    uint32_t dir;      /* FNV-1a of the working directory; 0 when unknown */
+} hs_record;
+
+typedef struct {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t reserved;
+    uint64_t log_dev;
+    uint64_t log_ino;
+} hs_index_header;
+
+typedef struct {
+    uint32_t key; /* the folded trigram plus one; 0 marks an empty slot */
+    uint32_t count;
+    uint32_t last; /* the newest entry in the list */
+    uint32_t size; /* bytes of deltas in use */
+    uint32_t capacity;
+    unsigned char *deltas; /* each entry minus the one before it (the first as is), LEB128 */
+} hs_posting;
+
+typedef struct {
+    hs_posting *slots;
+    size_t slot_count;
+    size_t used;
+    size_t covered; /* entries below this one have been added */
+} hs_trigrams;
+
+typedef struct {
+    const char *text;
+    size_t len;
+} hs_word;
+
+typedef struct {
+    uint64_t label; /* log offset of the edge's bytes */
+    uint32_t len;
+    uint32_t child; /* first child; 0 for none, as node 0 is unused */
+    uint32_t sibling;
+    uint32_t best; /* newest entry in the subtree */
+} hs_node;
+
+typedef struct {
+    uint32_t dir; /* 0 marks an empty slot */
+    uint32_t root;
+} hs_dir_root;
+
+typedef struct {
+    hs_node *nodes;
+    size_t node_count;
+    size_t node_capacity;
+    uint32_t root; /* of the trie of every entry */
+    hs_dir_root *dirs;
+    size_t dir_slots;
+    size_t dir_used;
+    size_t covered; /* entries from here on are still to be added */
+    size_t pending; /* and so are those below this one */
+} hs_prefixes;
+
+struct gs_history {
+    char *path;
+    int fd; /* the log, opened for appending when it is writable */
+    bool writable;
+    uint64_t dev;
+    uint64_t ino;
+    uint32_t session;
+    uint64_t serial; /* of this session's last record */
+    const unsigned char *log;
+    size_t log_size; /* bytes written when the log was last looked at */
+    size_t log_mapped;
+    void *index_map;
+    size_t index_map_size;
+    const uint64_t *index;
+    size_t indexed;
+    uint64_t *tail; /* offsets of the records past the index */
+    size_t tail_count;
+    size_t tail_capacity;
+    size_t scan_end; /* where scanning for new records resumes */
+    hs_trigrams *trigrams; /* filled by gs_history_warm and searches */
+    hs_prefixes *prefixes; /* built by the first suggestion */
+};
+
+static _Atomic uint32_t g_next_session = 1u;
+
+static size_t align8(size_t n) {
+    return (n + 7u) & ~(size_t)7u;
+}
+
+static uint32_t fnv1a(uint32_t hash, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= p[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static uint32_t record_checksum(const hs_record *rec, const void *text) {
+    hs_record copy = *rec;
+    copy.checksum = 0u;
+    return fnv1a(fnv1a(2166136261u, &copy, sizeof(copy)), text, rec->len);
+}
+
+/* Returns the length of the valid record at offset of the log mapping, or 0. */
+static size_t record_at(const struct gs_history *history, uint64_t offset, hs_record *out) {
+    if (offset > history->log_size || history->log_size - offset < sizeof(hs_record)) {
+        return 0u;
+    }
+    hs_record rec;
+    memcpy(&rec, history->log + offset, sizeof(rec));
+    if (rec.magic != HS_RECORD_MAGIC || rec.len == 0u || rec.len > HS_MAX_COMMAND ||
+        history->log_size - offset - sizeof(rec) < rec.len ||
+        record_checksum(&rec, history->log + offset + sizeof(rec)) != rec.checksum) {
+        return 0u;
+    }
+    if (out) {
+        *out = rec;
+    }
+    return align8(sizeof(rec) + rec.len);
+}
+
+static uint64_t offset_of(const struct gs_history *history, size_t index) {
+    return index < history->indexed ? history->index[index] : history->tail[index - history->indexed];
+}
+
+static char *index_path(const char *path) {
+    size_t len = strlen(path);
+    char *out = (char *)malloc(len + sizeof(".idx"));
+    if (out) {
+        memcpy(out, path, len);
+        memcpy(out + len, ".idx", sizeof(".idx"));
+    }
+    return out;
+}
+
+static bool header_matches(const struct gs_history *history, const hs_index_header *hdr) {
+    return memcmp(hdr->magic, HS_INDEX_MAGIC, sizeof(hdr->magic)) == 0 && hdr->byte_order == HS_BYTE_ORDER &&
+           hdr->log_dev == history->dev && hdr->log_ino == history->ino;
+}
+
+static void index_unmap(struct gs_history *history) {
+    if (history->index_map) {
+        munmap(history->index_map, history->index_map_size);
+    }
+    history->index_map = NULL;
+    history->index_map_size = 0u;
+    history->index = NULL;
+    history->indexed = 0u;
+}
+
+/*
+ * Maps the index held open as fd in place of the current one; false when it
+ * is not this log's or, unless want is SIZE_MAX, does not hold want offsets.
+ */
+static bool index_map(struct gs_history *history, int fd, size_t want) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(hs_index_header) ||
+        ((size_t)st.st_size - sizeof(hs_index_header)) % sizeof(uint64_t) != 0u) {
+        return false;
+    }
+    size_t size = (size_t)st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    size_t count = (size - sizeof(hs_index_header)) / sizeof(uint64_t);
+    if (!header_matches(history, (const hs_index_header *)map) || (want != SIZE_MAX && count != want)) {
+        munmap(map, size);
+        return false;
+    }
+    index_unmap(history);
+    history->index_map = map;
+    history->index_map_size = size;
+    history->index = (const uint64_t *)((const unsigned char *)map + sizeof(hs_index_header));
+    history->indexed = count;
+    return true;
+}
+
+/*
+ * Maps the log as far as it has been written. The shared mapping reaches
+ * HS_MAP_SLACK beyond the end, so later appends show up in it without a new
+ * mapping; only bytes below log_size are ever touched.
+ */
+static int log_map(struct gs_history *history) {
+    struct stat st;
+    if (fstat(history->fd, &st) != 0) {
+        return GS_ERR_EXEC;
+    }
+    size_t size = (size_t)st.st_size;
+    if (size <= history->log_mapped) {
+        history->log_size = size;
+        return GS_OK;
+    }
+    size_t length = size + HS_MAP_SLACK;
+    void *map = mmap(NULL, length, PROT_READ, MAP_SHARED, history->fd, 0);
+    if (map == MAP_FAILED) {
+        return GS_ERR_EXEC;
+    }
+    if (history->log) {
+        munmap((void *)history->log, history->log_mapped);
+    }
+    history->log = (const unsigned char *)map;
+    history->log_size = size;
+    history->log_mapped = length;
+    return GS_OK;
+}
+
+static int tail_push(struct gs_history *history, uint64_t offset) {
+    if (history->tail_count == history->tail_capacity) {
+        size_t new_cap = history->tail_capacity ? history->tail_capacity * 2u : 64u;
+        uint64_t *tmp = (uint64_t *)realloc(history->tail, new_cap * sizeof(uint64_t));
+        if (!tmp) {
+            return GS_ERR_ALLOC;
+        }
+        history->tail = tmp;
+        history->tail_capacity = new_cap;
+    }
+    history->tail[history->tail_count++] = offset;
+    return GS_OK;
+}
+
+/* Collects the records written since the last scan, stepping over torn ones. */
+static int scan(struct gs_history *history) {
+    size_t offset = history->scan_end;
+    while (offset < history->log_size) {
+        size_t len = record_at(history, offset, NULL);
+        if (len == 0u) {
+            size_t next = offset + 1u;
+            while (next < history->log_size && record_at(history, next, NULL) == 0u) {
+                ++next;
+            }
+            if (next >= history->log_size) {
+                break; /* possibly still being written */
+            }
+            offset = next;
+            continue;
+        }
+        if (tail_push(history, offset) != GS_OK) {
+            history->scan_end = offset;
+            return GS_ERR_ALLOC;
+        }
+        offset += len;
+    }
+    history->scan_end = offset;
+    return GS_OK;
+}
+
+static int write_all_at(int fd, const void *data, size_t len, off_t at) {
+    const unsigned char *p = (const unsigned char *)data;
+    while (len > 0u) {
+        ssize_t n = pwrite(fd, p, len, at);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return GS_ERR_EXEC;
+        }
+        p += n;
+        len -= (size_t)n;
+        at += n;
+    }
+    return GS_OK;
+}
+
+/* Writes the offsets of records [from, count) at byte position at of fd. */
+static int write_offsets(int fd, const struct gs_history *history, size_t from, size_t count, off_t at) {
+    uint64_t chunk[HS_OFFSET_CHUNK];
+    while (from < count) {
+        size_t n = 0u;
+        for (; n < HS_OFFSET_CHUNK && from + n < count; ++n) {
+            chunk[n] = offset_of(history, from + n);
+        }
+        if (write_all_at(fd, chunk, n * sizeof(uint64_t), at) != GS_OK) {
+            return GS_ERR_EXEC;
+        }
+        from += n;
+        at += (off_t)(n * sizeof(uint64_t));
+    }
+    return GS_OK;
+}
+
+/* Writes a fresh index of every known record and renames it over path. */
+static int index_rebuild(struct gs_history *history, const char *path) {
+    size_t path_len = strlen(path);
+    char *temp = (char *)malloc(path_len + sizeof(".XXXXXX"));
+    if (!temp) {
+        return GS_ERR_ALLOC;
+    }
+    memcpy(temp, path, path_len);
+    memcpy(temp + path_len, ".XXXXXX", sizeof(".XXXXXX"));
+    int fd = mkstemp(temp);
+    if (fd < 0) {
+        free(temp);
+        return GS_ERR_EXEC;
+    }
+    (void)fcntl(fd, F_SETFD, FD_CLOEXEC);
+    hs_index_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, HS_INDEX_MAGIC, sizeof(hdr.magic));
+    hdr.byte_order = HS_BYTE_ORDER;
+    hdr.log_dev = history->dev;
+    hdr.log_ino = history->ino;
+    size_t count = history->indexed + history->tail_count;
+    int status = write_all_at(fd, &hdr, sizeof(hdr), 0);
+    if (status == GS_OK) {
+        status = write_offsets(fd, history, 0u, count, (off_t)sizeof(hdr));
+    }
+    if (status == GS_OK && rename(temp, path) != 0) {
+        status = GS_ERR_EXEC;
+    }
+    /* Once renamed, another session may extend it before it is mapped here. */
+    if (status != GS_OK) {
+        unlink(temp);
+    } else if (index_map(history, fd, count)) {
+        history->tail_count = 0u;
+    }
+    close(fd);
+    free(temp);
+    return status;
+}
+
+/*
+ * Adds the offsets of the unindexed records to the index, unless another
+ * session is already doing so. A stale or damaged index is replaced.
+ */
+static void index_extend(struct gs_history *history) {
+    char *path = index_path(history->path);
+    int fd = path ? open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600) : -1;
+    struct stat held;
+    struct stat named;
+    if (fd < 0 || flock(fd, LOCK_EX | LOCK_NB) != 0 || fstat(fd, &held) != 0 || stat(path, &named) != 0 ||
+        held.st_dev != named.st_dev || held.st_ino != named.st_ino) {
+        goto done; /* busy, or replaced under us: the next extension will do */
+    }
+
+    size_t count = history->indexed + history->tail_count;
+    size_t size = (size_t)held.st_size;
+    hs_index_header hdr;
+    if (size < sizeof(hdr) || (size - sizeof(hdr)) % sizeof(uint64_t) != 0u ||
+        pread(fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr) || !header_matches(history, &hdr)) {
+        (void)index_rebuild(history, path);
+        goto done;
+    }
+    size_t have = (size - sizeof(hdr)) / sizeof(uint64_t);
+    if (have >= count) {
+        goto done; /* another session got further */
+    }
+    uint64_t last = 0u;
+    if (have > 0u && (pread(fd, &last, sizeof(last), (off_t)(size - sizeof(last))) != (ssize_t)sizeof(last) ||
+                      last != offset_of(history, have - 1u))) {
+        (void)index_rebuild(history, path);
+        goto done;
+    }
+    if (write_offsets(fd, history, have, count, (off_t)size) == GS_OK && index_map(history, fd, count)) {
+        history->tail_count = 0u;
+    }
+done:
+    if (fd >= 0) {
+        (void)flock(fd, LOCK_UN); /* a mapping of fd would otherwise keep it locked */
+        close(fd);
+    }
+    free(path);
+}
+
+/* Maps the index, trusting it only if its last offset starts a valid record. */
+static void index_load(struct gs_history *history) {
+    char *path = index_path(history->path);
+    int fd = path ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+    free(path);
+    if (fd < 0) {
+        return;
+    }
+    (void)index_map(history, fd, SIZE_MAX);
+    close(fd);
+}
+
+static void index_check(struct gs_history *history) {
+    if (history->indexed == 0u) {
+        return;
+    }
+    uint64_t last = history->index[history->indexed - 1u];
+    size_t len = record_at(history, last, NULL);
+    if (len == 0u || (history->indexed > 1u && history->index[history->indexed - 2u] >= last)) {
+        index_unmap(history);
+        return;
+    }
+    history->scan_end = (size_t)last + len;
+}
+
+static unsigned char fold(unsigned char c) {
+    return c >= 'A' && c <= 'Z' ? (unsigned char)(c + ('a' - 'A')) : c;
+}
+
+static uint32_t trigram_key(const char *p) {
+    return ((uint32_t)fold((unsigned char)p[0]) << 16 | (uint32_t)fold((unsigned char)p[1]) << 8 |
+            (uint32_t)fold((unsigned char)p[2])) +
+           1u;
+}
+
+static size_t trigram_slot(const hs_trigrams *trigrams, uint32_t key) {
+    uint32_t hash = key * 2654435761u;
+    size_t mask = trigrams->slot_count - 1u;
+    size_t slot = (hash ^ (hash >> 15)) & mask;
+    while (trigrams->slots[slot].key != 0u && trigrams->slots[slot].key != key) {
+        slot = (slot + 1u) & mask;
+    }
+    return slot;
+}
+
+static const hs_posting *trigram_find(const hs_trigrams *trigrams, uint32_t key) {
+    const hs_posting *posting = &trigrams->slots[trigram_slot(trigrams, key)];
+    return posting->key == key ? posting : NULL;
+}
+
+static int trigrams_grow(hs_trigrams *trigrams) {
+    size_t old_count = trigrams->slot_count;
+    hs_posting *old = trigrams->slots;
+    size_t new_count = old_count ? old_count * 2u : 4096u;
+    trigrams->slots = (hs_posting *)calloc(new_count, sizeof(hs_posting));
+    if (!trigrams->slots) {
+        trigrams->slots = old;
+        return GS_ERR_ALLOC;
+    }
+    trigrams->slot_count = new_count;
+    for (size_t i = 0; i < old_count; ++i) {
+        if (old[i].key != 0u) {
+            trigrams->slots[trigram_slot(trigrams, old[i].key)] = old[i];
+        }
+    }
+    free(old);
+    return GS_OK;
+}
+
+/* Adds entry to the posting list of each trigram of text; adding it again is harmless. */
+static int trigrams_add(hs_trigrams *trigrams, uint32_t entry, const char *text, size_t len) {
+    for (size_t i = 0; i + 3u <= len; ++i) {
+        if ((trigrams->used + 1u) * 2u > trigrams->slot_count && trigrams_grow(trigrams) != GS_OK) {
+            return GS_ERR_ALLOC;
+        }
+        uint32_t key = trigram_key(text + i);
+        hs_posting *posting = &trigrams->slots[trigram_slot(trigrams, key)];
+        if (posting->key == 0u) {
+            posting->key = key;
+            trigrams->used++;
+        }
+        if (posting->count > 0u && posting->last == entry) {
+            continue;
+        }
+        if (posting->size + 5u > posting->capacity) {
+            uint32_t new_cap = posting->capacity ? posting->capacity * 2u : 8u;
+            unsigned char *tmp = (unsigned char *)realloc(posting->deltas, new_cap);
+            if (!tmp) {
+                return GS_ERR_ALLOC;
+            }
+            posting->deltas = tmp;
+            posting->capacity = new_cap;
+        }
+        uint32_t delta = posting->count > 0u ? entry - posting->last : entry;
+        while (delta >= 0x80u) {
+            posting->deltas[posting->size++] = (unsigned char)(delta | 0x80u);
+            delta >>= 7;
+        }
+        posting->deltas[posting->size++] = (unsigned char)delta;
+        posting->last = entry;
+        posting->count++;
+    }
+    return GS_OK;
+}
+
+/* Walks a posting list from its newest entry back. */
+typedef struct {
+    const hs_posting *posting;
+    uint32_t end;   /* the deltas before this byte are still to be read */
+    uint32_t left;  /* entries still to be returned */
+    uint32_t entry; /* the next one */
+} hs_cursor;
+
+static void cursor_start(hs_cursor *cursor, const hs_posting *posting) {
+    cursor->posting = posting;
+    cursor->end = posting->size;
+    cursor->left = posting->count;
+    cursor->entry = posting->last;
+}
+
+static bool cursor_next(hs_cursor *cursor, uint32_t *entry) {
+    if (cursor->left == 0u) {
+        return false;
+    }
+    *entry = cursor->entry;
+    if (--cursor->left > 0u) {
+        const unsigned char *deltas = cursor->posting->deltas;
+        uint32_t start = cursor->end - 1u;
+        while (start > 0u && (deltas[start - 1u] & 0x80u)) {
+            --start;
+        }
+        uint32_t delta = 0u;
+        for (uint32_t i = cursor->end; i-- > start;) {
+            delta = delta << 7 | (deltas[i] & 0x7Fu);
+        }
+        cursor->end = start;
+        cursor->entry -= delta;
+    }
+    return true;
+}
+
+/* Adds up to batch more entries to the trigram index. */
+static int trigrams_sync(struct gs_history *history, size_t batch) {
+    hs_trigrams *trigrams = history->trigrams;
+    size_t count = gs_history_count(history);
+    for (; batch > 0u && trigrams->covered < count && trigrams->covered < UINT32_MAX; ++trigrams->covered, --batch) {
+        gs_history_entry entry;
+        if (gs_history_get(history, trigrams->covered, &entry) &&
+            trigrams_add(trigrams, (uint32_t)trigrams->covered, entry.text, entry.len) != GS_OK) {
+            return GS_ERR_ALLOC;
+        }
+    }
+    return GS_OK;
+}
+
+static void trigrams_free(hs_trigrams *trigrams) {
+    if (!trigrams) {
+        return;
+    }
+    for (size_t i = 0; i < trigrams->slot_count; ++i) {
+        free(trigrams->slots[i].deltas);
+    }
+    free(trigrams->slots);
+    free(trigrams);
+}
+
+/* Makes sure the trigram index exists and adds a batch of entries to it. */
+static bool trigrams_step(struct gs_history *history, size_t batch) {
+    if (!history->trigrams) {
+        history->trigrams = (hs_trigrams *)calloc(1u, sizeof(hs_trigrams));
+    }
+    if (history->trigrams && trigrams_sync(history, batch) != GS_OK) {
+        trigrams_free(history->trigrams); /* searches walk the entries instead */
+        history->trigrams = NULL;
+    }
+    return history->trigrams != NULL;
+}
+
+static uint32_t dir_hash(const char *dir) {
+    if (!dir || dir[0] == '\0') {
+        return 0u;
+    }
+    uint32_t hash = fnv1a(2166136261u, dir, strlen(dir));
+    return hash ? hash : 1u;
+}
+
+static uint32_t node_new(hs_prefixes *prefixes, uint64_t label, uint32_t len, uint32_t best) {
+    if (prefixes->node_count == prefixes->node_capacity) {
+        size_t new_cap = prefixes->node_capacity ? prefixes->node_capacity * 2u : 4096u;
+        if (new_cap > UINT32_MAX) {
+            return 0u;
+        }
+        hs_node *tmp = (hs_node *)realloc(prefixes->nodes, new_cap * sizeof(hs_node));
+        if (!tmp) {
+            return 0u;
+        }
+        prefixes->nodes = tmp;
+        prefixes->node_capacity = new_cap;
+        if (prefixes->node_count == 0u) {
+            prefixes->node_count = 1u; /* node 0 stands for "none" */
+        }
+    }
+    hs_node *node = &prefixes->nodes[prefixes->node_count];
+    node->label = label;
+    node->len = len;
+    node->child = 0u;
+    node->sibling = 0u;
+    node->best = best;
+    return (uint32_t)prefixes->node_count++;
+}
+
+static size_t dir_slot(const hs_prefixes *prefixes, uint32_t dir) {
+    size_t mask = prefixes->dir_slots - 1u;
+    size_t slot = (dir * 2654435761u) & mask;
+    while (prefixes->dirs[slot].dir != 0u && prefixes->dirs[slot].dir != dir) {
+        slot = (slot + 1u) & mask;
+    }
+    return slot;
+}
+
+static uint32_t dir_find(const hs_prefixes *prefixes, uint32_t dir) {
+    if (dir == 0u || prefixes->dir_slots == 0u) {
+        return 0u;
+    }
+    const hs_dir_root *found = &prefixes->dirs[dir_slot(prefixes, dir)];
+    return found->dir == dir ? found->root : 0u;
+}
+
+/* Returns the root of dir's trie, creating it; 0 when out of memory. */
+static uint32_t dir_root(hs_prefixes *prefixes, uint32_t dir) {
+    if ((prefixes->dir_used + 1u) * 2u > prefixes->dir_slots) {
+        size_t old_slots = prefixes->dir_slots;
+        hs_dir_root *old = prefixes->dirs;
+        size_t new_slots = old_slots ? old_slots * 2u : 256u;
+        prefixes->dirs = (hs_dir_root *)calloc(new_slots, sizeof(hs_dir_root));
+        if (!prefixes->dirs) {
+            prefixes->dirs = old;
+            return 0u;
+        }
+        prefixes->dir_slots = new_slots;
+        for (size_t i = 0; i < old_slots; ++i) {
+            if (old[i].dir != 0u) {
+                prefixes->dirs[dir_slot(prefixes, old[i].dir)] = old[i];
+            }
+        }
+        free(old);
+    }
+    hs_dir_root *slot = &prefixes->dirs[dir_slot(prefixes, dir)];
+    if (slot->dir == 0u) {
+        uint32_t root = node_new(prefixes, 0u, 0u, 0u);
+        if (root == 0u) {
+            return 0u;
+        }
+        slot->dir = dir;
+        slot->root = root;
+        prefixes->dir_used++;
+    }
+    return slot->root;
+}
+
+/* Inserts the entry whose text starts at log offset text into the trie at root. */
+static int prefixes_insert(const struct gs_history *history, hs_prefixes *prefixes, uint32_t root, uint32_t entry,
+                           uint64_t text, size_t len) {
+    const unsigned char *key = history->log + text;
+    uint32_t node = root;
+    size_t i = 0u;
+    for (;;) {
+        if (entry > prefixes->nodes[node].best) {
+            prefixes->nodes[node].best = entry;
+        }
+        if (i == len) {
+            return GS_OK;
+        }
+        uint32_t *link = &prefixes->nodes[node].child;
+        while (*link != 0u && history->log[prefixes->nodes[*link].label] != key[i]) {
+            link = &prefixes->nodes[*link].sibling;
+        }
+        uint32_t child = *link;
+        if (child == 0u) {
+            size_t link_at = (size_t)((char *)link - (char *)prefixes->nodes);
+            uint32_t leaf = node_new(prefixes, text + i, (uint32_t)(len - i), entry);
+            if (leaf == 0u) {
+                return GS_ERR_ALLOC;
+            }
+            *(uint32_t *)((char *)prefixes->nodes + link_at) = leaf;
+            return GS_OK;
+        }
+        hs_node *edge = &prefixes->nodes[child];
+        const unsigned char *label = history->log + edge->label;
+        size_t m = 1u;
+        while (m < edge->len && i + m < len && label[m] == key[i + m]) {
+            ++m;
+        }
+        if (m < edge->len) {
+            /* Split the edge: a node for the shared part takes its place. */
+            size_t link_at = (size_t)((char *)link - (char *)prefixes->nodes);
+            uint32_t mid = node_new(prefixes, edge->label, (uint32_t)m, entry);
+            if (mid == 0u) {
+                return GS_ERR_ALLOC;
+            }
+            edge = &prefixes->nodes[child];
+            prefixes->nodes[mid].child = child;
+            prefixes->nodes[mid].sibling = edge->sibling;
+            prefixes->nodes[mid].best = edge->best > entry ? edge->best : entry;
+            edge->sibling = 0u;
+            edge->label += m;
+            edge->len -= (uint32_t)m;
+            *(uint32_t *)((char *)prefixes->nodes + link_at) = mid;
+            child = mid;
+        }
+        node = child;
+        i += m;
+    }
+}
+
+static void prefixes_free(hs_prefixes *prefixes);
+
+/* Adds one entry to the tries; multi-line entries are left out. */
+static int prefixes_add(struct gs_history *history, size_t index) {
+    hs_prefixes *prefixes = history->prefixes;
+    gs_history_entry entry;
+    if (!gs_history_get(history, index, &entry) || memchr(entry.text, '\n', entry.len)) {
+        return GS_OK;
+    }
+    uint64_t text = (uint64_t)((const unsigned char *)entry.text - history->log);
+    if (prefixes_insert(history, prefixes, prefixes->root, (uint32_t)index, text, entry.len) != GS_OK) {
+        return GS_ERR_ALLOC;
+    }
+    uint32_t root = entry.dir ? dir_root(prefixes, entry.dir) : 0u;
+    if (entry.dir && (root == 0u || prefixes_insert(history, prefixes, root, (uint32_t)index, text, entry.len) != GS_OK)) {
+        return GS_ERR_ALLOC;
+    }
+    return GS_OK;
+}
+
+/* Adds the entries mapped since the last call and then up to batch older ones. */
+static int prefixes_sync(struct gs_history *history, size_t batch) {
+    hs_prefixes *prefixes = history->prefixes;
+    if (prefixes->root == 0u) {
+        if ((prefixes->root = node_new(prefixes, 0u, 0u, 0u)) == 0u) {
+            return GS_ERR_ALLOC;
+        }
+        prefixes->covered = prefixes->pending = gs_history_count(history);
+    }
+    size_t count = gs_history_count(history);
+    for (; prefixes->covered < count && prefixes->covered < UINT32_MAX; ++prefixes->covered) {
+        if (prefixes_add(history, prefixes->covered) != GS_OK) {
+            return GS_ERR_ALLOC;
+        }
+    }
+    for (; batch > 0u && prefixes->pending > 0u; --batch) {
+        if (prefixes->pending - 1u < UINT32_MAX && prefixes_add(history, prefixes->pending - 1u) != GS_OK) {
+            return GS_ERR_ALLOC;
+        }
+        --prefixes->pending;
+    }
+    return GS_OK;
+}
+
+/* Makes sure the tries exist and takes one step of filling them. */
+static bool prefixes_step(struct gs_history *history, size_t batch) {
+    if (!history->prefixes) {
+        history->prefixes = (hs_prefixes *)calloc(1u, sizeof(hs_prefixes));
+    }
+    if (history->prefixes && prefixes_sync(history, batch) != GS_OK) {
+        prefixes_free(history->prefixes);
+        history->prefixes = NULL;
+    }
+    return history->prefixes != NULL;
+}
+
+static void prefixes_free(hs_prefixes *prefixes) {
+    if (!prefixes) {
+        return;
+    }
+    free(prefixes->nodes);
+    free(prefixes->dirs);
+    free(prefixes);
+}
+
+int gs_history_open(const char *path, struct gs_history **out) {
+    *out = NULL;
+    struct gs_history *history = (struct gs_history *)calloc(1u, sizeof(struct gs_history));
+    if (!history) {
+        return GS_ERR_ALLOC;
+    }
+    history->fd = -1;
+    history->path = strdup(path);
+    if (!history->path) {
+        gs_history_close(history);
+        return GS_ERR_ALLOC;
+    }
+    history->fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    history->writable = history->fd >= 0;
+    if (!history->writable) {
+        history->fd = open(path, O_RDONLY | O_CLOEXEC);
+    }
+    struct stat st;
+    if (history->fd < 0 || fstat(history->fd, &st) != 0) {
+        gs_history_close(history);
+        return GS_ERR_EXEC;
+    }
+    history->dev = (uint64_t)st.st_dev;
+    history->ino = (uint64_t)st.st_ino;
+    history->session = atomic_fetch_add(&g_next_session, 1u);
+
+    /* The index first: every offset in it then lies within the log mapped after. */
+    index_load(history);
+    int status = log_map(history);
+    if (status == GS_OK) {
+        index_check(history);
+        status = scan(history);
+    }
+    if (status != GS_OK) {
+        gs_history_close(history);
+        return status;
+    }
+    if (history->tail_count >= HS_INDEX_LAG) {
+        index_extend(history);
+    }
+    *out = history;
+    return GS_OK;
+}
+
+void gs_history_close(struct gs_history *history) {
+    if (!history) {
+        return;
+    }
+    index_unmap(history);
+    if (history->log) {
+        munmap((void *)history->log, history->log_mapped);
+    }
+    if (history->fd >= 0) {
+        close(history->fd);
+    }
+    trigrams_free(history->trigrams);
+    prefixes_free(history->prefixes);
+    free(history->tail);
+    free(history->path);
+    free(history);
+}
+
+int gs_history_refresh(struct gs_history *history) {
+    int status = log_map(history);
+    if (status == GS_OK) {
+        status = scan(history);
+    }
+    if (history->tail_count >= HS_INDEX_LAG) {
+        index_extend(history);
+    }
+    if (history->prefixes && prefixes_sync(history, 0u) != GS_OK) {
+        prefixes_free(history->prefixes);
+        history->prefixes = NULL;
+    }
+    return status;
+}
+
+int gs_history_append(struct gs_history *history, const char *text, size_t len, const char *dir) {
+    if (!history->writable || len == 0u || len > HS_MAX_COMMAND) {
+        return GS_ERR_EXEC;
+    }
+    size_t total = align8(sizeof(hs_record) + len);
+    unsigned char *record = (unsigned char *)calloc(1u, total);
+    if (!record) {
+        return GS_ERR_ALLOC;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    hs_record rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.magic = HS_RECORD_MAGIC;
+    rec.len = (uint32_t)len;
+    rec.time = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    rec.pid = (uint32_t)getpid();
+    rec.session = history->session;
+    rec.serial = history->serial + 1u;
+    rec.dir = dir_hash(dir);
+    rec.checksum = record_checksum(&rec, text);
+    memcpy(record, &rec, sizeof(rec));
+    memcpy(record + sizeof(rec), text, len);
+
+    ssize_t n;
+    do {
+        n = write(history->fd, record, total);
+    } while (n < 0 && errno == EINTR);
+    free(record);
+    if (n != (ssize_t)total) {
+        return GS_ERR_EXEC; /* anything written is a torn record that readers skip */
+    }
+    history->serial = rec.serial;
+    return gs_history_refresh(history);
+}
+
+size_t gs_history_count(const struct gs_history *history) {
+    return history->indexed + history->tail_count;
+}
+
+bool gs_history_get(const struct gs_history *history, size_t index, gs_history_entry *out) {
+    if (index >= gs_history_count(history)) {
+        return false;
+    }
+    uint64_t offset = offset_of(history, index);
+    hs_record rec;
+    if (record_at(history, offset, &rec) == 0u) {
+        return false;
+    }
+    out->text = (const char *)history->log + offset + sizeof(rec);
+    out->len = rec.len;
+    out->time = rec.time;
+    out->pid = rec.pid;
+    out->session = rec.session;
+    out->serial = rec.serial;
+    out->dir = rec.dir;
+    return true;
+}
+
+static bool contains(const char *text, size_t len, const hs_word *word, bool fold_case) {
+    for (size_t start = 0u; start + word->len <= len; ++start) {
+        size_t i = 0u;
+        while (i < word->len && (fold_case ? fold((unsigned char)text[start + i]) == (unsigned char)word->text[i]
+                                           : text[start + i] == word->text[i])) {
+            ++i;
+        }
+        if (i == word->len) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool entry_matches(const struct gs_history *history, size_t index, const hs_word *words, size_t count,
+                          bool fold_case) {
+    gs_history_entry entry;
+    if (!gs_history_get(history, index, &entry)) {
+        return false;
+    }
+    for (size_t w = 0; w < count; ++w) {
+        if (!contains(entry.text, entry.len, &words[w], fold_case)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool gs_history_search(struct gs_history *history, const char *query, size_t before, size_t *out) {
+    hs_word words[HS_QUERY_WORDS];
+    size_t word_count = 0u;
+    bool fold_case = true;
+    for (const char *p = query; *p && word_count < HS_QUERY_WORDS;) {
+        while (*p == ' ') {
+            ++p;
+        }
+        const char *start = p;
+        while (*p && *p != ' ') {
+            fold_case = fold_case && !(*p >= 'A' && *p <= 'Z');
+            ++p;
+        }
+        if (p > start) {
+            words[word_count].text = start;
+            words[word_count].len = (size_t)(p - start);
+            ++word_count;
+        }
+    }
+    size_t count = gs_history_count(history);
+    if (before > count) {
+        before = count;
+    }
+    if (word_count == 0u) {
+        return false;
+    }
+
+    /* Entries the index does not cover yet are the newest; check them first. */
+    size_t covered = trigrams_step(history, HS_TRIGRAM_BATCH) ? history->trigrams->covered : 0u;
+    for (size_t i = before; i-- > covered;) {
+        if (entry_matches(history, i, words, word_count, fold_case)) {
+            *out = i;
+            return true;
+        }
+    }
+    if (before > covered) {
+        before = covered;
+    }
+    const hs_posting *rarest = NULL;
+    for (size_t w = 0; history->trigrams && w < word_count; ++w) {
+        for (size_t i = 0; i + 3u <= words[w].len; ++i) {
+            const hs_posting *posting = trigram_find(history->trigrams, trigram_key(words[w].text + i));
+            if (!posting) {
+                return false;
+            }
+            if (!rarest || posting->count < rarest->count) {
+                rarest = posting;
+            }
+        }
+    }
+
+    if (!rarest) {
+        /* Only short words (or no index): any entry may match, so walk them. */
+        for (size_t i = before; i-- > 0u;) {
+            if (entry_matches(history, i, words, word_count, fold_case)) {
+                *out = i;
+                return true;
+            }
+        }
+        return false;
+    }
+    hs_cursor cursor;
+    cursor_start(&cursor, rarest);
+    uint32_t entry;
+    while (cursor_next(&cursor, &entry)) {
+        if (entry < before && entry_matches(history, entry, words, word_count, fold_case)) {
+            *out = entry;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Returns the newest entry in the trie at root that extends prefix, or -1. */
+static int64_t prefix_best(const struct gs_history *history, const hs_prefixes *prefixes, uint32_t root,
+                           const char *prefix, size_t len) {
+    uint32_t node = root;
+    size_t i = 0u;
+    while (node != 0u && i < len) {
+        uint32_t child = prefixes->nodes[node].child;
+        while (child != 0u && history->log[prefixes->nodes[child].label] != (unsigned char)prefix[i]) {
+            child = prefixes->nodes[child].sibling;
+        }
+        if (child == 0u) {
+            return -1;
+        }
+        const hs_node *edge = &prefixes->nodes[child];
+        size_t m = edge->len < len - i ? edge->len : len - i;
+        if (memcmp(history->log + edge->label, prefix + i, m) != 0) {
+            return -1;
+        }
+        node = child;
+        i += m;
+    }
+    if (node == 0u) {
+        return -1;
+    }
+    gs_history_entry entry;
+    uint32_t best = prefixes->nodes[node].best;
+    if (!gs_history_get(history, best, &entry) || entry.len <= len) {
+        return -1; /* the newest use was the prefix itself */
+    }
+    return best;
+}
+
+bool gs_history_suggest(struct gs_history *history, const char *prefix, size_t len, const char *dir, size_t *out) {
+    if (len == 0u || !prefixes_step(history, HS_PREFIX_BATCH)) {
+        return false;
+    }
+    int64_t anywhere = prefix_best(history, history->prefixes, history->prefixes->root, prefix, len);
+    uint32_t root = dir_find(history->prefixes, dir_hash(dir));
+    int64_t here = root ? prefix_best(history, history->prefixes, root, prefix, len) : -1;
+    if (here >= 0 && (anywhere < 0 || here + HS_DIR_BONUS > anywhere)) {
+        *out = (size_t)here;
+    } else if (anywhere >= 0) {
+        *out = (size_t)anywhere;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool gs_history_warm(struct gs_history *history) {
+    if (prefixes_step(history, HS_PREFIX_BATCH) && history->prefixes->pending > 0u) {
+        return true;
+    }
+    return trigrams_step(history, HS_TRIGRAM_BATCH) && history->trigrams->covered < gs_history_count(history);
+}
+
+/* Returns the malloc'd log path, or NULL when none applies. */
+static char *history_path(const struct gs_shell *shell, bool interactive) {
+    const char *named = gs_shell_getvar(shell, "GENSHELL_HISTORY");
+    if (named) {
+        return named[0] ? strdup(named) : NULL;
+    }
+    const char *home = gs_shell_getvar(shell, "HOME");
+    if (!interactive || !home || home[0] != '/') {
+        return NULL;
+    }
+    size_t len = strlen(home);
+    char *path = (char *)malloc(len + sizeof("/.genshell_history"));
+    if (path) {
+        memcpy(path, home, len);
+        memcpy(path + len, "/.genshell_history", sizeof("/.genshell_history"));
+    }
+    return path;
+}
+
+struct gs_history *gs_shell_history(struct gs_shell *shell) {
+    char *path = history_path(shell, true);
+    if (shell->history && (!path || strcmp(path, shell->history->path) != 0)) {
+        gs_history_close(shell->history);
+        shell->history = NULL;
+    }
+    if (path && !shell->history) {
+        (void)gs_history_open(path, &shell->history);
+    }
+    free(path);
+    return shell->history;
+}
+
+void gs_history_record(struct gs_shell *shell, const char *text, size_t len) {
+    if (!shell->interactive && !gs_shell_getvar(shell, "GENSHELL_HISTORY")) {
+        return;
+    }
+    struct gs_history *history = gs_shell_history(shell);
+    if (history) {
+        (void)gs_history_append(history, text, len, gs_shell_getvar(shell, "PWD"));
+    }
+}
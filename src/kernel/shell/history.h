@@ -0,0 +1,79 @@
+#ifndef GS_HISTORY_H
+#define GS_HISTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct gs_shell;
+struct gs_history;
+
+/*
+ * Command history shared by every shell of the user. The log named by the
+ * shell's $GENSHELL_HISTORY (default ~/.genshell_history; empty disables it)
+ * is append-only: each command is one self-checking record written with a
+ * single O_APPEND write(2), so sessions append without any lock, and a
+ * sidecar "<log>.idx" holds the offsets of the records before it. Opening
+ * maps both files and scans only the records the index does not cover yet,
+ * so it takes the same time for ten entries as for ten million.
+ */
+
+typedef struct {
+    const char *text; /* not NUL-terminated; valid until the next append or refresh */
+    size_t len;
+    int64_t time; /* CLOCK_REALTIME nanoseconds */
+    uint32_t pid;
+    uint32_t session; /* distinguishes the sessions of one process */
+    uint64_t serial;  /* 1, 2, ... within the session */
+    uint32_t dir;     /* hash of the directory it ran in; 0 when unknown */
+} gs_history_entry;
+
+int gs_history_open(const char *path, struct gs_history **out);
+void gs_history_close(struct gs_history *history);
+
+/* Appends one command run in directory dir (may be NULL); returns GS_OK or a negative error. */
+int gs_history_append(struct gs_history *history, const char *text, size_t len, const char *dir);
+/* Maps whatever other sessions appended since the log was last looked at. */
+int gs_history_refresh(struct gs_history *history);
+
+size_t gs_history_count(const struct gs_history *history);
+/* Fills out with entry index (0 is the oldest); false when it is unreadable. */
+bool gs_history_get(const struct gs_history *history, size_t index, gs_history_entry *out);
+
+/*
+ * Finds the newest entry older than index before that contains every
+ * space-separated word of query, in any order; words match case-insensitively
+ * unless the query has an upper-case letter. Candidates come from a trigram
+ * index that gs_history_warm (and each search) extends by a batch of
+ * entries; those it does not cover yet are checked one by one.
+ */
+bool gs_history_search(struct gs_history *history, const char *query, size_t before, size_t *out);
+
+/*
+ * Finds the entry to suggest for a line starting with prefix: the newest
+ * single-line entry that starts with it, preferring one that ran in
+ * directory dir unless a much newer one ran elsewhere, and nothing when
+ * that entry is the prefix itself. Answers come from a prefix trie that
+ * each call (and gs_history_warm) extends by a batch of older entries, so a
+ * call costs about the length of the prefix however long the history is.
+ */
+bool gs_history_suggest(struct gs_history *history, const char *prefix, size_t len, const char *dir, size_t *out);
+/*
+ * Adds a batch of entries to the suggestion trie or, once that is full, to
+ * the search index; false once both hold every entry.
+ */
+bool gs_history_warm(struct gs_history *history);
+
+/*
+ * The history the shell reads, opened on first use and reopened when
+ * $GENSHELL_HISTORY changes; NULL when there is none.
+ */
+struct gs_history *gs_shell_history(struct gs_shell *shell);
+/*
+ * Appends a command line the shell read; failures are silently ignored.
+ * Only interactive shells use the default log, as with the frecency
+ * database; an explicit $GENSHELL_HISTORY records everywhere.
+ */
+void gs_history_record(struct gs_shell *shell, const char *text, size_t len);
+
+#endif /* GS_HISTORY_H */
@@ -0,0 +1,922 @@
+/*
+ * Interactive line editor.
+ *
+ * The line is kept as bytes; the cursor moves over UTF-8 sequences as a
+ * whole and control bytes are shown as ^X. Lines wider than the terminal
+ * scroll horizontally so the cursor stays on screen, and every change
+ * redraws the one line with a single write(2).
+ *
+ *   Left/Right, ^B/^F      move a character      Alt-B/Alt-F, ^Left/^Right  a word
+ *   Home/End, ^A/^E        start or end of line  Backspace/^H, Delete       erase
+ *   ^K, ^U, ^W             cut to end, to start, the previous word; ^Y pastes it
+ *   Up/Down, ^P/^N         older or newer history entry
+ *   ^R                     reverse search of the history (again for older matches)
+ *   ^C                     abandon the line      ^D  erase, or end input on an empty line
+ *   ^L                     clear the screen      Tab  complete the word (see complete.h)
+ *
+ * During a search typed characters extend the query, Backspace shortens it,
+ * ^G restores the line the search started from and any other key leaves
+ * the search with the match as the line and is then handled as usual, so
+ * Enter runs the match. Matches come from gs_history_search's trigram index.
+ *
+ * With the cursor at the end of the line, the rest of the history entry
+ * gs_history_suggest picks for it is shown dimmed after the cursor; Right,
+ * ^F, End or ^E take all of it and Alt-F or ^Right its next word.
+ *
+ * A prompt of several lines has all but its last printed once above the
+ * line; only the last is redrawn with it. Escape sequences in the prompt
+ * take no columns. While the line is edited, the editor also waits on the
+ * prompt's background segments (prompt.h) and redraws the whole prompt in
+ * place when one of them changes it.
+ */
+#include "lineedit.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "builtins/builtin.h"
+#include "complete.h"
+#include "history.h"
+#include "prompt.h"
+#include "shell.h"
+
+#define LE_ESCAPE_WAIT_MS 50 /* how long a lone ESC waits for the rest of a sequence */
+#define LE_LIST_MAX 256u     /* completion candidates listed at most */
+#define LE_SEARCH_PROMPT "(reverse-i-search)`"
+#define LE_FAILED_PROMPT "(failed reverse-i-search)`"
+#define LE_CTRL(c) ((c) & 0x1f)
+
+enum {
+    LE_KEY_NONE = 0x100,
+    LE_KEY_LEFT,
+    LE_KEY_RIGHT,
+    LE_KEY_UP,
+    LE_KEY_DOWN,
+    LE_KEY_HOME,
+    LE_KEY_END,
+    LE_KEY_DELETE,
+    LE_KEY_WORD_LEFT,
+    LE_KEY_WORD_RIGHT,
+    LE_KEY_EOF,
+    LE_KEY_ERROR,
+    LE_KEY_PROMPT /* a background prompt segment is ready */
+};
+
+/* Bytes kept NUL-terminated, so a query can be passed on as a string. */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} le_text;
+
+typedef struct {
+    struct gs_shell *shell;
+    int in_fd;
+    int out_fd;
+    char *full_prompt; /* as expanded, to hand back to gs_prompt_refresh */
+    const char *prompt; /* its last line, drawn with the edited line */
+    size_t head_lines;  /* lines above it */
+    le_text line;
+    size_t pos;
+    le_text cut; /* the text ^K, ^U or ^W removed last */
+    struct gs_history *history;
+    size_t history_count; /* entries when the line was started */
+    size_t recall;        /* entry on display; history_count for the line being typed */
+    le_text draft;        /* the line being typed, kept while browsing the history */
+    bool searching;
+    bool search_failed;
+    le_text query;
+    le_text origin; /* the line the search started from */
+    bool have_match;
+    size_t match;
+    le_text suggestion; /* what the suggested entry adds to the line */
+    le_text screen; /* output of one redraw */
+} le_state;
+
+static bool text_reserve(le_text *text, size_t len) {
+    if (len + 1u <= text->cap) {
+        return true;
+    }
+    size_t new_cap = text->cap ? text->cap : 64u;
+    while (new_cap < len + 1u) {
+        new_cap *= 2u;
+    }
+    char *tmp = (char *)realloc(text->data, new_cap);
+    if (!tmp) {
+        return false;
+    }
+    text->data = tmp;
+    text->cap = new_cap;
+    return true;
+}
+
+static bool text_insert(le_text *text, size_t at, const char *data, size_t len) {
+    if (!text_reserve(text, text->len + len)) {
+        return false;
+    }
+    memmove(text->data + at + len, text->data + at, text->len - at);
+    memcpy(text->data + at, data, len);
+    text->len += len;
+    text->data[text->len] = '\0';
+    return true;
+}
+
+static bool text_append(le_text *text, const char *data, size_t len) {
+    return text_insert(text, text->len, data, len);
+}
+
+static bool text_set(le_text *text, const char *data, size_t len) {
+    text->len = 0u;
+    if (!text_reserve(text, len)) {
+        return false;
+    }
+    return text_insert(text, 0u, data, len);
+}
+
+static void text_erase(le_text *text, size_t at, size_t len) {
+    memmove(text->data + at, text->data + at + len, text->len - at - len);
+    text->len -= len;
+    text->data[text->len] = '\0';
+}
+
+static void text_free(le_text *text) {
+    free(text->data);
+    memset(text, 0, sizeof(*text));
+}
+
+static bool is_continuation(unsigned char c) {
+    return (c & 0xC0u) == 0x80u;
+}
+
+static size_t byte_columns(unsigned char c) {
+    if (c < 0x20u || c == 0x7Fu) {
+        return 2u;
+    }
+    return is_continuation(c) ? 0u : 1u;
+}
+
+static size_t columns(const char *data, size_t len) {
+    size_t cols = 0u;
+    for (size_t i = 0; i < len; ++i) {
+        cols += byte_columns((unsigned char)data[i]);
+    }
+    return cols;
+}
+
+/* Columns of a prompt, whose CSI and OSC escape sequences take none. */
+static size_t prompt_columns(const char *prompt) {
+    size_t cols = 0u;
+    for (const unsigned char *p = (const unsigned char *)prompt; *p; ++p) {
+        if (*p == 0x1Bu && p[1] == '[') {
+            for (p += 2; *p && (*p < 0x40u || *p > 0x7Eu); ++p) {
+            }
+        } else if (*p == 0x1Bu && p[1] == ']') {
+            for (p += 2; *p && *p != '\a' && !(*p == 0x1Bu && p[1] == '\\'); ++p) {
+            }
+            p += *p == 0x1Bu;
+        } else if (*p != 0x1Bu) {
+            cols += byte_columns(*p);
+        }
+        if (!*p) {
+            break;
+        }
+    }
+    return cols;
+}
+
+/* Appends data with control bytes spelled ^X. */
+static void append_visible(le_text *out, const char *data, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char c = (unsigned char)data[i];
+        if (c < 0x20u || c == 0x7Fu) {
+            char caret[2] = {'^', (char)(c ^ 0x40u)};
+            text_append(out, caret, 2u);
+        } else {
+            text_append(out, &data[i], 1u);
+        }
+    }
+}
+
+static size_t prev_char(const le_text *line, size_t pos) {
+    while (pos > 0u && is_continuation((unsigned char)line->data[--pos])) {
+    }
+    return pos;
+}
+
+static size_t next_char(const le_text *line, size_t pos) {
+    if (pos < line->len) {
+        ++pos;
+    }
+    while (pos < line->len && is_continuation((unsigned char)line->data[pos])) {
+        ++pos;
+    }
+    return pos;
+}
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n';
+}
+
+static size_t prev_word(const le_text *line, size_t pos) {
+    while (pos > 0u && is_space(line->data[pos - 1u])) {
+        --pos;
+    }
+    while (pos > 0u && !is_space(line->data[pos - 1u])) {
+        --pos;
+    }
+    return pos;
+}
+
+static size_t next_word(const le_text *line, size_t pos) {
+    while (pos < line->len && is_space(line->data[pos])) {
+        ++pos;
+    }
+    while (pos < line->len && !is_space(line->data[pos])) {
+        ++pos;
+    }
+    return pos;
+}
+
+static size_t terminal_columns(int fd) {
+    struct winsize ws;
+    if (ioctl(fd, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) {
+        return ws.ws_col;
+    }
+    return 80u;
+}
+
+/* Redraws the line, scrolled so that the cursor is visible. */
+static void refresh(le_state *st) {
+    le_text *out = &st->screen;
+    out->len = 0u;
+    text_append(out, "\r", 1u);
+    size_t prefix_start = out->len;
+    if (st->searching) {
+        const char *label = st->search_failed ? LE_FAILED_PROMPT : LE_SEARCH_PROMPT;
+        text_append(out, label, strlen(label));
+        append_visible(out, st->query.data ? st->query.data : "", st->query.len);
+        text_append(out, "': ", 3u);
+    } else {
+        text_append(out, st->prompt, strlen(st->prompt));
+    }
+    size_t prefix_cols = st->searching ? columns(out->data + prefix_start, out->len - prefix_start) : prompt_columns(st->prompt);
+
+    size_t width = terminal_columns(st->out_fd);
+    size_t avail = width > prefix_cols + 1u ? width - prefix_cols - 1u : 1u;
+    const char *data = st->line.data ? st->line.data : "";
+    size_t start = 0u;
+    size_t cursor_cols = columns(data, st->pos);
+    while (cursor_cols > avail && start < st->pos) {
+        size_t next = next_char(&st->line, start);
+        cursor_cols -= columns(data + start, next - start);
+        start = next;
+    }
+    size_t end = start;
+    size_t shown = 0u;
+    while (end < st->line.len) {
+        size_t next = next_char(&st->line, end);
+        size_t cols = columns(data + end, next - end);
+        if (shown + cols > avail) {
+            break;
+        }
+        shown += cols;
+        end = next;
+    }
+    append_visible(out, data + start, end - start);
+    if (end == st->line.len && st->suggestion.len > 0u) {
+        size_t fit = 0u;
+        while (fit < st->suggestion.len && shown + byte_columns((unsigned char)st->suggestion.data[fit]) <= avail) {
+            shown += byte_columns((unsigned char)st->suggestion.data[fit++]);
+        }
+        while (fit < st->suggestion.len && is_continuation((unsigned char)st->suggestion.data[fit])) {
+            ++fit;
+        }
+        text_append(out, "\x1b[90m", 5u);
+        append_visible(out, st->suggestion.data, fit);
+        text_append(out, "\x1b[0m", 4u);
+    }
+    text_append(out, "\x1b[K\r", 4u);
+    size_t cursor = prefix_cols + cursor_cols;
+    if (cursor > 0u) {
+        char move[32];
+        int n = snprintf(move, sizeof(move), "\x1b[%zuC", cursor);
+        text_append(out, move, (size_t)n);
+    }
+    (void)gs_builtin_write_all(st->out_fd, out->data, out->len);
+}
+
+/* Takes prompt as the prompt; false, keeping the old one, when it cannot be copied. */
+static bool set_prompt(le_state *st, const char *prompt) {
+    char *copy = strdup(prompt);
+    if (!copy) {
+        return false;
+    }
+    free(st->full_prompt);
+    st->full_prompt = copy;
+    const char *last = strrchr(copy, '\n');
+    st->prompt = last ? last + 1 : copy;
+    st->head_lines = 0u;
+    for (const char *p = copy; p < st->prompt; ++p) {
+        st->head_lines += *p == '\n';
+    }
+    return true;
+}
+
+/* Prints the lines of the prompt above the edited line, clearing what they cover. */
+static void print_head(le_state *st) {
+    le_text *out = &st->screen;
+    out->len = 0u;
+    for (const char *p = st->full_prompt; p < st->prompt; ++p) {
+        if (*p == '\n') {
+            text_append(out, "\x1b[K", 3u);
+        }
+        text_append(out, p, 1u);
+    }
+    (void)gs_builtin_write_all(st->out_fd, out->data, out->len);
+}
+
+/* Draws the prompt again over the old one once a background segment has changed it. */
+static void update_prompt(le_state *st) {
+    char *fresh = gs_prompt_refresh(st->shell, st->full_prompt);
+    if (!fresh) {
+        return;
+    }
+    char up[32];
+    int n = st->head_lines > 0u ? snprintf(up, sizeof(up), "\r\x1b[%zuA", st->head_lines) : snprintf(up, sizeof(up), "\r");
+    (void)gs_builtin_write_all(st->out_fd, up, (size_t)n);
+    (void)gs_builtin_write_all(st->out_fd, "\x1b[J", 3u);
+    (void)set_prompt(st, fresh);
+    free(fresh);
+    print_head(st);
+}
+
+static int read_byte(int fd, unsigned char *out) {
+    for (;;) {
+        ssize_t n = read(fd, out, 1u);
+        if (n == 1) {
+            return 1;
+        }
+        if (n == 0) {
+            return 0;
+        }
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+static bool byte_ready(int fd, int timeout_ms) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    int rc;
+    do {
+        rc = poll(&pfd, 1u, timeout_ms);
+    } while (rc < 0 && errno == EINTR);
+    return rc > 0;
+}
+
+/* Decodes the rest of a CSI or SS3 sequence ("ESC [" or "ESC O"). */
+static int read_sequence(int fd) {
+    char params[16];
+    size_t len = 0u;
+    unsigned char c;
+    for (;;) {
+        if (read_byte(fd, &c) <= 0) {
+            return LE_KEY_NONE;
+        }
+        if (c >= 0x40u && c <= 0x7Eu) {
+            break;
+        }
+        if (len + 1u < sizeof(params)) {
+            params[len++] = (char)c;
+        }
+    }
+    params[len] = '\0';
+    bool word = strcmp(params, "1;5") == 0 || strcmp(params, "1;3") == 0;
+    switch (c) {
+    case 'A':
+        return LE_KEY_UP;
+    case 'B':
+        return LE_KEY_DOWN;
+    case 'C':
+        return word ? LE_KEY_WORD_RIGHT : LE_KEY_RIGHT;
+    case 'D':
+        return word ? LE_KEY_WORD_LEFT : LE_KEY_LEFT;
+    case 'H':
+        return LE_KEY_HOME;
+    case 'F':
+        return LE_KEY_END;
+    case '~':
+        switch (atoi(params)) {
+        case 1:
+        case 7:
+            return LE_KEY_HOME;
+        case 3:
+            return LE_KEY_DELETE;
+        case 4:
+        case 8:
+            return LE_KEY_END;
+        default:
+            return LE_KEY_NONE;
+        }
+    default:
+        return LE_KEY_NONE;
+    }
+}
+
+/* Returns the next key: a byte below 0x100 or one of the LE_KEY_ codes. */
+static int read_key(const le_state *st) {
+    /* Fill the suggestion trie and search index a batch at a time while no key is waiting. */
+    while (st->history && !byte_ready(st->in_fd, 0) && gs_history_warm(st->history)) {
+    }
+    int prompt_fd = gs_prompt_pending_fd(st->shell);
+    if (prompt_fd >= 0) {
+        struct pollfd pfds[2] = {{st->in_fd, POLLIN, 0}, {prompt_fd, POLLIN, 0}};
+        while (poll(pfds, 2u, -1) < 0 && errno == EINTR) {
+        }
+        if (pfds[0].revents == 0 && pfds[1].revents != 0) {
+            return LE_KEY_PROMPT;
+        }
+    }
+    unsigned char c;
+    int rc = read_byte(st->in_fd, &c);
+    if (rc <= 0) {
+        return rc == 0 ? LE_KEY_EOF : LE_KEY_ERROR;
+    }
+    if (c != 0x1Bu || !byte_ready(st->in_fd, LE_ESCAPE_WAIT_MS)) {
+        return c;
+    }
+    unsigned char next;
+    if (read_byte(st->in_fd, &next) <= 0) {
+        return LE_KEY_NONE;
+    }
+    switch (next) {
+    case '[':
+    case 'O':
+        return read_sequence(st->in_fd);
+    case 'b':
+    case 'B':
+        return LE_KEY_WORD_LEFT;
+    case 'f':
+    case 'F':
+        return LE_KEY_WORD_RIGHT;
+    default:
+        return LE_KEY_NONE;
+    }
+}
+
+/* Looks up the suggestion for the line, which needs the cursor at its end. */
+static void suggest(le_state *st) {
+    st->suggestion.len = 0u;
+    size_t index;
+    gs_history_entry entry;
+    if (!st->searching && st->history && st->line.len > 0u && st->pos == st->line.len &&
+        gs_history_suggest(st->history, st->line.data, st->line.len, gs_shell_getvar(st->shell, "PWD"), &index) &&
+        gs_history_get(st->history, index, &entry)) {
+        text_set(&st->suggestion, entry.text + st->line.len, entry.len - st->line.len);
+    }
+}
+
+/* Takes the suggestion into the line, all of it or up to the end of its next word. */
+static bool accept_suggestion(le_state *st, bool word) {
+    if (st->pos != st->line.len || st->suggestion.len == 0u) {
+        return false;
+    }
+    size_t len = st->suggestion.len;
+    if (word) {
+        len = 0u;
+        while (len < st->suggestion.len && is_space(st->suggestion.data[len])) {
+            ++len;
+        }
+        while (len < st->suggestion.len && !is_space(st->suggestion.data[len])) {
+            ++len;
+        }
+    }
+    if (text_append(&st->line, st->suggestion.data, len)) {
+        st->pos = st->line.len;
+    }
+    return true;
+}
+
+/* Shows the candidates in columns under the line; the caller redraws the line after. */
+static void list_candidates(le_state *st, const gs_completions *done) {
+    size_t shown = done->count < LE_LIST_MAX ? done->count : LE_LIST_MAX;
+    size_t widest = 0u;
+    for (size_t i = 0; i < shown; ++i) {
+        size_t cols = columns(done->items[i] + done->display, strlen(done->items[i] + done->display));
+        widest = cols > widest ? cols : widest;
+    }
+    size_t per_row = terminal_columns(st->out_fd) / (widest + 2u);
+    per_row = per_row ? per_row : 1u;
+    size_t rows = (shown + per_row - 1u) / per_row;
+    le_text *out = &st->screen;
+    out->len = 0u;
+    text_append(out, "\n", 1u);
+    for (size_t r = 0; r < rows; ++r) {
+        for (size_t c = 0; c < per_row && c * rows + r < shown; ++c) {
+            const char *name = done->items[c * rows + r] + done->display;
+            size_t len = strlen(name);
+            append_visible(out, name, len);
+            for (size_t pad = columns(name, len); c + 1u < per_row && (c + 1u) * rows + r < shown && pad < widest + 2u; ++pad) {
+                text_append(out, " ", 1u);
+            }
+        }
+        text_append(out, "\n", 1u);
+    }
+    if (shown < done->count) {
+        char more[64];
+        int n = snprintf(more, sizeof(more), "(%zu more)\n", done->count - shown);
+        text_append(out, more, (size_t)n);
+    }
+    (void)gs_builtin_write_all(st->out_fd, out->data, out->len);
+}
+
+/* Completes the word before the cursor as far as the candidates agree, or lists them. */
+static void complete_word(le_state *st) {
+    gs_completions done;
+    if (gs_complete(st->shell, st->line.data, st->pos, &done) != GS_OK || done.count == 0u) {
+        (void)gs_builtin_write_all(st->out_fd, "\a", 1u);
+        return;
+    }
+    const char *first = done.items[0];
+    size_t common = strlen(first);
+    for (size_t i = 1; i < done.count; ++i) {
+        size_t n = 0u;
+        while (n < common && first[n] == done.items[i][n]) {
+            ++n;
+        }
+        common = n;
+    }
+    /* Count the unquoted bytes, and never stop between a backslash and what it escapes. */
+    size_t raw = 0u;
+    for (size_t i = 0; i < common; ++i, ++raw) {
+        if (first[i] == '\\') {
+            if (i + 1u == common) {
+                common = i;
+                break;
+            }
+            ++i;
+        }
+    }
+    if (done.count == 1u || raw > done.raw_len) {
+        bool finished = done.count == 1u && first[common - 1u] != '/';
+        text_erase(&st->line, done.start, st->pos - done.start);
+        if (text_insert(&st->line, done.start, first, common)) {
+            st->pos = done.start + common;
+            if (finished && text_insert(&st->line, st->pos, " ", 1u)) {
+                st->pos++;
+            }
+        } else {
+            st->pos = done.start;
+        }
+    } else {
+        list_candidates(st, &done);
+        print_head(st);
+    }
+    gs_completions_dispose(&done);
+}
+
+static void cut(le_state *st, size_t from, size_t to) {
+    if (to > from) {
+        text_set(&st->cut, st->line.data + from, to - from);
+        text_erase(&st->line, from, to - from);
+        st->pos = from;
+    }
+}
+
+static bool same_as_line(const le_state *st, const gs_history_entry *entry) {
+    return entry->len == st->line.len && memcmp(entry->text, st->line.data, entry->len) == 0;
+}
+
+/* Shows history entry index, or the line being typed when index is history_count. */
+static void show_entry(le_state *st, size_t index) {
+    if (st->recall == st->history_count) {
+        text_set(&st->draft, st->line.data ? st->line.data : "", st->line.len);
+    }
+    gs_history_entry entry;
+    if (index == st->history_count) {
+        text_set(&st->line, st->draft.data ? st->draft.data : "", st->draft.len);
+    } else if (gs_history_get(st->history, index, &entry)) {
+        text_set(&st->line, entry.text, entry.len);
+    }
+    st->recall = index;
+    st->pos = st->line.len;
+}
+
+/* Moves to the nearest older (or newer) entry that differs from the line. */
+static void browse(le_state *st, bool older) {
+    if (!st->history) {
+        return;
+    }
+    size_t index = st->recall;
+    while (older ? index > 0u : index < st->history_count) {
+        index = older ? index - 1u : index + 1u;
+        gs_history_entry entry;
+        if (index == st->history_count || (gs_history_get(st->history, index, &entry) && !same_as_line(st, &entry))) {
+            show_entry(st, index);
+            return;
+        }
+    }
+}
+
+/* Offset of the query's first word in the line, for the cursor. */
+static size_t match_offset(const le_state *st) {
+    const char *word = st->query.data;
+    while (*word == ' ') {
+        ++word;
+    }
+    size_t word_len = strcspn(word, " ");
+    for (size_t start = 0u; word_len > 0u && start + word_len <= st->line.len; ++start) {
+        size_t i = 0u;
+        while (i < word_len && (st->line.data[start + i] == word[i] ||
+                                (word[i] >= 'a' && word[i] <= 'z' && st->line.data[start + i] == word[i] - 'a' + 'A'))) {
+            ++i;
+        }
+        if (i == word_len) {
+            return start;
+        }
+    }
+    return st->line.len;
+}
+
+/* Shows the newest match older than entry before, skipping copies of the line on display if skip_same. */
+static void search(le_state *st, size_t before, bool skip_same) {
+    size_t index;
+    while (st->history && st->query.len > 0u && gs_history_search(st->history, st->query.data, before, &index)) {
+        gs_history_entry entry;
+        before = index;
+        if (!gs_history_get(st->history, index, &entry) || (skip_same && same_as_line(st, &entry))) {
+            continue;
+        }
+        text_set(&st->line, entry.text, entry.len);
+        st->have_match = true;
+        st->match = index;
+        st->recall = index;
+        st->search_failed = false;
+        st->pos = match_offset(st);
+        return;
+    }
+    st->search_failed = st->query.len > 0u;
+}
+
+static void start_search(le_state *st) {
+    st->searching = true;
+    st->search_failed = false;
+    st->have_match = false;
+    text_set(&st->query, "", 0u);
+    text_set(&st->origin, st->line.data ? st->line.data : "", st->line.len);
+}
+
+/* Handles key during a search; false when it ends the search and is for the editor. */
+static bool search_key(le_state *st, int key) {
+    switch (key) {
+    case LE_CTRL('R'):
+        search(st, st->have_match ? st->match : st->history_count, true);
+        return true;
+    case 0x7F:
+    case LE_CTRL('H'):
+        if (st->query.len > 0u) {
+            size_t len = st->query.len;
+            while (len > 0u && is_continuation((unsigned char)st->query.data[--len])) {
+            }
+            text_erase(&st->query, len, st->query.len - len);
+            st->have_match = false;
+            search(st, st->history_count, false);
+        }
+        return true;
+    case LE_CTRL('G'):
+        text_set(&st->line, st->origin.data, st->origin.len);
+        st->pos = st->line.len;
+        st->recall = st->history_count;
+        st->searching = false;
+        return true;
+    case 0x1B:
+        st->searching = false;
+        return true;
+    default:
+        if (key >= 0x20 && key < 0x100 && key != 0x7F) {
+            char c = (char)key;
+            text_append(&st->query, &c, 1u);
+            search(st, st->have_match ? st->match + 1u : st->history_count, false);
+            return true;
+        }
+        st->searching = false;
+        return false;
+    }
+}
+
+/* Applies an editing key; true once the line is finished. */
+static bool edit_key(le_state *st, int key, bool *eof, bool *failed) {
+    switch (key) {
+    case LE_KEY_EOF:
+        *eof = true;
+        return true;
+    case LE_KEY_ERROR:
+        *failed = true;
+        return true;
+    case '\r':
+    case '\n':
+        return true;
+    case LE_CTRL('D'):
+        if (st->line.len == 0u) {
+            *eof = true;
+            return true;
+        }
+        text_erase(&st->line, st->pos, next_char(&st->line, st->pos) - st->pos);
+        break;
+    case LE_KEY_DELETE:
+        text_erase(&st->line, st->pos, next_char(&st->line, st->pos) - st->pos);
+        break;
+    case 0x7F:
+    case LE_CTRL('H'): {
+        size_t prev = prev_char(&st->line, st->pos);
+        text_erase(&st->line, prev, st->pos - prev);
+        st->pos = prev;
+        break;
+    }
+    case LE_CTRL('C'):
+        st->suggestion.len = 0u;
+        refresh(st);
+        (void)gs_builtin_write_all(st->out_fd, "^C\n", 3u);
+        print_head(st);
+        text_set(&st->line, "", 0u);
+        st->pos = 0u;
+        st->recall = st->history_count;
+        st->shell->last_status = 130;
+        break;
+    case LE_CTRL('A'):
+    case LE_KEY_HOME:
+        st->pos = 0u;
+        break;
+    case LE_CTRL('E'):
+    case LE_KEY_END:
+        if (!accept_suggestion(st, false)) {
+            st->pos = st->line.len;
+        }
+        break;
+    case LE_CTRL('B'):
+    case LE_KEY_LEFT:
+        st->pos = prev_char(&st->line, st->pos);
+        break;
+    case LE_CTRL('F'):
+    case LE_KEY_RIGHT:
+        if (!accept_suggestion(st, false)) {
+            st->pos = next_char(&st->line, st->pos);
+        }
+        break;
+    case LE_KEY_WORD_LEFT:
+        st->pos = prev_word(&st->line, st->pos);
+        break;
+    case LE_KEY_WORD_RIGHT:
+        if (!accept_suggestion(st, true)) {
+            st->pos = next_word(&st->line, st->pos);
+        }
+        break;
+    case LE_CTRL('K'):
+        cut(st, st->pos, st->line.len);
+        break;
+    case LE_CTRL('U'):
+        cut(st, 0u, st->pos);
+        break;
+    case LE_CTRL('W'):
+        cut(st, prev_word(&st->line, st->pos), st->pos);
+        break;
+    case LE_CTRL('Y'):
+        if (st->cut.len > 0u && text_insert(&st->line, st->pos, st->cut.data, st->cut.len)) {
+            st->pos += st->cut.len;
+        }
+        break;
+    case LE_CTRL('L'):
+        (void)gs_builtin_write_all(st->out_fd, "\x1b[H\x1b[2J", 7u);
+        print_head(st);
+        break;
+    case LE_CTRL('P'):
+    case LE_KEY_UP:
+        browse(st, true);
+        break;
+    case LE_CTRL('N'):
+    case LE_KEY_DOWN:
+        browse(st, false);
+        break;
+    case LE_CTRL('R'):
+        start_search(st);
+        break;
+    case '\t':
+        complete_word(st);
+        break;
+    default:
+        if (key >= 0x20 && key < 0x100 && key != 0x7F) {
+            char c = (char)key;
+            if (text_insert(&st->line, st->pos, &c, 1u)) {
+                st->pos++;
+            }
+        }
+        break;
+    }
+    return false;
+}
+
+bool gs_lineedit_usable(const struct gs_shell *shell, int in_fd) {
+    const char *term = gs_shell_getvar(shell, "TERM");
+    return shell->interactive && term && term[0] != '\0' && strcmp(term, "dumb") != 0 && isatty(in_fd) &&
+           isatty(shell->fds[STDOUT_FILENO]);
+}
+
+ssize_t gs_lineedit_read(struct gs_shell *shell, int in_fd, int out_fd, const char *prompt, char **line, size_t *cap,
+                         bool *eof) {
+    *eof = false;
+    struct termios saved;
+    if (tcgetattr(in_fd, &saved) != 0) {
+        return -1;
+    }
+    struct termios raw = saved;
+    raw.c_iflag &= ~(tcflag_t)(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_cflag |= CS8;
+    raw.c_lflag &= ~(tcflag_t)(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    if (tcsetattr(in_fd, TCSADRAIN, &raw) != 0) {
+        return -1;
+    }
+
+    le_state st;
+    memset(&st, 0, sizeof(st));
+    st.shell = shell;
+    st.in_fd = in_fd;
+    st.out_fd = out_fd;
+    if (!set_prompt(&st, prompt)) {
+        (void)tcsetattr(in_fd, TCSADRAIN, &saved);
+        errno = ENOMEM;
+        return -1;
+    }
+    st.history = gs_shell_history(shell);
+    if (st.history) {
+        (void)gs_history_refresh(st.history);
+        st.history_count = gs_history_count(st.history);
+    }
+    st.recall = st.history_count;
+    text_set(&st.line, "", 0u);
+    print_head(&st);
+    refresh(&st);
+
+    bool failed = false;
+    for (;;) {
+        int key = read_key(&st);
+        if (key == LE_KEY_PROMPT) {
+            update_prompt(&st);
+            refresh(&st);
+            continue;
+        }
+        if (st.searching && search_key(&st, key)) {
+            suggest(&st);
+            refresh(&st);
+            continue;
+        }
+        if (edit_key(&st, key, eof, &failed)) {
+            break;
+        }
+        suggest(&st);
+        refresh(&st);
+    }
+    if (!*eof && !failed) {
+        st.pos = st.line.len;
+        st.suggestion.len = 0u;
+        refresh(&st);
+        (void)gs_builtin_write_all(out_fd, "\n", 1u);
+    }
+    (void)tcsetattr(in_fd, TCSADRAIN, &saved);
+
+    ssize_t result = -1;
+    if (!*eof && !failed) {
+        size_t need = st.line.len + 2u;
+        if (*cap < need) {
+            char *tmp = (char *)realloc(*line, need);
+            if (tmp) {
+                *line = tmp;
+                *cap = need;
+            }
+        }
+        if (*cap >= need) {
+            memcpy(*line, st.line.data, st.line.len);
+            (*line)[st.line.len] = '\n';
+            (*line)[st.line.len + 1u] = '\0';
+            result = (ssize_t)st.line.len + 1;
+        } else {
+            errno = ENOMEM;
+        }
+    }
+    text_free(&st.line);
+    text_free(&st.cut);
+    text_free(&st.draft);
+    text_free(&st.query);
+    text_free(&st.origin);
+    text_free(&st.suggestion);
+    text_free(&st.screen);
+    free(st.full_prompt);
+    return result;
+}
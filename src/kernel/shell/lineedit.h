@@ -0,0 +1,28 @@
+#ifndef GS_LINEEDIT_H
+#define GS_LINEEDIT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+struct gs_shell;
+
+/*
+ * Line editor for the prompts of an interactive shell whose input is a
+ * terminal. The terminal is in raw mode only while a line is being edited,
+ * so commands always run with the settings the user had.
+ */
+
+/* Whether input from in_fd should go through the editor rather than getline. */
+bool gs_lineedit_usable(const struct gs_shell *shell, int in_fd);
+
+/*
+ * Shows prompt and reads one edited line into *line, growing it as
+ * getline(3) would. Returns the line's length including its newline, or -1
+ * with *eof set at the end of input (Ctrl-D on an empty line) and clear on
+ * a read error.
+ */
+ssize_t gs_lineedit_read(struct gs_shell *shell, int in_fd, int out_fd, const char *prompt, char **line, size_t *cap,
+                         bool *eof);
+
+#endif /* GS_LINEEDIT_H */
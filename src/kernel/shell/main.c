@@ -1,18 +1,73 @@
 #include "shell.h"
+#include "server.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
+/*
+ * Usage: genshell                  interactive (or stdin) session
+ *        genshell -c CMD [NAME]    run CMD, with $0 set to NAME
+ *        genshell SCRIPT           run the commands in SCRIPT
+ *        genshell --server SOCKET [RCFILE...]
+ *                                  source the RCFILEs, then run requests
+ *                                  from SOCKET in workers forked from that
+ *                                  warm shell
+ *        genshell --client SOCKET -c CMD
+ *                                  run CMD through the server on SOCKET
+ */
 int main(int argc, char **argv) {
-    (void)argc;
+    const char *progname = (argc > 0 && argv[0]) ? argv[0] : "genshell";
+    const char *command = NULL;
+    const char *script = NULL;
+    const char *server = NULL;
+
+    if (argc > 1 && strcmp(argv[1], "--client") == 0) {
+        if (argc != 5 || strcmp(argv[3], "-c") != 0) {
+            fputs("usage: genshell --client SOCKET -c CMD\n", stderr);
+            return 2;
+        }
+        return gs_server_request(argv[2], argv[4]);
+    }
+    if (argc > 1 && strcmp(argv[1], "--server") == 0) {
+        if (argc < 3) {
+            fputs("usage: genshell --server SOCKET [RCFILE...]\n", stderr);
+            return 2;
+        }
+        server = argv[2];
+    } else if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+        if (argc < 3) {
+            fputs("genshell: -c: option requires an argument\n", stderr);
+            return 2;
+        }
+        command = argv[2];
+        if (argc > 3) {
+            progname = argv[3];
+        }
+    } else if (argc > 1) {
+        script = argv[1];
+        progname = script;
+    }
 
     struct gs_shell shell;
-    if (gs_shell_init(&shell, argv ? argv[0] : "genshell") != GS_OK) {
+    if (gs_shell_init(&shell, progname) != GS_OK) {
         fputs("genshell: failed to initialise shell\n", stderr);
         return EXIT_FAILURE;
     }
 
-    int status = gs_shell_run(&shell);
+    int status;
+    if (server) {
+        for (int i = 3; i < argc && !shell.exit_requested; ++i) {
+            gs_shell_source(&shell, argv[i]);
+        }
+        status = shell.exit_requested ? shell.exit_status : gs_server_run(&shell, server);
+    } else if (command) {
+        status = gs_shell_run_string(&shell, command, true);
+    } else if (script) {
+        status = gs_shell_run_script(&shell, script);
+    } else {
+        status = gs_shell_run(&shell);
+    }
     gs_shell_destroy(&shell);
     if (status < 0) {
         status = EXIT_FAILURE;
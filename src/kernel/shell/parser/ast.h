@@ -10,20 +10,46 @@ typedef enum {
     GS_REDIR_STDIN,
     GS_REDIR_STDOUT,
     GS_REDIR_STDOUT_APPEND,
-    GS_REDIR_STDERR
+    GS_REDIR_STDERR,
+    GS_REDIR_CLOBBER,         /* n>| file */
+    GS_REDIR_READ_WRITE,      /* n<> file */
+    GS_REDIR_DUP,             /* n>&m, n<&m; target "-" closes n */
+    GS_REDIR_HEREDOC,         /* target holds the body, expanded at run time */
+    GS_REDIR_HEREDOC_LITERAL, /* quoted delimiter: body used verbatim */
+    GS_REDIR_HERESTRING       /* n<<< word */
 } gs_redirection_type;
 
 typedef struct {
     int fd;
     gs_redirection_type type;
-    char *target; /* owned */
+    char *target; /* owned; the body for here-documents */
 } gs_redirection;
 
+typedef enum {
+    GS_COMMAND_SIMPLE,
+    GS_COMMAND_SUBSHELL,   /* ( list ) */
+    GS_COMMAND_BRACE_GROUP /* { list; } */
+} gs_command_kind;
+
+typedef enum {
+    GS_CONNECT_SEQ, /* ';', '&' or newline */
+    GS_CONNECT_AND, /* && */
+    GS_CONNECT_OR   /* || */
+} gs_connector;
+
+struct gs_command_list;
+
+/*
+ * One stage of a pipeline. Grouped commands reuse the node: argv is empty
+ * and body holds the grouped list, while redirs apply to the whole group.
+ */
 typedef struct {
     char **argv;        /* NULL-terminated, owned */
     size_t argc;
     gs_redirection *redirs;
     size_t redir_count;
+    gs_command_kind kind;
+    struct gs_command_list *body; /* owned; grouped commands only */
 } gs_simple_command;
 
 typedef struct {
@@ -31,8 +57,15 @@ typedef struct {
     size_t length;
     bool background;
     bool terminator; /* true if command ended with ';' */
+    gs_connector connector; /* how this pipeline joins the previous one */
 } gs_pipeline;
 
+typedef struct gs_command_list {
+    gs_pipeline *pipelines;
+    size_t length;
+} gs_command_list;
+
 void gs_pipeline_dispose(gs_pipeline *pipeline);
+void gs_command_list_dispose(gs_command_list *list);
 
 #endif /* GS_PARSER_AST_H */
@@ -76,6 +76,15 @@ static int builder_append_literal(word_builder *builder, char ch) {
     return GS_OK;
 }
 
+/* True when the word so far starts with NAME=, which export and env take whole. */
+static bool builder_is_assignment(const word_builder *builder) {
+    size_t i = 0u;
+    while (i < builder->length && (builder->data[i] == '_' || isalnum((unsigned char)builder->data[i]))) {
+        ++i;
+    }
+    return i > 0u && i < builder->length && builder->data[i] == '=' && !isdigit((unsigned char)builder->data[0]);
+}
+
 static int builder_finalize(word_builder *builder, gs_token *out_token) {
     int rc = builder_reserve(builder, builder->length + 1u);
     if (rc != GS_OK) {
@@ -122,6 +131,72 @@ static int emit_word_token(gs_token_buffer *buf, word_builder *builder) {
     return rc;
 }
 
+/*
+ * Given p just past an opening '(', returns the matching ')' while honouring
+ * nested parentheses, quotes and backslashes, or NULL if it is unbalanced.
+ */
+const char *gs_lexer_find_closing_paren(const char *p) {
+    int depth = 1;
+    bool in_single = false;
+    bool in_double = false;
+    for (; *p; ++p) {
+        char ch = *p;
+        if (in_single) {
+            in_single = ch != '\'';
+            continue;
+        }
+        if (ch == '\\' && p[1] != '\0') {
+            ++p;
+            continue;
+        }
+        if (ch == '"') {
+            in_double = !in_double;
+            continue;
+        }
+        if (in_double) {
+            continue;
+        }
+        if (ch == '\'') {
+            in_single = true;
+        } else if (ch == '(') {
+            ++depth;
+        } else if (ch == ')' && --depth == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/* Emits <(cmd) / >(cmd) as a single word tagged with GS_PROCSUB_SENTINEL. */
+static int lex_process_substitution(const char **cursor, gs_token_buffer *buf) {
+    const char *p = *cursor;
+    const char *close = gs_lexer_find_closing_paren(p + 2);
+    if (!close) {
+        return GS_ERR_PARSE;
+    }
+    size_t len = (size_t)(close - (p + 2));
+    char *lexeme = (char *)malloc(len + 3u);
+    if (!lexeme) {
+        return GS_ERR_ALLOC;
+    }
+    lexeme[0] = GS_PROCSUB_SENTINEL;
+    lexeme[1] = p[0];
+    memcpy(lexeme + 2, p + 2, len);
+    lexeme[len + 2u] = '\0';
+
+    gs_token token;
+    token.type = GS_TOKEN_WORD;
+    token.lexeme = lexeme;
+    token.flags = 0u;
+    int rc = buffer_append(buf, &token);
+    if (rc != GS_OK) {
+        free(lexeme);
+        return rc;
+    }
+    *cursor = close + 1;
+    return GS_OK;
+}
+
 static int lex_word(const char **cursor, gs_token_buffer *buf) {
     const char *p = *cursor;
     int rc;
@@ -132,11 +207,11 @@ static int lex_word(const char **cursor, gs_token_buffer *buf) {
     while (*p) {
         char ch = *p;
         if (!in_single && !in_double) {
-            if (isspace((unsigned char)ch) || ch == '|' || ch == '&' || ch == ';' || ch == '<' || ch == '>') {
+            if (isspace((unsigned char)ch) || ch == '|' || ch == '&' || ch == ';' || ch == '<' || ch == '>' || ch == '(' || ch == ')') {
                 break;
             }
         }
-        if (!in_single && ch == '\'') {
+        if (!in_single && !in_double && ch == '\'') {
             in_single = true;
             ++p;
             continue;
@@ -151,6 +226,29 @@ static int lex_word(const char **cursor, gs_token_buffer *buf) {
             ++p;
             continue;
         }
+        if (!in_single && ch == '$' && p[1] == '(') {
+            /* Keep $(...) verbatim; the executor parses it again when expanding. */
+            const char *close = gs_lexer_find_closing_paren(p + 2);
+            if (!close) {
+                builder_dispose(&builder);
+                return GS_ERR_PARSE;
+            }
+            if (!in_double && !builder_is_assignment(&builder)) {
+                rc = builder_append_raw(&builder, GS_SPLIT_SENTINEL); /* the result is split into fields */
+                if (rc != GS_OK) {
+                    builder_dispose(&builder);
+                    return rc;
+                }
+            }
+            for (; p <= close; ++p) {
+                rc = builder_append_raw(&builder, *p);
+                if (rc != GS_OK) {
+                    builder_dispose(&builder);
+                    return rc;
+                }
+            }
+            continue;
+        }
         if (!in_single && ch == '\\') {
             ++p;
             char next = *p;
@@ -162,6 +260,15 @@ static int lex_word(const char **cursor, gs_token_buffer *buf) {
                 ++p;
                 continue; /* line continuation */
             }
+            if (in_double && next != '$' && next != '`' && next != '"' && next != '\\') {
+                /* Inside double quotes the backslash only escapes these; keep it. */
+                rc = builder_append_literal(&builder, '\\');
+                if (rc != GS_OK) {
+                    builder_dispose(&builder);
+                    return rc;
+                }
+                continue;
+            }
             rc = builder_append_literal(&builder, next);
             if (rc != GS_OK) {
                 builder_dispose(&builder);
@@ -183,8 +290,27 @@ static int lex_word(const char **cursor, gs_token_buffer *buf) {
             ++p;
             continue;
         }
-        if (in_single) {
-            rc = builder_append_literal(&builder, ch);
+        if (in_double && ch == '$' && (p[1] == '?' || p[1] == '*' || p[1] == '{')) {
+            /* $?, $* and ${...} expand inside double quotes; their characters are not patterns. */
+            const char *end = p + 1;
+            if (*end == '{') {
+                end = strchr(end, '}');
+                if (!end) {
+                    builder_dispose(&builder);
+                    return GS_ERR_PARSE;
+                }
+            }
+            for (; p <= end; ++p) {
+                rc = builder_append_raw(&builder, *p);
+                if (rc != GS_OK) {
+                    builder_dispose(&builder);
+                    return rc;
+                }
+            }
+            continue;
+        }
+        if (in_single || (in_double && (ch == '*' || ch == '?' || ch == '['))) {
+            rc = builder_append_literal(&builder, ch); /* quoted pattern characters match themselves */
         } else {
             rc = builder_append_raw(&builder, ch);
         }
@@ -265,19 +391,42 @@ int gs_lexer_tokenize(const char *line, gs_token_buffer *out_tokens) {
             }
         }
 
+        if ((ch == '<' || ch == '>') && p[1] == '(') {
+            int rc = lex_process_substitution(&p, out_tokens);
+            if (rc != GS_OK) {
+                gs_token_buffer_dispose(out_tokens);
+                return rc;
+            }
+            at_boundary = false;
+            continue;
+        }
+
         switch (ch) {
         case '|': {
-            int rc = append_simple_token(out_tokens, GS_TOKEN_PIPE);
+            gs_token_type type = p[1] == '|' ? GS_TOKEN_OR_IF : GS_TOKEN_PIPE;
+            int rc = append_simple_token(out_tokens, type);
             if (rc != GS_OK) {
                 gs_token_buffer_dispose(out_tokens);
                 return rc;
             }
-            ++p;
+            p += type == GS_TOKEN_OR_IF ? 2 : 1;
             at_boundary = true;
             continue;
         }
         case '&': {
-            int rc = append_simple_token(out_tokens, GS_TOKEN_BACKGROUND);
+            gs_token_type type = p[1] == '&' ? GS_TOKEN_AND_IF : GS_TOKEN_BACKGROUND;
+            int rc = append_simple_token(out_tokens, type);
+            if (rc != GS_OK) {
+                gs_token_buffer_dispose(out_tokens);
+                return rc;
+            }
+            p += type == GS_TOKEN_AND_IF ? 2 : 1;
+            at_boundary = true;
+            continue;
+        }
+        case '(':
+        case ')': {
+            int rc = append_simple_token(out_tokens, ch == '(' ? GS_TOKEN_LPAREN : GS_TOKEN_RPAREN);
             if (rc != GS_OK) {
                 gs_token_buffer_dispose(out_tokens);
                 return rc;
@@ -297,12 +446,29 @@ int gs_lexer_tokenize(const char *line, gs_token_buffer *out_tokens) {
             continue;
         }
         case '<': {
-            int rc = append_simple_token(out_tokens, GS_TOKEN_REDIR_IN);
+            ++p;
+            gs_token_type type = GS_TOKEN_REDIR_IN;
+            if (p[0] == '<' && p[1] == '<') {
+                type = GS_TOKEN_HERESTRING;
+                p += 2;
+            } else if (p[0] == '<' && p[1] == '-') {
+                type = GS_TOKEN_HEREDOC_STRIP;
+                p += 2;
+            } else if (*p == '<') {
+                type = GS_TOKEN_HEREDOC;
+                ++p;
+            } else if (*p == '&') {
+                type = GS_TOKEN_REDIR_DUP_IN;
+                ++p;
+            } else if (*p == '>') {
+                type = GS_TOKEN_REDIR_RDWR;
+                ++p;
+            }
+            int rc = append_simple_token(out_tokens, type);
             if (rc != GS_OK) {
                 gs_token_buffer_dispose(out_tokens);
                 return rc;
             }
-            ++p;
             at_boundary = true;
             continue;
         }
@@ -312,6 +478,12 @@ int gs_lexer_tokenize(const char *line, gs_token_buffer *out_tokens) {
             if (*p == '>') {
                 type = GS_TOKEN_REDIR_APPEND;
                 ++p;
+            } else if (*p == '&') {
+                type = GS_TOKEN_REDIR_DUP_OUT;
+                ++p;
+            } else if (*p == '|') {
+                type = GS_TOKEN_REDIR_CLOBBER;
+                ++p;
             }
             int rc = append_simple_token(out_tokens, type);
             if (rc != GS_OK) {
@@ -341,6 +513,31 @@ int gs_lexer_tokenize(const char *line, gs_token_buffer *out_tokens) {
     return GS_OK;
 }
 
+/*
+ * Moves the tokens of a freshly lexed line onto dst, separated from earlier
+ * lines by a NEWLINE token, so a construct spanning several input lines can
+ * be parsed as one stream. dst always ends with GS_TOKEN_END; line is left
+ * empty.
+ */
+int gs_token_buffer_append_line(gs_token_buffer *dst, gs_token_buffer *line) {
+    if (dst->length > 0u && dst->items[dst->length - 1u].type == GS_TOKEN_END) {
+        dst->items[dst->length - 1u].type = GS_TOKEN_NEWLINE;
+    }
+    int rc = ensure_capacity(dst, dst->length + line->length + 1u);
+    if (rc != GS_OK) {
+        return rc;
+    }
+    for (size_t i = 0; i < line->length; ++i) {
+        if (line->items[i].type == GS_TOKEN_END) {
+            continue;
+        }
+        dst->items[dst->length++] = line->items[i];
+    }
+    line->length = 0u;
+    gs_token_buffer_dispose(line);
+    return append_simple_token(dst, GS_TOKEN_END);
+}
+
 void gs_token_buffer_dispose(gs_token_buffer *buf) {
     if (!buf || !buf->items) {
         return;
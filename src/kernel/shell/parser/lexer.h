@@ -14,11 +14,25 @@ typedef enum {
     GS_TOKEN_REDIR_OUT,
     GS_TOKEN_REDIR_APPEND,
     GS_TOKEN_REDIR_ERR,
+    GS_TOKEN_REDIR_DUP_IN,   /* <& */
+    GS_TOKEN_REDIR_DUP_OUT,  /* >& */
+    GS_TOKEN_REDIR_RDWR,     /* <> */
+    GS_TOKEN_REDIR_CLOBBER,  /* >| */
+    GS_TOKEN_HEREDOC,        /* << */
+    GS_TOKEN_HEREDOC_STRIP,  /* <<- */
+    GS_TOKEN_HERESTRING,     /* <<< */
     GS_TOKEN_IO_NUMBER,
+    GS_TOKEN_AND_IF,   /* && */
+    GS_TOKEN_OR_IF,    /* || */
+    GS_TOKEN_LPAREN,
+    GS_TOKEN_RPAREN,
+    GS_TOKEN_NEWLINE,  /* inserted between joined input lines */
     GS_TOKEN_END
 } gs_token_type;
 
 #define GS_TOKEN_FLAG_HAS_SENTINEL 0x01u
+/* Set on a here-document body whose delimiter was quoted: no expansion. */
+#define GS_TOKEN_FLAG_HEREDOC_LITERAL 0x02u
 
 typedef struct {
     gs_token_type type;
@@ -34,5 +48,7 @@ typedef struct {
 
 int gs_lexer_tokenize(const char *line, gs_token_buffer *out_tokens);
 void gs_token_buffer_dispose(gs_token_buffer *buf);
+const char *gs_lexer_find_closing_paren(const char *p);
+int gs_token_buffer_append_line(gs_token_buffer *dst, gs_token_buffer *line);
 
 #endif /* GS_PARSER_LEXER_H */
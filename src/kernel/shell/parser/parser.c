@@ -97,27 +97,61 @@ static int redir_vec_push(redir_vec *vec, const gs_redirection *redir) {
     return GS_OK;
 }
 
-static void command_vec_dispose(command_vec *vec) {
-    if (!vec) {
-        return;
-    }
-    for (size_t i = 0; i < vec->length; ++i) {
-        gs_simple_command *cmd = &vec->items[i];
+static int parse_list(parse_state *st, gs_token_type closer, const char *closing_word, gs_command_list *out_list);
+
+static void simple_command_dispose(gs_simple_command *cmd) {
+    if (cmd->argv) {
         for (size_t j = 0; j < cmd->argc; ++j) {
             free(cmd->argv[j]);
         }
         free(cmd->argv);
+    }
+    if (cmd->redirs) {
         for (size_t j = 0; j < cmd->redir_count; ++j) {
             free(cmd->redirs[j].target);
         }
         free(cmd->redirs);
     }
+    if (cmd->body) {
+        gs_command_list_dispose(cmd->body);
+        free(cmd->body);
+    }
+    memset(cmd, 0, sizeof(*cmd));
+}
+
+static void command_vec_dispose(command_vec *vec) {
+    if (!vec) {
+        return;
+    }
+    for (size_t i = 0; i < vec->length; ++i) {
+        simple_command_dispose(&vec->items[i]);
+    }
     free(vec->items);
     vec->items = NULL;
     vec->length = 0u;
     vec->capacity = 0u;
 }
 
+typedef struct {
+    gs_pipeline *items;
+    size_t length;
+    size_t capacity;
+} pipeline_vec;
+
+static int pipeline_vec_push(pipeline_vec *vec, const gs_pipeline *pipeline) {
+    if (vec->length + 1u > vec->capacity) {
+        size_t new_cap = vec->capacity ? vec->capacity * 2u : 2u;
+        gs_pipeline *tmp = (gs_pipeline *)realloc(vec->items, new_cap * sizeof(gs_pipeline));
+        if (!tmp) {
+            return GS_ERR_ALLOC;
+        }
+        vec->items = tmp;
+        vec->capacity = new_cap;
+    }
+    vec->items[vec->length++] = *pipeline;
+    return GS_OK;
+}
+
 static int command_vec_push(command_vec *vec, const gs_simple_command *cmd) {
     if (vec->length + 1u > vec->capacity) {
         size_t new_cap = vec->capacity ? vec->capacity * 2u : 2u;
@@ -143,6 +177,50 @@ static int parse_io_number(const char *text, int *out_fd) {
     return GS_OK;
 }
 
+static bool redirection_for_token(gs_token_type token, gs_redirection_type *out_type, int *out_default_fd) {
+    switch (token) {
+    case GS_TOKEN_REDIR_IN:
+        *out_type = GS_REDIR_STDIN;
+        *out_default_fd = 0;
+        return true;
+    case GS_TOKEN_REDIR_OUT:
+        *out_type = GS_REDIR_STDOUT;
+        *out_default_fd = 1;
+        return true;
+    case GS_TOKEN_REDIR_APPEND:
+        *out_type = GS_REDIR_STDOUT_APPEND;
+        *out_default_fd = 1;
+        return true;
+    case GS_TOKEN_REDIR_CLOBBER:
+        *out_type = GS_REDIR_CLOBBER;
+        *out_default_fd = 1;
+        return true;
+    case GS_TOKEN_REDIR_RDWR:
+        *out_type = GS_REDIR_READ_WRITE;
+        *out_default_fd = 0;
+        return true;
+    case GS_TOKEN_REDIR_DUP_IN:
+        *out_type = GS_REDIR_DUP;
+        *out_default_fd = 0;
+        return true;
+    case GS_TOKEN_REDIR_DUP_OUT:
+        *out_type = GS_REDIR_DUP;
+        *out_default_fd = 1;
+        return true;
+    case GS_TOKEN_HEREDOC:
+    case GS_TOKEN_HEREDOC_STRIP:
+        *out_type = GS_REDIR_HEREDOC;
+        *out_default_fd = 0;
+        return true;
+    case GS_TOKEN_HERESTRING:
+        *out_type = GS_REDIR_HERESTRING;
+        *out_default_fd = 0;
+        return true;
+    default:
+        return false;
+    }
+}
+
 static int parse_redirection(parse_state *st, gs_redirection_type type, int default_fd, int explicit_fd, gs_redirection *out_redir) {
     const gs_token *target_token = consume(st);
     if (!target_token || target_token->type != GS_TOKEN_WORD || !target_token->lexeme) {
@@ -152,12 +230,73 @@ static int parse_redirection(parse_state *st, gs_redirection_type type, int defa
     if (!dup) {
         return GS_ERR_ALLOC;
     }
+    if (type == GS_REDIR_HEREDOC && (target_token->flags & GS_TOKEN_FLAG_HEREDOC_LITERAL)) {
+        type = GS_REDIR_HEREDOC_LITERAL;
+    }
     out_redir->fd = explicit_fd >= 0 ? explicit_fd : default_fd;
     out_redir->type = type;
     out_redir->target = dup;
     return GS_OK;
 }
 
+/* True for an unquoted reserved word such as "{" or "}". */
+static bool is_reserved_word(const gs_token *token, const char *word) {
+    return token && token->type == GS_TOKEN_WORD && token->lexeme && !(token->flags & GS_TOKEN_FLAG_HAS_SENTINEL) &&
+           strcmp(token->lexeme, word) == 0;
+}
+
+static void skip_newlines(parse_state *st) {
+    const gs_token *token = peek(st);
+    while (token && token->type == GS_TOKEN_NEWLINE) {
+        (void)consume(st);
+        token = peek(st);
+    }
+}
+
+/*
+ * Parses one redirection if the next tokens form one. Returns 1 when a
+ * redirection was appended, 0 when the next token is not a redirection, or a
+ * negative error code.
+ */
+static int parse_optional_redirection(parse_state *st, redir_vec *redirs) {
+    const gs_token *token = peek(st);
+    if (!token) {
+        return GS_ERR_PARSE;
+    }
+    int explicit_fd = -1;
+    const gs_token *op = token;
+    if (token->type == GS_TOKEN_IO_NUMBER) {
+        int rc = parse_io_number(token->lexeme, &explicit_fd);
+        if (rc != GS_OK) {
+            return rc;
+        }
+        op = st->index + 1u < st->tokens->length ? &st->tokens->items[st->index + 1u] : NULL;
+        if (!op) {
+            return GS_ERR_PARSE;
+        }
+    }
+    gs_redirection_type rtype = GS_REDIR_STDOUT;
+    int default_fd = 1;
+    if (!redirection_for_token(op->type, &rtype, &default_fd)) {
+        return explicit_fd >= 0 ? GS_ERR_PARSE : 0;
+    }
+    if (explicit_fd >= 0) {
+        (void)consume(st);
+    }
+    (void)consume(st);
+    gs_redirection redir = {0};
+    int rc = parse_redirection(st, rtype, default_fd, explicit_fd, &redir);
+    if (rc != GS_OK) {
+        return rc;
+    }
+    rc = redir_vec_push(redirs, &redir);
+    if (rc != GS_OK) {
+        free(redir.target);
+        return rc;
+    }
+    return 1;
+}
+
 static int parse_simple_command(parse_state *st, gs_simple_command *out_cmd) {
     memset(out_cmd, 0, sizeof(*out_cmd));
     string_vec argv_vec = {0};
@@ -184,67 +323,9 @@ static int parse_simple_command(parse_state *st, gs_simple_command *out_cmd) {
             (void)consume(st);
             continue;
         }
-        if (token->type == GS_TOKEN_IO_NUMBER) {
-            int fd = 0;
-            rc = parse_io_number(token->lexeme, &fd);
-            if (rc != GS_OK) {
-                break;
-            }
-            (void)consume(st);
-            const gs_token *op = peek(st);
-            if (!op) {
-                rc = GS_ERR_PARSE;
-                break;
-            }
-            gs_redirection redir = {0};
-            switch (op->type) {
-            case GS_TOKEN_REDIR_IN:
-                (void)consume(st);
-                rc = parse_redirection(st, GS_REDIR_STDIN, 0, fd, &redir);
-                break;
-            case GS_TOKEN_REDIR_OUT:
-                (void)consume(st);
-                rc = parse_redirection(st, GS_REDIR_STDOUT, 1, fd, &redir);
-                break;
-            case GS_TOKEN_REDIR_APPEND:
-                (void)consume(st);
-                rc = parse_redirection(st, GS_REDIR_STDOUT_APPEND, 1, fd, &redir);
-                break;
-            default:
-                rc = GS_ERR_PARSE;
-                break;
-            }
-            if (rc != GS_OK) {
-                break;
-            }
-            rc = redir_vec_push(&redirs, &redir);
-            if (rc != GS_OK) {
-                free(redir.target);
-                break;
-            }
-            continue;
-        }
-        if (token->type == GS_TOKEN_REDIR_IN || token->type == GS_TOKEN_REDIR_OUT || token->type == GS_TOKEN_REDIR_APPEND) {
-            gs_redirection redir = {0};
-            gs_redirection_type rtype = GS_REDIR_STDOUT;
-            int default_fd = 1;
-            if (token->type == GS_TOKEN_REDIR_IN) {
-                rtype = GS_REDIR_STDIN;
-                default_fd = 0;
-            } else if (token->type == GS_TOKEN_REDIR_APPEND) {
-                rtype = GS_REDIR_STDOUT_APPEND;
-                default_fd = 1;
-            }
-            (void)consume(st);
-            rc = parse_redirection(st, rtype, default_fd, -1, &redir);
-            if (rc != GS_OK) {
-                break;
-            }
-            rc = redir_vec_push(&redirs, &redir);
-            if (rc != GS_OK) {
-                free(redir.target);
-                break;
-            }
+        rc = parse_optional_redirection(st, &redirs);
+        if (rc == 1) {
+            rc = GS_OK;
             continue;
         }
         break;
@@ -259,7 +340,8 @@ static int parse_simple_command(parse_state *st, gs_simple_command *out_cmd) {
     if (argv_vec.length == 0u && redirs.length == 0u) {
         string_vec_dispose(&argv_vec);
         redir_vec_dispose(&redirs);
-        return GS_ERR_PARSE;
+        const gs_token *token = peek(st);
+        return (token && token->type == GS_TOKEN_END) ? GS_ERR_EOF : GS_ERR_PARSE;
     }
 
     rc = string_vec_push(&argv_vec, NULL);
@@ -273,64 +355,204 @@ static int parse_simple_command(parse_state *st, gs_simple_command *out_cmd) {
     out_cmd->argv = argv_vec.items;
     out_cmd->redirs = redirs.items;
     out_cmd->redir_count = redirs.length;
+    out_cmd->kind = GS_COMMAND_SIMPLE;
     return GS_OK;
 }
 
-int gs_parse_tokens(const gs_token_buffer *tokens, gs_pipeline *out_pipeline) {
+/* Parses "( list )" or "{ list }" followed by optional redirections. */
+static int parse_group(parse_state *st, gs_command_kind kind, gs_simple_command *out_cmd) {
+    memset(out_cmd, 0, sizeof(*out_cmd));
+    (void)consume(st);
+
+    gs_command_list *body = (gs_command_list *)calloc(1u, sizeof(gs_command_list));
+    if (!body) {
+        return GS_ERR_ALLOC;
+    }
+    int rc = kind == GS_COMMAND_SUBSHELL ? parse_list(st, GS_TOKEN_RPAREN, NULL, body)
+                                         : parse_list(st, GS_TOKEN_WORD, "}", body);
+    if (rc == GS_OK && body->length == 0u) {
+        rc = GS_ERR_PARSE;
+    }
+    if (rc != GS_OK) {
+        gs_command_list_dispose(body);
+        free(body);
+        return rc;
+    }
+    (void)consume(st); /* closing ')' or '}' */
+
+    redir_vec redirs = {0};
+    while ((rc = parse_optional_redirection(st, &redirs)) == 1) {
+    }
+    if (rc < 0) {
+        redir_vec_dispose(&redirs);
+        gs_command_list_dispose(body);
+        free(body);
+        return rc;
+    }
+
+    out_cmd->argv = (char **)calloc(1u, sizeof(char *));
+    if (!out_cmd->argv) {
+        redir_vec_dispose(&redirs);
+        gs_command_list_dispose(body);
+        free(body);
+        return GS_ERR_ALLOC;
+    }
+    out_cmd->kind = kind;
+    out_cmd->body = body;
+    out_cmd->redirs = redirs.items;
+    out_cmd->redir_count = redirs.length;
+    return GS_OK;
+}
+
+static int parse_command(parse_state *st, gs_simple_command *out_cmd) {
+    const gs_token *token = peek(st);
+    if (token && token->type == GS_TOKEN_LPAREN) {
+        return parse_group(st, GS_COMMAND_SUBSHELL, out_cmd);
+    }
+    if (is_reserved_word(token, "{")) {
+        return parse_group(st, GS_COMMAND_BRACE_GROUP, out_cmd);
+    }
+    return parse_simple_command(st, out_cmd);
+}
+
+static int parse_pipeline(parse_state *st, gs_connector connector, gs_pipeline *out_pipeline) {
     memset(out_pipeline, 0, sizeof(*out_pipeline));
-    parse_state st = {tokens, 0};
     command_vec commands = {0};
     int rc;
 
     while (true) {
         gs_simple_command cmd;
-        rc = parse_simple_command(&st, &cmd);
+        rc = parse_command(st, &cmd);
         if (rc != GS_OK) {
             command_vec_dispose(&commands);
             return rc;
         }
         rc = command_vec_push(&commands, &cmd);
         if (rc != GS_OK) {
-            for (size_t i = 0; i < cmd.argc; ++i) {
-                free(cmd.argv[i]);
-            }
-            free(cmd.argv);
-            for (size_t i = 0; i < cmd.redir_count; ++i) {
-                free(cmd.redirs[i].target);
-            }
-            free(cmd.redirs);
+            simple_command_dispose(&cmd);
             command_vec_dispose(&commands);
             return rc;
         }
 
-        const gs_token *next = peek(&st);
+        const gs_token *next = peek(st);
+        if (next && next->type == GS_TOKEN_PIPE) {
+            (void)consume(st);
+            skip_newlines(st);
+            continue;
+        }
+        break;
+    }
+
+    out_pipeline->commands = commands.items;
+    out_pipeline->length = commands.length;
+    out_pipeline->connector = connector;
+    return GS_OK;
+}
+
+static bool at_list_closer(const parse_state *st, gs_token_type closer, const char *closing_word) {
+    const gs_token *token = peek(st);
+    if (!token) {
+        return false;
+    }
+    if (closing_word) {
+        return is_reserved_word(token, closing_word);
+    }
+    return token->type == closer;
+}
+
+/*
+ * list := and_or ((';' | '&' | newline) and_or)*, where and_or chains
+ * pipelines with '&&' / '||'. Stops in front of the closer (END, ')' or the
+ * reserved word "}") without consuming it.
+ */
+static int parse_list(parse_state *st, gs_token_type closer, const char *closing_word, gs_command_list *out_list) {
+    memset(out_list, 0, sizeof(*out_list));
+    pipeline_vec pipelines = {0};
+    int rc = GS_OK;
+    gs_connector connector = GS_CONNECT_SEQ;
+
+    while (true) {
+        skip_newlines(st);
+        if (at_list_closer(st, closer, closing_word)) {
+            break;
+        }
+        const gs_token *token = peek(st);
+        if (!token || token->type == GS_TOKEN_END) {
+            rc = closer == GS_TOKEN_END ? GS_OK : GS_ERR_EOF;
+            break;
+        }
+
+        gs_pipeline pipeline;
+        rc = parse_pipeline(st, connector, &pipeline);
+        if (rc != GS_OK) {
+            break;
+        }
+        rc = pipeline_vec_push(&pipelines, &pipeline);
+        if (rc != GS_OK) {
+            gs_pipeline_dispose(&pipeline);
+            break;
+        }
+
+        gs_pipeline *last = &pipelines.items[pipelines.length - 1u];
+        const gs_token *next = peek(st);
         if (!next) {
-            command_vec_dispose(&commands);
-            return GS_ERR_PARSE;
+            rc = GS_ERR_PARSE;
+            break;
         }
-        if (next->type == GS_TOKEN_PIPE) {
-            (void)consume(&st);
+        if (next->type == GS_TOKEN_AND_IF || next->type == GS_TOKEN_OR_IF) {
+            connector = next->type == GS_TOKEN_AND_IF ? GS_CONNECT_AND : GS_CONNECT_OR;
+            (void)consume(st);
+            skip_newlines(st);
+            next = peek(st);
+            if (next && next->type == GS_TOKEN_END) {
+                rc = GS_ERR_EOF;
+                break;
+            }
             continue;
         }
+        connector = GS_CONNECT_SEQ;
         if (next->type == GS_TOKEN_BACKGROUND) {
-            out_pipeline->background = true;
-            (void)consume(&st);
+            last->background = true;
+            (void)consume(st);
+            continue;
         }
         if (next->type == GS_TOKEN_SEMICOLON) {
-            out_pipeline->terminator = true;
-            (void)consume(&st);
+            last->terminator = true;
+            (void)consume(st);
+            continue;
         }
+        if (next->type == GS_TOKEN_NEWLINE) {
+            continue;
+        }
+        if (at_list_closer(st, closer, closing_word) || next->type == GS_TOKEN_END) {
+            continue;
+        }
+        rc = GS_ERR_PARSE;
         break;
     }
 
+    if (rc != GS_OK) {
+        gs_command_list list = {pipelines.items, pipelines.length};
+        gs_command_list_dispose(&list);
+        return rc;
+    }
+    out_list->pipelines = pipelines.items;
+    out_list->length = pipelines.length;
+    return GS_OK;
+}
+
+int gs_parse_tokens(const gs_token_buffer *tokens, gs_command_list *out_list) {
+    memset(out_list, 0, sizeof(*out_list));
+    parse_state st = {tokens, 0};
+    int rc = parse_list(&st, GS_TOKEN_END, NULL, out_list);
+    if (rc != GS_OK) {
+        return rc;
+    }
     const gs_token *terminal = peek(&st);
     if (!terminal || terminal->type != GS_TOKEN_END) {
-        command_vec_dispose(&commands);
+        gs_command_list_dispose(out_list);
         return GS_ERR_PARSE;
     }
-
-    out_pipeline->commands = commands.items;
-    out_pipeline->length = commands.length;
     return GS_OK;
 }
 
@@ -339,19 +561,7 @@ void gs_pipeline_dispose(gs_pipeline *pipeline) {
         return;
     }
     for (size_t i = 0; i < pipeline->length; ++i) {
-        gs_simple_command *cmd = &pipeline->commands[i];
-        if (cmd->argv) {
-            for (size_t j = 0; j < cmd->argc; ++j) {
-                free(cmd->argv[j]);
-            }
-            free(cmd->argv);
-        }
-        if (cmd->redirs) {
-            for (size_t j = 0; j < cmd->redir_count; ++j) {
-                free(cmd->redirs[j].target);
-            }
-            free(cmd->redirs);
-        }
+        simple_command_dispose(&pipeline->commands[i]);
     }
     free(pipeline->commands);
     pipeline->commands = NULL;
@@ -359,3 +569,15 @@ void gs_pipeline_dispose(gs_pipeline *pipeline) {
     pipeline->background = false;
     pipeline->terminator = false;
 }
+
+void gs_command_list_dispose(gs_command_list *list) {
+    if (!list || !list->pipelines) {
+        return;
+    }
+    for (size_t i = 0; i < list->length; ++i) {
+        gs_pipeline_dispose(&list->pipelines[i]);
+    }
+    free(list->pipelines);
+    list->pipelines = NULL;
+    list->length = 0u;
+}
@@ -4,6 +4,11 @@
 #include "ast.h"
 #include "lexer.h"
 
-int gs_parse_tokens(const gs_token_buffer *tokens, gs_pipeline *out_pipeline);
+/*
+ * Parses a complete command list. Returns GS_ERR_EOF when the tokens end
+ * inside an unfinished construct (open group, trailing '|', '&&' or '||'),
+ * meaning the caller should append another input line and retry.
+ */
+int gs_parse_tokens(const gs_token_buffer *tokens, gs_command_list *out_list);
 
 #endif /* GS_PARSER_PARSER_H */
@@ -0,0 +1,249 @@
+/*
+ * The shell's working directory.
+ *
+ * Each shell holds its working directory open as a descriptor and resolves
+ * relative paths against it with the *at(2) calls, so shells sharing a
+ * process each have their own and none of them calls chdir(2). PWD is
+ * tracked as a string, the way the user navigated (symbolic links
+ * included), instead of asking the kernel for the physical path, which
+ * walks the tree one ".." at a time and is slow on deep network mounts. The
+ * physical path is only needed when PWD does not name the directory (at
+ * start-up) and by the -P forms of cd and pwd.
+ */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "shell.h"
+
+/* A directory descriptor only needs to name the directory; O_PATH skips the read check. */
+#if defined(O_PATH)
+#define DIR_OPEN_FLAGS (O_PATH | O_DIRECTORY | O_CLOEXEC)
+#else
+#define DIR_OPEN_FLAGS (O_RDONLY | O_DIRECTORY | O_CLOEXEC)
+#endif
+
+/* Descriptors the shell keeps for itself stay above the slots its commands use. */
+#define KEPT_FD_MIN GS_SHELL_FD_COUNT
+
+void gs_path_canonicalize(char *path) {
+    if (!path || path[0] != '/') {
+        return;
+    }
+    size_t w = 1u; /* path[0..w) is the canonical prefix, always starting "/" */
+    const char *p = path + 1;
+    while (*p) {
+        while (*p == '/') {
+            ++p;
+        }
+        const char *start = p;
+        while (*p && *p != '/') {
+            ++p;
+        }
+        size_t len = (size_t)(p - start);
+        if (len == 0u || (len == 1u && start[0] == '.')) {
+            continue;
+        }
+        if (len == 2u && start[0] == '.' && start[1] == '.') {
+            while (w > 1u && path[w - 1u] != '/') {
+                --w;
+            }
+            if (w > 1u) {
+                --w; /* drop the separator too, unless it is the root */
+            }
+            continue;
+        }
+        if (w > 1u) {
+            path[w++] = '/';
+        }
+        memmove(path + w, start, len);
+        w += len;
+    }
+    path[w] = '\0';
+}
+
+bool gs_path_is_canonical(const char *path) {
+    if (!path || path[0] != '/') {
+        return false;
+    }
+    if (path[1] == '\0') {
+        return true;
+    }
+    const char *p = path;
+    while (*p) {
+        const char *start = ++p; /* past the '/' */
+        while (*p && *p != '/') {
+            ++p;
+        }
+        size_t len = (size_t)(p - start);
+        if (len == 0u || (len == 1u && start[0] == '.') || (len == 2u && start[0] == '.' && start[1] == '.')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int gs_shell_set_cwd(struct gs_shell *shell, const char *path) {
+    int fd = openat(shell->cwd_fd, path, DIR_OPEN_FLAGS);
+    if (fd < 0) {
+        return GS_ERR_EXEC;
+    }
+    /* chdir(2) would insist on search permission, which O_PATH does not check. */
+    if (faccessat(fd, ".", X_OK, AT_EACCESS) != 0) {
+        int saved_errno = errno;
+        close(fd);
+        errno = saved_errno;
+        return GS_ERR_EXEC;
+    }
+    int kept = fd >= KEPT_FD_MIN ? fd : fcntl(fd, F_DUPFD_CLOEXEC, KEPT_FD_MIN);
+    if (kept != fd) {
+        int saved_errno = errno;
+        close(fd);
+        if (kept < 0) {
+            errno = saved_errno;
+            return GS_ERR_EXEC;
+        }
+    }
+    if (shell->cwd_fd >= 0) {
+        close(shell->cwd_fd);
+    }
+    shell->cwd_fd = kept;
+    return GS_OK;
+}
+
+static bool same_file(const struct stat *a, const struct stat *b) {
+    return a->st_dev == b->st_dev && a->st_ino == b->st_ino;
+}
+
+/* Returns "/NAME" + path, where NAME is the entry of parent that is the directory st. */
+static char *prepend_entry(int parent, const struct stat *st, const char *path) {
+    int list_fd = fcntl(parent, F_DUPFD_CLOEXEC, 0);
+    DIR *listing = list_fd >= 0 ? fdopendir(list_fd) : NULL;
+    if (!listing) {
+        if (list_fd >= 0) {
+            close(list_fd);
+        }
+        return NULL;
+    }
+    char *joined = NULL;
+    struct dirent *d;
+    errno = ENOENT;
+    while (!joined && (d = readdir(listing)) != NULL) {
+        struct stat child;
+        if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0 ||
+            fstatat(parent, d->d_name, &child, AT_SYMLINK_NOFOLLOW) != 0 || !same_file(&child, st)) {
+            continue;
+        }
+        size_t name_len = strlen(d->d_name);
+        size_t path_len = strlen(path);
+        joined = (char *)malloc(name_len + path_len + 2u);
+        if (joined) {
+            joined[0] = '/';
+            memcpy(joined + 1, d->d_name, name_len);
+            memcpy(joined + 1 + name_len, path, path_len + 1u);
+        }
+    }
+    closedir(listing);
+    return joined;
+}
+
+/*
+ * Builds the path of the directory open as fd by walking ".." up to the
+ * root and looking each directory up by inode in its parent, as getcwd(3)
+ * does, but without changing the process's working directory.
+ */
+static char *walk_to_root(int fd) {
+    int dir = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    char *path = strdup("");
+    struct stat st;
+    bool ok = dir >= 0 && path && fstat(dir, &st) == 0;
+    while (ok) {
+        int parent = openat(dir, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        struct stat parent_st;
+        if (parent < 0 || fstat(parent, &parent_st) != 0) {
+            if (parent >= 0) {
+                close(parent);
+            }
+            ok = false;
+            break;
+        }
+        if (same_file(&st, &parent_st)) {
+            close(parent); /* the root is its own parent */
+            break;
+        }
+        char *joined = prepend_entry(parent, &st, path);
+        close(dir);
+        dir = parent;
+        st = parent_st;
+        ok = joined != NULL;
+        if (ok) {
+            free(path);
+            path = joined;
+        }
+    }
+    int saved_errno = errno;
+    if (dir >= 0) {
+        close(dir);
+    }
+    if (!ok) {
+        free(path);
+        errno = saved_errno;
+        return NULL;
+    }
+    if (path[0] == '\0') {
+        free(path);
+        return strdup("/");
+    }
+    return path;
+}
+
+char *gs_shell_physical_cwd(const struct gs_shell *shell) {
+    struct stat held;
+    if (fstat(shell->cwd_fd, &held) != 0) {
+        return NULL;
+    }
+    /* Ask the kernel for the name it has for the descriptor, then check it. */
+    char buf[PATH_MAX];
+    bool named = false;
+#if defined(__linux__)
+    char link[32];
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", shell->cwd_fd);
+    ssize_t n = readlink(link, buf, sizeof(buf) - 1u);
+    if (n > 0) {
+        buf[n] = '\0';
+        named = true;
+    }
+#elif defined(F_GETPATH)
+    named = fcntl(shell->cwd_fd, F_GETPATH, buf) == 0;
+#endif
+    struct stat st;
+    if (named && buf[0] == '/' && stat(buf, &st) == 0 && same_file(&st, &held)) {
+        return strdup(buf);
+    }
+    return walk_to_root(shell->cwd_fd);
+}
+
+void gs_shell_sync_pwd(struct gs_shell *shell) {
+    const char *pwd = gs_shell_getvar(shell, "PWD");
+    struct stat logical;
+    struct stat physical;
+    if (gs_path_is_canonical(pwd) && stat(pwd, &logical) == 0 && fstat(shell->cwd_fd, &physical) == 0 &&
+        same_file(&logical, &physical)) {
+        return;
+    }
+    char *cwd = gs_shell_physical_cwd(shell);
+    if (cwd) {
+        gs_shell_setvar(shell, "PWD", cwd);
+        free(cwd);
+    }
+}
@@ -0,0 +1,405 @@
+/*
+ * Prompt expansion.
+ *
+ * The prompt is expanded afresh for every command line. Segments that
+ * only read shell state or a file or two are filled in directly. For \g
+ * the branch is read from the repository's HEAD, found by walking up from
+ * $PWD. Whether the work tree is dirty takes "git status", which can run
+ * for seconds in a large repository. So each expansion starts it in a child
+ * process (unless one is still running), waits up to PR_WAIT_MS for it, and
+ * otherwise shows the mark last seen for that work tree. The child's stdout
+ * is a non-blocking pipe. Its first byte means the tree is dirty, and EOF
+ * with exit status 0 means it is clean. The line editor polls the pipe next
+ * to the terminal and swaps in the prompt gs_prompt_refresh returns. The
+ * child is put in its own process group, so a ^C meant for a foreground
+ * command does not kill it and a stale one is killed with all it started.
+ */
+#include "prompt.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pwd.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "shell.h"
+
+#define PR_WAIT_MS 20 /* how long a prompt waits for git status before showing the last mark */
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+    bool failed;
+} pr_text;
+
+struct gs_prompt {
+    char *root;  /* work tree of the latest \g */
+    int dirty;   /* 1 or 0 for that tree; -1 when not known yet */
+    pid_t pid;   /* git status still running, or 0 */
+    int fd;      /* its output */
+    char *shown; /* the latest expansion */
+};
+
+static void text_add(pr_text *text, const char *data, size_t len) {
+    if (text->failed) {
+        return;
+    }
+    if (text->len + len + 1u > text->cap) {
+        size_t new_cap = text->cap ? text->cap : 64u;
+        while (new_cap < text->len + len + 1u) {
+            new_cap *= 2u;
+        }
+        char *tmp = (char *)realloc(text->data, new_cap);
+        if (!tmp) {
+            text->failed = true;
+            return;
+        }
+        text->data = tmp;
+        text->cap = new_cap;
+    }
+    memcpy(text->data + text->len, data, len);
+    text->len += len;
+    text->data[text->len] = '\0';
+}
+
+static void text_puts(pr_text *text, const char *s) {
+    text_add(text, s, strlen(s));
+}
+
+static struct gs_prompt *prompt_state(struct gs_shell *shell) {
+    if (!shell->prompt) {
+        shell->prompt = (struct gs_prompt *)calloc(1u, sizeof(struct gs_prompt));
+        if (shell->prompt) {
+            shell->prompt->dirty = -1;
+            shell->prompt->fd = -1;
+        }
+    }
+    return shell->prompt;
+}
+
+/* Reaps the git child; with collect, its result first becomes the dirty mark. */
+static void git_finish(struct gs_prompt *prompt, int dirty) {
+    if (prompt->pid > 0) {
+        if (dirty != 0) {
+            kill(-prompt->pid, SIGKILL); /* it has said enough, or is no longer wanted */
+        }
+        int status;
+        pid_t rc;
+        do {
+            rc = waitpid(prompt->pid, &status, 0);
+        } while (rc < 0 && errno == EINTR);
+        if (dirty == 0 && (rc < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)) {
+            dirty = -1;
+        }
+    }
+    if (prompt->fd >= 0) {
+        close(prompt->fd);
+    }
+    prompt->pid = 0;
+    prompt->fd = -1;
+    if (dirty != -2) {
+        prompt->dirty = dirty;
+    }
+}
+
+/* Reads what the git child wrote; true once it has decided. */
+static bool git_collect(struct gs_prompt *prompt) {
+    if (prompt->pid <= 0) {
+        return false;
+    }
+    char byte;
+    ssize_t n;
+    do {
+        n = read(prompt->fd, &byte, 1u);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return false;
+    }
+    git_finish(prompt, n > 0 ? 1 : n == 0 ? 0 : -1);
+    return true;
+}
+
+static void git_start(struct gs_shell *shell, struct gs_prompt *prompt) {
+    int fds[2];
+    if (gs_pipe_cloexec(fds) != 0) {
+        return;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        setpgid(0, 0);
+        int null_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+        for (int fd = 0; fd < GS_SHELL_FD_COUNT; ++fd) {
+            shell->fds[fd] = -1;
+        }
+        shell->fds[STDIN_FILENO] = null_fd;
+        shell->fds[STDOUT_FILENO] = fds[1];
+        shell->fds[STDERR_FILENO] = null_fd;
+        gs_shell_enter_process(shell);
+        char *argv[] = {"git", "--no-optional-locks", "status", "--porcelain", "--ignore-submodules=dirty", NULL};
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    close(fds[1]);
+    if (pid < 0) {
+        close(fds[0]);
+        return;
+    }
+    (void)setpgid(pid, pid); /* whichever of the two runs first */
+    (void)fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    prompt->pid = pid;
+    prompt->fd = fds[0];
+}
+
+/* Reads up to size-1 bytes of dir/name into buf, trimmed at the first newline. */
+static bool read_small(const char *dir, const char *name, char *buf, size_t size) {
+    char path[4096];
+    if ((size_t)snprintf(path, sizeof(path), "%s/%s", dir, name) >= sizeof(path)) {
+        return false;
+    }
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t n = read(fd, buf, size - 1u);
+    close(fd);
+    if (n <= 0) {
+        return false;
+    }
+    buf[n] = '\0';
+    buf[strcspn(buf, "\n")] = '\0';
+    return true;
+}
+
+/*
+ * Finds the work tree holding the directory pwd. Sets *root to it (malloc'd)
+ * and copies the branch name, or the short commit of a detached HEAD, into branch.
+ */
+static bool git_locate(const char *pwd, char **root, char *branch, size_t size) {
+    if (!pwd || pwd[0] != '/') {
+        return false;
+    }
+    char dir[4096];
+    if (strlen(pwd) >= sizeof(dir)) {
+        return false;
+    }
+    strcpy(dir, pwd);
+    for (;;) {
+        char git_dir[4096];
+        struct stat st;
+        bool found = false;
+        if ((size_t)snprintf(git_dir, sizeof(git_dir), "%s/.git", strcmp(dir, "/") == 0 ? "" : dir) < sizeof(git_dir) &&
+            stat(git_dir, &st) == 0) {
+            char link[4096];
+            found = S_ISDIR(st.st_mode);
+            /* A linked work tree or submodule has a ".git" file naming the real directory. */
+            if (!found && read_small(dir, ".git", link, sizeof(link)) && strncmp(link, "gitdir: ", 8) == 0) {
+                int n = link[8] == '/' ? snprintf(git_dir, sizeof(git_dir), "%s", link + 8)
+                                       : snprintf(git_dir, sizeof(git_dir), "%s/%s", dir, link + 8);
+                found = n > 0 && (size_t)n < sizeof(git_dir);
+            }
+        }
+        char head[256];
+        if (found && read_small(git_dir, "HEAD", head, sizeof(head))) {
+            const char *name = head;
+            if (strncmp(head, "ref: refs/heads/", 16) == 0) {
+                name = head + 16;
+            } else if (strncmp(head, "ref: ", 5) == 0) {
+                name = head + 5;
+            } else {
+                head[7] = '\0';
+            }
+            snprintf(branch, size, "%s", name);
+            *root = strdup(dir);
+            return *root != NULL;
+        }
+        char *slash = strrchr(dir, '/');
+        if (!slash || strcmp(dir, "/") == 0) {
+            return false;
+        }
+        slash[slash == dir ? 1 : 0] = '\0';
+    }
+}
+
+static void add_git(struct gs_shell *shell, pr_text *out, bool start) {
+    struct gs_prompt *prompt = prompt_state(shell);
+    char *root = NULL;
+    char branch[256];
+    if (!prompt || !git_locate(gs_shell_getvar(shell, "PWD"), &root, branch, sizeof(branch))) {
+        return;
+    }
+    if (!prompt->root || strcmp(prompt->root, root) != 0) {
+        git_finish(prompt, -1); /* another tree: its child's answer is of no use */
+        free(prompt->root);
+        prompt->root = root;
+    } else {
+        free(root);
+    }
+    if (start && prompt->pid == 0) {
+        git_start(shell, prompt);
+        struct pollfd pfd = {prompt->fd, POLLIN, 0};
+        if (prompt->pid > 0 && poll(&pfd, 1u, PR_WAIT_MS) > 0) {
+            (void)git_collect(prompt);
+        }
+    }
+    text_puts(out, branch);
+    if (prompt->dirty == 1) {
+        text_puts(out, "*");
+    }
+}
+
+static void add_duration(const struct gs_shell *shell, pr_text *out) {
+    if (shell->last_duration < 0) {
+        return;
+    }
+    long long ms = (long long)(shell->last_duration / 1000000);
+    char buf[64];
+    if (ms < 1000) {
+        snprintf(buf, sizeof(buf), "%lldms", ms);
+    } else if (ms < 60000) {
+        snprintf(buf, sizeof(buf), "%lld.%llds", ms / 1000, ms % 1000 / 100);
+    } else {
+        snprintf(buf, sizeof(buf), "%lldm%02llds", ms / 60000, ms % 60000 / 1000);
+    }
+    text_puts(out, buf);
+}
+
+static void add_directory(const struct gs_shell *shell, pr_text *out, bool last_only) {
+    const char *pwd = gs_shell_getvar(shell, "PWD");
+    const char *home = gs_shell_getvar(shell, "HOME");
+    if (!pwd) {
+        return;
+    }
+    size_t home_len = home ? strlen(home) : 0u;
+    bool in_home = home_len > 1u && strncmp(pwd, home, home_len) == 0 && (pwd[home_len] == '/' || pwd[home_len] == '\0');
+    if (last_only) {
+        const char *slash = strrchr(pwd, '/');
+        text_puts(out, in_home && pwd[home_len] == '\0' ? "~" : slash && slash[1] ? slash + 1 : pwd);
+    } else if (in_home) {
+        text_puts(out, "~");
+        text_puts(out, pwd + home_len);
+    } else {
+        text_puts(out, pwd);
+    }
+}
+
+static char *expand(struct gs_shell *shell, const char *fallback, bool start) {
+    const char *ps1 = gs_shell_getvar(shell, "PS1");
+    if (!ps1) {
+        return fallback ? strdup(fallback) : NULL;
+    }
+    pr_text out = {NULL, 0u, 0u, false};
+    text_add(&out, "", 0u);
+    for (const char *p = ps1; *p; ++p) {
+        if (*p != '\\' || p[1] == '\0') {
+            text_add(&out, p, 1u);
+            continue;
+        }
+        char buf[256];
+        switch (*++p) {
+        case 'u': {
+            const char *user = gs_shell_getvar(shell, "USER");
+            struct passwd *pw = user ? NULL : getpwuid(geteuid());
+            text_puts(&out, user ? user : pw ? pw->pw_name : "");
+            break;
+        }
+        case 'h':
+            if (gethostname(buf, sizeof(buf)) == 0) {
+                buf[sizeof(buf) - 1u] = '\0';
+                buf[strcspn(buf, ".")] = '\0';
+                text_puts(&out, buf);
+            }
+            break;
+        case 'w':
+        case 'W':
+            add_directory(shell, &out, *p == 'W');
+            break;
+        case '$':
+            text_puts(&out, geteuid() == 0 ? "#" : "$");
+            break;
+        case 't': {
+            time_t now = time(NULL);
+            struct tm tm;
+            if (localtime_r(&now, &tm) && strftime(buf, sizeof(buf), "%H:%M:%S", &tm) > 0u) {
+                text_puts(&out, buf);
+            }
+            break;
+        }
+        case '?':
+            snprintf(buf, sizeof(buf), "%d", shell->last_status);
+            text_puts(&out, buf);
+            break;
+        case 'D':
+            add_duration(shell, &out);
+            break;
+        case 'g':
+            add_git(shell, &out, start);
+            break;
+        case 'n':
+            text_puts(&out, "\n");
+            break;
+        case 'e':
+            text_puts(&out, "\x1b");
+            break;
+        case '[':
+        case ']':
+            break;
+        default:
+            text_add(&out, p - 1, 2u);
+            break;
+        }
+    }
+    if (out.failed) {
+        free(out.data);
+        return NULL;
+    }
+    struct gs_prompt *prompt = prompt_state(shell);
+    if (prompt) {
+        free(prompt->shown);
+        prompt->shown = strdup(out.data);
+    }
+    return out.data;
+}
+
+char *gs_prompt_expand(struct gs_shell *shell, const char *fallback) {
+    struct gs_prompt *prompt = shell->prompt;
+    if (prompt) {
+        (void)git_collect(prompt); /* a child that finished meanwhile is current enough */
+    }
+    return expand(shell, fallback, true);
+}
+
+int gs_prompt_pending_fd(const struct gs_shell *shell) {
+    return shell->prompt && shell->prompt->pid > 0 ? shell->prompt->fd : -1;
+}
+
+char *gs_prompt_refresh(struct gs_shell *shell, const char *shown) {
+    struct gs_prompt *prompt = shell->prompt;
+    if (!prompt || !git_collect(prompt) || !prompt->shown || !shown || strcmp(prompt->shown, shown) != 0) {
+        return NULL;
+    }
+    char *fresh = expand(shell, NULL, false);
+    if (fresh && strcmp(fresh, shown) == 0) {
+        free(fresh);
+        return NULL;
+    }
+    return fresh;
+}
+
+void gs_prompt_free(struct gs_prompt *prompt) {
+    if (!prompt) {
+        return;
+    }
+    git_finish(prompt, -2);
+    free(prompt->root);
+    free(prompt->shown);
+    free(prompt);
+}
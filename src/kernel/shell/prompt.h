@@ -0,0 +1,37 @@
+#ifndef GS_PROMPT_H
+#define GS_PROMPT_H
+
+#include <stdbool.h>
+
+struct gs_shell;
+struct gs_prompt;
+
+/*
+ * The primary prompt of an interactive shell, expanded from $PS1:
+ *
+ *   \u  user name            \h  host name up to the first '.'
+ *   \w  working directory, with $HOME shown as ~      \W  its last component
+ *   \$  '#' for root, else '$'                         \t  time as HH:MM:SS
+ *   \?  exit status of the last command                \D  how long it ran
+ *   \g  git branch, followed by '*' when the work tree has changes
+ *   \n  newline   \e  escape   \\  backslash   \[ \]  accepted and ignored
+ *
+ * Everything but the dirty mark of \g is computed as the prompt is drawn.
+ * "git status" runs in a child process. The prompt shows the mark last seen
+ * for that work tree until the child reports, and the line editor then
+ * redraws the prompt with gs_prompt_refresh.
+ */
+
+/* Returns the malloc'd prompt: $PS1 expanded, or a copy of fallback when PS1 is unset. */
+char *gs_prompt_expand(struct gs_shell *shell, const char *fallback);
+/* Descriptor that becomes readable when a background segment finishes; -1 when none runs. */
+int gs_prompt_pending_fd(const struct gs_shell *shell);
+/*
+ * Collects a finished background segment. Returns the malloc'd new prompt
+ * when shown is the latest expansion and the segment changed it, else NULL.
+ */
+char *gs_prompt_refresh(struct gs_shell *shell, const char *shown);
+/* Stops any background segment and frees the prompt state. */
+void gs_prompt_free(struct gs_prompt *prompt);
+
+#endif /* GS_PROMPT_H */
@@ -0,0 +1,594 @@
+/*
+ * Command server mode (genshell --server / --client).
+ *
+ * Start-up work (rc files, the parsed-file cache behind ".", the builtin
+ * table, glob and printf caches) is done once by the server; each request
+ * then costs a connect, a fork of the warm server and the command itself.
+ *
+ * A request is one gs_server_request_header followed by the client's
+ * working directory and command text, with the client's descriptors 0, 1
+ * and 2 attached as SCM_RIGHTS ancillary data. The worker becomes a session
+ * leader, so it never contends for the server's terminal and the whole job
+ * can be signalled as a group. After the request the client may send a
+ * 32-bit signal number, which is forwarded to the worker's session
+ * (closing the connection sends SIGHUP); the server answers with the 32-bit
+ * exit status once the worker is reaped (128+N for death by signal N).
+ * Only connections from the server's own user are accepted. The request is
+ * read by the worker, not the accept loop, so a client that stalls only
+ * holds up its own worker; the server watches the connection for signals
+ * once the worker closes its end of the job's "ready" pipe.
+ */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "server.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SERVER_BACKLOG 128
+#define SERVER_MAX_REQUEST (16u * 1024u * 1024u)
+#define SERVER_RECV_TIMEOUT_SEC 5
+#define SERVER_STATUS_FAILED 125 /* the request could not be started */
+
+#if !defined(MSG_NOSIGNAL)
+#define MSG_NOSIGNAL 0 /* SIGPIPE is ignored by the server instead */
+#endif
+
+typedef struct {
+    int conn;
+    pid_t pid;
+    bool hung_up;
+    int ready; /* read end of a pipe the worker closes once it has the request; -1 after */
+} server_job;
+
+typedef struct {
+    int listen_fd;
+    server_job *jobs;
+    size_t job_count;
+    size_t job_capacity;
+} server_state;
+
+static volatile sig_atomic_t g_stop;
+static int g_wake[2] = {-1, -1};
+
+static void on_server_signal(int sig) {
+    int saved_errno = errno;
+    if (sig != SIGCHLD) {
+        g_stop = 1;
+    }
+    if (g_wake[1] >= 0) {
+        (void)write(g_wake[1], "", 1u);
+    }
+    errno = saved_errno;
+}
+
+static int set_cloexec_nonblock(int fd, bool nonblock) {
+    int flags = fcntl(fd, F_GETFD);
+    if (flags < 0 || fcntl(fd, F_SETFD, flags | FD_CLOEXEC) != 0) {
+        return -1;
+    }
+    if (nonblock) {
+        flags = fcntl(fd, F_GETFL);
+        if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static bool make_address(const char *path, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "genshell: %s: socket path too long\n", path);
+        return false;
+    }
+    strcpy(addr->sun_path, path);
+    return true;
+}
+
+static int read_full(int fd, void *buf, size_t len) {
+    char *p = (char *)buf;
+    while (len > 0u) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int send_full(int fd, const void *buf, size_t len) {
+    const char *p = (const char *)buf;
+    while (len > 0u) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static bool peer_is_owner(int conn) {
+#if defined(SO_PEERCRED)
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+    return getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 && cred.uid == getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    return getpeereid(conn, &uid, &gid) == 0 && uid == getuid();
+#endif
+}
+
+/*
+ * Reads a request. On success fds holds the client's three descriptors and
+ * *out_cwd / *out_command are malloc'd strings.
+ */
+static int receive_request(int conn, int fds[3], char **out_cwd, char **out_command) {
+    struct gs_server_request_header hdr;
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(3 * sizeof(int))];
+    } control;
+    struct iovec iov = {&hdr, sizeof(hdr)};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    fds[0] = fds[1] = fds[2] = -1;
+    int flags = 0;
+#if defined(MSG_CMSG_CLOEXEC)
+    flags |= MSG_CMSG_CLOEXEC;
+#endif
+    ssize_t n;
+    do {
+        n = recvmsg(conn, &msg, flags);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        return GS_ERR_EXEC;
+    }
+    size_t received = 0u;
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+            size_t count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t i = 0; i < count; ++i) {
+                int fd;
+                memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+                if (received < 3u) {
+                    fds[received++] = fd;
+                    set_cloexec_nonblock(fd, false);
+                } else {
+                    close(fd);
+                }
+            }
+        }
+    }
+
+    int rc = GS_ERR_EXEC;
+    if (received == 3u && (msg.msg_flags & MSG_CTRUNC) == 0 &&
+        ((size_t)n == sizeof(hdr) || read_full(conn, (char *)&hdr + n, sizeof(hdr) - (size_t)n) == 0) &&
+        hdr.magic == GS_SERVER_MAGIC && (uint64_t)hdr.cwd_len + hdr.command_len <= SERVER_MAX_REQUEST) {
+        char *cwd = (char *)malloc((size_t)hdr.cwd_len + 1u);
+        char *command = (char *)malloc((size_t)hdr.command_len + 1u);
+        if (cwd && command && read_full(conn, cwd, hdr.cwd_len) == 0 &&
+            read_full(conn, command, hdr.command_len) == 0) {
+            cwd[hdr.cwd_len] = '\0';
+            command[hdr.command_len] = '\0';
+            *out_cwd = cwd;
+            *out_command = command;
+            return GS_OK;
+        }
+        free(cwd);
+        free(command);
+        rc = GS_ERR_ALLOC;
+    }
+    for (size_t i = 0; i < received; ++i) {
+        close(fds[i]);
+    }
+    return rc;
+}
+
+/* The worker: reads the request, adopts the client's descriptors and directory, then runs the command. */
+static void run_worker(struct gs_shell *shell, server_state *state, int conn, int ready) {
+    setsid();
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = SIG_DFL;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGCHLD, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+    sigaction(SIGPIPE, &sa, NULL);
+
+    close(g_wake[0]);
+    close(g_wake[1]);
+    g_wake[0] = g_wake[1] = -1;
+    close(state->listen_fd);
+    for (size_t i = 0; i < state->job_count; ++i) {
+        close(state->jobs[i].conn);
+        if (state->jobs[i].ready >= 0) {
+            close(state->jobs[i].ready);
+        }
+    }
+
+    struct timeval timeout = {SERVER_RECV_TIMEOUT_SEC, 0};
+    int fds[3];
+    char *cwd = NULL;
+    char *command = NULL;
+    if (setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0 ||
+        receive_request(conn, fds, &cwd, &command) != GS_OK) {
+        _exit(SERVER_STATUS_FAILED);
+    }
+    close(ready); /* what the client sends from now on is for the server */
+    close(conn);
+
+    /* Move the received descriptors clear of 0-2 before installing them. */
+    for (int i = 0; i < 3; ++i) {
+        int high = fcntl(fds[i], F_DUPFD, 10);
+        close(fds[i]);
+        fds[i] = high;
+    }
+    for (int i = 0; i < 3; ++i) {
+        if (fds[i] < 0 || dup2(fds[i], i) < 0) {
+            _exit(SERVER_STATUS_FAILED);
+        }
+        close(fds[i]);
+    }
+
+    if (cwd[0] != '\0') {
+        if (gs_shell_set_cwd(shell, cwd) != GS_OK) {
+            fprintf(stderr, "genshell: %s: %s\n", cwd, strerror(errno));
+            _exit(1);
+        }
+        gs_shell_setvar(shell, "PWD", cwd);
+    }
+    shell->interactive = false;
+    shell->last_status = 0;
+    int status = gs_shell_run_string(shell, command, true);
+    fflush(NULL);
+    _exit(status < 0 ? 1 : status & 0xff);
+}
+
+static void drop_job(server_state *state, size_t index) {
+    close(state->jobs[index].conn);
+    if (state->jobs[index].ready >= 0) {
+        close(state->jobs[index].ready);
+    }
+    state->jobs[index] = state->jobs[--state->job_count];
+}
+
+static void accept_request(struct gs_shell *shell, server_state *state) {
+    int conn = accept(state->listen_fd, NULL, NULL);
+    if (conn < 0) {
+        return;
+    }
+    int32_t failed = SERVER_STATUS_FAILED;
+    if (set_cloexec_nonblock(conn, false) != 0 || !peer_is_owner(conn)) {
+        (void)send_full(conn, &failed, sizeof(failed));
+        close(conn);
+        return;
+    }
+
+    if (state->job_count == state->job_capacity) {
+        size_t new_cap = state->job_capacity ? state->job_capacity * 2u : 16u;
+        server_job *tmp = (server_job *)realloc(state->jobs, new_cap * sizeof(server_job));
+        if (tmp) {
+            state->jobs = tmp;
+            state->job_capacity = new_cap;
+        }
+    }
+    int ready[2] = {-1, -1};
+    pid_t pid = state->job_count < state->job_capacity && gs_pipe_cloexec(ready) == 0 ? fork() : -1;
+    if (pid == 0) {
+        close(ready[0]);
+        run_worker(shell, state, conn, ready[1]);
+    }
+    if (ready[1] >= 0) {
+        close(ready[1]);
+    }
+    if (pid < 0) {
+        if (ready[0] >= 0) {
+            close(ready[0]);
+        }
+        (void)send_full(conn, &failed, sizeof(failed));
+        close(conn);
+        return;
+    }
+    state->jobs[state->job_count].conn = conn;
+    state->jobs[state->job_count].pid = pid;
+    state->jobs[state->job_count].hung_up = false;
+    state->jobs[state->job_count].ready = ready[0];
+    state->job_count++;
+}
+
+static void reap_workers(server_state *state) {
+    int wstatus;
+    pid_t pid;
+    while ((pid = waitpid(-1, &wstatus, WNOHANG)) > 0) {
+        int32_t status = WIFEXITED(wstatus) ? WEXITSTATUS(wstatus) : 128 + WTERMSIG(wstatus);
+        for (size_t i = 0; i < state->job_count; ++i) {
+            if (state->jobs[i].pid == pid) {
+                (void)send_full(state->jobs[i].conn, &status, sizeof(status));
+                drop_job(state, i);
+                break;
+            }
+        }
+    }
+}
+
+/* A client wrote a signal number or went away: pass it on to the job. */
+static void forward_signal(server_job *job) {
+    int32_t sig = 0;
+    ssize_t n;
+    do {
+        n = recv(job->conn, &sig, sizeof(sig), MSG_DONTWAIT);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return;
+    }
+    if (n != (ssize_t)sizeof(sig) || sig <= 0 || sig >= NSIG) {
+        job->hung_up = true;
+        sig = SIGHUP;
+    }
+    kill(-job->pid, sig);
+}
+
+static int open_listener(const char *path) {
+    struct sockaddr_un addr;
+    if (!make_address(path, &addr)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || set_cloexec_nonblock(fd, true) != 0) {
+        fprintf(stderr, "genshell: socket: %s\n", strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    mode_t old_mask = umask(077);
+    int rc = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    if (rc != 0 && errno == EADDRINUSE) {
+        /* Replace the socket of a server that is gone, never a live one. */
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        bool live = probe >= 0 && connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+        if (probe >= 0) {
+            close(probe);
+        }
+        if (!live && unlink(path) == 0) {
+            rc = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+        } else {
+            errno = EADDRINUSE;
+        }
+    }
+    umask(old_mask);
+    if (rc != 0 || listen(fd, SERVER_BACKLOG) != 0) {
+        fprintf(stderr, "genshell: %s: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int gs_server_run(struct gs_shell *shell, const char *socket_path) {
+    server_state state;
+    memset(&state, 0, sizeof(state));
+    state.listen_fd = open_listener(socket_path);
+    if (state.listen_fd < 0) {
+        return 1;
+    }
+    if (pipe(g_wake) != 0 || set_cloexec_nonblock(g_wake[0], true) != 0 ||
+        set_cloexec_nonblock(g_wake[1], true) != 0) {
+        fprintf(stderr, "genshell: pipe: %s\n", strerror(errno));
+        close(state.listen_fd);
+        unlink(socket_path);
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_server_signal;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    sa.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &sa, NULL);
+    fflush(NULL); /* nothing buffered may be inherited by workers */
+
+    struct pollfd *pfds = NULL;
+    size_t pfd_capacity = 0u;
+    while (!g_stop) {
+        if (state.job_count + 2u > pfd_capacity) {
+            size_t new_cap = state.job_count + 18u;
+            struct pollfd *tmp = (struct pollfd *)realloc(pfds, new_cap * sizeof(struct pollfd));
+            if (!tmp) {
+                break;
+            }
+            pfds = tmp;
+            pfd_capacity = new_cap;
+        }
+        pfds[0].fd = g_wake[0];
+        pfds[0].events = POLLIN;
+        pfds[1].fd = state.listen_fd;
+        pfds[1].events = POLLIN;
+        size_t watched = state.job_count;
+        for (size_t i = 0; i < watched; ++i) {
+            pfds[i + 2u].fd = state.jobs[i].ready >= 0 ? state.jobs[i].ready
+                              : state.jobs[i].hung_up ? -1
+                                                      : state.jobs[i].conn;
+            pfds[i + 2u].events = POLLIN;
+            pfds[i + 2u].revents = 0; /* left as is when poll is interrupted */
+        }
+        if (poll(pfds, watched + 2u, -1) < 0 && errno != EINTR) {
+            fprintf(stderr, "genshell: poll: %s\n", strerror(errno));
+            break;
+        }
+        for (size_t i = 0; i < watched && i < state.job_count; ++i) {
+            if (pfds[i + 2u].fd < 0 || !(pfds[i + 2u].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+            if (state.jobs[i].ready >= 0) {
+                close(state.jobs[i].ready); /* the worker has its request */
+                state.jobs[i].ready = -1;
+            } else {
+                forward_signal(&state.jobs[i]);
+            }
+        }
+        if (pfds[0].revents & POLLIN) {
+            char drain[64];
+            while (read(g_wake[0], drain, sizeof(drain)) > 0) {
+            }
+        }
+        reap_workers(&state);
+        if (!g_stop && (pfds[1].revents & POLLIN)) {
+            accept_request(shell, &state);
+        }
+    }
+
+    for (size_t i = 0; i < state.job_count; ++i) {
+        kill(-state.jobs[i].pid, SIGHUP);
+        close(state.jobs[i].conn);
+    }
+    free(state.jobs);
+    free(pfds);
+    close(state.listen_fd);
+    unlink(socket_path);
+    close(g_wake[0]);
+    close(g_wake[1]);
+    g_wake[0] = g_wake[1] = -1;
+    return 0;
+}
+
+static volatile sig_atomic_t g_client_signal;
+
+static void on_client_signal(int sig) {
+    g_client_signal = sig;
+}
+
+/* The client's directory: $PWD when it names the current directory, else getcwd. */
+static char *client_cwd(void) {
+    const char *pwd = getenv("PWD");
+    struct stat pwd_st;
+    struct stat dot_st;
+    if (gs_path_is_canonical(pwd) && stat(pwd, &pwd_st) == 0 && stat(".", &dot_st) == 0 &&
+        pwd_st.st_dev == dot_st.st_dev && pwd_st.st_ino == dot_st.st_ino) {
+        return strdup(pwd);
+    }
+    return getcwd(NULL, 0);
+}
+
+int gs_server_request(const char *socket_path, const char *command) {
+    struct sockaddr_un addr;
+    if (!make_address(socket_path, &addr)) {
+        return SERVER_STATUS_FAILED;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "genshell: %s: %s\n", socket_path, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return SERVER_STATUS_FAILED;
+    }
+
+    char *cwd_copy = client_cwd();
+    const char *cwd = cwd_copy ? cwd_copy : "";
+    struct gs_server_request_header hdr = {GS_SERVER_MAGIC, (uint32_t)strlen(cwd), (uint32_t)strlen(command), 0u};
+    int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(sizeof(fds))];
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct iovec iov = {&hdr, sizeof(hdr)};
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(c), fds, sizeof(fds));
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    if (sent != (ssize_t)sizeof(hdr) || send_full(fd, cwd, hdr.cwd_len) != 0 ||
+        send_full(fd, command, hdr.command_len) != 0) {
+        fprintf(stderr, "genshell: %s: %s\n", socket_path, strerror(errno));
+        free(cwd_copy);
+        close(fd);
+        return SERVER_STATUS_FAILED;
+    }
+    free(cwd_copy);
+
+    /* Interrupts are forwarded to the worker, whose status then ends the wait. */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_client_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+    sigaction(SIGQUIT, &sa, NULL);
+
+    int32_t status = 0;
+    char *p = (char *)&status;
+    size_t remaining = sizeof(status);
+    while (remaining > 0u) {
+        ssize_t n = read(fd, p, remaining);
+        if (n < 0 && errno == EINTR) {
+            int32_t sig = (int32_t)g_client_signal;
+            g_client_signal = 0;
+            if (sig != 0) {
+                (void)send_full(fd, &sig, sizeof(sig));
+            }
+            continue;
+        }
+        if (n <= 0) {
+            fprintf(stderr, "genshell: %s: server closed the connection\n", socket_path);
+            close(fd);
+            return SERVER_STATUS_FAILED;
+        }
+        p += n;
+        remaining -= (size_t)n;
+    }
+    close(fd);
+    return (int)status;
+}
@@ -0,0 +1,32 @@
+#ifndef GS_SERVER_H
+#define GS_SERVER_H
+
+#include <stdint.h>
+
+#include "shell.h"
+
+/*
+ * Command server ("zygote") mode. gs_server_run listens on a Unix socket
+ * with a shell that has already sourced its start-up files; for every
+ * request it forks a worker from that warm state, which adopts the client's
+ * stdin, stdout and stderr (received with SCM_RIGHTS) and working directory,
+ * runs the command and reports its exit status back. gs_server_request is
+ * the client side used by "genshell --client".
+ */
+
+#define GS_SERVER_MAGIC 0x67735a31u /* "gsZ1" */
+
+/* Fixed part of a request; the cwd and command bytes follow it. */
+struct gs_server_request_header {
+    uint32_t magic;
+    uint32_t cwd_len;
+    uint32_t command_len;
+    uint32_t reserved;
+};
+
+/* Serves until SIGINT or SIGTERM; returns the shell's exit status. */
+int gs_server_run(struct gs_shell *shell, const char *socket_path);
+/* Runs command through the server at socket_path; returns its exit status. */
+int gs_server_request(const char *socket_path, const char *command);
+
+#endif /* GS_SERVER_H */
@@ -1,25 +1,72 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
 #include "shell.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "builtins/builtin.h"
+#include "complete.h"
 #include "exec/executor.h"
+#include "history.h"
+#include "lineedit.h"
 #include "parser/lexer.h"
 #include "parser/parser.h"
+#include "prompt.h"
 
-int gs_shell_init(struct gs_shell *shell, const char *progname) {
-    if (!shell) {
+extern char **environ;
+
+int gs_shell_init_with(struct gs_shell *shell, const gs_shell_options *options) {
+    if (!shell || !options) {
         return GS_ERR_ALLOC;
     }
-    shell->progname = progname;
-    shell->last_status = 0;
-    shell->exit_requested = false;
-    shell->exit_status = 0;
+    memset(shell, 0, sizeof(*shell));
+    shell->progname = options->progname ? options->progname : "genshell";
+    shell->umask = options->umask & 0777u;
+    shell->cwd_fd = AT_FDCWD;
+    shell->last_duration = -1;
+    for (int fd = 0; fd < GS_SHELL_FD_COUNT; ++fd) {
+        shell->fds[fd] = -1;
+    }
+    gs_shell_set_io(shell, options->in_fd, options->out_fd, options->err_fd);
+    if (gs_vars_init(&shell->vars, options->envp) != GS_OK) {
+        return GS_ERR_ALLOC;
+    }
+    if (gs_shell_set_cwd(shell, options->cwd ? options->cwd : ".") != GS_OK) {
+        gs_vars_dispose(&shell->vars);
+        return GS_ERR_EXEC;
+    }
+    /* A logical starting directory is kept as PWD if it names the directory. */
+    if (options->cwd && options->cwd[0] == '/' && gs_shell_setvar(shell, "PWD", options->cwd) != GS_OK) {
+        gs_shell_destroy(shell);
+        return GS_ERR_ALLOC;
+    }
+    gs_shell_sync_pwd(shell);
+    return GS_OK;
+}
+
+int gs_shell_init(struct gs_shell *shell, const char *progname) {
+    mode_t mask = umask(0);
+    gs_shell_options options = {progname, environ, NULL, STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, (unsigned)mask};
+    int rc = gs_shell_init_with(shell, &options);
+    if (rc != GS_OK) {
+        umask(mask);
+        return rc;
+    }
+    /* Whatever of 0-9 the shell was started with is passed on to its commands. */
+    for (int fd = 0; fd < GS_SHELL_FD_COUNT; ++fd) {
+        shell->fds[fd] = fcntl(fd, F_GETFD) >= 0 ? fd : -1;
+    }
     shell->interactive = isatty(STDIN_FILENO) && isatty(STDOUT_FILENO);
 
     struct sigaction sa = {0};
@@ -33,67 +80,405 @@ int gs_shell_init(struct gs_shell *shell, const char *progname) {
 }
 
 void gs_shell_destroy(struct gs_shell *shell) {
-    (void)shell;
+    if (!shell) {
+        return;
+    }
+    for (size_t i = 0; i < shell->dir_count; ++i) {
+        free(shell->dirs[i]);
+    }
+    free(shell->dirs);
+    shell->dirs = NULL;
+    shell->dir_count = 0u;
+    shell->dir_capacity = 0u;
+    gs_vars_dispose(&shell->vars);
+    if (shell->cwd_fd >= 0) {
+        close(shell->cwd_fd);
+    }
+    shell->cwd_fd = -1;
+    gs_history_close(shell->history);
+    shell->history = NULL;
+    gs_command_index_free(shell->commands);
+    shell->commands = NULL;
+    gs_prompt_free(shell->prompt);
+    shell->prompt = NULL;
 }
 
-static int run_line(struct gs_shell *shell, const char *line) {
-    gs_token_buffer tokens = {0};
-    int rc = gs_lexer_tokenize(line, &tokens);
-    if (rc != GS_OK) {
-        fprintf(stderr, "genshell: failed to lex input\n");
-        gs_token_buffer_dispose(&tokens);
-        shell->last_status = 1;
-        return rc;
+struct gs_shell *gs_shell_new(const gs_shell_options *options) {
+    struct gs_shell *shell = (struct gs_shell *)malloc(sizeof(struct gs_shell));
+    if (shell && gs_shell_init_with(shell, options) != GS_OK) {
+        free(shell);
+        return NULL;
+    }
+    return shell;
+}
+
+void gs_shell_free(struct gs_shell *shell) {
+    gs_shell_destroy(shell);
+    free(shell);
+}
+
+void gs_shell_set_io(struct gs_shell *shell, int in_fd, int out_fd, int err_fd) {
+    shell->fds[STDIN_FILENO] = in_fd;
+    shell->fds[STDOUT_FILENO] = out_fd;
+    shell->fds[STDERR_FILENO] = err_fd;
+}
+
+int gs_shell_open(const struct gs_shell *shell, const char *path, int flags) {
+    return openat(shell->cwd_fd, path, flags | O_CLOEXEC, (mode_t)(0666u & ~shell->umask));
+}
+
+void gs_shell_enter_process(struct gs_shell *shell) {
+    /* Copies go above the slots first, so no slot is overwritten before it is read. */
+    int staged[GS_SHELL_FD_COUNT];
+    for (int fd = 0; fd < GS_SHELL_FD_COUNT; ++fd) {
+        staged[fd] = shell->fds[fd] >= 0 ? fcntl(shell->fds[fd], F_DUPFD_CLOEXEC, GS_SHELL_FD_COUNT) : -1;
+    }
+    for (int fd = 0; fd < GS_SHELL_FD_COUNT; ++fd) {
+        if (shell->fds[fd] >= GS_SHELL_FD_COUNT) {
+            close(shell->fds[fd]);
+        }
+    }
+    for (int fd = 0; fd < GS_SHELL_FD_COUNT; ++fd) {
+        if (staged[fd] >= 0) {
+            dup2(staged[fd], fd);
+            close(staged[fd]);
+            shell->fds[fd] = fd;
+        } else {
+            close(fd);
+            shell->fds[fd] = -1;
+        }
+    }
+    gs_builtin_io_bind(NULL);
+    if (shell->cwd_fd >= 0) {
+        (void)fchdir(shell->cwd_fd);
+    }
+    umask((mode_t)shell->umask);
+    environ = gs_shell_environ(shell);
+}
+
+int gs_pipe_cloexec(int fds[2]) {
+#if defined(__linux__)
+    return pipe2(fds, O_CLOEXEC);
+#else
+    if (pipe(fds) != 0) {
+        return -1;
+    }
+    (void)fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    (void)fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return 0;
+#endif
+}
+
+/*
+ * Where command lines (and here-document bodies following them) come from.
+ * With record set, each parsed command list is kept there after it runs.
+ * With history set, each command's lines are gathered in typed and appended
+ * to the shell's history before it runs. Prompted lines from a terminal go
+ * through the line editor, which sets eof itself since it bypasses stream.
+ */
+struct gs_command_source {
+    FILE *stream;
+    struct gs_parsed_script *record;
+    bool history;
+    char *typed;
+    size_t typed_len;
+    size_t typed_cap;
+    bool eof;
+};
+
+static ssize_t source_read_line(struct gs_shell *shell, struct gs_command_source *source, const char *prompt, char **line, size_t *cap) {
+    if (prompt && gs_lineedit_usable(shell, fileno(source->stream))) {
+        return gs_lineedit_read(shell, fileno(source->stream), shell->fds[STDOUT_FILENO], prompt, line, cap,
+                                &source->eof);
+    }
+    if (shell->interactive && prompt) {
+        (void)gs_builtin_write_all(shell->fds[STDOUT_FILENO], prompt, strlen(prompt));
+    }
+    ssize_t n;
+    do {
+        errno = 0;
+        n = getline(line, cap, source->stream);
+        if (n < 0 && errno == EINTR) {
+            clearerr(source->stream);
+        }
+    } while (n < 0 && errno == EINTR);
+    return n;
+}
+
+/*
+ * Copies a here-document line into the body. Unless the delimiter was quoted,
+ * backslash escapes of '$', '`' and '\\' become literal-sentinel pairs so the
+ * executor's expansion leaves them alone.
+ */
+static void append_heredoc_line(FILE *body, const char *text, size_t len, bool literal) {
+    for (size_t i = 0; i < len; ++i) {
+        char ch = text[i];
+        if (!literal && ch == '\\' && i + 1 < len) {
+            char next = text[i + 1];
+            if (next == '$' || next == '`' || next == '\\') {
+                fputc(GS_LITERAL_SENTINEL, body);
+                fputc(next, body);
+                ++i;
+                continue;
+            }
+        }
+        if (ch == GS_LITERAL_SENTINEL) {
+            continue;
+        }
+        fputc(ch, body);
+    }
+}
+
+/*
+ * Reads the body of every here-document operator on the line from the
+ * command source and stores it in place of the delimiter word.
+ */
+static int collect_heredocs(struct gs_shell *shell, struct gs_command_source *source, gs_token_buffer *tokens) {
+    for (size_t i = 0; i + 1u < tokens->length; ++i) {
+        gs_token_type type = tokens->items[i].type;
+        if (type != GS_TOKEN_HEREDOC && type != GS_TOKEN_HEREDOC_STRIP) {
+            continue;
+        }
+        gs_token *word = &tokens->items[i + 1u];
+        if (word->type != GS_TOKEN_WORD || !word->lexeme) {
+            continue;
+        }
+
+        bool literal = (word->flags & GS_TOKEN_FLAG_HAS_SENTINEL) != 0u;
+        size_t delim_len = 0u;
+        for (const char *p = word->lexeme; *p; ++p) {
+            if (*p != GS_LITERAL_SENTINEL) {
+                word->lexeme[delim_len++] = *p;
+            }
+        }
+        word->lexeme[delim_len] = '\0';
+
+        char *body = NULL;
+        size_t body_len = 0u;
+        FILE *out = open_memstream(&body, &body_len);
+        if (!out) {
+            return GS_ERR_ALLOC;
+        }
+
+        char *line = NULL;
+        size_t cap = 0u;
+        bool terminated = false;
+        while (true) {
+            ssize_t n = source_read_line(shell, source, "> ", &line, &cap);
+            if (n < 0) {
+                break;
+            }
+            const char *text = line;
+            size_t len = (size_t)n;
+            if (len > 0u && text[len - 1u] == '\n') {
+                --len;
+            }
+            if (type == GS_TOKEN_HEREDOC_STRIP) {
+                while (len > 0u && *text == '\t') {
+                    ++text;
+                    --len;
+                }
+            }
+            if (len == delim_len && memcmp(text, word->lexeme, len) == 0) {
+                terminated = true;
+                break;
+            }
+            if (!literal && len > 0u && text[len - 1u] == '\\') {
+                append_heredoc_line(out, text, len - 1u, literal);
+                continue; /* line continuation */
+            }
+            append_heredoc_line(out, text, len, literal);
+            fputc('\n', out);
+        }
+        free(line);
+        if (fclose(out) != 0) {
+            free(body);
+            return GS_ERR_ALLOC;
+        }
+        if (!terminated) {
+            gs_builtin_err_printf("genshell: warning: here-document delimited by end-of-file (wanted `%s')\n", word->lexeme);
+        }
+
+        free(word->lexeme);
+        word->lexeme = body;
+        word->flags = literal ? GS_TOKEN_FLAG_HEREDOC_LITERAL : 0u;
+        ++i;
+    }
+    return GS_OK;
+}
+
+/* True once nothing is left to read, i.e. the command just parsed is the last. */
+static bool source_at_eof(struct gs_command_source *source) {
+    int ch = getc(source->stream);
+    if (ch == EOF) {
+        return true;
     }
+    ungetc(ch, source->stream);
+    return false;
+}
+
+/* A command failed to parse, so the recorded script is not the whole file. */
+static void discard_record(struct gs_command_source *source) {
+    if (source->record) {
+        source->record->complete = false;
+    }
+}
+
+/* Adds a line of the command being read to the text kept for the history. */
+static void add_typed_line(struct gs_command_source *source, const char *line) {
+    size_t len = strlen(line);
+    if (source->typed_len + len + 1u > source->typed_cap) {
+        size_t new_cap = source->typed_cap ? source->typed_cap : 128u;
+        while (new_cap < source->typed_len + len + 1u) {
+            new_cap *= 2u;
+        }
+        char *tmp = (char *)realloc(source->typed, new_cap);
+        if (!tmp) {
+            return;
+        }
+        source->typed = tmp;
+        source->typed_cap = new_cap;
+    }
+    memcpy(source->typed + source->typed_len, line, len + 1u);
+    source->typed_len += len;
+}
+
+/* Appends the command just read to the history, without its final newline. */
+static void record_typed(struct gs_shell *shell, struct gs_command_source *source) {
+    size_t len = source->typed_len;
+    while (len > 0u && source->typed[len - 1u] == '\n') {
+        --len;
+    }
+    size_t start = 0u;
+    while (start < len && (source->typed[start] == ' ' || source->typed[start] == '\t')) {
+        ++start;
+    }
+    if (start < len) {
+        gs_history_record(shell, source->typed, len);
+    }
+}
 
-    if (tokens.length == 1u && tokens.items[0].type == GS_TOKEN_END) {
-        gs_token_buffer_dispose(&tokens);
-        return GS_OK;
+/* Moves list onto the end of script. */
+static int record_command(struct gs_parsed_script *script, gs_command_list *list) {
+    if (script->count == script->capacity) {
+        size_t new_cap = script->capacity ? script->capacity * 2u : 16u;
+        gs_command_list *tmp = (gs_command_list *)realloc(script->units, new_cap * sizeof(gs_command_list));
+        if (!tmp) {
+            return GS_ERR_ALLOC;
+        }
+        script->units = tmp;
+        script->capacity = new_cap;
     }
+    script->units[script->count++] = *list;
+    return GS_OK;
+}
 
-    gs_pipeline pipeline = {0};
-    rc = gs_parse_tokens(&tokens, &pipeline);
+/*
+ * Lexes *line, reads any here-document bodies it introduces and parses it.
+ * While the parser reports an unfinished construct (an open group, a
+ * trailing '|' or '&&'), further lines are read with a "> " prompt and joined
+ * on. The command is then executed; exec_last lets the executor replace the
+ * shell with its final command when the source has nothing more to offer.
+ */
+static int run_command(struct gs_shell *shell, struct gs_command_source *source, char **line, size_t *cap, bool exec_last) {
+    gs_token_buffer tokens = {0};
+    gs_command_list list = {0};
+    int rc;
+
+    source->typed_len = 0u;
+    while (true) {
+        if (source->history) {
+            add_typed_line(source, *line);
+        }
+        gs_token_buffer line_tokens = {0};
+        rc = gs_lexer_tokenize(*line, &line_tokens);
+        if (rc != GS_OK) {
+            gs_builtin_err_printf("genshell: failed to lex input\n");
+            gs_token_buffer_dispose(&line_tokens);
+            gs_token_buffer_dispose(&tokens);
+            shell->last_status = 1;
+            discard_record(source);
+            return rc;
+        }
+
+        rc = collect_heredocs(shell, source, &line_tokens);
+        if (rc == GS_OK) {
+            rc = gs_token_buffer_append_line(&tokens, &line_tokens);
+        }
+        if (rc != GS_OK) {
+            gs_builtin_err_printf("genshell: failed to read here-document\n");
+            gs_token_buffer_dispose(&line_tokens);
+            gs_token_buffer_dispose(&tokens);
+            shell->last_status = 1;
+            discard_record(source);
+            return rc;
+        }
+
+        rc = gs_parse_tokens(&tokens, &list);
+        if (rc != GS_ERR_EOF) {
+            break;
+        }
+        if (source_read_line(shell, source, "> ", line, cap) < 0) {
+            gs_builtin_err_printf("genshell: syntax error: unexpected end of file\n");
+            gs_token_buffer_dispose(&tokens);
+            shell->last_status = 2;
+            discard_record(source);
+            return GS_ERR_PARSE;
+        }
+    }
     gs_token_buffer_dispose(&tokens);
+    if (source->history) {
+        record_typed(shell, source);
+    }
 
     if (rc != GS_OK) {
-        fprintf(stderr, "genshell: syntax error\n");
+        gs_builtin_err_printf("genshell: syntax error\n");
         shell->last_status = 2;
+        discard_record(source);
         return rc;
     }
 
-    rc = gs_execute_pipeline(shell, &pipeline);
-    gs_pipeline_dispose(&pipeline);
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    rc = gs_execute_list(shell, &list, exec_last && source_at_eof(source));
+    if (source->history) {
+        struct timespec ended;
+        clock_gettime(CLOCK_MONOTONIC, &ended);
+        shell->last_duration = (long long)(ended.tv_sec - started.tv_sec) * 1000000000LL + (ended.tv_nsec - started.tv_nsec);
+    }
+    if (source->record && list.length > 0u) {
+        if (record_command(source->record, &list) != GS_OK) {
+            discard_record(source);
+            gs_command_list_dispose(&list);
+        }
+    } else {
+        gs_command_list_dispose(&list);
+    }
     return rc;
 }
 
-int gs_shell_run(struct gs_shell *shell) {
-    if (!shell) {
-        return GS_ERR_ALLOC;
-    }
-
+/*
+ * Runs commands from source until it is exhausted or exit is requested, with
+ * the shell's standard descriptors bound for the diagnostics along the way.
+ */
+static int run_source(struct gs_shell *shell, struct gs_command_source *source, const char *prompt, bool exec_last) {
     char *line = NULL;
     size_t cap = 0u;
+    gs_builtin_io io = {shell->fds[STDIN_FILENO], shell->fds[STDOUT_FILENO], shell->fds[STDERR_FILENO]};
+    const gs_builtin_io *outer = gs_builtin_io_bind(&io);
 
     while (!shell->exit_requested) {
-        if (shell->interactive) {
-            fputs("genshell$ ", stdout);
-            fflush(stdout);
-        }
-
-        errno = 0;
-        ssize_t n = getline(&line, &cap, stdin);
+        char *shown = prompt && shell->interactive ? gs_prompt_expand(shell, prompt) : NULL;
+        ssize_t n = source_read_line(shell, source, shown ? shown : prompt, &line, &cap);
+        free(shown);
         if (n < 0) {
-            if (feof(stdin)) {
+            if (feof(source->stream) || source->eof) {
                 if (shell->interactive) {
-                    fputc('\n', stdout);
+                    (void)gs_builtin_write_all(shell->fds[STDOUT_FILENO], "\n", 1u);
                 }
                 break;
             }
-            if (errno == EINTR) {
-                clearerr(stdin);
-                continue;
-            }
-            perror("genshell: getline");
+            gs_builtin_err_printf("genshell: getline: %s\n", strerror(errno));
             shell->last_status = 1;
             break;
         }
@@ -102,12 +487,128 @@ int gs_shell_run(struct gs_shell *shell) {
             continue;
         }
 
-        int line_status = run_line(shell, line);
+        int line_status = run_command(shell, source, &line, &cap, exec_last);
         if (line_status < 0) {
             shell->last_status = 1;
         }
     }
 
     free(line);
+    free(source->typed);
+    source->typed = NULL;
+    source->typed_len = 0u;
+    source->typed_cap = 0u;
+    gs_builtin_io_bind(outer);
     return shell->exit_requested ? shell->exit_status : shell->last_status;
 }
+
+int gs_shell_run(struct gs_shell *shell) {
+    if (!shell) {
+        return GS_ERR_ALLOC;
+    }
+    int in_fd = shell->fds[STDIN_FILENO];
+    if (in_fd == STDIN_FILENO) {
+        struct gs_command_source source = {stdin, NULL, true, NULL, 0u, 0u, false};
+        return run_source(shell, &source, "genshell$ ", false);
+    }
+    int fd = in_fd >= 0 ? fcntl(in_fd, F_DUPFD_CLOEXEC, GS_SHELL_FD_COUNT) : -1;
+    FILE *stream = fd >= 0 ? fdopen(fd, "r") : NULL;
+    if (!stream) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return GS_ERR_EXEC;
+    }
+    struct gs_command_source source = {stream, NULL, true, NULL, 0u, 0u, false};
+    int status = run_source(shell, &source, "genshell$ ", false);
+    fclose(stream);
+    return status;
+}
+
+int gs_shell_run_string(struct gs_shell *shell, const char *text, bool exec_last) {
+    if (!shell || !text) {
+        return GS_ERR_ALLOC;
+    }
+    FILE *stream = fmemopen((void *)text, strlen(text), "r");
+    if (!stream) {
+        return GS_ERR_ALLOC;
+    }
+
+    bool was_interactive = shell->interactive;
+    shell->interactive = false;
+    struct gs_command_source source = {stream, NULL, false, NULL, 0u, 0u, false};
+    int status = run_source(shell, &source, NULL, exec_last);
+    fclose(stream);
+    shell->interactive = was_interactive;
+    return status;
+}
+
+/*
+ * Runs every line of text as if it had been typed, without prompts. Used for
+ * work that must return to the caller, such as in-process substitutions.
+ */
+int gs_shell_eval(struct gs_shell *shell, const char *text) {
+    return gs_shell_run_string(shell, text, false);
+}
+
+int gs_shell_run_script(struct gs_shell *shell, const char *path) {
+    int fd = gs_shell_open(shell, path, O_RDONLY);
+    FILE *stream = fd >= 0 ? fdopen(fd, "r") : NULL;
+    if (!stream) {
+        int saved_errno = errno;
+        gs_builtin_err_printf("genshell: %s: %s\n", path, strerror(saved_errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return saved_errno == ENOENT ? 127 : 126;
+    }
+
+    shell->interactive = false;
+    struct gs_command_source source = {stream, NULL, false, NULL, 0u, 0u, false};
+    int status = run_source(shell, &source, NULL, true);
+    fclose(stream);
+    return status;
+}
+
+int gs_shell_run_text(struct gs_shell *shell, const char *text, size_t length, struct gs_parsed_script *record) {
+    if (!shell || !text) {
+        return GS_ERR_ALLOC;
+    }
+    if (length == 0u) {
+        return 0;
+    }
+    FILE *stream = fmemopen((void *)text, length, "r");
+    if (!stream) {
+        return GS_ERR_ALLOC;
+    }
+
+    bool was_interactive = shell->interactive;
+    shell->interactive = false;
+    struct gs_command_source source = {stream, record, false, NULL, 0u, 0u, false};
+    int status = run_source(shell, &source, NULL, false);
+    fclose(stream);
+    shell->interactive = was_interactive;
+    return status;
+}
+
+int gs_shell_run_parsed(struct gs_shell *shell, const struct gs_parsed_script *script) {
+    for (size_t i = 0; i < script->count && !shell->exit_requested; ++i) {
+        if (gs_execute_list(shell, &script->units[i], false) < 0) {
+            shell->last_status = 1;
+        }
+    }
+    return shell->exit_requested ? shell->exit_status : shell->last_status;
+}
+
+void gs_parsed_script_dispose(struct gs_parsed_script *script) {
+    if (!script) {
+        return;
+    }
+    for (size_t i = 0; i < script->count; ++i) {
+        gs_command_list_dispose(&script->units[i]);
+    }
+    free(script->units);
+    script->units = NULL;
+    script->count = 0u;
+    script->capacity = 0u;
+}
@@ -4,8 +4,14 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include <genshell.h>
+
 struct gs_pipeline;
+struct gs_command_list;
 struct gs_command_source;
+struct gs_history;
+struct gs_command_index;
+struct gs_prompt;
 struct gs_shell;
 
 /*
@@ -22,16 +28,157 @@ struct gs_shell;
 /* Sentinel byte used to tag characters that must not be further expanded. */
 #define GS_LITERAL_SENTINEL ((char)0x1D)
 
+/*
+ * Leading byte of a word produced by process substitution: followed by '<'
+ * or '>' and the command text, e.g. "\x1E<sort a.txt" for <(sort a.txt).
+ */
+#define GS_PROCSUB_SENTINEL ((char)0x1E)
+
+/* Precedes an unquoted $(...) in a word: its result is split into fields on IFS. */
+#define GS_SPLIT_SENTINEL ((char)0x1F)
+
+/* Variable value recorded before a snapshotted builtin first changed it. */
+struct gs_saved_variable {
+    char *name;
+    char *value; /* NULL when the variable was unset */
+};
+
+/*
+ * Copy-on-write record of shell state for a subshell that runs inside this
+ * process. Nothing is copied up front: builtins call the gs_shell_preserve_*
+ * hooks before their first change, and restore undoes exactly those changes.
+ */
+struct gs_shell_snapshot {
+    struct gs_shell_snapshot *outer;
+    struct gs_saved_variable *vars;
+    size_t var_count;
+    size_t var_capacity;
+    int cwd_fd; /* the shell's directory descriptor, -1 until it is about to change */
+    bool umask_saved;
+    unsigned umask_value;
+    bool exit_requested;
+    int exit_status;
+    bool dirs_saved;
+    char **dirs;
+    size_t dir_count;
+};
+
+/*
+ * Shell variables as "NAME=value" strings sorted by name and NULL-terminated,
+ * so the array doubles as the environment of the commands the shell runs.
+ */
+struct gs_vars {
+    char **entries;
+    size_t count;
+    size_t capacity;
+};
+
+/*
+ * Descriptors 0-9 as the shell's commands see them. In-process redirections
+ * only change these slots (-1 is closed); a child process installs them as
+ * its real descriptors before running anything (gs_shell_enter_process).
+ */
+#define GS_SHELL_FD_COUNT 10
+
 struct gs_shell {
     const char *progname;
     int last_status;
+    long long last_duration; /* nanoseconds the last typed command ran; -1 before the first */
     bool exit_requested;
     int exit_status;
     bool interactive;
+    struct gs_shell_snapshot *snapshot; /* innermost in-process subshell */
+    char **dirs; /* pushd stack below the current directory, newest first */
+    size_t dir_count;
+    size_t dir_capacity;
+    struct gs_vars vars;
+    int cwd_fd; /* the working directory; relative paths resolve against it */
+    unsigned umask;
+    int fds[GS_SHELL_FD_COUNT];
+    struct gs_history *history; /* opened on first use; see history.h */
+    struct gs_command_index *commands; /* PATH executables for completion; see complete.h */
+    struct gs_prompt *prompt; /* background prompt segments; see prompt.h */
 };
 
+/*
+ * Sets up the shell of the genshell executable: variables come from environ,
+ * the working directory and umask from the process (whose own umask is then
+ * cleared, as the shell applies its mask itself), descriptors 0-9 are the
+ * process's, and SIGINT/SIGQUIT get their interactive dispositions.
+ */
 int gs_shell_init(struct gs_shell *shell, const char *progname);
+/* Sets up a shell from options without touching any process-wide state. */
+int gs_shell_init_with(struct gs_shell *shell, const gs_shell_options *options);
 void gs_shell_destroy(struct gs_shell *shell);
 int gs_shell_run(struct gs_shell *shell);
 
+/*
+ * Non-interactive entry points for "-c" strings and script files. With
+ * exec_last the final command is exec'd in place of the shell when it is an
+ * external program, since nothing would run after it.
+ */
+int gs_shell_run_string(struct gs_shell *shell, const char *text, bool exec_last);
+int gs_shell_run_script(struct gs_shell *shell, const char *path);
+
+/*
+ * Command lists of a sourced file in the order they ran, kept so an unchanged
+ * file can be executed again without lexing or parsing it (see source.c).
+ */
+struct gs_parsed_script {
+    struct gs_command_list *units;
+    size_t count;
+    size_t capacity;
+    bool complete; /* cleared when a command failed to parse */
+};
+
+/*
+ * Runs length bytes of text as a non-interactive source that never execs in
+ * place. With record, each parsed command list is appended to it.
+ */
+int gs_shell_run_text(struct gs_shell *shell, const char *text, size_t length, struct gs_parsed_script *record);
+int gs_shell_run_parsed(struct gs_shell *shell, const struct gs_parsed_script *script);
+void gs_parsed_script_dispose(struct gs_parsed_script *script);
+/* Runs the file at path in the current shell, reusing its parse when unchanged. */
+int gs_shell_source(struct gs_shell *shell, const char *path);
+
+void gs_shell_snapshot_begin(struct gs_shell *shell, struct gs_shell_snapshot *snapshot);
+int gs_shell_snapshot_restore(struct gs_shell *shell, struct gs_shell_snapshot *snapshot);
+int gs_shell_preserve_variable(struct gs_shell *shell, const char *name);
+int gs_shell_preserve_cwd(struct gs_shell *shell);
+void gs_shell_preserve_umask(struct gs_shell *shell);
+int gs_shell_preserve_dirs(struct gs_shell *shell);
+
+char **gs_shell_environ(struct gs_shell *shell);
+int gs_vars_init(struct gs_vars *vars, char *const *envp);
+void gs_vars_dispose(struct gs_vars *vars);
+
+/*
+ * Opens path relative to the shell's working directory, close-on-exec; files
+ * it creates get mode 0666 less the shell's umask.
+ */
+int gs_shell_open(const struct gs_shell *shell, const char *path, int flags);
+/*
+ * Makes path (relative to the current one) the shell's working directory.
+ * PWD is left to the caller. Returns GS_OK, or GS_ERR_EXEC with errno set.
+ */
+int gs_shell_set_cwd(struct gs_shell *shell, const char *path);
+/* The malloc'd physical path of the working directory, or NULL with errno set. */
+char *gs_shell_physical_cwd(const struct gs_shell *shell);
+/*
+ * Turns a freshly forked child into the process the shell describes: its
+ * descriptor slots become the real descriptors 0-9 (all others the shell
+ * referred to are closed), and the working directory, umask and environment
+ * are the shell's. Also used by a shell about to exec in place.
+ */
+void gs_shell_enter_process(struct gs_shell *shell);
+/* pipe(2) with both ends close-on-exec, so concurrent shells' children never inherit them. */
+int gs_pipe_cloexec(int fds[2]);
+
+/* Lexically resolves ".", ".." and repeated slashes in an absolute path. */
+void gs_path_canonicalize(char *path);
+/* True for an absolute path with no ".", ".." or empty components. */
+bool gs_path_is_canonical(const char *path);
+/* Replaces a PWD that does not name the working directory by its physical path. */
+void gs_shell_sync_pwd(struct gs_shell *shell);
+
 #endif /* GS_SHELL_H */
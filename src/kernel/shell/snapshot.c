@@ -0,0 +1,155 @@
+/*
+ * Copy-on-write shell state for subshells that run inside the shell process.
+ *
+ * A builtin-only "( ... )" does not need a fork to keep its changes private:
+ * the state builtins can touch is the working directory and pushd stack, the
+ * umask and variables, plus a pending exit. Each mutating builtin
+ * calls a preserve hook first; only the innermost snapshot records anything,
+ * because restoring it brings the state back to what the enclosing snapshot
+ * expects.
+ */
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "shell.h"
+
+void gs_shell_snapshot_begin(struct gs_shell *shell, struct gs_shell_snapshot *snapshot) {
+    memset(snapshot, 0, sizeof(*snapshot));
+    snapshot->outer = shell->snapshot;
+    snapshot->cwd_fd = -1;
+    snapshot->exit_requested = shell->exit_requested;
+    snapshot->exit_status = shell->exit_status;
+    shell->snapshot = snapshot;
+}
+
+/*
+ * Undoes everything recorded since gs_shell_snapshot_begin and returns the
+ * subshell's exit status: the exit builtin's status if one ran, otherwise the
+ * status of the last command.
+ */
+int gs_shell_snapshot_restore(struct gs_shell *shell, struct gs_shell_snapshot *snapshot) {
+    int status = shell->exit_requested ? shell->exit_status : shell->last_status;
+
+    for (size_t i = snapshot->var_count; i > 0; --i) {
+        struct gs_saved_variable *var = &snapshot->vars[i - 1u];
+        if (var->value) {
+            gs_shell_setvar(shell, var->name, var->value);
+        } else {
+            gs_shell_unsetvar(shell, var->name);
+        }
+        free(var->name);
+        free(var->value);
+    }
+    free(snapshot->vars);
+
+    if (snapshot->cwd_fd >= 0) {
+        if (shell->cwd_fd >= 0) {
+            close(shell->cwd_fd);
+        }
+        shell->cwd_fd = snapshot->cwd_fd;
+    }
+    if (snapshot->umask_saved) {
+        shell->umask = snapshot->umask_value;
+    }
+    if (snapshot->dirs_saved) {
+        for (size_t i = 0; i < shell->dir_count; ++i) {
+            free(shell->dirs[i]);
+        }
+        free(shell->dirs);
+        shell->dirs = snapshot->dirs;
+        shell->dir_count = snapshot->dir_count;
+        shell->dir_capacity = snapshot->dir_count;
+    }
+
+    shell->exit_requested = snapshot->exit_requested;
+    shell->exit_status = snapshot->exit_status;
+    shell->snapshot = snapshot->outer;
+    memset(snapshot, 0, sizeof(*snapshot));
+    snapshot->cwd_fd = -1;
+    return status;
+}
+
+int gs_shell_preserve_variable(struct gs_shell *shell, const char *name) {
+    struct gs_shell_snapshot *snapshot = shell ? shell->snapshot : NULL;
+    if (!snapshot) {
+        return GS_OK;
+    }
+    for (size_t i = 0; i < snapshot->var_count; ++i) {
+        if (strcmp(snapshot->vars[i].name, name) == 0) {
+            return GS_OK;
+        }
+    }
+    if (snapshot->var_count == snapshot->var_capacity) {
+        size_t new_cap = snapshot->var_capacity ? snapshot->var_capacity * 2u : 4u;
+        struct gs_saved_variable *tmp =
+            (struct gs_saved_variable *)realloc(snapshot->vars, new_cap * sizeof(struct gs_saved_variable));
+        if (!tmp) {
+            return GS_ERR_ALLOC;
+        }
+        snapshot->vars = tmp;
+        snapshot->var_capacity = new_cap;
+    }
+    const char *value = gs_shell_getvar(shell, name);
+    struct gs_saved_variable var = {strdup(name), value ? strdup(value) : NULL};
+    if (!var.name || (value && !var.value)) {
+        free(var.name);
+        free(var.value);
+        return GS_ERR_ALLOC;
+    }
+    snapshot->vars[snapshot->var_count++] = var;
+    return GS_OK;
+}
+
+/* Keeps a copy of the directory descriptor for restore to put back. */
+int gs_shell_preserve_cwd(struct gs_shell *shell) {
+    struct gs_shell_snapshot *snapshot = shell ? shell->snapshot : NULL;
+    if (!snapshot || snapshot->cwd_fd >= 0) {
+        return GS_OK;
+    }
+    int fd = fcntl(shell->cwd_fd, F_DUPFD_CLOEXEC, GS_SHELL_FD_COUNT);
+    if (fd < 0) {
+        return GS_ERR_EXEC;
+    }
+    snapshot->cwd_fd = fd;
+    return GS_OK;
+}
+
+void gs_shell_preserve_umask(struct gs_shell *shell) {
+    struct gs_shell_snapshot *snapshot = shell ? shell->snapshot : NULL;
+    if (!snapshot || snapshot->umask_saved) {
+        return;
+    }
+    snapshot->umask_value = shell->umask;
+    snapshot->umask_saved = true;
+}
+
+/* Copies the directory stack, which pushd, popd and dirs -c are about to change. */
+int gs_shell_preserve_dirs(struct gs_shell *shell) {
+    struct gs_shell_snapshot *snapshot = shell ? shell->snapshot : NULL;
+    if (!snapshot || snapshot->dirs_saved) {
+        return GS_OK;
+    }
+    char **dirs = NULL;
+    if (shell->dir_count > 0u) {
+        dirs = (char **)calloc(shell->dir_count, sizeof(char *));
+        if (!dirs) {
+            return GS_ERR_ALLOC;
+        }
+        for (size_t i = 0; i < shell->dir_count; ++i) {
+            dirs[i] = strdup(shell->dirs[i]);
+            if (!dirs[i]) {
+                while (i > 0u) {
+                    free(dirs[--i]);
+                }
+                free(dirs);
+                return GS_ERR_ALLOC;
+            }
+        }
+    }
+    snapshot->dirs = dirs;
+    snapshot->dir_count = shell->dir_count;
+    snapshot->dirs_saved = true;
+    return GS_OK;
+}
@@ -0,0 +1,279 @@
+/*
+ * Sourced files ("." and "source").
+ *
+ * A sourced file is mapped rather than read through stdio, and the command
+ * lists parsed while it first runs to completion are kept in a small cache
+ * keyed by device and inode. An entry stays valid while the file's size,
+ * modification time and change time are unchanged, so sourcing the same
+ * library again costs one stat(2) before the cached lists are executed.
+ * Entries in use by a running source are reference counted: a nested source
+ * that finds the file changed replaces the entry without freeing the lists
+ * still being executed further up. The cache is shared by every shell in the
+ * process and guarded by a mutex, which is held across fork so a child never
+ * inherits it locked; the parsed lists themselves are immutable, so several
+ * shells can run one entry at once.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "builtins/builtin.h"
+#include "shell.h"
+
+#define SOURCE_CACHE_SLOTS 32u
+
+struct source_entry {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    struct timespec ctime;
+    struct gs_parsed_script script;
+    unsigned refs;
+    bool detached; /* replaced or evicted; freed once refs drops to zero */
+    uint64_t last_used;
+};
+
+static pthread_mutex_t g_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t g_atfork_once = PTHREAD_ONCE_INIT;
+static struct source_entry *g_entries[SOURCE_CACHE_SLOTS];
+static uint64_t g_clock;
+
+static void lock_before_fork(void) {
+    pthread_mutex_lock(&g_lock);
+}
+
+static void unlock_after_fork(void) {
+    pthread_mutex_unlock(&g_lock);
+}
+
+static void register_atfork(void) {
+    pthread_atfork(lock_before_fork, unlock_after_fork, unlock_after_fork);
+}
+
+static void cache_lock(void) {
+    pthread_once(&g_atfork_once, register_atfork);
+    pthread_mutex_lock(&g_lock);
+}
+
+static bool same_time(const struct timespec *a, const struct timespec *b) {
+    return a->tv_sec == b->tv_sec && a->tv_nsec == b->tv_nsec;
+}
+
+static const struct timespec *stat_mtime(const struct stat *st) {
+#if defined(__APPLE__)
+    return &st->st_mtimespec;
+#else
+    return &st->st_mtim;
+#endif
+}
+
+static const struct timespec *stat_ctime(const struct stat *st) {
+#if defined(__APPLE__)
+    return &st->st_ctimespec;
+#else
+    return &st->st_ctim;
+#endif
+}
+
+static bool same_version(const struct stat *a, const struct stat *b) {
+    return a->st_dev == b->st_dev && a->st_ino == b->st_ino && a->st_size == b->st_size &&
+           same_time(stat_mtime(a), stat_mtime(b)) && same_time(stat_ctime(a), stat_ctime(b));
+}
+
+static bool entry_matches(const struct source_entry *entry, const struct stat *st) {
+    return entry->size == st->st_size && same_time(&entry->mtime, stat_mtime(st)) &&
+           same_time(&entry->ctime, stat_ctime(st));
+}
+
+static void entry_free(struct source_entry *entry) {
+    gs_parsed_script_dispose(&entry->script);
+    free(entry);
+}
+
+static void entry_release(struct source_entry *entry) {
+    cache_lock();
+    bool unused = --entry->refs == 0u && entry->detached;
+    pthread_mutex_unlock(&g_lock);
+    if (unused) {
+        entry_free(entry);
+    }
+}
+
+/*
+ * Removes slot's entry from the table, freeing it unless a source is running
+ * it. The cache_* functions run with g_lock held.
+ */
+static void cache_drop(size_t slot) {
+    struct source_entry *entry = g_entries[slot];
+    g_entries[slot] = NULL;
+    if (entry->refs > 0u) {
+        entry->detached = true;
+    } else {
+        entry_free(entry);
+    }
+}
+
+/* Returns the cached parse of the file described by st, referenced, dropping stale ones. */
+static struct source_entry *cache_find(const struct stat *st) {
+    for (size_t i = 0; i < SOURCE_CACHE_SLOTS; ++i) {
+        struct source_entry *entry = g_entries[i];
+        if (!entry || entry->dev != st->st_dev || entry->ino != st->st_ino) {
+            continue;
+        }
+        if (!entry_matches(entry, st)) {
+            cache_drop(i);
+            return NULL;
+        }
+        entry->last_used = ++g_clock;
+        entry->refs++;
+        return entry;
+    }
+    return NULL;
+}
+
+/* Takes ownership of script, caching it or disposing of it. */
+static void cache_store(const struct stat *st, struct gs_parsed_script *script) {
+    for (size_t i = 0; i < SOURCE_CACHE_SLOTS; ++i) {
+        struct source_entry *entry = g_entries[i];
+        if (entry && entry->dev == st->st_dev && entry->ino == st->st_ino) {
+            cache_drop(i); /* a nested source of the same file got here first */
+        }
+    }
+    size_t victim = 0u; /* a free slot, else the least recently used entry */
+    for (size_t i = 0; i < SOURCE_CACHE_SLOTS; ++i) {
+        if (!g_entries[i]) {
+            victim = i;
+            break;
+        }
+        if (g_entries[i]->last_used < g_entries[victim]->last_used) {
+            victim = i;
+        }
+    }
+
+    struct source_entry *entry = (struct source_entry *)calloc(1u, sizeof(struct source_entry));
+    if (!entry) {
+        gs_parsed_script_dispose(script);
+        return;
+    }
+    if (g_entries[victim]) {
+        cache_drop(victim);
+    }
+    entry->dev = st->st_dev;
+    entry->ino = st->st_ino;
+    entry->size = st->st_size;
+    entry->mtime = *stat_mtime(st);
+    entry->ctime = *stat_ctime(st);
+    entry->script = *script;
+    entry->last_used = ++g_clock;
+    g_entries[victim] = entry;
+}
+
+/* Pipes and devices cannot be mapped: read them whole and run them uncached. */
+static int run_stream(struct gs_shell *shell, int fd, const char *path) {
+    char *text = NULL;
+    size_t length = 0u;
+    size_t capacity = 0u;
+    for (;;) {
+        if (length == capacity) {
+            size_t new_cap = capacity ? capacity * 2u : 4096u;
+            char *tmp = (char *)realloc(text, new_cap);
+            if (!tmp) {
+                gs_builtin_err_printf("genshell: %s: allocation failure\n", path);
+                free(text);
+                close(fd);
+                return 1;
+            }
+            text = tmp;
+            capacity = new_cap;
+        }
+        ssize_t n = read(fd, text + length, capacity - length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            gs_builtin_err_printf("genshell: %s: %s\n", path, strerror(errno));
+            free(text);
+            close(fd);
+            return 1;
+        }
+        if (n == 0) {
+            break;
+        }
+        length += (size_t)n;
+    }
+    close(fd);
+    int status = gs_shell_run_text(shell, text, length, NULL);
+    free(text);
+    return status;
+}
+
+int gs_shell_source(struct gs_shell *shell, const char *path) {
+    struct stat st;
+    if (fstatat(shell->cwd_fd, path, &st, 0) != 0) {
+        gs_builtin_err_printf("genshell: %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        gs_builtin_err_printf("genshell: %s: %s\n", path, strerror(EISDIR));
+        return 1;
+    }
+
+    shell->last_status = 0; /* the status when the file runs no commands */
+    cache_lock();
+    struct source_entry *entry = cache_find(&st);
+    pthread_mutex_unlock(&g_lock);
+    if (entry) {
+        int status = gs_shell_run_parsed(shell, &entry->script);
+        entry_release(entry);
+        return status;
+    }
+
+    int fd = gs_shell_open(shell, path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        gs_builtin_err_printf("genshell: %s: %s\n", path, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 1;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        return run_stream(shell, fd, path);
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    size_t length = (size_t)st.st_size;
+    void *map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    int saved_errno = errno;
+    close(fd);
+    if (map == MAP_FAILED) {
+        gs_builtin_err_printf("genshell: %s: %s\n", path, strerror(saved_errno));
+        return 1;
+    }
+
+    struct gs_parsed_script script = {0};
+    script.complete = true;
+    int status = gs_shell_run_text(shell, (const char *)map, length, &script);
+    munmap(map, length);
+
+    /* Only a file that parsed to the end, unmodified meanwhile, is reusable. */
+    struct stat after;
+    if (script.complete && !shell->exit_requested && fstatat(shell->cwd_fd, path, &after, 0) == 0 &&
+        same_version(&st, &after)) {
+        cache_lock();
+        cache_store(&st, &script);
+        pthread_mutex_unlock(&g_lock);
+    } else {
+        gs_parsed_script_dispose(&script);
+    }
+    return status;
+}
@@ -0,0 +1,155 @@
+/*
+ * Shell variables.
+ *
+ * Each shell keeps its variables in its own table instead of the process
+ * environment, so shells embedded in one process never see or clobber each
+ * other's, and nothing needs setenv(3), which is not thread-safe. The table
+ * is an array of "NAME=value" strings sorted by name with a NULL after the
+ * last: lookups are binary searches, export lists it in order, and a child
+ * adopts the array itself as environ before exec. Every variable is
+ * exported, as the shell has no unexported ones.
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "shell.h"
+
+/* Orders the name of entry ("NAME=value") against name[0..len). */
+static int compare_name(const char *entry, const char *name, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        unsigned char e = (unsigned char)entry[i];
+        if (e == '=') {
+            return -1;
+        }
+        if (e != (unsigned char)name[i]) {
+            return e < (unsigned char)name[i] ? -1 : 1;
+        }
+    }
+    return entry[len] == '=' ? 0 : 1;
+}
+
+/* The index of name, or of the position it would be inserted at. */
+static size_t find(const struct gs_vars *vars, const char *name, size_t len, bool *found) {
+    size_t lo = 0u;
+    size_t hi = vars->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2u;
+        int cmp = compare_name(vars->entries[mid], name, len);
+        if (cmp == 0) {
+            *found = true;
+            return mid;
+        }
+        if (cmp < 0) {
+            lo = mid + 1u;
+        } else {
+            hi = mid;
+        }
+    }
+    *found = false;
+    return lo;
+}
+
+/* Stores entry (malloc'd "NAME=value" with a name of len bytes), replacing any old value. */
+static int vars_put(struct gs_vars *vars, char *entry, size_t len, bool replace) {
+    bool found = false;
+    size_t index = find(vars, entry, len, &found);
+    if (found) {
+        if (replace) {
+            free(vars->entries[index]);
+            vars->entries[index] = entry;
+        } else {
+            free(entry);
+        }
+        return GS_OK;
+    }
+    if (vars->count + 1u >= vars->capacity) {
+        size_t new_cap = vars->capacity * 2u;
+        char **tmp = (char **)realloc(vars->entries, new_cap * sizeof(char *));
+        if (!tmp) {
+            free(entry);
+            return GS_ERR_ALLOC;
+        }
+        vars->entries = tmp;
+        vars->capacity = new_cap;
+    }
+    memmove(vars->entries + index + 1u, vars->entries + index, (vars->count - index + 1u) * sizeof(char *));
+    vars->entries[index] = entry;
+    vars->count++;
+    return GS_OK;
+}
+
+int gs_vars_init(struct gs_vars *vars, char *const *envp) {
+    vars->count = 0u;
+    vars->capacity = 64u;
+    vars->entries = (char **)malloc(vars->capacity * sizeof(char *));
+    if (!vars->entries) {
+        return GS_ERR_ALLOC;
+    }
+    vars->entries[0] = NULL;
+    for (char *const *env = envp; env && *env; ++env) {
+        const char *eq = strchr(*env, '=');
+        if (!eq || eq == *env) {
+            continue;
+        }
+        char *entry = strdup(*env);
+        /* The first of duplicate names wins, as it does for getenv(3). */
+        if (!entry || vars_put(vars, entry, (size_t)(eq - *env), false) != GS_OK) {
+            gs_vars_dispose(vars);
+            return GS_ERR_ALLOC;
+        }
+    }
+    return GS_OK;
+}
+
+void gs_vars_dispose(struct gs_vars *vars) {
+    for (size_t i = 0; i < vars->count; ++i) {
+        free(vars->entries[i]);
+    }
+    free(vars->entries);
+    vars->entries = NULL;
+    vars->count = 0u;
+    vars->capacity = 0u;
+}
+
+const char *gs_shell_getvar(const struct gs_shell *shell, const char *name) {
+    if (!shell || !name) {
+        return NULL;
+    }
+    size_t len = strlen(name);
+    bool found = false;
+    size_t index = find(&shell->vars, name, len, &found);
+    return found ? shell->vars.entries[index] + len + 1u : NULL;
+}
+
+int gs_shell_setvar(struct gs_shell *shell, const char *name, const char *value) {
+    size_t name_len = strlen(name);
+    size_t value_len = strlen(value);
+    if (name_len == 0u || strchr(name, '=')) {
+        return GS_ERR_EXEC;
+    }
+    /* Built before the old entry goes, since value may point into it. */
+    char *entry = (char *)malloc(name_len + value_len + 2u);
+    if (!entry) {
+        return GS_ERR_ALLOC;
+    }
+    memcpy(entry, name, name_len);
+    entry[name_len] = '=';
+    memcpy(entry + name_len + 1u, value, value_len + 1u);
+    return vars_put(&shell->vars, entry, name_len, true);
+}
+
+int gs_shell_unsetvar(struct gs_shell *shell, const char *name) {
+    bool found = false;
+    struct gs_vars *vars = &shell->vars;
+    size_t index = find(vars, name, strlen(name), &found);
+    if (found) {
+        free(vars->entries[index]);
+        memmove(vars->entries + index, vars->entries + index + 1u, (vars->count - index) * sizeof(char *));
+        vars->count--;
+    }
+    return GS_OK;
+}
+
+char **gs_shell_environ(struct gs_shell *shell) {
+    return shell->vars.entries;
+}
@@ -83,6 +83,10 @@ export CTX_YAML_TEST_TMPDIR="$build_dir"
 "$yaml_test_bin"
 pass "ctx_yaml parser"
 
+# Drives bin/genshell through scripted sessions covering pipelines and builtins.
+"$repo_root/tests/shell/test_genshell.sh"
+pass "genshell smoke tests"
+
 rm -f "$gemma_cli_bin" "$yaml_test_bin"
 rmdir "$build_dir" 2>/dev/null || true
 
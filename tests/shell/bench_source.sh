@@ -0,0 +1,76 @@
+#!/usr/bin/env bash
+# Benchmark for "." on an unchanged library: one genshell session sources a
+# generated LINES-line library SOURCES times (10000 x 2000 by default). The
+# library has the usual include guard, so after the first run the cost is
+# dominated by getting the file's commands back, which the parse cache turns
+# into a stat(2). Set BASELINE to another shell (e.g. BASELINE=dash) to time
+# the same driver there for comparison.
+set -euo pipefail
+
+repo_root=$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)
+build_dir="$repo_root/build/tests/shell"
+mkdir -p "$build_dir"
+
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:-"-std=c17 -O2"}
+SOURCES=${SOURCES:-10000}
+LINES=${LINES:-2000}
+
+EXTRA_CFLAGS="-D_POSIX_C_SOURCE=200809L"
+if [[ "$(uname)" == "Darwin" ]]; then
+    EXTRA_CFLAGS+=" -D_DARWIN_C_SOURCE"
+fi
+
+genshell_bin="$build_dir/genshell_bench"
+work_dir=$(mktemp -d)
+trap 'rm -rf "$work_dir"' EXIT
+
+mapfile -t shell_sources < <(find "$repo_root/src/kernel/shell" -name '*.c' | sort)
+$CC $CFLAGS $EXTRA_CFLAGS -I"$repo_root/src/kernel/shell" -I"$repo_root/include" \
+    "${shell_sources[@]}" -rdynamic -o "$genshell_bin" -lpthread -ldl
+
+{
+    printf '# generated library: %d lines\n' "$LINES"
+    printf '[ -n "$BENCH_LIB_LOADED" ] || {\n'
+    for ((i = 3; i < LINES; i += 2)); do
+        printf '    # helper %d: exported under a guarded block\n' "$i"
+        printf '    export BENCH_LIB_VALUE_%d="value %d" && test -n "$BENCH_LIB_VALUE_%d"\n' "$i" "$i" "$i"
+    done
+    printf '}\nexport BENCH_LIB_LOADED=1\n'
+} >"$work_dir/lib.sh"
+
+{
+    for ((i = 0; i < SOURCES; ++i)); do
+        printf '. ./lib.sh\n'
+    done
+    printf 'echo "$BENCH_LIB_VALUE_3"\n'
+} >"$work_dir/driver.sh"
+printf '. ./lib.sh\necho "$BENCH_LIB_VALUE_3"\n' >"$work_dir/once.sh"
+
+# run_timed LABEL SHELL SCRIPT: prints the wall time of SHELL SCRIPT in ms.
+run_timed() {
+    local label="$1" shell="$2" script="$3"
+    local start end output
+    start=$EPOCHREALTIME
+    output=$(cd "$work_dir" && "$shell" "$script")
+    end=$EPOCHREALTIME
+    if [[ "$output" != "value 3" ]]; then
+        printf '%s: unexpected output: %s\n' "$label" "$output" >&2
+        exit 1
+    fi
+    awk -v s="$start" -v e="$end" 'BEGIN { printf "%.1f", (e - s) * 1000 }'
+}
+
+once_ms=$(run_timed "genshell (1 source)" "$genshell_bin" once.sh)
+many_ms=$(run_timed "genshell ($SOURCES sources)" "$genshell_bin" driver.sh)
+awk -v once="$once_ms" -v many="$many_ms" -v n="$SOURCES" -v lines="$LINES" 'BEGIN {
+    printf "genshell: %d-line library sourced once: %.1f ms, %d times: %.1f ms (%.2f us per re-source)\n",
+        lines, once, n, many, (many - once) * 1000 / (n > 1 ? n - 1 : 1)
+}'
+
+if [[ -n "${BASELINE:-}" ]]; then
+    base_ms=$(run_timed "$BASELINE" "$BASELINE" driver.sh)
+    awk -v ms="$base_ms" -v n="$SOURCES" -v sh="$BASELINE" 'BEGIN {
+        printf "%s: %d sources: %.1f ms (%.2f us per source)\n", sh, n, ms, ms * 1000 / n
+    }'
+fi
@@ -0,0 +1,175 @@
+/*
+ * Embedding test used by test_genshell.sh: runs several genshell sessions at
+ * once, one per thread, each with its own directory, variables, umask and
+ * output file, and checks that every session saw only its own state and
+ * that the process's working directory, environment and umask never moved.
+ * Usage: embed_sessions DIR
+ */
+#if !defined(_XOPEN_SOURCE)
+#define _XOPEN_SOURCE 700 /* realpath */
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <genshell.h>
+
+#define SESSIONS 8
+#define ROUNDS 20
+
+static const char k_script[] = "mkdir -p sub\n"
+                               "cd sub\n"
+                               "export GREETING=hello-$SESSION\n"
+                               "echo $GREETING > note.txt\n"
+                               "cat note.txt\n"
+                               "pwd\n"
+                               "sh -c 'echo child $GREETING $(pwd); umask'\n"
+                               "echo *\n"
+                               "cd ..\n";
+
+typedef struct {
+    int index;
+    char dir[PATH_MAX + 32];
+    const char *path_var;
+    int failed;
+} session_job;
+
+static char *read_file(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return NULL;
+    }
+    static const size_t limit = 1u << 16;
+    char *text = (char *)calloc(1u, limit + 1u);
+    if (text) {
+        size_t n = fread(text, 1u, limit, file);
+        text[n] = '\0';
+    }
+    fclose(file);
+    return text;
+}
+
+static void *run_session(void *arg) {
+    session_job *job = (session_job *)arg;
+    char out_path[PATH_MAX + 64];
+    snprintf(out_path, sizeof(out_path), "%s/stdout", job->dir);
+    int out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    char session_var[32];
+    snprintf(session_var, sizeof(session_var), "SESSION=%d", job->index);
+    char *envp[] = {(char *)job->path_var, session_var, NULL};
+    gs_shell_options options = {"embed", envp, job->dir, -1, out_fd, out_fd, 027};
+    options.in_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    struct gs_shell *shell = out_fd >= 0 ? gs_shell_new(&options) : NULL;
+    if (!shell) {
+        fprintf(stderr, "session %d: cannot start\n", job->index);
+        job->failed = 1;
+        return NULL;
+    }
+    for (int round = 0; round < ROUNDS; ++round) {
+        int status = gs_shell_eval(shell, k_script);
+        if (status != 0) {
+            fprintf(stderr, "session %d: status %d\n", job->index, status);
+            job->failed = 1;
+        }
+    }
+    const char *greeting = gs_shell_getvar(shell, "GREETING");
+    char want_greeting[32];
+    snprintf(want_greeting, sizeof(want_greeting), "hello-%d", job->index);
+    if (!greeting || strcmp(greeting, want_greeting) != 0) {
+        fprintf(stderr, "session %d: GREETING is %s\n", job->index, greeting ? greeting : "unset");
+        job->failed = 1;
+    }
+    gs_shell_free(shell);
+    close(out_fd);
+    close(options.in_fd);
+
+    char expected_round[4 * PATH_MAX + 256];
+    snprintf(expected_round, sizeof(expected_round), "hello-%d\n%s/sub\nchild hello-%d %s/sub\n0027\nnote.txt\n",
+             job->index, job->dir, job->index, job->dir);
+    char *actual = read_file(out_path);
+    size_t round_len = strlen(expected_round);
+    for (int round = 0; actual && round < ROUNDS; ++round) {
+        if (strncmp(actual + (size_t)round * round_len, expected_round, round_len) != 0) {
+            fprintf(stderr, "session %d: round %d differs\n--- expected\n%s--- actual\n%s", job->index, round,
+                    expected_round, actual + (size_t)round * round_len);
+            job->failed = 1;
+            break;
+        }
+    }
+    if (!actual || strlen(actual) != round_len * ROUNDS) {
+        job->failed = 1;
+    }
+    free(actual);
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: embed_sessions DIR\n");
+        return 2;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    umask(0);
+    char base[PATH_MAX];
+    if (!realpath(argv[1], base)) {
+        fprintf(stderr, "%s: %s\n", argv[1], strerror(errno));
+        return 1;
+    }
+    char cwd_before[PATH_MAX];
+    if (!getcwd(cwd_before, sizeof(cwd_before))) {
+        return 1;
+    }
+    const char *path = getenv("PATH");
+    char path_var[4096];
+    snprintf(path_var, sizeof(path_var), "PATH=%s", path ? path : "/usr/bin:/bin");
+
+    session_job jobs[SESSIONS];
+    pthread_t threads[SESSIONS];
+    for (int i = 0; i < SESSIONS; ++i) {
+        jobs[i].index = i;
+        jobs[i].path_var = path_var;
+        jobs[i].failed = 0;
+        snprintf(jobs[i].dir, sizeof(jobs[i].dir), "%s/session%d", base, i);
+        if (mkdir(jobs[i].dir, 0755) != 0 && errno != EEXIST) {
+            fprintf(stderr, "%s: %s\n", jobs[i].dir, strerror(errno));
+            return 1;
+        }
+    }
+    for (int i = 0; i < SESSIONS; ++i) {
+        if (pthread_create(&threads[i], NULL, run_session, &jobs[i]) != 0) {
+            return 1;
+        }
+    }
+    int failed = 0;
+    for (int i = 0; i < SESSIONS; ++i) {
+        pthread_join(threads[i], NULL);
+        failed |= jobs[i].failed;
+    }
+
+    char cwd_after[PATH_MAX];
+    if (!getcwd(cwd_after, sizeof(cwd_after)) || strcmp(cwd_before, cwd_after) != 0) {
+        fprintf(stderr, "process directory changed\n");
+        failed = 1;
+    }
+    if (getenv("GREETING") || getenv("SESSION")) {
+        fprintf(stderr, "process environment changed\n");
+        failed = 1;
+    }
+    if (umask(0) != 0) {
+        fprintf(stderr, "process umask changed\n");
+        failed = 1;
+    }
+    if (!failed) {
+        puts("pass");
+    }
+    return failed;
+}
@@ -0,0 +1,85 @@
+/*
+ * History search test used by test_genshell.sh: writes a long history log,
+ * opens it again as a new session would and checks that reverse search
+ * answers at once. The first search must not wait for an index of the
+ * whole log, gs_history_warm must fill the index in short steps, and a
+ * search over the full index must find an old entry. Prints "pass", or
+ * what went wrong.
+ * Usage: history_search LOG
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "history.h"
+#include "shell.h"
+
+#define ENTRIES 200000u
+#define FIRST_SEARCH_MS 50.0 /* the whole index took about 500 ms to build at this size */
+#define WARM_STEP_MS 20.0
+#define INDEXED_SEARCH_MS 5.0
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: history_search LOG\n");
+        return 2;
+    }
+    struct gs_history *history;
+    if (gs_history_open(argv[1], &history) != GS_OK) {
+        printf("cannot open %s\n", argv[1]);
+        return 1;
+    }
+    for (unsigned i = 0; i < ENTRIES; ++i) {
+        char line[128];
+        int n = snprintf(line, sizeof(line), "git commit -m 'change %u in module m%u' && make target%u", i, i % 977u,
+                         i % 31u);
+        if (gs_history_append(history, line, (size_t)n, "/work") != GS_OK) {
+            printf("append %u failed\n", i);
+            return 1;
+        }
+    }
+    gs_history_close(history);
+
+    if (gs_history_open(argv[1], &history) != GS_OK) {
+        printf("cannot reopen %s\n", argv[1]);
+        return 1;
+    }
+    size_t count = gs_history_count(history);
+    size_t found = 0u;
+    double start = now_ms();
+    bool ok = gs_history_search(history, "change 199990 ", count, &found);
+    double first = now_ms() - start;
+    if (!ok || found != 199990u || first > FIRST_SEARCH_MS) {
+        printf("first search: found %d at %zu in %.1f ms\n", ok, found, first);
+        return 1;
+    }
+
+    double slowest = 0.0;
+    for (bool more = true; more;) {
+        start = now_ms();
+        more = gs_history_warm(history);
+        double step = now_ms() - start;
+        slowest = step > slowest ? step : slowest;
+    }
+    if (slowest > WARM_STEP_MS) {
+        printf("slowest warm step took %.1f ms\n", slowest);
+        return 1;
+    }
+
+    start = now_ms();
+    ok = gs_history_search(history, "m334 change 4242", count, &found);
+    double indexed = now_ms() - start;
+    if (!ok || found != 4242u || indexed > INDEXED_SEARCH_MS) {
+        printf("indexed search: found %d at %zu in %.1f ms\n", ok, found, indexed);
+        return 1;
+    }
+    gs_history_close(history);
+    printf("pass\n");
+    return 0;
+}
@@ -0,0 +1,163 @@
+/*
+ * Terminal test driver used by test_genshell.sh: runs PROGRAM on a new
+ * pseudo-terminal as its controlling terminal and types each STEP into it,
+ * waiting after every step until the program has finished a line and shown
+ * its "genshell$ " prompt again, so keys are never typed ahead into a
+ * running command. A step "--expect=TEXT" types nothing and waits for TEXT
+ * to appear after the start of the last typed step instead. Ctrl-D then
+ * ends the session. Exits with the program's status, printing what it wrote
+ * to the terminal if a prompt or an expected text never came.
+ * Usage: pty_session PROGRAM STEP...
+ */
+#if !defined(_XOPEN_SOURCE)
+#define _XOPEN_SOURCE 700 /* posix_openpt */
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define STEP_TIMEOUT_MS 5000
+#define PROMPT "genshell$ "
+#define EXPECT "--expect="
+
+static char *g_transcript;
+static size_t g_transcript_len;
+
+static void fail(const char *what) {
+    fprintf(stderr, "pty_session: %s\n--- transcript ---\n", what);
+    fwrite(g_transcript, 1u, g_transcript_len, stderr);
+    fputs("\n------------------\n", stderr);
+    exit(1);
+}
+
+/*
+ * Reads output until text arrives after offset from, and after a newline
+ * there too when a typed line has to finish first.
+ */
+static void wait_for(int master, size_t from, bool after_newline, const char *text) {
+    size_t text_len = strlen(text);
+    for (;;) {
+        const char *start = g_transcript ? g_transcript + from : NULL;
+        if (start && after_newline) {
+            start = memchr(start, '\n', g_transcript_len - from);
+        }
+        if (start) {
+            size_t tail = g_transcript_len - (size_t)(start - g_transcript);
+            for (size_t i = 0; i + text_len <= tail; ++i) {
+                if (memcmp(start + i, text, text_len) == 0) {
+                    return;
+                }
+            }
+        }
+        struct pollfd pfd = {master, POLLIN, 0};
+        int rc = poll(&pfd, 1u, STEP_TIMEOUT_MS);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            fprintf(stderr, "pty_session: waiting for \"%s\"\n", text);
+            fail("timed out");
+        }
+        char buf[4096];
+        ssize_t n = read(master, buf, sizeof(buf));
+        if (n <= 0) {
+            fail("the terminal closed too early");
+        }
+        char *tmp = realloc(g_transcript, g_transcript_len + (size_t)n + 1u);
+        if (!tmp) {
+            fail("out of memory");
+        }
+        g_transcript = tmp;
+        memcpy(g_transcript + g_transcript_len, buf, (size_t)n);
+        g_transcript_len += (size_t)n;
+        g_transcript[g_transcript_len] = '\0';
+    }
+}
+
+static void type(int master, const char *keys) {
+    size_t len = strlen(keys);
+    while (len > 0u) {
+        ssize_t n = write(master, keys, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            fail("could not type into the terminal");
+        }
+        keys += n;
+        len -= (size_t)n;
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: pty_session PROGRAM STEP...\n");
+        return 2;
+    }
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        perror("pty_session: posix_openpt");
+        return 1;
+    }
+    const char *slave_name = ptsname(master);
+    struct winsize ws = {24, 80, 0, 0};
+    (void)ioctl(master, TIOCSWINSZ, &ws);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("pty_session: fork");
+        return 1;
+    }
+    if (pid == 0) {
+        setsid();
+        int slave = open(slave_name, O_RDWR);
+        if (slave < 0) {
+            _exit(127);
+        }
+        dup2(slave, STDIN_FILENO);
+        dup2(slave, STDOUT_FILENO);
+        dup2(slave, STDERR_FILENO);
+        if (slave > STDERR_FILENO) {
+            close(slave);
+        }
+        close(master);
+        execl(argv[1], argv[1], (char *)NULL);
+        _exit(127);
+    }
+
+    wait_for(master, 0u, false, PROMPT);
+    size_t from = 0u;
+    for (int i = 2; i < argc; ++i) {
+        if (strncmp(argv[i], EXPECT, sizeof(EXPECT) - 1u) == 0) {
+            wait_for(master, from, false, argv[i] + sizeof(EXPECT) - 1u);
+            continue;
+        }
+        from = g_transcript_len;
+        type(master, argv[i]);
+        wait_for(master, from, true, PROMPT);
+    }
+    type(master, "\x04");
+
+    /* Drain the terminal so the program never blocks writing to it. */
+    char buf[4096];
+    struct pollfd pfd = {master, POLLIN, 0};
+    while (poll(&pfd, 1u, STEP_TIMEOUT_MS) > 0 && read(master, buf, sizeof(buf)) > 0) {
+    }
+    close(master); /* hangs up on a program still running */
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0) {
+        perror("pty_session: waitpid");
+        return 1;
+    }
+    free(g_transcript);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
@@ -0,0 +1,20 @@
+/*
+ * Loadable builtin used by test_genshell.sh to exercise "enable -f": prints
+ * its operands through the shell's output writer and fails without any.
+ */
+#include <string.h>
+
+#include <genshell_builtin.h>
+
+static int sample_builtin(struct gs_shell *shell, int argc, char *const argv[]) {
+    (void)shell;
+    gs_builtin_out_printf("sample(%d)", argc - 1);
+    for (int i = 1; i < argc; ++i) {
+        gs_builtin_out_write(" ", 1u);
+        gs_builtin_out_ref(argv[i], strlen(argv[i]));
+    }
+    gs_builtin_out_write("\n", 1u);
+    return argc > 1 ? 0 : 3;
+}
+
+GS_BUILTIN_PLUGIN(sample, sample_builtin, GS_BUILTIN_FLAG_INPROC | GS_BUILTIN_FLAG_PRODUCER);
@@ -0,0 +1,377 @@
+#!/usr/bin/env bash
+# Scripted smoke tests for bin/genshell: each case feeds input on stdin and
+# compares the combined output against the expected text.
+set -euo pipefail
+
+repo_root=$(cd "$(dirname "${BASH_SOURCE[0]}")/../.." && pwd)
+build_dir="$repo_root/build/tests/shell"
+mkdir -p "$build_dir"
+
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:-"-std=c17 -Wall -Wextra -Werror -Wno-unused-parameter"}
+
+EXTRA_CFLAGS="-D_POSIX_C_SOURCE=200809L"
+if [[ "$(uname)" == "Darwin" ]]; then
+    EXTRA_CFLAGS+=" -D_DARWIN_C_SOURCE"
+fi
+
+genshell_bin="$build_dir/genshell"
+work_dir=$(mktemp -d)
+trap 'rm -rf "$work_dir"' EXIT
+
+mapfile -t shell_sources < <(find "$repo_root/src/kernel/shell" -name '*.c' | sort)
+$CC $CFLAGS $EXTRA_CFLAGS -I"$repo_root/src/kernel/shell" -I"$repo_root/include" \
+    "${shell_sources[@]}" -rdynamic -o "$genshell_bin" -lpthread -ldl
+
+sample_plugin="$build_dir/sample_builtin.so"
+$CC $CFLAGS $EXTRA_CFLAGS -shared -fPIC -I"$repo_root/include" \
+    "$repo_root/tests/shell/sample_builtin.c" -o "$sample_plugin"
+
+pass() {
+    printf '✔ %s\n' "$1"
+}
+
+# expect NAME INPUT EXPECTED: runs INPUT through genshell inside $work_dir.
+expect() {
+    local name="$1" input="$2" expected="$3"
+    local actual
+    actual=$(cd "$work_dir" && printf '%s\n' "$input" | "$genshell_bin" 2>&1) || true
+    if [[ "$actual" != "$expected" ]]; then
+        printf '✘ %s\n--- expected\n%s\n--- actual\n%s\n' "$name" "$expected" "$actual" >&2
+        exit 1
+    fi
+    pass "$name"
+}
+
+expect "builtin pipeline head" 'echo hi | cat' 'hi'
+expect "builtin pipeline middle" 'echo one | echo two | cat' 'two'
+expect "builtin stage redirection" 'echo x > out.txt | cat
+cat out.txt' 'x'
+expect "builtin stage status" 'printf abc | echo -n zz | wc -c
+echo $?' '2
+0'
+expect "large builtin output through pipe" "echo $(printf '%*s' 100000 '' | tr ' ' y) | wc -c" '100001'
+
+seq 1 50000 >"$work_dir/numbers.txt"
+expect "cat builtin file to pipe" 'cat numbers.txt | cat | wc -l' '50000'
+expect "cat builtin file to file" 'cat numbers.txt numbers.txt > twice.txt
+wc -l < twice.txt' '100000'
+expect "cat builtin stdin operand" 'echo head | cat - numbers.txt | head -2' 'head
+1'
+expect "cat refuses to append a file to itself" 'echo self > self.txt
+cat self.txt numbers.txt >> self.txt
+echo $?
+cat < self.txt >> self.txt
+wc -l < self.txt' 'genshell: cat: self.txt: input file is output file
+1
+genshell: cat: -: input file is output file
+50001'
+expect "cat defers unknown options" 'echo x | cat -n' '     1	x'
+expect "tee builtin duplicates pipe input" 'cat numbers.txt | tee copy1.txt copy2.txt | wc -l
+cat copy1.txt copy2.txt | wc -l' '50000
+100000'
+expect "tee builtin appends" 'echo extra | tee -a copy1.txt > /dev/null
+tail -1 copy1.txt' 'extra'
+expect "tee builtin keeps files after reader exits" 'cat numbers.txt | tee copy3.txt | head -1
+wc -l < copy3.txt' '1
+50000'
+expect "parent builtin output follows redirections" 'export GS_LISTED=yes; export > env.txt; umask 027; umask >> env.txt
+grep -c GS_LISTED=yes env.txt; tail -1 env.txt' '1
+027'
+expect "stderr duplication" 'ls /nonexistent-genshell 2>&1 | wc -l' '1'
+expect "descriptor close" 'echo gone >&-
+echo $?' 'genshell: echo: write error: Bad file descriptor
+1'
+expect "clobber and read-write opens" 'echo first >| rw.txt
+cat 0<> rw.txt' 'first'
+expect "here-document expansion" 'export HOME=/h
+cat <<EOF
+$HOME \$HOME
+EOF' '/h $HOME'
+expect "quoted here-document" "cat <<'EOF'
+\$HOME
+EOF" '$HOME'
+expect "here-document tab stripping" "$(printf 'cat <<-EOF\n\t\tindented\n\tEOF')" 'indented'
+expect "here-string" 'tr a-z A-Z <<< "quiet words"' 'QUIET WORDS'
+expect "quotes and backslashes inside double quotes" "echo \"it's\" \"a\\qb\" \"c\\\\d \\\"e\\\"\"" "it's a\\qb c\\d \"e\""
+expect "input process substitution" 'diff <(echo a) <(echo b)' '1c1
+< a
+---
+> b'
+expect "output process substitution" 'cat numbers.txt | tee >(wc -l > counted.txt) > /dev/null
+cat counted.txt' '50000'
+expect "builtin command substitution" 'echo "[$(echo hi | cat)]"' '[hi]'
+expect "forked command substitution" 'echo "$(seq 1 3 | wc -l)" $(false)$?' '3 1'
+expect "nested command substitution" 'echo $(echo $(echo deep))' 'deep'
+expect "unquoted command substitution is split into fields" 'printf "[%s]" $(echo a b) "$(echo c d)" x$(echo " e  f ")y $(true)
+echo
+export IFS=:
+printf "<%s>" $(echo "a::b:")
+export IFS=" :"
+printf "{%s}" $(echo " a : b ")
+echo' '[a][b][c d][x][e][f][y]
+<a><><b>{a}{b}'
+expect "large command substitution" 'echo "$(cat numbers.txt)" | wc -l' '50000'
+expect "process substitution as a redirection target" 'seq 3 -1 1 > >(sort)
+cat < <(echo read)
+ls | grep -c ">"' '1
+2
+3
+read
+0'
+expect "and-or lists" 'false && echo no || echo yes; true || echo no; echo $?' 'yes
+0'
+expect "brace group redirection" '{ echo a; echo b; } > group.txt; cat group.txt' 'a
+b'
+expect "multi-line group" '{ echo one
+echo two
+} | wc -l' '2'
+expect "in-process subshell isolates state" 'umask 027; (cd /; export GS_SUB=1; umask 077; exit 3); echo $? "[$GS_SUB]"; umask; pwd' "3 []
+027
+$work_dir"
+expect "here-document pipeline head" 'cat <<EOF | sort
+b
+a
+EOF
+cat <<< "with here-string" | wc -c' 'a
+b
+17'
+expect "test builtin" 'test -f numbers.txt -a ! -d numbers.txt && echo file; [ 10 -gt 9 ] && [ "$HOME" ] && echo cmp
+[ a = b -o "(" -s numbers.txt ")" ]; echo $?; test 1 -lt x; echo $?' 'file
+cmp
+0
+genshell: test: x: integer expression expected
+2'
+expect "printf builtin" 'export PATH=/nonexistent; printf "%s=%03d\n" a 1 b 22 c; printf "%b|%-4s|%5.1f\n" "x\\ty" ab 2.25' 'a=001
+b=022
+c=000
+x	y|ab  |  2.2'
+long_literal=$(printf '%*s' 200 '' | tr ' ' X)
+expect "printf past its format cache" "$(for i in $(seq 100); do echo "printf 'f$i\n' >/dev/null"; done)
+printf '${long_literal}%s\n' end" "${long_literal}end"
+expect "read leaves the rest of the input" '{ read a; read -r b c; head -n 1; } < numbers.txt; echo "$a/$b/$c"
+printf " x\\ y  z w \n4\n" | { read p q; cat; echo "[$p][$q]"; }' '3
+1/2/
+4
+[x y][z w]'
+expect "source reuses and refreshes parsed files" 'echo "echo first; export SOURCED=1" > sourced.sh; . ./sourced.sh; source ./sourced.sh
+echo "echo second" > sourced.sh; . ./sourced.sh; echo $SOURCED' 'first
+first
+second
+1'
+expect "enable loads builtins from shared objects" "enable -f $sample_plugin sample; sample a b | cat; sample; echo \$?" 'sample(2) a b
+sample(0)
+3'
+expect "cd keeps a logical PWD and a directory stack" 'cd -P .; export HOME=$PWD; mkdir -p cdroot/alpha/beta; ln -s cdroot/alpha link
+cd link/beta; dirs; cd ..; dirs; cd -P .; dirs; export CDPATH=$HOME/cdroot; cd ~; cd alpha >/dev/null; dirs
+pushd beta; pushd; popd; (pushd /; dirs -c); dirs -v' '~/link/beta
+~/link
+~/cdroot/alpha
+~/cdroot/alpha
+~/cdroot/alpha/beta ~/cdroot/alpha
+~/cdroot/alpha ~/cdroot/alpha/beta
+~/cdroot/alpha/beta
+/ ~/cdroot/alpha/beta
+ 0  ~/cdroot/alpha/beta'
+expect "z jumps to frecent directories recorded by cd" 'export GENSHELL_Z_DB=$PWD/z.db; mkdir -p zdirs/src/genshell zdirs/doc/genshell zdirs/src/Tools
+cd zdirs/src/genshell; cd ../../doc/genshell; cd ../../src/genshell; cd ../Tools; cd /
+z gensh; pwd; z doc gen; pwd; z -e tool; z tool; z -x; z -e tool; echo $?' "$work_dir/zdirs/src/genshell
+$work_dir/zdirs/doc/genshell
+$work_dir/zdirs/src/Tools
+1"
+expect "history lists the commands read" 'export GENSHELL_HISTORY=$PWD/history.log
+echo one
+history; history 1' 'one
+    1  echo one
+    2  history; history 1
+    2  history; history 1'
+expect "pathname expansion" 'mkdir -p globs/sub; touch globs/a.c globs/b.c globs/.h.c globs/sub/c.c; cd globs
+echo *.c; echo "*.c" \*.c *.none; echo */ [!a].c [[:alpha:]].c; echo ./*/*.c .*' 'a.c b.c
+*.c *.c *.none
+sub/ b.c a.c b.c
+./sub/c.c .h.c'
+expect "expansions inside double quotes are not patterns" 'touch globs/x1; export x=globs/x; false; echo "rc=$?" "${x}*" "$(echo ?)" "$x?"' 'rc=1 globs/x* ? globs/x?'
+expect "enable in a subshell leaves the shell unchanged" "(enable -f $sample_plugin sample); echo \$(enable -f $sample_plugin sample); sample z" '
+genshell: sample: No such file or directory'
+expect "a subshell sourcing enable leaves the shell unchanged" "echo 'enable -f $sample_plugin sample' > en.sh; (. ./en.sh); sample leaked" 'genshell: sample: No such file or directory'
+expect "parallel keeps item order" 'printf "3\n1\n2\n" | parallel -j3 -k sh -c "sleep 0.{}; echo item {}"' 'item 3
+item 1
+item 2'
+expect "parallel counts failures" 'parallel -j2 test 1 = ::: 1 2 3; echo $?' '2'
+expect "forked subshell in pipeline" '(ls numbers.txt; echo done) | cat' 'numbers.txt
+done'
+
+# The final command of -c replaces the shell, so it reports the shell's pid.
+pids=$(cd "$work_dir" && "$genshell_bin" -c 'echo $$; sh -c "echo \$\$"')
+if [[ $(sort -u <<< "$pids" | wc -l) -ne 1 ]]; then
+    printf '✘ -c execs its last command in place\n%s\n' "$pids" >&2
+    exit 1
+fi
+pass "-c execs its last command in place"
+
+# --server keeps a warm shell; --client runs commands in workers forked from it.
+printf 'export WARM=loaded\n' > "$work_dir/server.rc"
+(cd "$work_dir" && exec "$genshell_bin" --server "$work_dir/gs.sock" server.rc) &
+server_pid=$!
+for _ in $(seq 50); do [[ -S "$work_dir/gs.sock" ]] && break; sleep 0.1; done
+mkdir -p "$work_dir/client"
+# A client that connects and never sends its request must not hold up others.
+stall_pid=
+if command -v python3 >/dev/null; then
+    python3 -c 'import socket, sys, time
+s = socket.socket(socket.AF_UNIX); s.connect(sys.argv[1]); time.sleep(10)' "$work_dir/gs.sock" &
+    stall_pid=$!
+    sleep 0.2
+fi
+set +e
+served_start=$SECONDS
+served=$(cd "$work_dir/client" && "$genshell_bin" --client "$work_dir/gs.sock" -c 'echo $WARM; pwd; exit 7')
+served_status=$?
+served_time=$((SECONDS - served_start))
+set -e
+[[ -n "$stall_pid" ]] && { kill "$stall_pid"; wait "$stall_pid" 2>/dev/null || true; }
+kill "$server_pid"; wait "$server_pid" 2>/dev/null || true
+if [[ "$served" != "loaded
+$work_dir/client" || $served_status -ne 7 || $served_time -ge 3 || -e "$work_dir/gs.sock" ]]; then
+    printf '✘ --client runs commands in the warm --server shell\n%s (status %s, %ss)\n' "$served" "$served_status" "$served_time" >&2
+    exit 1
+fi
+pass "--client runs commands in the warm --server shell"
+
+# Concurrent sessions append to one history log without locking; every
+# command lands once, each session's in order, past a torn record.
+for session in 1 2 3 4 5 6; do
+    for i in $(seq 300); do printf 'echo %s-%s >/dev/null\n' "$session" "$i"; done |
+        (cd "$work_dir" && GENSHELL_HISTORY="$work_dir/shared.log" "$genshell_bin") &
+done
+wait
+printf 'torn' >> "$work_dir/shared.log"
+listed=$(cd "$work_dir" && printf 'echo last\nhistory\n' | GENSHELL_HISTORY="$work_dir/shared.log" "$genshell_bin")
+ordered=$(awk '$2 == "echo" && $3 ~ /-/ { split($3, s, "-"); if (s[2] != ++seen[s[1]]) bad = 1 }
+    END { print (bad ? "out of order" : NR) }' <<< "$listed")
+if [[ "$ordered" != "1803" || ! -s "$work_dir/shared.log.idx" ]]; then
+    printf '✘ concurrent sessions share one history log\n%s\n' "$ordered" >&2
+    exit 1
+fi
+pass "concurrent sessions share one history log"
+
+# Reverse search over a long history answers without first indexing all of it.
+search_bin="$build_dir/history_search"
+search_sources=()
+for src in "${shell_sources[@]}"; do
+    [[ "$src" == */main.c ]] || search_sources+=("$src")
+done
+$CC $CFLAGS $EXTRA_CFLAGS -I"$repo_root/src/kernel/shell" -I"$repo_root/include" \
+    "${search_sources[@]}" "$repo_root/tests/shell/history_search.c" -rdynamic -o "$search_bin" -lpthread -ldl
+searched=$("$search_bin" "$work_dir/search.log" 2>&1) || true
+if [[ "$searched" != "pass" ]]; then
+    printf '✘ the first history search does not wait for the index\n%s\n' "$searched" >&2
+    exit 1
+fi
+pass "the first history search does not wait for the index"
+
+# On a terminal lines are edited in place; ^R finds history entries by words.
+pty_bin="$build_dir/pty_session"
+$CC $CFLAGS $EXTRA_CFLAGS "$repo_root/tests/shell/pty_session.c" -o "$pty_bin"
+mkdir -p "$work_dir/pty"
+set +e
+(cd "$work_dir/pty" && TERM=xterm GENSHELL_HISTORY="$work_dir/pty/history" "$pty_bin" "$genshell_bin" \
+    $'echo wrld > edit.txt\x01\e[C\e[C\e[C\e[C\e[C\e[Co\r' \
+    $'echo needle-one > /dev/null\r' $'echo other > /dev/null\r' \
+    $'\x12one needle\x05\x7f\x7f\x7f\x7f\x7f\x7f\x7f\x7f\x7fsearch.txt\r' \
+    $'\e[A\x17up.txt\r' $'echo nope > nope.txt\x03' $'echo $? > status.txt\r')
+pty_status=$?
+set -e
+edited=$(cd "$work_dir/pty" && cat edit.txt search.txt up.txt status.txt 2>&1; ls *.txt)
+if [[ $pty_status -ne 0 || "$edited" != "world
+needle-one
+needle-one
+130
+edit.txt
+search.txt
+status.txt
+up.txt" ]]; then
+    printf '✘ the line editor edits, recalls and searches history\n%s (status %s)\n' "$edited" "$pty_status" >&2
+    exit 1
+fi
+pass "the line editor edits, recalls and searches history"
+
+# Suggestions complete a line from history, preferring the current directory's.
+mkdir -p "$work_dir/suggest/a" "$work_dir/suggest/b"
+set +e
+(cd "$work_dir/suggest" && TERM=xterm GENSHELL_HISTORY="$work_dir/suggest/history" "$pty_bin" "$genshell_bin" \
+    $'cd a\r' $'echo alpha-in-a >> log.txt\r' $'cd ../b\r' $'echo alpha-in-b >> log.txt\r' \
+    $'cd ../a\r' $'echo al\e[C\r' $'cd ../b\r' $'echo al\x05\r' $'ech\ef\ef >> log.txt\r')
+pty_status=$?
+set -e
+suggested=$(cd "$work_dir/suggest" && cat a/log.txt b/log.txt)
+if [[ $pty_status -ne 0 || "$suggested" != "alpha-in-a
+alpha-in-a
+alpha-in-b
+alpha-in-b
+alpha-in-b" ]]; then
+    printf '✘ suggestions come from history, by directory\n%s (status %s)\n' "$suggested" "$pty_status" >&2
+    exit 1
+fi
+pass "suggestions come from history, by directory"
+
+# Tab completes commands from PATH (noticing new ones), builtins, variables and files.
+comp_dir="$work_dir/complete"
+mkdir -p "$comp_dir/bin" "$comp_dir/alpha-dir"
+touch "$comp_dir/alpha-file.txt" "$comp_dir/alpha-dir/x file"
+printf '#!/bin/sh\necho tool-ran > tool.txt\n' > "$comp_dir/bin/gs-complete-tool"
+chmod +x "$comp_dir/bin/gs-complete-tool"
+set +e
+(cd "$comp_dir" && TERM=xterm GENSHELL_HISTORY= PATH="$comp_dir/bin:$PATH" GS_COMPLETION_VAR=value \
+    "$pty_bin" "$genshell_bin" $'gs-complete-to\t\r' $'umas\t > umask.txt\r' $'echo $GS_COMPLETION_V\t> var.txt\r' \
+    $'echo alp\td\tx\t>> alp\tf\t\r' \
+    $'printf \'#!/bin/sh\\necho new-ran > new.txt\\n\' > bin/gs-complete-new; chmod +x bin/gs-complete-new\r' \
+    $'gs-complete-n\t\r')
+pty_status=$?
+set -e
+completed=$(cd "$comp_dir" && cat tool.txt umask.txt var.txt alpha-file.txt new.txt 2>&1)
+if [[ $pty_status -ne 0 || "$completed" != "tool-ran
+$("$genshell_bin" -c umask)
+value
+alpha-dir/x file
+new-ran" ]]; then
+    printf '✘ tab completes commands, builtins, variables and files\n%s (status %s)\n' "$completed" "$pty_status" >&2
+    exit 1
+fi
+pass "tab completes commands, builtins, variables and files"
+
+# PS1 segments: the branch and status show at once, a slow git status is patched in when it reports.
+prompt_dir="$work_dir/prompt"
+mkdir -p "$prompt_dir/bin" "$prompt_dir/repo/.git/refs/heads" "$prompt_dir/repo/sub"
+printf 'ref: refs/heads/feature-x\n' > "$prompt_dir/repo/.git/HEAD"
+printf '#!/bin/sh\nsleep 1\necho " M x"\n' > "$prompt_dir/bin/git"
+chmod +x "$prompt_dir/bin/git"
+set +e
+prompted=$(cd "$prompt_dir/repo/sub" && TERM=xterm GENSHELL_HISTORY= PATH="$prompt_dir/bin:$PATH" \
+    PS1='<\g|\?|\D> genshell$ ' "$pty_bin" "$genshell_bin" \
+    '--expect=<feature-x|0|> genshell$ ' '--expect=<feature-x*|0|> genshell$ ' $'false\r' '--expect=<feature-x*|1|' $'true\r' 2>&1)
+pty_status=$?
+set -e
+if [[ $pty_status -ne 0 ]]; then
+    printf '✘ the prompt shows git state computed in the background\n%s (status %s)\n' "$prompted" "$pty_status" >&2
+    exit 1
+fi
+pass "the prompt shows git state computed in the background"
+
+# Sessions embedded through libgenshell run side by side on threads of one process.
+embed_bin="$build_dir/embed_sessions"
+embed_sources=()
+for src in "${shell_sources[@]}"; do
+    [[ "$src" == */main.c ]] || embed_sources+=("$src")
+done
+$CC $CFLAGS $EXTRA_CFLAGS -I"$repo_root/src/kernel/shell" -I"$repo_root/include" \
+    "${embed_sources[@]}" "$repo_root/tests/shell/embed_sessions.c" -rdynamic -o "$embed_bin" -lpthread -ldl
+mkdir -p "$work_dir/embed"
+embedded=$(cd "$work_dir" && "$embed_bin" "$work_dir/embed" 2>&1) || true
+if [[ "$embedded" != "pass" ]]; then
+    printf '✘ embedded sessions keep their own state\n%s\n' "$embedded" >&2
+    exit 1
+fi
+pass "embedded sessions keep their own state"
+
+rm -f "$genshell_bin" "$embed_bin" "$pty_bin" "$search_bin"